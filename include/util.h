@@ -110,4 +110,33 @@ __InterlockedSubtract(
     return New;
 }
 
+// Number of processors across all groups. Suitable for sizing an array
+// indexed by __GetCurrentProcessorIndex().
+static FORCEINLINE ULONG
+__GetActiveProcessorCount(
+    VOID
+    )
+{
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    return KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+#else
+    return KeQueryActiveProcessorCount(NULL);
+#endif
+}
+
+// System-wide index of the current processor, unique across processor
+// groups. Must be called at DISPATCH_LEVEL (or with the thread affinitized)
+// for the result to remain meaningful.
+static FORCEINLINE ULONG
+__GetCurrentProcessorIndex(
+    VOID
+    )
+{
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    return KeGetCurrentProcessorNumberEx(NULL);
+#else
+    return KeGetCurrentProcessorNumber();
+#endif
+}
+
 #endif  // _UTIL_H
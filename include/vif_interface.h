@@ -386,6 +386,36 @@ typedef enum XENVIF_CALLBACK_TYPE {
                       IN  PXENVIF_VIF_CONTEXT       Context,                                    \
                       OUT PULONG                    Size                                        \
                       )                                                                         \
+                      )                                                                         \
+        VIF_OPERATION(VOID,                                                                     \
+                      ReturnPackets,                                                            \
+                      (                                                                         \
+                      IN  PXENVIF_VIF_CONTEXT       Context,                                    \
+                      IN  PLIST_ENTRY               List                                        \
+                      )                                                                         \
+                      )                                                                         \
+        VIF_OPERATION(VOID,                                                                     \
+                      QueryTransmitterQueueCount,                                               \
+                      (                                                                         \
+                      IN  PXENVIF_VIF_CONTEXT       Context,                                    \
+                      OUT PULONG                    Count                                       \
+                      )                                                                         \
+                      )                                                                         \
+        VIF_OPERATION(VOID,                                                                     \
+                      QueryTransmitterQueueRingSize,                                            \
+                      (                                                                         \
+                      IN  PXENVIF_VIF_CONTEXT       Context,                                    \
+                      IN  ULONG                     Index,                                      \
+                      OUT PULONG                    Size                                        \
+                      )                                                                         \
+                      )                                                                         \
+        VIF_OPERATION(NTSTATUS,                                                                 \
+                      QueueTransmitterPackets,                                                  \
+                      (                                                                         \
+                      IN  PXENVIF_VIF_CONTEXT           Context,                                \
+                      IN  ULONG                         Index,                                  \
+                      IN  PXENVIF_TRANSMITTER_PACKET    HeadPacket                              \
+                      )                                                                         \
                       )
 
 typedef struct _XENVIF_VIF_CONTEXT  XENVIF_VIF_CONTEXT, *PXENVIF_VIF_CONTEXT;
@@ -415,7 +445,15 @@ DEFINE_GUID(GUID_VIF_INTERFACE,
             0x95,
             0xc3);
 
-#define VIF_INTERFACE_VERSION    14
+#define VIF_INTERFACE_VERSION    16
+
+// Oldest version a client may accept. Operations added since then must
+// only be called if the negotiated version is at least the one that
+// introduced them.
+#define VIF_INTERFACE_VERSION_MIN   14
+
+#define VIF_INTERFACE_VERSION_RETURN_PACKETS    15
+#define VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES    16
 
 #define VIF_OPERATIONS(_Interface) \
         (PXENVIF_VIF_OPERATIONS *)((ULONG_PTR)(_Interface))
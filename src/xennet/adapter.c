@@ -132,6 +132,12 @@ static NDIS_OID XennetSupportedOids[] =
     OID_PNP_CAPABILITIES,
     OID_PNP_QUERY_POWER,
     OID_PNP_SET_POWER,
+    OID_GEN_RECEIVE_SCALE_PARAMETERS,
+    OID_GEN_VLAN_ID,
+    OID_XENNET_RECEIVER_STATISTICS,
+    OID_XENNET_VLAN_FILTER,
+    OID_XENNET_POLLER_STATISTICS,
+    OID_XENNET_TRANSMITTER_STATISTICS,
 };
 
 #define INITIALIZE_NDIS_OBJ_HEADER(obj, type) do {               \
@@ -145,7 +151,7 @@ NTSTATUS AllocAdapter(OUT PADAPTER *Adapter)
     if (Adapter == NULL)
         return STATUS_INVALID_PARAMETER;
 
-    *Adapter = (PADAPTER)ExAllocatePoolWithTag(NonPagedPool, sizeof (ADAPTER), ' TEN');
+    *Adapter = (PADAPTER)ExAllocatePoolWithTag(NonPagedPoolCacheAligned, sizeof (ADAPTER), ' TEN');
     if (*Adapter == NULL)
         return STATUS_INSUFFICIENT_RESOURCES;
 
@@ -215,7 +221,12 @@ AdapterCheckForHang (
     IN  NDIS_HANDLE NdisHandle
     )
 {
-    UNREFERENCED_PARAMETER(NdisHandle);
+    PADAPTER Adapter = (PADAPTER)NdisHandle;
+
+    // Called every couple of seconds; a convenient point to re-evaluate
+    // the receive in-flight watermark and shrink the receive cache.
+    ReceiverUpdateWatermark(&Adapter->Receiver);
+    ReceiverTrim(&Adapter->Receiver);
 
     return FALSE;
 }
@@ -360,7 +371,7 @@ AdapterVifCallback(
 
         HeadPacket = va_arg(Arguments, PXENVIF_TRANSMITTER_PACKET);
 
-        TransmitterCompletePackets(Adapter->Transmitter, HeadPacket);
+        PollerCompletePackets(&Adapter->Poller, HeadPacket);
         break;
     }
     case XENVIF_CALLBACK_RECEIVE_PACKETS: {
@@ -368,7 +379,7 @@ AdapterVifCallback(
 
         List = va_arg(Arguments, PLIST_ENTRY);
 
-        ReceiverReceivePackets(&Adapter->Receiver, List);
+        PollerReceivePackets(&Adapter->Poller, List);
         break;
     }
     case XENVIF_CALLBACK_MEDIA_STATE_CHANGE: {
@@ -424,7 +435,24 @@ AdapterGetAdvancedSettings(
     read_property(lsov6, L"*LSOv2IPv6", 1);
     read_property(lrov4, L"LROIPv4", 1);
     read_property(lrov6, L"LROIPv6", 1);
+    read_property(grov4, L"GROIPv4", 0);
+    read_property(grov6, L"GROIPv6", 0);
     read_property(need_csum_value, L"NeedChecksumValue", 1);
+    read_property(rx_in_flight_limit, L"ReceiveInFlightLimit", 0);
+    read_property(rx_copy_break, L"ReceiveCopyBreak", 128);
+    read_property(rx_prewarm_factor, L"ReceivePrewarmFactor", 2);
+    read_property(rss, L"*RSS", 1);
+    read_property(vlan_id, L"VlanID", 0);
+    read_property(rx_broadcast_limit, L"BroadcastRateLimit", 0);
+    read_property(rx_multicast_limit, L"MulticastRateLimit", 0);
+    read_property(rx_budget, L"ReceiveBudget", 256);
+    read_property(rx_budget_time, L"ReceiveBudgetTime", 100);
+    read_property(poll_threshold, L"PollThreshold", 0);
+    read_property(tx_batch, L"TransmitBatch", 32);
+    read_property(tx_batch_time, L"TransmitBatchTime", 50);
+    read_property(tx_queues, L"TransmitQueues", TRANSMITTER_MAXIMUM_QUEUES);
+    read_property(tx_gso, L"SoftwareLargeSend", 1);
+    read_property(sw_csum, L"SoftwareChecksum", 1);
 
     NdisCloseConfiguration(hConfigurationHandle);
 
@@ -469,11 +497,17 @@ AdapterInitialize (
         goto exit;
     }
 
+    PollerInitialize(&Adapter->Poller, Adapter);
+
     ndisStatus = AdapterGetAdvancedSettings(Adapter);
     if (ndisStatus != NDIS_STATUS_SUCCESS) {
         goto exit;
     }
 
+    if (ReceiverSetVlanId(&Adapter->Receiver,
+                          (ULONG)Adapter->Properties.vlan_id) != NDIS_STATUS_SUCCESS)
+        Warning("ignoring VlanID %d\n", Adapter->Properties.vlan_id);
+
     ndisStatus = AdapterSetRegistrationAttributes(Adapter);
     if (ndisStatus != NDIS_STATUS_SUCCESS) {
         goto exit;
@@ -514,6 +548,9 @@ AdapterInitialize (
                  Adapter);
     if (NT_SUCCESS(status)) {
         TransmitterEnable(Adapter->Transmitter);
+        ReceiverEnable(&Adapter->Receiver);
+        PollerEnable(&Adapter->Poller,
+                     (ULONG)Adapter->Properties.poll_threshold);
         Adapter->Enabled = TRUE;
         ndisStatus = NDIS_STATUS_SUCCESS;
     } else {
@@ -594,9 +631,14 @@ AdapterPause (
     if (!Adapter->Enabled)
         goto done;
 
+    TransmitterFlush(Adapter->Transmitter);
+
     VIF(Disable,
         Adapter->VifInterface);
 
+    PollerDisable(&Adapter->Poller);
+    ReceiverDisable(&Adapter->Receiver);
+
     AdapterMediaStateChange(Adapter);
 
     Adapter->Enabled = FALSE;
@@ -764,9 +806,12 @@ GetPacketFilter(PADAPTER Adapter, PULONG PacketFilter)
         *PacketFilter |= NDIS_PACKET_TYPE_DIRECTED;
     }
 
-    if (MulticastFilterLevel == MAC_FILTER_ALL)
+    // The backend passes all multicast frames when the receiver is
+    // filtering a long list.
+    if (MulticastFilterLevel == MAC_FILTER_ALL &&
+        !Adapter->Receiver.MulticastFilterEnabled)
         *PacketFilter |= NDIS_PACKET_TYPE_ALL_MULTICAST;
-    else if (MulticastFilterLevel == MAC_FILTER_MATCHING)
+    else if (MulticastFilterLevel != MAC_FILTER_NONE)
         *PacketFilter |= NDIS_PACKET_TYPE_MULTICAST;
 
     if (BroadcastFilterLevel == MAC_FILTER_ALL)
@@ -795,6 +840,10 @@ AdapterQueryInformation (
     ULONG informationBufferLength;
     PVOID informationBuffer;
     NDIS_INTERRUPT_MODERATION_PARAMETERS intModParams;
+    RECEIVER_STATISTICS receiverStatistics;
+    RECEIVER_VLAN_FILTER vlanFilter;
+    POLLER_STATISTICS pollerStatistics;
+    TRANSMITTER_STATISTICS transmitterStatistics;
     NDIS_STATUS ndisStatus = NDIS_STATUS_SUCCESS;
     NDIS_OID oid;
 
@@ -909,6 +958,36 @@ AdapterQueryInformation (
             bytesAvailable = sizeof(ULONG);
             break;
         
+        case OID_XENNET_RECEIVER_STATISTICS:
+            ReceiverQueryStatistics(&Adapter->Receiver, &receiverStatistics);
+            info = &receiverStatistics;
+            bytesAvailable = sizeof(receiverStatistics);
+            break;
+
+        case OID_XENNET_VLAN_FILTER:
+            ReceiverQueryVlanFilter(&Adapter->Receiver, &vlanFilter);
+            info = &vlanFilter;
+            bytesAvailable = sizeof(vlanFilter);
+            break;
+
+        case OID_XENNET_POLLER_STATISTICS:
+            PollerQueryStatistics(&Adapter->Poller, &pollerStatistics);
+            info = &pollerStatistics;
+            bytesAvailable = sizeof(pollerStatistics);
+            break;
+
+        case OID_XENNET_TRANSMITTER_STATISTICS:
+            TransmitterQueryStatistics(Adapter->Transmitter, &transmitterStatistics);
+            info = &transmitterStatistics;
+            bytesAvailable = sizeof(transmitterStatistics);
+            break;
+
+        case OID_GEN_VLAN_ID:
+            infoData = ReceiverQueryVlanId(&Adapter->Receiver);
+            info = &infoData;
+            bytesAvailable = sizeof(ULONG);
+            break;
+
         case OID_GEN_STATISTICS:
             doCopy = FALSE;
 
@@ -926,6 +1005,20 @@ AdapterQueryInformation (
 
             doCopy = FALSE;
 
+            if (Adapter->MulticastFilter) {
+                ReceiverQueryMulticastAddresses(&Adapter->Receiver,
+                                                NULL,
+                                                &Count);
+                bytesAvailable = Count * ETHERNET_ADDRESS_LENGTH;
+
+                if (informationBufferLength >= bytesAvailable)
+                    ReceiverQueryMulticastAddresses(&Adapter->Receiver,
+                                                    informationBuffer,
+                                                    &Count);
+
+                break;
+            }
+
             VIF(QueryMulticastAddresses,
                 Adapter->VifInterface,
                 NULL,
@@ -1100,7 +1193,7 @@ AdapterQueryInformation (
             break;
 
         case OID_802_3_MAXIMUM_LIST_SIZE:
-            infoData = MAXIMUM_MULTICAST_ADDRESS_COUNT;
+            infoData = XENNET_MAXIMUM_MULTICAST_LIST_SIZE;
             info = &infoData;
             bytesAvailable = sizeof(ULONG);
             break;
@@ -1363,6 +1456,9 @@ AdapterRestart (
                  Adapter);
     if (NT_SUCCESS(status)) {
         TransmitterEnable(Adapter->Transmitter);
+        ReceiverEnable(&Adapter->Receiver);
+        PollerEnable(&Adapter->Poller,
+                     (ULONG)Adapter->Properties.poll_threshold);
         Adapter->Enabled = TRUE;
         ndisStatus = NDIS_STATUS_SUCCESS;
     } else {
@@ -1431,6 +1527,7 @@ AdapterSetGeneralAttributes (
 {
     PNDIS_MINIPORT_ADAPTER_ATTRIBUTES adapterAttributes;
     NDIS_MINIPORT_ADAPTER_GENERAL_ATTRIBUTES generalAttributes;
+    NDIS_RECEIVE_SCALE_CAPABILITIES rssCapabilities;
     NDIS_STATUS ndisStatus;
 
     NdisZeroMemory(&generalAttributes, 
@@ -1464,7 +1561,7 @@ AdapterSetGeneralAttributes (
 
     generalAttributes.SupportedPacketFilters = XENNET_SUPPORTED_PACKET_FILTERS;
         
-    generalAttributes.MaxMulticastListSize = MAXIMUM_MULTICAST_ADDRESS_COUNT;
+    generalAttributes.MaxMulticastListSize = XENNET_MAXIMUM_MULTICAST_LIST_SIZE;
     generalAttributes.MacAddressLength = ETHERNET_ADDRESS_LENGTH;
 
     VIF(QueryPermanentAddress,
@@ -1476,6 +1573,22 @@ AdapterSetGeneralAttributes (
 
     generalAttributes.PhysicalMediumType = NdisPhysicalMedium802_3;
     generalAttributes.RecvScaleCapabilities = NULL;
+
+    if (Adapter->Properties.rss) {
+        NdisZeroMemory(&rssCapabilities, sizeof(rssCapabilities));
+
+        rssCapabilities.Header.Type = NDIS_OBJECT_TYPE_RSS_CAPABILITIES;
+        rssCapabilities.Header.Revision = NDIS_RECEIVE_SCALE_CAPABILITIES_REVISION_1;
+        rssCapabilities.Header.Size = NDIS_SIZEOF_RECEIVE_SCALE_CAPABILITIES_REVISION_1;
+
+        rssCapabilities.CapabilitiesFlags = NDIS_RSS_CAPS_CLASSIFICATION_AT_DPC |
+                                            NDIS_RSS_CAPS_HASH_TYPE_TCP_IPV4 |
+                                            NDIS_RSS_CAPS_HASH_TYPE_TCP_IPV6;
+        rssCapabilities.NumberOfInterruptMessages = 1;
+        rssCapabilities.NumberOfReceiveQueues = ReceiverQueryRssQueueCount(&Adapter->Receiver);
+
+        generalAttributes.RecvScaleCapabilities = &rssCapabilities;
+    }
     generalAttributes.AccessType = NET_IF_ACCESS_BROADCAST;
     generalAttributes.DirectionType = NET_IF_DIRECTION_SENDRECEIVE;
     generalAttributes.ConnectionType = NET_IF_CONNECTION_DEDICATED;
@@ -1638,9 +1751,8 @@ AdapterSetOffloadAttributes(
 
     supported.Checksum.IPv6Receive.UdpChecksum = 1;
 
-    VIF(QueryOffloadOptions,
-        Adapter->VifInterface,
-        &Options);
+    TransmitterQueryOffloadOptions(Adapter->Transmitter,
+                                   &Options);
 
     supported.Checksum.IPv4Transmit.Encapsulation = NDIS_ENCAPSULATION_IEEE_802_3;
 
@@ -1672,10 +1784,9 @@ AdapterSetOffloadAttributes(
     if (Options.OffloadIpVersion4LargePacket) {
         ULONG Size;
 
-        VIF(QueryLargePacketSize,
-            Adapter->VifInterface,
-            4,
-            &Size);
+        TransmitterQueryLargePacketSize(Adapter->Transmitter,
+                                        4,
+                                        &Size);
 
         supported.LsoV2.IPv4.Encapsulation = NDIS_ENCAPSULATION_IEEE_802_3;
         supported.LsoV2.IPv4.MaxOffLoadSize = Size;
@@ -1685,10 +1796,9 @@ AdapterSetOffloadAttributes(
     if (Options.OffloadIpVersion6LargePacket) {
         ULONG Size;
 
-        VIF(QueryLargePacketSize,
-            Adapter->VifInterface,
-            6,
-            &Size);
+        TransmitterQueryLargePacketSize(Adapter->Transmitter,
+                                        6,
+                                        &Size);
 
         supported.LsoV2.IPv6.Encapsulation = NDIS_ENCAPSULATION_IEEE_802_3;
         supported.LsoV2.IPv6.MaxOffLoadSize = Size;
@@ -1837,10 +1947,9 @@ AdapterIndicateOffloadChanged (
     if (Adapter->Transmitter->OffloadOptions.OffloadIpVersion4LargePacket) {
         ULONG Size;
 
-        VIF(QueryLargePacketSize,
-            Adapter->VifInterface,
-            4,
-            &Size);
+        TransmitterQueryLargePacketSize(Adapter->Transmitter,
+                                        4,
+                                        &Size);
 
         offload.LsoV2.IPv4.Encapsulation = NDIS_ENCAPSULATION_IEEE_802_3;
         offload.LsoV2.IPv4.MaxOffLoadSize = Size;
@@ -1850,10 +1959,9 @@ AdapterIndicateOffloadChanged (
     if (Adapter->Transmitter->OffloadOptions.OffloadIpVersion6LargePacket) {
         ULONG Size;
 
-        VIF(QueryLargePacketSize,
-            Adapter->VifInterface,
-            6,
-            &Size);
+        TransmitterQueryLargePacketSize(Adapter->Transmitter,
+                                        6,
+                                        &Size);
 
         offload.LsoV2.IPv6.Encapsulation = NDIS_ENCAPSULATION_IEEE_802_3;
         offload.LsoV2.IPv6.MaxOffLoadSize = Size;
@@ -1879,12 +1987,40 @@ AdapterIndicateOffloadChanged (
 
 }
 
+static NDIS_STATUS
+SetPacketFilter(PADAPTER Adapter, PULONG PacketFilter);
+
+//
+// A list the backend can hold is passed to it. A longer one is kept by
+// the receiver, which then drops frames for other groups, while the
+// backend is told to pass all multicast frames.
+//
 static NDIS_STATUS
 SetMulticastAddresses(PADAPTER Adapter, PETHERNET_ADDRESS Address, ULONG Count)
 {
     NTSTATUS status;
+    NDIS_STATUS ndisStatus;
+
+    if (Count > XENNET_MAXIMUM_MULTICAST_LIST_SIZE)
+        return NDIS_STATUS_MULTICAST_FULL;
+
+    if (Count > MAXIMUM_MULTICAST_ADDRESS_COUNT) {
+        ndisStatus = ReceiverSetMulticastAddresses(&Adapter->Receiver,
+                                                   Address,
+                                                   Count);
+        if (ndisStatus != NDIS_STATUS_SUCCESS)
+            return ndisStatus;
 
-    ASSERT3U(Count, <=, MAXIMUM_MULTICAST_ADDRESS_COUNT);
+        Adapter->MulticastFilter = TRUE;
+        (VOID) SetPacketFilter(Adapter, &Adapter->PacketFilter);
+
+        (VOID) VIF(UpdateMulticastAddresses,
+                   Adapter->VifInterface,
+                   NULL,
+                   0);
+
+        return NDIS_STATUS_SUCCESS;
+    }
 
     status = VIF(UpdateMulticastAddresses,
                  Adapter->VifInterface,
@@ -1893,6 +2029,13 @@ SetMulticastAddresses(PADAPTER Adapter, PETHERNET_ADDRESS Address, ULONG Count)
     if (!NT_SUCCESS(status))
         return NDIS_STATUS_INVALID_DATA;
 
+    if (Adapter->MulticastFilter) {
+        Adapter->MulticastFilter = FALSE;
+        (VOID) SetPacketFilter(Adapter, &Adapter->PacketFilter);
+
+        (VOID) ReceiverSetMulticastAddresses(&Adapter->Receiver, NULL, 0);
+    }
+
     return NDIS_STATUS_SUCCESS;
 }
 
@@ -1902,10 +2045,14 @@ SetPacketFilter(PADAPTER Adapter, PULONG PacketFilter)
     XENVIF_MAC_FILTER_LEVEL UnicastFilterLevel;
     XENVIF_MAC_FILTER_LEVEL MulticastFilterLevel;
     XENVIF_MAC_FILTER_LEVEL BroadcastFilterLevel;
+    BOOLEAN MulticastFilter;
 
     if (*PacketFilter & ~XENNET_SUPPORTED_PACKET_FILTERS)
         return NDIS_STATUS_INVALID_PARAMETER;
 
+    Adapter->PacketFilter = *PacketFilter;
+    MulticastFilter = FALSE;
+
     if (*PacketFilter & NDIS_PACKET_TYPE_PROMISCUOUS) {
         UnicastFilterLevel = MAC_FILTER_ALL;
         MulticastFilterLevel = MAC_FILTER_ALL;
@@ -1918,12 +2065,18 @@ SetPacketFilter(PADAPTER Adapter, PULONG PacketFilter)
     else
         UnicastFilterLevel = MAC_FILTER_NONE;
 
-    if (*PacketFilter & NDIS_PACKET_TYPE_ALL_MULTICAST)
+    if (*PacketFilter & NDIS_PACKET_TYPE_ALL_MULTICAST) {
         MulticastFilterLevel = MAC_FILTER_ALL;
-    else if (*PacketFilter & NDIS_PACKET_TYPE_MULTICAST)
+    } else if (*PacketFilter & NDIS_PACKET_TYPE_MULTICAST) {
         MulticastFilterLevel = MAC_FILTER_MATCHING;
-    else
+
+        if (Adapter->MulticastFilter) {
+            MulticastFilterLevel = MAC_FILTER_ALL;
+            MulticastFilter = TRUE;
+        }
+    } else {
         MulticastFilterLevel = MAC_FILTER_NONE;
+    }
 
     if (*PacketFilter & NDIS_PACKET_TYPE_BROADCAST)
         BroadcastFilterLevel = MAC_FILTER_ALL;
@@ -1931,6 +2084,10 @@ SetPacketFilter(PADAPTER Adapter, PULONG PacketFilter)
         BroadcastFilterLevel = MAC_FILTER_NONE;
 
 done:
+    // Filter in the receiver before the backend starts passing everything
+    if (MulticastFilter)
+        ReceiverEnableMulticastFilter(&Adapter->Receiver, TRUE);
+
     VIF(UpdateFilterLevel,
         Adapter->VifInterface,
         ETHERNET_ADDRESS_UNICAST,
@@ -1946,6 +2103,9 @@ done:
         ETHERNET_ADDRESS_BROADCAST,
         BroadcastFilterLevel);
 
+    if (!MulticastFilter)
+        ReceiverEnableMulticastFilter(&Adapter->Receiver, FALSE);
+
     return NDIS_STATUS_SUCCESS;
 }
 
@@ -2038,6 +2198,45 @@ AdapterSetInformation (
             ndisStatus = NDIS_STATUS_INVALID_DATA;
             break;
 
+        case OID_GEN_VLAN_ID:
+            bytesNeeded = sizeof(ULONG);
+            if (informationBufferLength == sizeof(ULONG)) {
+                ndisStatus = ReceiverSetVlanId(&Adapter->Receiver,
+                                               *(PULONG)informationBuffer);
+                if (ndisStatus == NDIS_STATUS_SUCCESS)
+                    bytesRead = sizeof(ULONG);
+            } else {
+                ndisStatus = NDIS_STATUS_INVALID_LENGTH;
+            }
+
+            break;
+
+        case OID_XENNET_VLAN_FILTER:
+            bytesNeeded = sizeof(RECEIVER_VLAN_FILTER);
+            if (informationBufferLength >= sizeof(RECEIVER_VLAN_FILTER)) {
+                ReceiverSetVlanFilter(&Adapter->Receiver, informationBuffer);
+                bytesRead = sizeof(RECEIVER_VLAN_FILTER);
+            } else {
+                ndisStatus = NDIS_STATUS_INVALID_LENGTH;
+            }
+
+            break;
+
+        case OID_GEN_RECEIVE_SCALE_PARAMETERS:
+            if (!Adapter->Properties.rss) {
+                ndisStatus = NDIS_STATUS_NOT_SUPPORTED;
+                break;
+            }
+
+            bytesNeeded = NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_1;
+            ndisStatus = ReceiverSetRssParameters(&Adapter->Receiver,
+                                                  informationBuffer,
+                                                  informationBufferLength);
+            if (ndisStatus == NDIS_STATUS_SUCCESS)
+                bytesRead = informationBufferLength;
+
+            break;
+
         case OID_OFFLOAD_ENCAPSULATION: {
             PNDIS_OFFLOAD_ENCAPSULATION offloadEncapsulation;
 
@@ -2059,9 +2258,8 @@ AdapterSetInformation (
                         ndisStatus = NDIS_STATUS_INVALID_PARAMETER;
                 }
 
-                VIF(QueryOffloadOptions,
-                    Adapter->VifInterface,
-                    &Options);
+                TransmitterQueryOffloadOptions(Adapter->Transmitter,
+                                               &Options);
                 
                 Adapter->Transmitter->OffloadOptions.Value = 0;
                 Adapter->Transmitter->OffloadOptions.OffloadTagManipulation = 1;
@@ -2148,9 +2346,8 @@ AdapterSetInformation (
                 if (!no_change(offloadParameters->LsoV2IPv4)) {
                     XENVIF_OFFLOAD_OPTIONS  Options;
 
-                    VIF(QueryOffloadOptions,
-                        Adapter->VifInterface,
-                        &Options);
+                    TransmitterQueryOffloadOptions(Adapter->Transmitter,
+                                                   &Options);
 
                     if (!(Options.OffloadIpVersion4LargePacket))
                         ndisStatus = NDIS_STATUS_INVALID_PARAMETER;
@@ -2159,9 +2356,8 @@ AdapterSetInformation (
                 if (!no_change(offloadParameters->LsoV2IPv6)) {
                     XENVIF_OFFLOAD_OPTIONS  Options;
 
-                    VIF(QueryOffloadOptions,
-                        Adapter->VifInterface,
-                        &Options);
+                    TransmitterQueryOffloadOptions(Adapter->Transmitter,
+                                                   &Options);
 
                     if (!(Options.OffloadIpVersion6LargePacket))
                         ndisStatus = NDIS_STATUS_INVALID_PARAMETER;
@@ -2419,9 +2615,14 @@ IN  PADAPTER    Adapter
     if (!Adapter->Enabled)
         goto done;
 
+    TransmitterFlush(Adapter->Transmitter);
+
     VIF(Disable,
         Adapter->VifInterface);
 
+    PollerDisable(&Adapter->Poller);
+    ReceiverDisable(&Adapter->Receiver);
+
     Adapter->Enabled = FALSE;
 
 done:
@@ -33,8 +33,18 @@
 
 #define XENNET_INTERFACE_TYPE           NdisInterfaceInternal
 
+// Driver-private OIDs
+#define OID_XENNET_RECEIVER_STATISTICS      0xFF010001  // RECEIVER_STATISTICS
+#define OID_XENNET_VLAN_FILTER              0xFF010002  // RECEIVER_VLAN_FILTER
+#define OID_XENNET_POLLER_STATISTICS        0xFF010003  // POLLER_STATISTICS
+#define OID_XENNET_TRANSMITTER_STATISTICS   0xFF010004  // TRANSMITTER_STATISTICS
+
 #define XENNET_MEDIA_TYPE               NdisMedium802_3
 
+// Lists longer than the backend's MAXIMUM_MULTICAST_ADDRESS_COUNT are
+// filtered by the receiver.
+#define XENNET_MAXIMUM_MULTICAST_LIST_SIZE  4096
+
 #define XENNET_MAC_OPTIONS              (NDIS_MAC_OPTION_COPY_LOOKAHEAD_DATA |  \
                                          NDIS_MAC_OPTION_TRANSFERS_NOT_PEND |   \
                                          NDIS_MAC_OPTION_NO_LOOPBACK |          \
@@ -52,11 +62,29 @@ typedef struct _PROPERTIES {
     int lsov6;
     int lrov4;
     int lrov6;
+    int grov4;
+    int grov6;
+    int rx_in_flight_limit;
+    int rx_copy_break;
+    int rx_prewarm_factor;
+    int rss;
+    int vlan_id;
+    int rx_broadcast_limit;
+    int rx_multicast_limit;
+    int rx_budget;
+    int rx_budget_time;
+    int poll_threshold;
+    int tx_batch;
+    int tx_batch_time;
+    int tx_queues;
+    int tx_gso;
+    int sw_csum;
 } PROPERTIES, *PPROPERTIES;
 
 struct _ADAPTER {
     LIST_ENTRY              ListEntry;
     PXENVIF_VIF_INTERFACE   VifInterface;
+    ULONG                   VifInterfaceVersion;
     BOOLEAN                 AcquiredInterfaces;
     ULONG                   MaximumFrameSize;
     ULONG                   CurrentLookahead;
@@ -66,8 +94,11 @@ struct _ADAPTER {
     PROPERTIES              Properties;
     RECEIVER                Receiver;
     PTRANSMITTER            Transmitter;
+    POLLER                  Poller;
     BOOLEAN                 Enabled;
     NDIS_OFFLOAD            Offload;
+    ULONG                   PacketFilter;
+    BOOLEAN                 MulticastFilter;    // List held by Receiver
 };
 
 MINIPORT_CANCEL_OID_REQUEST AdapterCancelOidRequest;
@@ -166,9 +197,3 @@ AdapterShutdown (
     IN  NDIS_HANDLE             MiniportAdapterContext,
     IN  NDIS_SHUTDOWN_ACTION    ShutdownAction
     );
-
-extern VOID
-ReceiverReceivePackets(
-    IN  PRECEIVER   Receiver,
-    IN  PLIST_ENTRY List
-    );
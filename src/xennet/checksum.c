@@ -0,0 +1,461 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#if defined(_M_AMD64)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#pragma warning(disable:4711)
+
+// Using AVX2 means saving the extended processor state, and the routines
+// that do so first appeared in Windows 7 SP1. They are looked up rather
+// than imported so that the driver still loads on earlier kernels, where
+// it falls back to SSE2.
+#if defined(_M_AMD64) && (NTDDI_VERSION >= NTDDI_WIN7)
+#define CHECKSUM_AVX2
+#endif
+
+#if defined(CHECKSUM_AVX2)
+typedef ULONG64
+(*CHECKSUM_GET_ENABLED_EXTENDED_FEATURES)(
+    IN  ULONG64 FeatureMask
+    );
+
+typedef NTSTATUS
+(*CHECKSUM_SAVE_EXTENDED_PROCESSOR_STATE)(
+    IN  ULONG64         Mask,
+    OUT PXSTATE_SAVE    XStateSave
+    );
+
+typedef VOID
+(*CHECKSUM_RESTORE_EXTENDED_PROCESSOR_STATE)(
+    IN  PXSTATE_SAVE    XStateSave
+    );
+
+static BOOLEAN                                      ChecksumAvx2;
+static CHECKSUM_SAVE_EXTENDED_PROCESSOR_STATE       ChecksumSaveExtendedProcessorState;
+static CHECKSUM_RESTORE_EXTENDED_PROCESSOR_STATE    ChecksumRestoreExtendedProcessorState;
+
+static PVOID
+ChecksumGetSystemRoutine(
+    IN  PCWSTR      Name
+    )
+{
+    UNICODE_STRING  Unicode;
+
+    RtlInitUnicodeString(&Unicode, Name);
+
+    return MmGetSystemRoutineAddress(&Unicode);
+}
+#endif
+
+// Must be called at PASSIVE_LEVEL.
+VOID
+ChecksumInitialize(
+    VOID
+    )
+{
+#if defined(CHECKSUM_AVX2)
+    CHECKSUM_GET_ENABLED_EXTENDED_FEATURES  GetEnabledExtendedFeatures;
+    int                                     Registers[4];
+
+    ChecksumAvx2 = FALSE;
+
+    // CPUID.01H:ECX.OSXSAVE[bit 27] and AVX[bit 28], CPUID.(EAX=07H,
+    // ECX=0):EBX.AVX2[bit 5], and the OS must have enabled the AVX state.
+    __cpuid(Registers, 0);
+    if (Registers[0] < 7)
+        return;
+
+    __cpuid(Registers, 1);
+    if ((Registers[2] & (1 << 27)) == 0 ||
+        (Registers[2] & (1 << 28)) == 0)
+        return;
+
+    __cpuidex(Registers, 7, 0);
+    if ((Registers[1] & (1 << 5)) == 0)
+        return;
+
+    GetEnabledExtendedFeatures = ChecksumGetSystemRoutine(L"RtlGetEnabledExtendedFeatures");
+    ChecksumSaveExtendedProcessorState = ChecksumGetSystemRoutine(L"KeSaveExtendedProcessorState");
+    ChecksumRestoreExtendedProcessorState = ChecksumGetSystemRoutine(L"KeRestoreExtendedProcessorState");
+
+    if (GetEnabledExtendedFeatures == NULL ||
+        ChecksumSaveExtendedProcessorState == NULL ||
+        ChecksumRestoreExtendedProcessorState == NULL) {
+        Info("extended processor state not supported: using SSE2\n");
+        return;
+    }
+
+    if ((GetEnabledExtendedFeatures(XSTATE_MASK_AVX) & XSTATE_MASK_AVX) == 0)
+        return;
+
+    ChecksumAvx2 = TRUE;
+
+    Info("using AVX2\n");
+#endif
+}
+
+static FORCEINLINE ULONG
+__ChecksumFold(
+    IN  ULONG64 Sum
+    )
+{
+    while ((Sum >> 16) != 0)
+        Sum = (Sum & 0xFFFF) + (Sum >> 16);
+
+    return (ULONG)Sum;
+}
+
+// Adding 32-bit words into a 64-bit accumulator gives the same result,
+// once folded, as adding 16-bit words with end-around carry since
+// 2^16 = 1 modulo 2^16 - 1.
+static FORCEINLINE ULONG64
+__ChecksumAddScalar(
+    IN  ULONG64     Sum,
+    IN  const UCHAR *Data,
+    IN  ULONG       Length
+    )
+{
+    while (Length >= 8) {
+        Sum += *(const ULONG UNALIGNED *)Data;
+        Sum += *(const ULONG UNALIGNED *)(Data + 4);
+        Data += 8;
+        Length -= 8;
+    }
+
+    if (Length >= 4) {
+        Sum += *(const ULONG UNALIGNED *)Data;
+        Data += 4;
+        Length -= 4;
+    }
+
+    if (Length >= 2) {
+        Sum += *(const USHORT UNALIGNED *)Data;
+        Data += 2;
+        Length -= 2;
+    }
+
+    // A trailing odd byte is the high-order byte of a zero-padded word,
+    // which is the low-order byte of a little-endian load
+    if (Length != 0)
+        Sum += *Data;
+
+    return Sum;
+}
+
+#if defined(_M_AMD64)
+// XMM state needs no saving in x64 kernel code. Each 32-bit word is
+// widened into a 64-bit lane so the lanes cannot overflow.
+static FORCEINLINE ULONG64
+__ChecksumAddSse2(
+    IN      ULONG64     Sum,
+    IN OUT  const UCHAR **Data,
+    IN OUT  PULONG      Length
+    )
+{
+    const UCHAR         *Next = *Data;
+    ULONG               Remaining = *Length;
+    __m128i             Zero = _mm_setzero_si128();
+    __m128i             Low = Zero;
+    __m128i             High = Zero;
+
+    while (Remaining >= 32) {
+        __m128i First = _mm_loadu_si128((const __m128i *)Next);
+        __m128i Second = _mm_loadu_si128((const __m128i *)(Next + 16));
+
+        Low = _mm_add_epi64(Low, _mm_unpacklo_epi32(First, Zero));
+        High = _mm_add_epi64(High, _mm_unpackhi_epi32(First, Zero));
+        Low = _mm_add_epi64(Low, _mm_unpacklo_epi32(Second, Zero));
+        High = _mm_add_epi64(High, _mm_unpackhi_epi32(Second, Zero));
+
+        Next += 32;
+        Remaining -= 32;
+    }
+
+    Low = _mm_add_epi64(Low, High);
+    Sum += (ULONG64)_mm_cvtsi128_si64(Low);
+    Sum += (ULONG64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(Low, Low));
+
+    *Data = Next;
+    *Length = Remaining;
+
+    return Sum;
+}
+#endif
+
+#if defined(CHECKSUM_AVX2)
+// As __ChecksumAddSse2() but 64 bytes at a time. The caller must have
+// saved the AVX state.
+static DECLSPEC_TARGET("avx2") ULONG64
+__ChecksumAddAvx2(
+    IN      ULONG64     Sum,
+    IN OUT  const UCHAR **Data,
+    IN OUT  PULONG      Length
+    )
+{
+    const UCHAR         *Next = *Data;
+    ULONG               Remaining = *Length;
+    __m256i             Zero = _mm256_setzero_si256();
+    __m256i             Low = Zero;
+    __m256i             High = Zero;
+    __m128i             Total;
+
+    while (Remaining >= 64) {
+        __m256i First = _mm256_loadu_si256((const __m256i *)Next);
+        __m256i Second = _mm256_loadu_si256((const __m256i *)(Next + 32));
+
+        Low = _mm256_add_epi64(Low, _mm256_unpacklo_epi32(First, Zero));
+        High = _mm256_add_epi64(High, _mm256_unpackhi_epi32(First, Zero));
+        Low = _mm256_add_epi64(Low, _mm256_unpacklo_epi32(Second, Zero));
+        High = _mm256_add_epi64(High, _mm256_unpackhi_epi32(Second, Zero));
+
+        Next += 64;
+        Remaining -= 64;
+    }
+
+    Low = _mm256_add_epi64(Low, High);
+    Total = _mm_add_epi64(_mm256_castsi256_si128(Low),
+                          _mm256_extracti128_si256(Low, 1));
+
+    _mm256_zeroupper();
+
+    Sum += (ULONG64)_mm_cvtsi128_si64(Total);
+    Sum += (ULONG64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(Total, Total));
+
+    *Data = Next;
+    *Length = Remaining;
+
+    return Sum;
+}
+
+static FORCEINLINE BOOLEAN
+__ChecksumSaveAvx2(
+    IN  ULONG       Length,
+    OUT PXSTATE_SAVE State
+    )
+{
+    if (!ChecksumAvx2 || Length < CHECKSUM_AVX2_THRESHOLD)
+        return FALSE;
+
+    return NT_SUCCESS(ChecksumSaveExtendedProcessorState(XSTATE_MASK_AVX, State)) ? TRUE : FALSE;
+}
+#endif
+
+static FORCEINLINE ULONG
+__ChecksumAdd(
+    IN  const UCHAR *Data,
+    IN  ULONG       Length,
+    IN  BOOLEAN     Avx2
+    )
+{
+    ULONG64         Sum = 0;
+
+#if defined(CHECKSUM_AVX2)
+    if (Avx2)
+        Sum = __ChecksumAddAvx2(Sum, &Data, &Length);
+#else
+    UNREFERENCED_PARAMETER(Avx2);
+#endif
+
+#if defined(_M_AMD64)
+    Sum = __ChecksumAddSse2(Sum, &Data, &Length);
+#endif
+
+    return __ChecksumFold(__ChecksumAddScalar(Sum, Data, Length));
+}
+
+ULONG
+ChecksumAdd(
+    IN  ULONG       Sum,
+    IN  const VOID  *Data,
+    IN  ULONG       Length
+    )
+{
+    BOOLEAN         Avx2;
+#if defined(CHECKSUM_AVX2)
+    XSTATE_SAVE     State;
+
+    Avx2 = __ChecksumSaveAvx2(Length, &State);
+#else
+    Avx2 = FALSE;
+#endif
+
+    Sum = __ChecksumFold((ULONG64)Sum + __ChecksumAdd(Data, Length, Avx2));
+
+#if defined(CHECKSUM_AVX2)
+    if (Avx2)
+        ChecksumRestoreExtendedProcessorState(&State);
+#endif
+
+    return Sum;
+}
+
+NTSTATUS
+ChecksumAddMdl(
+    IN      PMDL    Mdl,
+    IN      ULONG   Offset,
+    IN      ULONG   Length,
+    IN OUT  PULONG  Sum
+    )
+{
+    ULONG64         Total;
+    BOOLEAN         Odd;
+    BOOLEAN         Avx2;
+    NTSTATUS        status;
+#if defined(CHECKSUM_AVX2)
+    XSTATE_SAVE     State;
+
+    Avx2 = __ChecksumSaveAvx2(Length, &State);
+#else
+    Avx2 = FALSE;
+#endif
+
+    Total = *Sum;
+    Odd = FALSE;
+
+    while (Length != 0) {
+        PUCHAR  StartVa;
+        ULONG   ByteCount;
+        ULONG   Partial;
+
+        status = STATUS_INVALID_PARAMETER;
+        if (Mdl == NULL)
+            goto fail1;
+
+        ByteCount = MmGetMdlByteCount(Mdl);
+        if (Offset >= ByteCount) {
+            Offset -= ByteCount;
+            Mdl = Mdl->Next;
+            continue;
+        }
+
+        status = STATUS_INSUFFICIENT_RESOURCES;
+
+        StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        if (StartVa == NULL)
+            goto fail2;
+
+        ByteCount -= Offset;
+        if (ByteCount > Length)
+            ByteCount = Length;
+
+        Partial = __ChecksumAdd(StartVa + Offset, ByteCount, Avx2);
+
+        // A fragment starting at an odd offset has its bytes the other
+        // way round within each word
+        if (Odd)
+            Partial = ((Partial & 0xFF) << 8) | (Partial >> 8);
+
+        Total += Partial;
+        Odd ^= (ByteCount & 1) ? TRUE : FALSE;
+
+        Length -= ByteCount;
+        Offset = 0;
+        Mdl = Mdl->Next;
+    }
+
+#if defined(CHECKSUM_AVX2)
+    if (Avx2)
+        ChecksumRestoreExtendedProcessorState(&State);
+#endif
+
+    *Sum = __ChecksumFold(Total);
+
+    return STATUS_SUCCESS;
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", status);
+
+#if defined(CHECKSUM_AVX2)
+    if (Avx2)
+        ChecksumRestoreExtendedProcessorState(&State);
+#endif
+
+    return status;
+}
+
+ULONG
+ChecksumPseudoHeader(
+    IN  const IP_HEADER *IpHeader,
+    IN  UCHAR           Protocol,
+    IN  ULONG           Length
+    )
+{
+    PSEUDO_HEADER       PseudoHeader;
+
+    RtlZeroMemory(&PseudoHeader, sizeof (PseudoHeader));
+
+    if (IpHeader->Version == 4) {
+        PseudoHeader.Version4.SourceAddress = IpHeader->Version4.SourceAddress;
+        PseudoHeader.Version4.DestinationAddress = IpHeader->Version4.DestinationAddress;
+        PseudoHeader.Version4.Protocol = Protocol;
+        PseudoHeader.Version4.Length = HTONS((USHORT)Length);
+
+        return __ChecksumFold(__ChecksumAddScalar(0,
+                                                  (const UCHAR *)&PseudoHeader.Version4,
+                                                  sizeof (IPV4_PSEUDO_HEADER)));
+    }
+
+    ASSERT3U(IpHeader->Version, ==, 6);
+
+    PseudoHeader.Version6.SourceAddress = IpHeader->Version6.SourceAddress;
+    PseudoHeader.Version6.DestinationAddress = IpHeader->Version6.DestinationAddress;
+    PseudoHeader.Version6.NextHeader = Protocol;
+    PseudoHeader.Version6.Length = HTONS((USHORT)Length);
+
+    return __ChecksumFold(__ChecksumAddScalar(0,
+                                              (const UCHAR *)&PseudoHeader.Version6,
+                                              sizeof (IPV6_PSEUDO_HEADER)));
+}
+
+USHORT
+ChecksumUpdate(
+    IN  USHORT  Checksum,
+    IN  USHORT  Old,
+    IN  USHORT  New
+    )
+{
+    ULONG       Sum;
+
+    // HC' = ~(~HC + ~m + m')
+    Sum = (USHORT)~Checksum;
+    Sum += (USHORT)~Old;
+    Sum += New;
+
+    return (USHORT)~__ChecksumFold(Sum);
+}
@@ -0,0 +1,81 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+// Internet checksum (RFC 1071) helpers. Sums are kept folded to 16 bits
+// and uncomplemented, and are in network byte order in the sense that
+// storing the low 16 bits to memory gives the bytes of the sum; the
+// checksum field of a header is the complement of the final sum.
+
+// Buffers at least this long are summed with AVX2, where available, in
+// spite of the cost of saving the extended processor state.
+#define CHECKSUM_AVX2_THRESHOLD 2048
+
+VOID
+ChecksumInitialize(
+    VOID
+    );
+
+ULONG
+ChecksumAdd(
+    IN  ULONG       Sum,
+    IN  const VOID  *Data,
+    IN  ULONG       Length
+    );
+
+// Sums Length bytes starting Offset bytes into an MDL chain. Fails only
+// if an MDL cannot be mapped.
+NTSTATUS
+ChecksumAddMdl(
+    IN      PMDL    Mdl,
+    IN      ULONG   Offset,
+    IN      ULONG   Length,
+    IN OUT  PULONG  Sum
+    );
+
+// Sum of the IPv4 or IPv6 pseudo-header for a transport header and
+// payload Length bytes long.
+ULONG
+ChecksumPseudoHeader(
+    IN  const IP_HEADER *IpHeader,
+    IN  UCHAR           Protocol,
+    IN  ULONG           Length
+    );
+
+// Checksum field updated for a 16-bit word changing from Old to New
+// (RFC 1624).
+USHORT
+ChecksumUpdate(
+    IN  USHORT  Checksum,
+    IN  USHORT  Old,
+    IN  USHORT  New
+    );
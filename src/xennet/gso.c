@@ -0,0 +1,177 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#pragma warning(disable:4711)
+
+BOOLEAN
+GsoPrepare(
+    OUT PGSO_TEMPLATE           Template,
+    IN  const UCHAR             *Header,
+    IN  ULONG                   HeaderLength,
+    IN  ULONG                   FrameLength,
+    IN  UCHAR                   IpVersion,
+    IN  ULONG                   TcpHeaderOffset,
+    IN  ULONG                   MaximumSegmentSize
+    )
+{
+    const ETHERNET_HEADER       *EthernetHeader;
+    const TCP_HEADER            *TcpHeader;
+    ULONG                       IpHeaderOffset;
+    USHORT                      Type;
+
+    if (MaximumSegmentSize == 0)
+        return FALSE;
+
+    if (HeaderLength < sizeof (ETHERNET_UNTAGGED_HEADER))
+        return FALSE;
+
+    EthernetHeader = (const ETHERNET_HEADER *)Header;
+
+    if (ETHERNET_HEADER_IS_TAGGED(EthernetHeader)) {
+        IpHeaderOffset = sizeof (ETHERNET_TAGGED_HEADER);
+        Type = NTOHS(EthernetHeader->Tagged.TypeOrLength);
+    } else {
+        IpHeaderOffset = sizeof (ETHERNET_UNTAGGED_HEADER);
+        Type = NTOHS(EthernetHeader->Untagged.TypeOrLength);
+    }
+
+    if (FrameLength - IpHeaderOffset > GSO_MAXIMUM_SIZE ||
+        TcpHeaderOffset + sizeof (TCP_HEADER) > HeaderLength)
+        return FALSE;
+
+    if (IpVersion == 4) {
+        const IPV4_HEADER   *IpHeader;
+
+        if (Type != ETHERTYPE_IPV4 ||
+            IpHeaderOffset + sizeof (IPV4_HEADER) > TcpHeaderOffset)
+            return FALSE;
+
+        IpHeader = (const IPV4_HEADER *)(Header + IpHeaderOffset);
+
+        if (IpHeader->Version != 4 ||
+            IpHeader->Protocol != IPPROTO_TCP ||
+            IpHeaderOffset + IPV4_HEADER_LENGTH(IpHeader) != TcpHeaderOffset)
+            return FALSE;
+    } else if (IpVersion == 6) {
+        const IPV6_HEADER   *IpHeader;
+
+        if (Type != ETHERTYPE_IPV6 ||
+            IpHeaderOffset + sizeof (IPV6_HEADER) > TcpHeaderOffset)
+            return FALSE;
+
+        IpHeader = (const IPV6_HEADER *)(Header + IpHeaderOffset);
+
+        // Any extension headers lie between the IPv6 and TCP headers
+        if (IpHeader->Version != 6)
+            return FALSE;
+    } else {
+        return FALSE;
+    }
+
+    TcpHeader = (const TCP_HEADER *)(Header + TcpHeaderOffset);
+
+    HeaderLength = TcpHeaderOffset + TCP_HEADER_LENGTH(TcpHeader);
+    if (TCP_HEADER_LENGTH(TcpHeader) < sizeof (TCP_HEADER) ||
+        HeaderLength > GSO_MAXIMUM_HEADER_LENGTH ||
+        HeaderLength >= FrameLength)
+        return FALSE;
+
+    RtlCopyMemory(Template->Header, Header, HeaderLength);
+
+    Template->HeaderLength = HeaderLength;
+    Template->IpHeaderOffset = IpHeaderOffset;
+    Template->TcpHeaderOffset = TcpHeaderOffset;
+    Template->IpVersion = IpVersion;
+    Template->PayloadLength = FrameLength - HeaderLength;
+    Template->MaximumSegmentSize = MaximumSegmentSize;
+    Template->SegmentCount = (Template->PayloadLength + MaximumSegmentSize - 1) /
+                             MaximumSegmentSize;
+
+    return TRUE;
+}
+
+ULONG
+GsoBuildHeader(
+    IN  PGSO_TEMPLATE   Template,
+    IN  ULONG           Index,
+    OUT PUCHAR          Buffer
+    )
+{
+    PTCP_HEADER         TcpHeader;
+    ULONG               PayloadLength;
+    ULONG               TcpLength;
+
+    ASSERT3U(Index, <, Template->SegmentCount);
+
+    PayloadLength = Template->PayloadLength - (Index * Template->MaximumSegmentSize);
+    if (PayloadLength > Template->MaximumSegmentSize)
+        PayloadLength = Template->MaximumSegmentSize;
+
+    RtlCopyMemory(Buffer, Template->Header, Template->HeaderLength);
+
+    TcpHeader = (PTCP_HEADER)(Buffer + Template->TcpHeaderOffset);
+    TcpLength = Template->HeaderLength - Template->TcpHeaderOffset + PayloadLength;
+
+    TcpHeader->Seq = HTONL(NTOHL(TcpHeader->Seq) + (Index * Template->MaximumSegmentSize));
+
+    // FIN and PSH belong to the last segment and CWR to the first
+    if (Index != Template->SegmentCount - 1)
+        TcpHeader->Flags &= ~(TCP_FIN | TCP_PSH);
+    if (Index != 0)
+        TcpHeader->Flags &= ~TCP_CWR;
+
+    if (Template->IpVersion == 4) {
+        PIPV4_HEADER    IpHeader = (PIPV4_HEADER)(Buffer + Template->IpHeaderOffset);
+
+        IpHeader->PacketLength = HTONS((USHORT)(Template->TcpHeaderOffset - Template->IpHeaderOffset + TcpLength));
+        IpHeader->PacketID = HTONS((USHORT)(NTOHS(IpHeader->PacketID) + Index));
+
+        IpHeader->Checksum = 0;
+        IpHeader->Checksum = (USHORT)~ChecksumAdd(0,
+                                                  IpHeader,
+                                                  IPV4_HEADER_LENGTH(IpHeader));
+    } else {
+        PIPV6_HEADER    IpHeader = (PIPV6_HEADER)(Buffer + Template->IpHeaderOffset);
+
+        IpHeader->PayloadLength = HTONS((USHORT)(Template->TcpHeaderOffset - Template->IpHeaderOffset -
+                                                 sizeof (IPV6_HEADER) + TcpLength));
+    }
+
+    // As the stack leaves it for checksum offload: the pseudo-header sum,
+    // not complemented
+    TcpHeader->Checksum = (USHORT)ChecksumPseudoHeader((PIP_HEADER)(Buffer + Template->IpHeaderOffset),
+                                                       IPPROTO_TCP,
+                                                       TcpLength);
+
+    return PayloadLength;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+// Longest header (Ethernet, IP including any extension headers, and TCP)
+// that can be segmented
+#define GSO_MAXIMUM_HEADER_LENGTH   256
+
+// Largest IP datagram accepted for segmentation
+#define GSO_MAXIMUM_SIZE            65535
+
+// Built by GsoPrepare() from the headers of a large TCP send, and used by
+// GsoBuildHeader() to produce the headers of each segment. Only touches
+// memory it is handed, so can be built outside the driver.
+typedef struct _GSO_TEMPLATE {
+    UCHAR   Header[GSO_MAXIMUM_HEADER_LENGTH];
+    ULONG   HeaderLength;
+    ULONG   IpHeaderOffset;
+    ULONG   TcpHeaderOffset;
+    UCHAR   IpVersion;
+    ULONG   PayloadLength;
+    ULONG   MaximumSegmentSize;
+    ULONG   SegmentCount;
+} GSO_TEMPLATE, *PGSO_TEMPLATE;
+
+// Header points at the first HeaderLength bytes of a frame FrameLength
+// bytes long, sent with LSO: TcpHeaderOffset and MaximumSegmentSize are
+// as passed by the stack. Returns FALSE if the frame cannot be segmented.
+BOOLEAN
+GsoPrepare(
+    OUT PGSO_TEMPLATE   Template,
+    IN  const UCHAR     *Header,
+    IN  ULONG           HeaderLength,
+    IN  ULONG           FrameLength,
+    IN  UCHAR           IpVersion,
+    IN  ULONG           TcpHeaderOffset,
+    IN  ULONG           MaximumSegmentSize
+    );
+
+// Writes Template->HeaderLength bytes of headers for segment Index into
+// Buffer and returns the length of its payload, which follows the
+// previous segment's in the original frame. The IPv4 header checksum is
+// complete and the TCP checksum holds the pseudo-header sum, ready for
+// checksum offload.
+ULONG
+GsoBuildHeader(
+    IN  PGSO_TEMPLATE   Template,
+    IN  ULONG           Index,
+    OUT PUCHAR          Buffer
+    );
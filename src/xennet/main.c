@@ -199,6 +199,8 @@ DriverEntry (
     if (*InitSafeBootMode > 0)
         return NDIS_STATUS_SUCCESS;
 
+    ChecksumInitialize();
+
     //
     // Register miniport with NDIS.
     //
@@ -38,21 +38,21 @@
 extern NTSTATUS AllocAdapter(PADAPTER *Adapter);
 
 static NTSTATUS
-QueryVifInterface(
+__QueryVifInterface(
     IN  PDEVICE_OBJECT      DeviceObject,
-    IN  PADAPTER            Adapter
+    IN  USHORT              Version,
+    OUT PINTERFACE          Interface
     )
 {
     KEVENT                  Event;
     IO_STATUS_BLOCK         StatusBlock;
     PIRP                    Irp;
     PIO_STACK_LOCATION      StackLocation;
-    INTERFACE               Interface;
     NTSTATUS                status;
 
     KeInitializeEvent(&Event, NotificationEvent, FALSE);
     RtlZeroMemory(&StatusBlock, sizeof(IO_STATUS_BLOCK));
-    RtlZeroMemory(&Interface, sizeof(INTERFACE));
+    RtlZeroMemory(Interface, sizeof(INTERFACE));
 
     Irp = IoBuildSynchronousFsdRequest(IRP_MJ_PNP,
                                        DeviceObject,
@@ -71,8 +71,8 @@ QueryVifInterface(
 
     StackLocation->Parameters.QueryInterface.InterfaceType = &GUID_VIF_INTERFACE;
     StackLocation->Parameters.QueryInterface.Size = sizeof (INTERFACE);
-    StackLocation->Parameters.QueryInterface.Version = VIF_INTERFACE_VERSION;
-    StackLocation->Parameters.QueryInterface.Interface = &Interface;
+    StackLocation->Parameters.QueryInterface.Version = Version;
+    StackLocation->Parameters.QueryInterface.Interface = Interface;
     
     Irp->IoStatus.Status = STATUS_NOT_SUPPORTED;
 
@@ -90,18 +90,52 @@ QueryVifInterface(
         goto fail2;
 
     status = STATUS_INVALID_PARAMETER;
-    if (Interface.Version != VIF_INTERFACE_VERSION)
+    if (Interface->Version != Version)
         goto fail3;
 
-    Adapter->VifInterface = Interface.Context;
-
     return STATUS_SUCCESS;
 
 fail3:
-    Error("fail3\n");
+    Trace("fail3\n");
 
 fail2:
-    Error("fail2\n");
+    Trace("fail2\n");
+
+fail1:
+    Trace("fail1 (%08x)\n", status);
+
+    return status;
+}
+
+static NTSTATUS
+QueryVifInterface(
+    IN  PDEVICE_OBJECT      DeviceObject,
+    IN  PADAPTER            Adapter
+    )
+{
+    INTERFACE               Interface;
+    USHORT                  Version;
+    NTSTATUS                status;
+
+    // Ask for the newest version we understand first and fall back so
+    // that we can still run against an older XENVIF.
+    for (Version = VIF_INTERFACE_VERSION;
+         Version >= VIF_INTERFACE_VERSION_MIN;
+         --Version) {
+        status = __QueryVifInterface(DeviceObject, Version, &Interface);
+        if (NT_SUCCESS(status))
+            break;
+    }
+
+    if (!NT_SUCCESS(status))
+        goto fail1;
+
+    Info("VIF interface version %u\n", Version);
+
+    Adapter->VifInterface = Interface.Context;
+    Adapter->VifInterfaceVersion = Version;
+
+    return STATUS_SUCCESS;
 
 fail1:
     Error("fail1 (%08x)\n", status);
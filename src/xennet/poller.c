@@ -0,0 +1,372 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#pragma warning(disable:4711)
+
+#define POLLER_MAXIMUM_PASSES   16
+
+static KDEFERRED_ROUTINE PollerDpc;
+static KDEFERRED_ROUTINE PollerThreadedDpc;
+
+VOID
+PollerInitialize(
+    IN  PPOLLER     Poller,
+    IN  PADAPTER    Adapter
+    )
+{
+    RtlZeroMemory(Poller, sizeof (POLLER));
+
+    Poller->Adapter = Adapter;
+
+    KeInitializeSpinLock(&Poller->Lock);
+    InitializeListHead(&Poller->Receive);
+    Poller->CompleteTail = &Poller->CompleteHead;
+
+    // Low importance so the DPC does not interrupt the CPU when queued
+    // from the backend's DPC; anything else queued meanwhile, including
+    // further events from the backend, runs first and adds to the batch.
+    KeInitializeDpc(&Poller->Dpc, PollerDpc, Poller);
+    KeSetImportanceDpc(&Poller->Dpc, LowImportance);
+
+    KeInitializeThreadedDpc(&Poller->ThreadedDpc, PollerThreadedDpc, Poller);
+}
+
+VOID
+PollerEnable(
+    IN  PPOLLER     Poller,
+    IN  ULONG       Threshold
+    )
+{
+    KIRQL           Irql;
+
+    KeAcquireSpinLock(&Poller->Lock, &Irql);
+    ASSERT(!Poller->Polling);
+    Poller->Threshold = Threshold;
+    KeReleaseSpinLock(&Poller->Lock, Irql);
+
+    if (Threshold != 0)
+        Info("Threshold = %u\n", Threshold);
+}
+
+//
+// Must be called once the backend has been disabled, so no more callbacks
+// can arrive, and before the receiver is disabled.
+//
+VOID
+PollerDisable(
+    IN  PPOLLER     Poller
+    )
+{
+    // The poll DPCs re-queue each other until one finds nothing to do
+    while (Poller->Polling)
+        KeFlushQueuedDpcs();
+
+    ASSERT(IsListEmpty(&Poller->Receive));
+    ASSERT3P(Poller->CompleteHead, ==, NULL);
+
+    if (Poller->Threshold != 0)
+        Info("Events = %llu (%llu polled) Polls = %llu Rearms = %llu Yields = %llu Packets = %llu/%llu (%llu polled)\n",
+             Poller->Statistics.Events,
+             Poller->Statistics.PolledEvents,
+             Poller->Statistics.Polls,
+             Poller->Statistics.Rearms,
+             Poller->Statistics.Yields,
+             Poller->Statistics.Packets,
+             Poller->Statistics.Completions,
+             Poller->Statistics.PolledPackets);
+}
+
+static FORCEINLINE VOID
+__PollerMoveList(
+    IN  PLIST_ENTRY Destination,
+    IN  PLIST_ENTRY Source
+    )
+{
+    if (IsListEmpty(Source))
+        return;
+
+    Source->Flink->Blink = Destination->Blink;
+    Destination->Blink->Flink = Source->Flink;
+
+    Source->Blink->Flink = Destination;
+    Destination->Blink = Source->Blink;
+
+    InitializeListHead(Source);
+}
+
+// Must be called with Poller->Lock held. Queues the poll DPC if the
+// poller is not already running; the caller's packets must already be
+// on the poller's lists.
+static FORCEINLINE VOID
+__PollerStart(
+    IN  PPOLLER     Poller
+    )
+{
+    if (Poller->Polling)
+        return;
+
+    Poller->Polling = TRUE;
+    (VOID) KeInsertQueueDpc(&Poller->Dpc, NULL, NULL);
+}
+
+// Must be called at DISPATCH_LEVEL. Makes one pass over whatever the
+// callbacks have queued and then queues the next pass, unless there was
+// nothing to do.
+static VOID
+PollerPoll(
+    IN  PPOLLER                 Poller
+    )
+{
+    PADAPTER                    Adapter = Poller->Adapter;
+    PRECEIVER                   Receiver = &Adapter->Receiver;
+    LIST_ENTRY                  List;
+    PXENVIF_TRANSMITTER_PACKET  HeadPacket;
+    ULONG64                     Elapsed;
+
+    InitializeListHead(&List);
+
+    KeAcquireSpinLockAtDpcLevel(&Poller->Lock);
+
+    ASSERT(Poller->Polling);
+    Poller->Statistics.Polls++;
+
+    if (Poller->Pending == 0) {
+        // Run dry: let the callbacks process packets themselves again
+        Poller->Statistics.Rearms++;
+        Poller->Polling = FALSE;
+        Poller->Passes = 0;
+
+        KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+        return;
+    }
+
+    if (Poller->Passes++ == 0) {
+        Poller->Processed = 0;
+        Poller->Start = KeQueryPerformanceCounter(NULL).QuadPart;
+    }
+
+    __PollerMoveList(&List, &Poller->Receive);
+
+    HeadPacket = Poller->CompleteHead;
+    Poller->CompleteHead = NULL;
+    Poller->CompleteTail = &Poller->CompleteHead;
+
+    Poller->Statistics.PolledPackets += Poller->Pending;
+    Poller->Processed += Poller->Pending;
+    Poller->Pending = 0;
+
+    KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+
+    if (HeadPacket != NULL)
+        TransmitterCompletePackets(Adapter->Transmitter, HeadPacket);
+
+    if (!IsListEmpty(&List))
+        ReceiverReceivePackets(Receiver, &List);
+
+    ASSERT(IsListEmpty(&List));
+
+    Elapsed = KeQueryPerformanceCounter(NULL).QuadPart - Poller->Start;
+
+    // Poll again; callbacks keep queueing until a poll finds nothing
+    if (Poller->Passes < POLLER_MAXIMUM_PASSES &&
+        (Receiver->Budget == 0 || Poller->Processed < Receiver->Budget) &&
+        (Receiver->BudgetTime == 0 || Elapsed < Receiver->BudgetTime)) {
+        (VOID) KeInsertQueueDpc(&Poller->Dpc, NULL, NULL);
+        return;
+    }
+
+    // Out of budget: start a new poll from the threaded DPC
+    Poller->Passes = 0;
+    (VOID) KeInsertQueueDpc(&Poller->ThreadedDpc, NULL, NULL);
+}
+
+static VOID
+PollerDpc(
+    IN  PKDPC   Dpc,
+    IN  PVOID   Context,
+    IN  PVOID   Argument1,
+    IN  PVOID   Argument2
+    )
+{
+    PPOLLER     Poller = Context;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    ASSERT(Poller != NULL);
+
+    PollerPoll(Poller);
+}
+
+// Runs at PASSIVE_LEVEL unless threaded DPCs are disabled, in which case
+// it behaves like an ordinary DPC.
+static VOID
+PollerThreadedDpc(
+    IN  PKDPC   Dpc,
+    IN  PVOID   Context,
+    IN  PVOID   Argument1,
+    IN  PVOID   Argument2
+    )
+{
+    PPOLLER     Poller = Context;
+    KIRQL       Irql;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    ASSERT(Poller != NULL);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    KeAcquireSpinLockAtDpcLevel(&Poller->Lock);
+    Poller->Statistics.Yields++;
+    KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+
+    PollerPoll(Poller);
+
+    KeLowerIrql(Irql);
+}
+
+//
+// Called by the backend with a list of received packets.
+// Must be called at DISPATCH_LEVEL.
+//
+VOID
+PollerReceivePackets(
+    IN  PPOLLER     Poller,
+    IN  PLIST_ENTRY List
+    )
+{
+    PADAPTER        Adapter = Poller->Adapter;
+    PLIST_ENTRY     ListEntry;
+    ULONG           Count;
+
+    if (Poller->Threshold == 0) {
+        ReceiverReceivePackets(&Adapter->Receiver, List);
+        return;
+    }
+
+    Count = 0;
+    for (ListEntry = List->Flink; ListEntry != List; ListEntry = ListEntry->Flink)
+        Count++;
+
+    KeAcquireSpinLockAtDpcLevel(&Poller->Lock);
+
+    Poller->Statistics.Events++;
+    Poller->Statistics.Packets += Count;
+
+    if (!Poller->Polling && Count < Poller->Threshold) {
+        KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+
+        ReceiverReceivePackets(&Adapter->Receiver, List);
+        return;
+    }
+
+    if (Poller->Polling)
+        Poller->Statistics.PolledEvents++;
+
+    __PollerMoveList(&Poller->Receive, List);
+    Poller->Pending += Count;
+
+    __PollerStart(Poller);
+
+    KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+}
+
+//
+// Called by the backend with a chain of completed transmit packets.
+// Must be called at DISPATCH_LEVEL.
+//
+VOID
+PollerCompletePackets(
+    IN  PPOLLER                     Poller,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    )
+{
+    PADAPTER                        Adapter = Poller->Adapter;
+    PXENVIF_TRANSMITTER_PACKET      *TailPacket;
+    ULONG                           Count;
+
+    if (Poller->Threshold == 0) {
+        TransmitterCompletePackets(Adapter->Transmitter, HeadPacket);
+        return;
+    }
+
+    Count = 0;
+    for (TailPacket = &HeadPacket; *TailPacket != NULL; TailPacket = &(*TailPacket)->Next)
+        Count++;
+
+    KeAcquireSpinLockAtDpcLevel(&Poller->Lock);
+
+    Poller->Statistics.Events++;
+    Poller->Statistics.Completions += Count;
+
+    if (!Poller->Polling && Count < Poller->Threshold) {
+        KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+
+        TransmitterCompletePackets(Adapter->Transmitter, HeadPacket);
+        return;
+    }
+
+    if (Poller->Polling)
+        Poller->Statistics.PolledEvents++;
+
+    if (HeadPacket != NULL) {
+        *Poller->CompleteTail = HeadPacket;
+        Poller->CompleteTail = TailPacket;
+    }
+    Poller->Pending += Count;
+
+    __PollerStart(Poller);
+
+    KeReleaseSpinLockFromDpcLevel(&Poller->Lock);
+}
+
+VOID
+PollerQueryStatistics(
+    IN  PPOLLER             Poller,
+    OUT PPOLLER_STATISTICS  Statistics
+    )
+{
+    KIRQL                   Irql;
+
+    KeAcquireSpinLock(&Poller->Lock, &Irql);
+
+    *Statistics = Poller->Statistics;
+    Statistics->Threshold = Poller->Threshold;
+    Statistics->Polling = Poller->Polling;
+
+    KeReleaseSpinLock(&Poller->Lock, Irql);
+}
@@ -0,0 +1,120 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+// Returned by OID_XENNET_POLLER_STATISTICS. Events counts the receive and
+// completion callbacks made by the backend and PolledEvents those that
+// found the poller already running, so only had to queue their packets.
+// Polls counts runs of the poll DPC and Rearms those that found nothing
+// to do and so handed processing back to the callbacks. Yields counts
+// polls that used up their budget and so continued from the threaded
+// DPC. Packets and
+// Completions count received and completed transmit packets, and
+// PolledPackets how many of either were processed by the poll DPC rather
+// than in the callback. Events / (Packets + Completions) is the number of
+// events taken per packet.
+typedef struct _POLLER_STATISTICS {
+    ULONG   Threshold;
+    BOOLEAN Polling;
+    ULONG64 Events;
+    ULONG64 PolledEvents;
+    ULONG64 Polls;
+    ULONG64 Rearms;
+    ULONG64 Yields;
+    ULONG64 Packets;
+    ULONG64 Completions;
+    ULONG64 PolledPackets;
+} POLLER_STATISTICS, *PPOLLER_STATISTICS;
+
+// Callbacks carrying at least Threshold packets switch the adapter into
+// polling: from then on callbacks only queue their packets and the poll
+// DPC processes them, re-queueing itself until it finds nothing to do. A
+// Threshold of 0 leaves the callbacks to do all the work.
+//
+// A poll is limited to the receiver's budget of packets and time and to
+// POLLER_MAXIMUM_PASSES runs of the DPC. Once it is used up the poll
+// carries on from ThreadedDpc, so the CPU can leave DISPATCH_LEVEL
+// between polls instead of running the same DPC back to back. Passes,
+// Processed and Start belong to whichever of the two DPCs is queued or
+// running; there is only ever one.
+typedef struct _POLLER {
+    PADAPTER                    Adapter;
+    ULONG                       Threshold;
+
+    KSPIN_LOCK                  Lock;
+    BOOLEAN                     Polling;
+    LIST_ENTRY                  Receive;
+    PXENVIF_TRANSMITTER_PACKET  CompleteHead;
+    PXENVIF_TRANSMITTER_PACKET  *CompleteTail;
+    ULONG                       Pending;
+    KDPC                        Dpc;
+    KDPC                        ThreadedDpc;
+    ULONG                       Passes;
+    ULONG                       Processed;
+    ULONG64                     Start;
+    POLLER_STATISTICS           Statistics;
+} POLLER, *PPOLLER;
+
+VOID
+PollerInitialize(
+    IN  PPOLLER     Poller,
+    IN  PADAPTER    Adapter
+    );
+
+VOID
+PollerEnable(
+    IN  PPOLLER     Poller,
+    IN  ULONG       Threshold
+    );
+
+VOID
+PollerDisable(
+    IN  PPOLLER     Poller
+    );
+
+VOID
+PollerReceivePackets(
+    IN  PPOLLER     Poller,
+    IN  PLIST_ENTRY List
+    );
+
+VOID
+PollerCompletePackets(
+    IN  PPOLLER                     Poller,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    );
+
+VOID
+PollerQueryStatistics(
+    IN  PPOLLER             Poller,
+    OUT PPOLLER_STATISTICS  Statistics
+    );
@@ -61,6 +61,10 @@ MpGetAdvancedSettings(
     IN PADAPTER Adapter
     );
 
+#include "toeplitz.h"
+#include "checksum.h"
+#include "gso.h"
 #include "transmitter.h"
 #include "receiver.h"
+#include "poller.h"
 #include "adapter.h"
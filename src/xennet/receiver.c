@@ -33,6 +33,67 @@
 
 #pragma warning(disable:4711)
 
+// Used until the backend's ring size is known
+#define RECEIVER_IN_NDIS_DEFAULT    1024
+
+// Bounds on the adaptive in-flight watermark, in receive rings
+#define RECEIVER_IN_NDIS_MIN_RINGS  1
+#define RECEIVER_IN_NDIS_MAX_RINGS  8
+
+// Upper bound on the number of receive rings' worth of NET_BUFFER_LISTs
+// pre-allocated by ReceiverEnable()
+#define RECEIVER_PREWARM_MAXIMUM_FACTOR 8
+
+// Number of ReceiverTrim() calls (AdapterCheckForHang() ticks, roughly two
+// seconds each) over which the depot's unused magazines are measured.
+#define RECEIVER_TRIM_INTERVAL          5
+
+#define RECEIVER_STORM_MINIMUM_BURST    64
+
+// Values below this in the TypeOrLength field are lengths
+#define RECEIVER_MINIMUM_ETHERTYPE      0x0600
+
+// A homogeneous run at least this long is indicated on its own, with
+// NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE and NDIS_RECEIVE_FLAGS_SINGLE_VLAN
+#define RECEIVER_HINT_MINIMUM_RUN       4
+
+// Packets processed between checks of the time budget
+#define RECEIVER_BUDGET_CHECK_INTERVAL  16
+
+static KDEFERRED_ROUTINE ReceiverQueueDpc;
+static KDEFERRED_ROUTINE ReceiverBacklogDpc;
+
+static VOID
+ReceiverInitializeQueue(
+    IN  PRECEIVER       Receiver,
+    IN  ULONG           Index
+    )
+{
+    PRECEIVER_QUEUE     Queue;
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    PROCESSOR_NUMBER    ProcessorNumber;
+    NTSTATUS            status;
+#endif
+
+    Queue = &Receiver->Processor[Index].Queue;
+
+    KeInitializeSpinLock(&Queue->Lock);
+    Queue->Head = NULL;
+    Queue->Tail = &Queue->Head;
+    Queue->Count = 0;
+
+    KeInitializeDpc(&Queue->Dpc, ReceiverQueueDpc, Receiver);
+
+#if (NTDDI_VERSION >= NTDDI_WIN7)
+    status = KeGetProcessorNumberFromIndex(Index, &ProcessorNumber);
+    ASSERT(NT_SUCCESS(status));
+
+    (VOID) KeSetTargetProcessorDpcEx(&Queue->Dpc, &ProcessorNumber);
+#else
+    KeSetTargetProcessorDpc(&Queue->Dpc, (CCHAR)Index);
+#endif
+}
+
 NDIS_STATUS
 ReceiverInitialize (
     IN  PRECEIVER                   Receiver
@@ -41,14 +102,52 @@ ReceiverInitialize (
     PADAPTER                        Adapter;
     NDIS_STATUS                     ndisStatus = NDIS_STATUS_SUCCESS;
     NET_BUFFER_LIST_POOL_PARAMETERS poolParameters;
-    ULONG                           Cpu;
-
-    Receiver->PutList = NULL;
-    for (Cpu = 0; Cpu < MAXIMUM_PROCESSORS; Cpu++)
-        Receiver->GetList[Cpu] = NULL;
+    UNICODE_STRING                  Name;
+    ULONG                           Index;
+
+    KeInitializeSpinLock(&Receiver->DepotLock);
+    InitializeListHead(&Receiver->FullDepot);
+    InitializeListHead(&Receiver->EmptyDepot);
+
+    // Signalled by the memory manager when non-paged pool runs low.
+    // ReceiverTrim() polls it; the cache simply isn't shrunk early if it
+    // cannot be opened.
+    RtlInitUnicodeString(&Name, L"\\KernelObjects\\LowNonPagedPoolCondition");
+    Receiver->LowMemoryEvent = IoCreateNotificationEvent(&Name,
+                                                         &Receiver->LowMemoryHandle);
+    if (Receiver->LowMemoryEvent == NULL)
+        Warning("cannot open low memory event\n");
 
     Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
 
+    Receiver->ProcessorCount = __GetActiveProcessorCount();
+    ASSERT(Receiver->ProcessorCount != 0);
+
+    Receiver->Processor = ExAllocatePoolWithTag(NonPagedPoolCacheAligned,
+                                                sizeof (RECEIVER_PROCESSOR) * Receiver->ProcessorCount,
+                                                ' TEN');
+
+    ndisStatus = NDIS_STATUS_RESOURCES;
+    if (Receiver->Processor == NULL)
+        goto fail1;
+
+    RtlZeroMemory(Receiver->Processor,
+                  sizeof (RECEIVER_PROCESSOR) * Receiver->ProcessorCount);
+
+    for (Index = 0; Index < Receiver->ProcessorCount; Index++)
+        ReceiverInitializeQueue(Receiver, Index);
+
+    KeInitializeSpinLock(&Receiver->RssLock);
+    RtlZeroMemory(&Receiver->Rss, sizeof (RECEIVER_RSS));
+
+    KeInitializeSpinLock(&Receiver->StormLock);
+
+    KeInitializeSpinLock(&Receiver->BacklogLock);
+    InitializeListHead(&Receiver->Backlog);
+    KeInitializeDpc(&Receiver->BacklogDpc, ReceiverBacklogDpc, Receiver);
+
+    Receiver->InNDISLimit = RECEIVER_IN_NDIS_DEFAULT;
+
     NdisZeroMemory(&poolParameters, sizeof(NET_BUFFER_LIST_POOL_PARAMETERS));
     poolParameters.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
     poolParameters.Header.Revision =
@@ -64,358 +163,3477 @@ ReceiverInitialize (
                                       &poolParameters);
 
     if (!Receiver->NetBufferListPool)
-        ndisStatus = NDIS_STATUS_RESOURCES;
+        goto fail2;
+
+    return NDIS_STATUS_SUCCESS;
+
+fail2:
+    Error("fail2\n");
+
+    ExFreePool(Receiver->Processor);
+    Receiver->Processor = NULL;
+
+fail1:
+    Error("fail1 (%08x)\n", ndisStatus);
+
+    Receiver->ProcessorCount = 0;
+
+    if (Receiver->LowMemoryEvent != NULL) {
+        ZwClose(Receiver->LowMemoryHandle);
+        Receiver->LowMemoryHandle = NULL;
+        Receiver->LowMemoryEvent = NULL;
+    }
 
     return ndisStatus;
 }
 
-VOID 
-ReceiverCleanup (
-    IN  PRECEIVER       Receiver
+static VOID
+ReceiverSlabFree(
+    IN  PRECEIVER_SLAB  Slab
     )
 {
-    ULONG               Cpu;
-    PNET_BUFFER_LIST    NetBufferList;
-
-    ASSERT(Receiver != NULL);
+    ULONG               Index;
 
-    for (Cpu = 0; Cpu < MAXIMUM_PROCESSORS; Cpu++) {
-        NetBufferList = Receiver->GetList[Cpu];
-        while (NetBufferList != NULL) {
-            PNET_BUFFER_LIST    Next;
+    if (Slab->Buffer == NULL)
+        return;
 
-            Next = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
-            NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+    for (Index = 0; Index < Slab->Count; Index++) {
+        PRECEIVER_SLAB_BUFFER   Buffer = &Slab->Buffer[Index];
 
-            NdisFreeNetBufferList(NetBufferList);
+        if (Buffer->NetBufferList != NULL)
+            NdisFreeNetBufferList(Buffer->NetBufferList);
 
-            NetBufferList = Next;
-        }
+        if (Buffer->Mdl != NULL)
+            NdisFreeMdl(Buffer->Mdl);
     }
 
-    NetBufferList = Receiver->PutList;
-    while (NetBufferList != NULL) {
-        PNET_BUFFER_LIST    Next;
-
-        Next = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
-        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
-
-        NdisFreeNetBufferList(NetBufferList);
+    ExFreePool(Slab->Data);
+    Slab->Data = NULL;
 
-        NetBufferList = Next;
-    }
+    ExFreePool(Slab->Buffer);
+    Slab->Buffer = NULL;
 
-    if (Receiver->NetBufferListPool) {
-        NdisFreeNetBufferListPool(Receiver->NetBufferListPool);
-        Receiver->NetBufferListPool = NULL;
-    }
+    NdisFreeNetBufferListPool(Slab->NetBufferListPool);
+    Slab->NetBufferListPool = NULL;
 
-    return;
+    Slab->Size = 0;
+    Slab->Count = 0;
 }
 
-PNET_BUFFER_LIST
-ReceiverAllocateNetBufferList(
-    IN  PRECEIVER       Receiver,
-    IN  PMDL            Mdl,
-    IN  ULONG           Offset,
-    IN  ULONG           Length
+// The NET_BUFFER_LISTs come from a pool of their own so that they can be
+// recognized when the stack returns them, and each NET_BUFFER points back
+// at its buffer.
+static NDIS_STATUS
+ReceiverSlabAllocate(
+    IN  PRECEIVER                   Receiver,
+    IN  PRECEIVER_SLAB              Slab,
+    IN  ULONG                       Size,
+    IN  ULONG                       Count
     )
 {
-    ULONG               Cpu;
-    PNET_BUFFER_LIST    NetBufferList;
+    PADAPTER                        Adapter;
+    NET_BUFFER_LIST_POOL_PARAMETERS poolParameters;
+    ULONG                           Index;
+    NDIS_STATUS                     ndisStatus;
 
-    Cpu = KeGetCurrentProcessorNumber();
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
 
-    NetBufferList = Receiver->GetList[Cpu];
+    ASSERT3P(Slab->Buffer, ==, NULL);
+    InitializeSListHead(&Slab->FreeList);
 
-    if (NetBufferList == NULL)
-        Receiver->GetList[Cpu] = InterlockedExchangePointer(&Receiver->PutList, NULL);
+    NdisZeroMemory(&poolParameters, sizeof(NET_BUFFER_LIST_POOL_PARAMETERS));
+    poolParameters.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
+    poolParameters.Header.Revision =
+        NET_BUFFER_LIST_POOL_PARAMETERS_REVISION_1;
+    poolParameters.Header.Size = sizeof(poolParameters);
+    poolParameters.ProtocolId = 0;
+    poolParameters.ContextSize = 0;
+    poolParameters.fAllocateNetBuffer = TRUE;
+    poolParameters.PoolTag = ' TEN';
 
-    NetBufferList = Receiver->GetList[Cpu];
+    Slab->NetBufferListPool =
+        NdisAllocateNetBufferListPool(Adapter->NdisAdapterHandle,
+                                      &poolParameters);
 
-    if (NetBufferList != NULL) {
-        PNET_BUFFER NetBuffer;
+    ndisStatus = NDIS_STATUS_RESOURCES;
+    if (Slab->NetBufferListPool == NULL)
+        goto fail1;
 
-        Receiver->GetList[Cpu] = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
-        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+    Slab->Buffer = ExAllocatePoolWithTag(NonPagedPool,
+                                         sizeof (RECEIVER_SLAB_BUFFER) * Count,
+                                         ' TEN');
+    if (Slab->Buffer == NULL)
+        goto fail2;
 
-        NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
-        NET_BUFFER_FIRST_MDL(NetBuffer) = Mdl;
-        NET_BUFFER_CURRENT_MDL(NetBuffer) = Mdl;
-        NET_BUFFER_DATA_OFFSET(NetBuffer) = Offset;
-        NET_BUFFER_DATA_LENGTH(NetBuffer) = Length;
-        NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) = Offset;
-    } else {
-        NetBufferList = NdisAllocateNetBufferAndNetBufferList(Receiver->NetBufferListPool,
-                                                              0,
-                                                              0,
-                                                              Mdl,
-                                                              Offset,
-                                                              Length);
-        ASSERT(IMPLY(NetBufferList != NULL, NET_BUFFER_LIST_NEXT_NBL(NetBufferList) == NULL));
-    }
+    RtlZeroMemory(Slab->Buffer, sizeof (RECEIVER_SLAB_BUFFER) * Count);
 
-    return NetBufferList;
-}        
+    Slab->Data = ExAllocatePoolWithTag(NonPagedPool, Size * Count, ' TEN');
+    if (Slab->Data == NULL)
+        goto fail3;
 
-VOID
-ReceiverReleaseNetBufferList(
-    IN  PRECEIVER           Receiver,
-    IN  PNET_BUFFER_LIST    NetBufferList,
-    IN  BOOLEAN             Cache
-    )
-{
-    if (Cache) {
-        PNET_BUFFER_LIST    Old;
-        PNET_BUFFER_LIST    New;
+    for (Index = 0; Index < Count; Index++) {
+        PRECEIVER_SLAB_BUFFER   Buffer = &Slab->Buffer[Index];
+        PNET_BUFFER             NetBuffer;
 
-        ASSERT3P(NET_BUFFER_LIST_NEXT_NBL(NetBufferList), ==, NULL);
+        Buffer->Mdl = NdisAllocateMdl(Adapter->NdisAdapterHandle,
+                                      Slab->Data + (Index * Size),
+                                      Size);
+        if (Buffer->Mdl == NULL)
+            goto fail4;
+
+        Buffer->NetBufferList = NdisAllocateNetBufferAndNetBufferList(Slab->NetBufferListPool,
+                                                                      0,
+                                                                      0,
+                                                                      Buffer->Mdl,
+                                                                      0,
+                                                                      0);
+        if (Buffer->NetBufferList == NULL)
+            goto fail4;
+
+        NetBuffer = NET_BUFFER_LIST_FIRST_NB(Buffer->NetBufferList);
+        NET_BUFFER_MINIPORT_RESERVED(NetBuffer)[0] = Buffer;
+
+        InterlockedPushEntrySList(&Slab->FreeList, &Buffer->ListEntry);
+    }
 
-        do {
-            Old = Receiver->PutList;
+    Slab->Size = Size;
+    Slab->Count = Count;
 
-            NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = Old;
-            New = NetBufferList;
-        } while (InterlockedCompareExchangePointer(&Receiver->PutList, New, Old) != Old);
-    } else {
-        NdisFreeNetBufferList(NetBufferList);
-    }
-}
+    return NDIS_STATUS_SUCCESS;
 
-static FORCEINLINE ULONG
-__ReceiverReturnNetBufferLists(
-    IN  PRECEIVER           Receiver,
-    IN  PNET_BUFFER_LIST    NetBufferList,
-    IN  BOOLEAN             Cache
-    )
-{
-    PADAPTER                Adapter;
-    ULONG                   Count;
+fail4:
+    Error("fail4\n");
 
-    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+    InitializeSListHead(&Slab->FreeList);
 
-    Count = 0;
-    while (NetBufferList != NULL) {
-        PNET_BUFFER_LIST        Next;
-        PNET_BUFFER             NetBuffer;
-        PMDL                    Mdl;
-        PXENVIF_RECEIVER_PACKET Packet;
+    do {
+        PRECEIVER_SLAB_BUFFER   Buffer = &Slab->Buffer[Index];
 
-        Next = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
-        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+        if (Buffer->NetBufferList != NULL)
+            NdisFreeNetBufferList(Buffer->NetBufferList);
 
-        NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
-        ASSERT3P(NET_BUFFER_NEXT_NB(NetBuffer), ==, NULL);
+        if (Buffer->Mdl != NULL)
+            NdisFreeMdl(Buffer->Mdl);
+    } while (Index-- != 0);
 
-        Mdl = NET_BUFFER_FIRST_MDL(NetBuffer);
+    ExFreePool(Slab->Data);
+    Slab->Data = NULL;
 
-        ReceiverReleaseNetBufferList(Receiver, NetBufferList, Cache);
+fail3:
+    Error("fail3\n");
 
-        Packet = CONTAINING_RECORD(Mdl, XENVIF_RECEIVER_PACKET, Mdl);
+    ExFreePool(Slab->Buffer);
+    Slab->Buffer = NULL;
 
-        VIF(ReturnPacket,
-            Adapter->VifInterface,
-            Packet);
+fail2:
+    Error("fail2\n");
 
-        Count++;
-        NetBufferList = Next;
-    }
+    NdisFreeNetBufferListPool(Slab->NetBufferListPool);
+    Slab->NetBufferListPool = NULL;
 
-    return Count;
+fail1:
+    Error("fail1 (%08x)\n", ndisStatus);
+
+    return ndisStatus;
 }
 
-VOID
-ReceiverReturnNetBufferLists(
-    IN  PRECEIVER           Receiver,
-    IN  PNET_BUFFER_LIST    HeadNetBufferList,
-    IN  ULONG               Flags
+static VOID
+ReceiverFreeMagazine(
+    IN  PRECEIVER_MAGAZINE  Magazine
     )
 {
-    ULONG                   Count;
+    while (Magazine->Count != 0) {
+        PNET_BUFFER_LIST    NetBufferList;
 
-    UNREFERENCED_PARAMETER(Flags);
+        NetBufferList = Magazine->NetBufferList[--Magazine->Count];
+        Magazine->NetBufferList[Magazine->Count] = NULL;
 
-    Count = __ReceiverReturnNetBufferLists(Receiver, HeadNetBufferList, TRUE);
-    (VOID) __InterlockedSubtract(&Receiver->InNDIS, Count);
+        NdisFreeNetBufferList(NetBufferList);
+    }
+
+    ExFreePool(Magazine);
 }
 
-static PNET_BUFFER_LIST
-ReceiverReceivePacket(
-    IN  PRECEIVER                               Receiver,
-    IN  PMDL                                    Mdl,
-    IN  ULONG                                   Offset,
-    IN  ULONG                                   Length,
-    IN  XENVIF_CHECKSUM_FLAGS                   Flags,
-    IN  USHORT                                  TagControlInformation
+VOID 
+ReceiverCleanup (
+    IN  PRECEIVER       Receiver
     )
 {
-    PADAPTER                                    Adapter;
-    PNET_BUFFER_LIST                            NetBufferList;
-    NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO   csumInfo;
+    ULONG               Index;
 
-    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+    ASSERT(Receiver != NULL);
 
-    NetBufferList = ReceiverAllocateNetBufferList(Receiver,
-                                                  Mdl,
-                                                  Offset,
-                                                  Length);
-    if (NetBufferList == NULL)
-        goto fail1;
+    // Nothing can have been cached if initialization never succeeded
+    if (Receiver->Processor == NULL)
+        return;
 
-    NetBufferList->SourceHandle = Adapter->NdisAdapterHandle;
+    if (Receiver->LowMemoryEvent != NULL) {
+        ZwClose(Receiver->LowMemoryHandle);
+        Receiver->LowMemoryHandle = NULL;
+        Receiver->LowMemoryEvent = NULL;
+    }
 
-    csumInfo.Value = 0;
+    for (Index = 0; Index < Receiver->ProcessorCount; Index++) {
+        PRECEIVER_PROCESSOR Processor;
 
-    csumInfo.Receive.IpChecksumSucceeded = Flags.IpChecksumSucceeded;
-    csumInfo.Receive.IpChecksumFailed = Flags.IpChecksumFailed;
+        Processor = &Receiver->Processor[Index];
 
-    csumInfo.Receive.TcpChecksumSucceeded = Flags.TcpChecksumSucceeded;
-    csumInfo.Receive.TcpChecksumFailed = Flags.TcpChecksumFailed;
+        ASSERT3U(Processor->Queue.Count, ==, 0);
 
-    csumInfo.Receive.UdpChecksumSucceeded = Flags.UdpChecksumSucceeded;
-    csumInfo.Receive.UdpChecksumFailed = Flags.UdpChecksumFailed;
+        if (Processor->Loaded != NULL) {
+            ReceiverFreeMagazine(Processor->Loaded);
+            Processor->Loaded = NULL;
+        }
 
-    NET_BUFFER_LIST_INFO(NetBufferList, TcpIpChecksumNetBufferListInfo) = (PVOID)(ULONG_PTR)csumInfo.Value;
+        if (Processor->Previous != NULL) {
+            ReceiverFreeMagazine(Processor->Previous);
+            Processor->Previous = NULL;
+        }
+    }
 
-    if (TagControlInformation != 0) {
-        NDIS_NET_BUFFER_LIST_8021Q_INFO Ieee8021QInfo;
+    while (!IsListEmpty(&Receiver->FullDepot)) {
+        PLIST_ENTRY         ListEntry;
+        PRECEIVER_MAGAZINE  Magazine;
 
-        UNPACK_TAG_CONTROL_INFORMATION(TagControlInformation,
-                                       Ieee8021QInfo.TagHeader.UserPriority,
-                                       Ieee8021QInfo.TagHeader.CanonicalFormatId,
-                                       Ieee8021QInfo.TagHeader.VlanId);
+        ListEntry = RemoveHeadList(&Receiver->FullDepot);
+        Magazine = CONTAINING_RECORD(ListEntry, RECEIVER_MAGAZINE, ListEntry);
 
-        if (Ieee8021QInfo.TagHeader.VlanId != 0)
-            goto fail2;
+        ReceiverFreeMagazine(Magazine);
+    }
+    Receiver->FullDepotCount = 0;
+    Receiver->FullDepotMinimum = 0;
 
-        NET_BUFFER_LIST_INFO(NetBufferList, Ieee8021QNetBufferListInfo) = Ieee8021QInfo.Value;
+    while (!IsListEmpty(&Receiver->EmptyDepot)) {
+        PLIST_ENTRY         ListEntry;
+        PRECEIVER_MAGAZINE  Magazine;
+
+        ListEntry = RemoveHeadList(&Receiver->EmptyDepot);
+        Magazine = CONTAINING_RECORD(ListEntry, RECEIVER_MAGAZINE, ListEntry);
+
+        ReceiverFreeMagazine(Magazine);
     }
 
-    return NetBufferList;
+    NdisFreeNetBufferListPool(Receiver->NetBufferListPool);
+    Receiver->NetBufferListPool = NULL;
 
-fail2:
-    ReceiverReleaseNetBufferList(Receiver, NetBufferList, TRUE);
+    if (Receiver->ToeplitzKey != NULL) {
+        ExFreePool(Receiver->ToeplitzKey);
+        Receiver->ToeplitzKey = NULL;
+    }
 
-fail1:
-    return NULL;
+    if (Receiver->MulticastFilter != NULL) {
+        ExFreePool(Receiver->MulticastFilter);
+        Receiver->MulticastFilter = NULL;
+    }
+
+    ReceiverSlabFree(&Receiver->Copy);
+    ReceiverSlabFree(&Receiver->Bounce);
+
+    ExFreePool(Receiver->Processor);
+    Receiver->Processor = NULL;
+    Receiver->ProcessorCount = 0;
+
+    return;
 }
 
-static VOID
-ReceiverPushPackets(
-    IN  PRECEIVER           Receiver,
-    IN  PNET_BUFFER_LIST    NetBufferList,
-    IN  ULONG               Count,
-    IN  BOOLEAN             LowResources
+// Must be called at DISPATCH_LEVEL.
+static PRECEIVER_MAGAZINE
+ReceiverDepotGet(
+    IN  PRECEIVER       Receiver,
+    IN  BOOLEAN         Full
     )
 {
-    PADAPTER                Adapter;
-    ULONG                   Flags;
-    LONG                    InNDIS;
+    PLIST_ENTRY         Depot;
+    PRECEIVER_MAGAZINE  Magazine;
 
-    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+    Depot = (Full) ? &Receiver->FullDepot : &Receiver->EmptyDepot;
+    Magazine = NULL;
 
-    InNDIS = Receiver->InNDIS;
+    KeAcquireSpinLockAtDpcLevel(&Receiver->DepotLock);
 
-    Flags = NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL;
-    if (LowResources) {
-        Flags |= NDIS_RECEIVE_FLAGS_RESOURCES;
-    } else {
-        InNDIS = __InterlockedAdd(&Receiver->InNDIS, Count);
-    }
+    if (!IsListEmpty(Depot)) {
+        PLIST_ENTRY ListEntry;
 
-    for (;;) {
-        LONG    InNDISMax;
+        ListEntry = RemoveHeadList(Depot);
+        Magazine = CONTAINING_RECORD(ListEntry, RECEIVER_MAGAZINE, ListEntry);
 
-        InNDISMax = Receiver->InNDISMax;
-        KeMemoryBarrier();
+        if (Full) {
+            ASSERT(Receiver->FullDepotCount != 0);
+            if (--Receiver->FullDepotCount < Receiver->FullDepotMinimum)
+                Receiver->FullDepotMinimum = Receiver->FullDepotCount;
+        }
+    }
 
-        if (InNDIS <= InNDISMax)
-            break;
+    KeReleaseSpinLockFromDpcLevel(&Receiver->DepotLock);
 
-        if (InterlockedCompareExchange(&Receiver->InNDISMax, InNDIS, InNDISMax) == InNDISMax)
-            break;
+    if (Magazine == NULL && !Full) {
+        Magazine = ExAllocatePoolWithTag(NonPagedPool, sizeof (RECEIVER_MAGAZINE), ' TEN');
+        if (Magazine != NULL)
+            RtlZeroMemory(Magazine, sizeof (RECEIVER_MAGAZINE));
     }
 
-    NdisMIndicateReceiveNetBufferLists(Adapter->NdisAdapterHandle,
-                                       NetBufferList,
-                                       NDIS_DEFAULT_PORT_NUMBER,
-                                       Count,
-                                       Flags);
-
-    if (LowResources)
-        (VOID) __ReceiverReturnNetBufferLists(Receiver, NetBufferList, FALSE);
+    ASSERT(IMPLY(Magazine != NULL, (Full) ?
+                                   Magazine->Count == RECEIVER_MAGAZINE_SIZE :
+                                   Magazine->Count == 0));
+    return Magazine;
 }
 
-#define IN_NDIS_MAX 1024
-
-VOID
-ReceiverReceivePackets(
-    IN  PRECEIVER       Receiver,
-    IN  PLIST_ENTRY     List
+// Must be called at DISPATCH_LEVEL.
+static VOID
+ReceiverDepotPut(
+    IN  PRECEIVER           Receiver,
+    IN  PRECEIVER_MAGAZINE  Magazine
     )
 {
-    PADAPTER            Adapter;
-    PNET_BUFFER_LIST    HeadNetBufferList;
-    PNET_BUFFER_LIST    *TailNetBufferList;
-    ULONG               Count;
-    BOOLEAN             LowResources;
+    PLIST_ENTRY             Depot;
 
-    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
-    LowResources = FALSE;
+    ASSERT(Magazine->Count == 0 || Magazine->Count == RECEIVER_MAGAZINE_SIZE);
+    Depot = (Magazine->Count != 0) ? &Receiver->FullDepot : &Receiver->EmptyDepot;
 
-again:
-    HeadNetBufferList = NULL;
-    TailNetBufferList = &HeadNetBufferList;
-    Count = 0;
+    KeAcquireSpinLockAtDpcLevel(&Receiver->DepotLock);
+    InsertTailList(Depot, &Magazine->ListEntry);
+    if (Magazine->Count != 0)
+        Receiver->FullDepotCount++;
+    KeReleaseSpinLockFromDpcLevel(&Receiver->DepotLock);
+}
 
+// Free the magazines on a list taken off the depot, returning the number
+// of NET_BUFFER_LISTs they held.
+static ULONG
+ReceiverFreeMagazines(
+    IN  PLIST_ENTRY List
+    )
+{
+    ULONG           Count;
+
+    Count = 0;
     while (!IsListEmpty(List)) {
-        PLIST_ENTRY                     ListEntry;
-        PXENVIF_RECEIVER_PACKET         Packet;
-        PMDL                            Mdl;
-        ULONG                           Offset;
-        ULONG                           Length;
-        XENVIF_CHECKSUM_FLAGS           Flags;
-        USHORT                          TagControlInformation;
-        PNET_BUFFER_LIST                NetBufferList;
+        PLIST_ENTRY         ListEntry;
+        PRECEIVER_MAGAZINE  Magazine;
 
-        if (!LowResources &&
-            Receiver->InNDIS + Count > IN_NDIS_MAX)
+        ListEntry = RemoveHeadList(List);
+        Magazine = CONTAINING_RECORD(ListEntry, RECEIVER_MAGAZINE, ListEntry);
+
+        Count += Magazine->Count;
+        ReceiverFreeMagazine(Magazine);
+    }
+
+    return Count;
+}
+
+// Free every magazine in the depot. Those loaded on a CPU are left alone
+// as they can only be touched from that CPU.
+static VOID
+ReceiverTrimDepot(
+    IN  PRECEIVER   Receiver
+    )
+{
+    LIST_ENTRY      List;
+    KIRQL           Irql;
+    ULONG           Count;
+
+    InitializeListHead(&List);
+
+    KeAcquireSpinLock(&Receiver->DepotLock, &Irql);
+
+    while (!IsListEmpty(&Receiver->FullDepot))
+        InsertTailList(&List, RemoveHeadList(&Receiver->FullDepot));
+
+    while (!IsListEmpty(&Receiver->EmptyDepot))
+        InsertTailList(&List, RemoveHeadList(&Receiver->EmptyDepot));
+
+    Receiver->FullDepotCount = 0;
+    Receiver->FullDepotMinimum = 0;
+
+    KeReleaseSpinLock(&Receiver->DepotLock, Irql);
+
+    Count = ReceiverFreeMagazines(&List);
+    if (Count != 0)
+        Trace("freed %u NET_BUFFER_LISTs\n", Count);
+}
+
+// Fill the depot with full magazines to cover the given number of
+// NET_BUFFER_LISTs so that the first packets after (re)starting do not
+// each have to allocate one. Every CPU takes a magazine from the depot on
+// its first cache miss so they end up spread across CPUs.
+static VOID
+ReceiverPrewarm(
+    IN  PRECEIVER   Receiver,
+    IN  ULONG       Target
+    )
+{
+    ULONG           Count;
+    KIRQL           Irql;
+
+    KeAcquireSpinLock(&Receiver->DepotLock, &Irql);
+    Count = Receiver->FullDepotCount * RECEIVER_MAGAZINE_SIZE;
+    KeReleaseSpinLock(&Receiver->DepotLock, Irql);
+
+    while (Count < Target) {
+        PRECEIVER_MAGAZINE  Magazine;
+
+        Magazine = ExAllocatePoolWithTag(NonPagedPool, sizeof (RECEIVER_MAGAZINE), ' TEN');
+        if (Magazine == NULL)
             break;
 
-        ListEntry = RemoveHeadList(List);
-        ASSERT(ListEntry != List);
+        RtlZeroMemory(Magazine, sizeof (RECEIVER_MAGAZINE));
 
-        RtlZeroMemory(ListEntry, sizeof (LIST_ENTRY));
+        while (Magazine->Count != RECEIVER_MAGAZINE_SIZE) {
+            PNET_BUFFER_LIST    NetBufferList;
 
-        Packet = CONTAINING_RECORD(ListEntry, XENVIF_RECEIVER_PACKET, ListEntry);
-        Mdl = &Packet->Mdl;
-        Offset = Packet->Offset;
-        Length = Packet->Length;
-        Flags = Packet->Flags;
-        TagControlInformation = Packet->TagControlInformation;
+            NetBufferList = NdisAllocateNetBufferAndNetBufferList(Receiver->NetBufferListPool,
+                                                                  0,
+                                                                  0,
+                                                                  NULL,
+                                                                  0,
+                                                                  0);
+            if (NetBufferList == NULL)
+                break;
 
-        NetBufferList = ReceiverReceivePacket(Receiver, Mdl, Offset, Length, Flags, TagControlInformation);
+            Magazine->NetBufferList[Magazine->Count++] = NetBufferList;
+        }
 
-        if (NetBufferList != NULL) {
-            *TailNetBufferList = NetBufferList;
-            TailNetBufferList = &NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
-            Count++;
-        } else {
-            VIF(ReturnPacket,
-                Adapter->VifInterface,
-                Packet);
+        // Only full magazines may go in the full depot
+        if (Magazine->Count != RECEIVER_MAGAZINE_SIZE) {
+            ReceiverFreeMagazine(Magazine);
+            break;
         }
+
+        KeAcquireSpinLock(&Receiver->DepotLock, &Irql);
+        InsertTailList(&Receiver->FullDepot, &Magazine->ListEntry);
+        Receiver->FullDepotCount++;
+        KeReleaseSpinLock(&Receiver->DepotLock, Irql);
+
+        Count += RECEIVER_MAGAZINE_SIZE;
     }
 
-    if (Count != 0) {
-        ASSERT(HeadNetBufferList != NULL);
+    Trace("%u NET_BUFFER_LISTs (target %u)\n", Count, Target);
+}
+
+// Reads a counter that another CPU may be updating. An aligned 64-bit
+// load is atomic on x64, but on x86 it is two loads and could see half
+// of an update.
+static FORCEINLINE ULONG64
+__ReceiverReadCounter(
+    IN  volatile ULONG64    *Counter
+    )
+{
+#if defined(_M_AMD64)
+    return *Counter;
+#else
+    return (ULONG64)InterlockedCompareExchange64((volatile LONG64 *)Counter,
+                                                 0,
+                                                 0);
+#endif
+}
+
+// Must be called at DISPATCH_LEVEL.
+static FORCEINLINE PRECEIVER_PROCESSOR
+__ReceiverGetProcessor(
+    IN  PRECEIVER   Receiver
+    )
+{
+    ULONG           Index;
+
+    Index = __GetCurrentProcessorIndex();
+
+    // A processor added after initialization has no cache
+    if (Index >= Receiver->ProcessorCount)
+        return NULL;
+
+    return &Receiver->Processor[Index];
+}
+
+// Must be called at DISPATCH_LEVEL.
+static PNET_BUFFER_LIST
+ReceiverCacheGet(
+    IN  PRECEIVER       Receiver
+    )
+{
+    PRECEIVER_PROCESSOR Processor;
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor == NULL)
+        return NULL;
 
-        ReceiverPushPackets(Receiver, HeadNetBufferList, Count, LowResources);
+    for (;;) {
+        PRECEIVER_MAGAZINE  Magazine;
+
+        Magazine = Processor->Loaded;
+        if (Magazine != NULL && Magazine->Count != 0) {
+            PNET_BUFFER_LIST    NetBufferList;
+
+            NetBufferList = Magazine->NetBufferList[--Magazine->Count];
+            Magazine->NetBufferList[Magazine->Count] = NULL;
+
+            Processor->CacheHit++;
+            return NetBufferList;
+        }
+
+        if (Processor->Previous != NULL && Processor->Previous->Count != 0) {
+            Processor->Loaded = Processor->Previous;
+            Processor->Previous = Magazine;
+            continue;
+        }
+
+        // Both magazines are empty (or absent) so swap in a full one
+        Magazine = ReceiverDepotGet(Receiver, TRUE);
+        if (Magazine == NULL) {
+            Processor->CacheMiss++;
+            return NULL;
+        }
+
+        if (Processor->Previous != NULL)
+            ReceiverDepotPut(Receiver, Processor->Previous);
+
+        Processor->Previous = Processor->Loaded;
+        Processor->Loaded = Magazine;
     }
+}
 
-    if (!IsListEmpty(List)) {
-        ASSERT(!LowResources);
-        LowResources = TRUE;
-        goto again;
+// Must be called at DISPATCH_LEVEL.
+static BOOLEAN
+ReceiverCachePut(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    PRECEIVER_PROCESSOR     Processor;
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor == NULL)
+        return FALSE;
+
+    for (;;) {
+        PRECEIVER_MAGAZINE  Magazine;
+
+        Magazine = Processor->Loaded;
+        if (Magazine != NULL && Magazine->Count != RECEIVER_MAGAZINE_SIZE) {
+            Magazine->NetBufferList[Magazine->Count++] = NetBufferList;
+            return TRUE;
+        }
+
+        if (Processor->Previous != NULL && Processor->Previous->Count != RECEIVER_MAGAZINE_SIZE) {
+            Processor->Loaded = Processor->Previous;
+            Processor->Previous = Magazine;
+            continue;
+        }
+
+        // Both magazines are full (or absent) so swap in an empty one
+        Magazine = ReceiverDepotGet(Receiver, FALSE);
+        if (Magazine == NULL) {
+            Processor->Released++;
+            return FALSE;
+        }
+
+        if (Processor->Previous != NULL)
+            ReceiverDepotPut(Receiver, Processor->Previous);
+
+        Processor->Previous = Processor->Loaded;
+        Processor->Loaded = Magazine;
+    }
+}
+
+// Returns the slab a NET_BUFFER_LIST belongs to, or NULL if it is not
+// from one.
+static FORCEINLINE PRECEIVER_SLAB
+__ReceiverGetSlab(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    if (Receiver->Copy.NetBufferListPool != NULL &&
+        NetBufferList->NdisPoolHandle == Receiver->Copy.NetBufferListPool)
+        return &Receiver->Copy;
+
+    if (Receiver->Bounce.NetBufferListPool != NULL &&
+        NetBufferList->NdisPoolHandle == Receiver->Bounce.NetBufferListPool)
+        return &Receiver->Bounce;
+
+    return NULL;
+}
+
+// Returns NULL if the slab is absent or exhausted or Length does not fit.
+static FORCEINLINE PRECEIVER_SLAB_BUFFER
+__ReceiverSlabGet(
+    IN  PRECEIVER_SLAB  Slab,
+    IN  ULONG           Length
+    )
+{
+    PSLIST_ENTRY        ListEntry;
+
+    if (Length > Slab->Size)
+        return NULL;
+
+    ListEntry = InterlockedPopEntrySList(&Slab->FreeList);
+    if (ListEntry == NULL)
+        return NULL;
+
+    return CONTAINING_RECORD(ListEntry, RECEIVER_SLAB_BUFFER, ListEntry);
+}
+
+static FORCEINLINE VOID
+__ReceiverSlabPut(
+    IN  PRECEIVER_SLAB          Slab,
+    IN  PRECEIVER_SLAB_BUFFER   Buffer
+    )
+{
+    InterlockedPushEntrySList(&Slab->FreeList, &Buffer->ListEntry);
+}
+
+// Copies a frame into Buffer, which is given back to the slab on failure.
+// Must be called at DISPATCH_LEVEL.
+static PNET_BUFFER_LIST
+ReceiverSlabCopy(
+    IN  PRECEIVER_SLAB          Slab,
+    IN  PRECEIVER_SLAB_BUFFER   Buffer,
+    IN  PMDL                    Mdl,
+    IN  ULONG                   Offset,
+    IN  ULONG                   Length
+    )
+{
+    PUCHAR                      Data;
+    ULONG                       Remaining;
+    PNET_BUFFER_LIST            NetBufferList;
+    PNET_BUFFER                 NetBuffer;
+
+    ASSERT3U(Length, <=, Slab->Size);
+
+    Data = MmGetMdlVirtualAddress(Buffer->Mdl);
+    Remaining = Length;
+
+    while (Remaining != 0) {
+        PUCHAR  StartVa;
+        ULONG   Count;
+
+        if (Mdl == NULL)
+            goto fail;
+
+        if (Offset >= Mdl->ByteCount) {
+            Offset -= Mdl->ByteCount;
+            Mdl = Mdl->Next;
+            continue;
+        }
+
+        StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        if (StartVa == NULL)
+            goto fail;
+
+        Count = Mdl->ByteCount - Offset;
+        if (Count > Remaining)
+            Count = Remaining;
+
+        RtlCopyMemory(Data, StartVa + Offset, Count);
+        Data += Count;
+        Remaining -= Count;
+
+        Offset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    NetBufferList = Buffer->NetBufferList;
+
+    RtlZeroMemory(NetBufferList->NetBufferListInfo,
+                  sizeof (NetBufferList->NetBufferListInfo));
+
+    NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+    ASSERT3P(NET_BUFFER_FIRST_MDL(NetBuffer), ==, Buffer->Mdl);
+    NET_BUFFER_CURRENT_MDL(NetBuffer) = Buffer->Mdl;
+    NET_BUFFER_DATA_OFFSET(NetBuffer) = 0;
+    NET_BUFFER_DATA_LENGTH(NetBuffer) = Length;
+    NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) = 0;
+
+    return NetBufferList;
+
+fail:
+    __ReceiverSlabPut(Slab, Buffer);
+
+    return NULL;
+}
+
+// Copies a frame shorter than CopyBreak bytes, returning NULL if it is
+// too big or the slab is exhausted.
+// Must be called at DISPATCH_LEVEL.
+static PNET_BUFFER_LIST
+ReceiverCopyPacket(
+    IN  PRECEIVER           Receiver,
+    IN  PMDL                Mdl,
+    IN  ULONG               Offset,
+    IN  ULONG               Length
+    )
+{
+    PRECEIVER_SLAB_BUFFER   Buffer;
+    PNET_BUFFER_LIST        NetBufferList;
+    PRECEIVER_PROCESSOR     Processor;
+
+    if (Length >= Receiver->CopyBreak)
+        return NULL;
+
+    Buffer = __ReceiverSlabGet(&Receiver->Copy, Length);
+    if (Buffer == NULL)
+        return NULL;
+
+    NetBufferList = ReceiverSlabCopy(&Receiver->Copy, Buffer, Mdl, Offset, Length);
+    if (NetBufferList == NULL)
+        return NULL;
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor != NULL)
+        Processor->Copied++;
+
+    return NetBufferList;
+}
+
+PNET_BUFFER_LIST
+ReceiverAllocateNetBufferList(
+    IN  PRECEIVER       Receiver,
+    IN  PMDL            Mdl,
+    IN  ULONG           Offset,
+    IN  ULONG           Length
+    )
+{
+    PNET_BUFFER_LIST    NetBufferList;
+
+    ASSERT3U(KeGetCurrentIrql(), ==, DISPATCH_LEVEL);
+
+    NetBufferList = ReceiverCacheGet(Receiver);
+
+    if (NetBufferList != NULL) {
+        PNET_BUFFER NetBuffer;
+
+        ASSERT3P(NET_BUFFER_LIST_NEXT_NBL(NetBufferList), ==, NULL);
+
+        // Nothing (e.g. hash or coalescing info) may leak from a previous
+        // indication
+        RtlZeroMemory(NetBufferList->NetBufferListInfo,
+                      sizeof (NetBufferList->NetBufferListInfo));
+
+        NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+        NET_BUFFER_FIRST_MDL(NetBuffer) = Mdl;
+        NET_BUFFER_CURRENT_MDL(NetBuffer) = Mdl;
+        NET_BUFFER_DATA_OFFSET(NetBuffer) = Offset;
+        NET_BUFFER_DATA_LENGTH(NetBuffer) = Length;
+        NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) = Offset;
+    } else {
+        NetBufferList = NdisAllocateNetBufferAndNetBufferList(Receiver->NetBufferListPool,
+                                                              0,
+                                                              0,
+                                                              Mdl,
+                                                              Offset,
+                                                              Length);
+        ASSERT(IMPLY(NetBufferList != NULL, NET_BUFFER_LIST_NEXT_NBL(NetBufferList) == NULL));
+    }
+
+    return NetBufferList;
+}        
+
+// Must be called at DISPATCH_LEVEL.
+VOID
+ReceiverReleaseNetBufferList(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  BOOLEAN             Cache
+    )
+{
+    PRECEIVER_SLAB          Slab;
+
+    ASSERT3P(NET_BUFFER_LIST_NEXT_NBL(NetBufferList), ==, NULL);
+
+    Slab = __ReceiverGetSlab(Receiver, NetBufferList);
+    if (Slab != NULL) {
+        PNET_BUFFER             NetBuffer;
+        PRECEIVER_SLAB_BUFFER   Buffer;
+
+        NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+        Buffer = NET_BUFFER_MINIPORT_RESERVED(NetBuffer)[0];
+        ASSERT3P(Buffer->NetBufferList, ==, NetBufferList);
+
+        __ReceiverSlabPut(Slab, Buffer);
+        return;
+    }
+
+    if (Cache && ReceiverCachePut(Receiver, NetBufferList))
+        return;
+
+    NdisFreeNetBufferList(NetBufferList);
+}
+
+static VOID
+ReceiverReturnPackets(
+    IN  PRECEIVER   Receiver,
+    IN  PLIST_ENTRY List
+    )
+{
+    PADAPTER        Adapter;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    if (IsListEmpty(List))
+        return;
+
+    if (Adapter->VifInterfaceVersion >= VIF_INTERFACE_VERSION_RETURN_PACKETS) {
+        VIF(ReturnPackets,
+            Adapter->VifInterface,
+            List);
+        return;
+    }
+
+    while (!IsListEmpty(List)) {
+        PLIST_ENTRY             ListEntry;
+        PXENVIF_RECEIVER_PACKET Packet;
+
+        ListEntry = RemoveHeadList(List);
+        ASSERT(ListEntry != List);
+
+        RtlZeroMemory(ListEntry, sizeof (LIST_ENTRY));
+
+        Packet = CONTAINING_RECORD(ListEntry, XENVIF_RECEIVER_PACKET, ListEntry);
+
+        VIF(ReturnPacket,
+            Adapter->VifInterface,
+            Packet);
     }
 }
+
+static FORCEINLINE VOID
+__ReceiverSetTimestamp(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  LARGE_INTEGER       Now
+    )
+{
+    NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList)[0] = (PVOID)(ULONG_PTR)Now.QuadPart;
+}
+
+// Only the low 32 bits of the timestamp are kept on 32-bit systems so
+// compute the difference modulo 2^32.
+static FORCEINLINE ULONG
+__ReceiverGetLatency(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  LARGE_INTEGER       Now
+    )
+{
+    ULONG                   Then;
+
+    Then = (ULONG)(ULONG_PTR)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList)[0];
+
+    return (ULONG)Now.QuadPart - Then;
+}
+
+// Undo a coalesced receive (see ReceiverGroMerge()), freeing the MDLs
+// that describe the payload of the merged segments and queuing all the
+// constituent packets on List.
+static VOID
+ReceiverGroSplit(
+    IN  PXENVIF_RECEIVER_PACKET Packet,
+    IN  PLIST_ENTRY             List
+    )
+{
+    PMDL                        Mdl;
+    PLIST_ENTRY                 ListEntry;
+
+    Mdl = Packet->Mdl.Next;
+    Packet->Mdl.Next = NULL;
+
+    while (Mdl != NULL) {
+        PMDL    Next = Mdl->Next;
+
+        NdisFreeMdl(Mdl);
+        Mdl = Next;
+    }
+
+    ListEntry = Packet->ListEntry.Flink;
+    InsertTailList(List, &Packet->ListEntry);
+
+    while (ListEntry != NULL) {
+        PLIST_ENTRY Next = ListEntry->Flink;
+
+        InsertTailList(List, ListEntry);
+        ListEntry = Next;
+    }
+}
+
+static FORCEINLINE ULONG
+__ReceiverReturnNetBufferLists(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  BOOLEAN             Cache,
+    IN  PLARGE_INTEGER      Now OPTIONAL,
+    OUT PULONG64            Latency OPTIONAL
+    )
+{
+    LIST_ENTRY              List;
+    ULONG                   Count;
+
+    ASSERT(IMPLY(Now != NULL, Latency != NULL));
+
+    InitializeListHead(&List);
+
+    Count = 0;
+    while (NetBufferList != NULL) {
+        PNET_BUFFER_LIST        Next;
+        PNET_BUFFER             NetBuffer;
+        PMDL                    Mdl;
+        BOOLEAN                 Copied;
+        PXENVIF_RECEIVER_PACKET Packet;
+
+        Next = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+
+        NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+        ASSERT3P(NET_BUFFER_NEXT_NB(NetBuffer), ==, NULL);
+
+        Mdl = NET_BUFFER_FIRST_MDL(NetBuffer);
+        Copied = (__ReceiverGetSlab(Receiver, NetBufferList) != NULL) ? TRUE : FALSE;
+
+        if (Now != NULL)
+            *Latency += __ReceiverGetLatency(NetBufferList, *Now);
+
+        ReceiverReleaseNetBufferList(Receiver, NetBufferList, Cache);
+
+        // The packet of a copied frame went back when it was received
+        if (!Copied) {
+            Packet = CONTAINING_RECORD(Mdl, XENVIF_RECEIVER_PACKET, Mdl);
+
+            if (Mdl->Next != NULL)
+                ReceiverGroSplit(Packet, &List);
+            else
+                InsertTailList(&List, &Packet->ListEntry);
+        }
+
+        Count++;
+        NetBufferList = Next;
+    }
+
+    ReceiverReturnPackets(Receiver, &List);
+
+    return Count;
+}
+
+VOID
+ReceiverReturnNetBufferLists(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    HeadNetBufferList,
+    IN  ULONG               Flags
+    )
+{
+    LARGE_INTEGER           Now;
+    ULONG64                 Latency;
+    ULONG                   Count;
+    PRECEIVER_PROCESSOR     Processor;
+    KIRQL                   Irql;
+
+    if (!NDIS_TEST_RETURN_AT_DISPATCH_LEVEL(Flags)) {
+        ASSERT3U(NDIS_CURRENT_IRQL(), <=, DISPATCH_LEVEL);
+        NDIS_RAISE_IRQL_TO_DISPATCH(&Irql);
+    } else {
+        Irql = DISPATCH_LEVEL;
+    }
+
+    Now = KeQueryPerformanceCounter(NULL);
+    Latency = 0;
+
+    Count = __ReceiverReturnNetBufferLists(Receiver, HeadNetBufferList, TRUE, &Now, &Latency);
+    (VOID) __InterlockedSubtract(&Receiver->InNDIS, Count);
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor != NULL) {
+        Processor->Returned += Count;
+        Processor->ReturnLatency += Latency;
+    }
+
+    NDIS_LOWER_IRQL(Irql, DISPATCH_LEVEL);
+}
+
+// Returns the number of MSS-sized segments the backend coalesced into
+// Packet, or 0 if it is not a large receive.
+static FORCEINLINE ULONG
+__ReceiverGetSegmentCount(
+    IN  PXENVIF_RECEIVER_PACKET Packet
+    )
+{
+    PXENVIF_PACKET_INFO         Info;
+    ULONG                       HeaderLength;
+    ULONG                       PayloadLength;
+
+    Info = &Packet->Info;
+
+    if (Packet->MaximumSegmentSize == 0 || Info->TcpHeader.Length == 0)
+        return 0;
+
+    HeaderLength = Info->TcpHeader.Offset +
+                   Info->TcpHeader.Length +
+                   Info->TcpOptions.Length;
+    if (HeaderLength >= Packet->Length)
+        return 0;
+
+    PayloadLength = Packet->Length - HeaderLength;
+
+    return (PayloadLength + Packet->MaximumSegmentSize - 1) / Packet->MaximumSegmentSize;
+}
+
+// Tells the stack how many segments an indication stands for so that ACK
+// generation and congestion control account for all of them. Only pure
+// data segments are ever coalesced so there are no duplicate ACKs.
+// Must be called at DISPATCH_LEVEL.
+static VOID
+ReceiverSetCoalesceInfo(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count
+    )
+{
+    PRECEIVER_PROCESSOR     Processor;
+
+    if (Count <= 1)
+        return;
+
+#if (NDIS_SUPPORT_NDIS630)
+    NET_BUFFER_LIST_COALESCED_SEG_COUNT(NetBufferList) = (USHORT)Count;
+    NET_BUFFER_LIST_DUP_ACK_COUNT(NetBufferList) = 0;
+#else
+    UNREFERENCED_PARAMETER(NetBufferList);
+#endif
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor != NULL) {
+        Processor->Coalesced++;
+        Processor->CoalescedSegments += Count;
+    }
+}
+
+static PNET_BUFFER_LIST
+ReceiverReceivePacket(
+    IN  PRECEIVER                               Receiver,
+    IN  PRECEIVER_SLAB_BUFFER                   Bounce OPTIONAL,
+    IN  PMDL                                    Mdl,
+    IN  ULONG                                   Offset,
+    IN  ULONG                                   Length,
+    IN  XENVIF_CHECKSUM_FLAGS                   Flags,
+    IN  USHORT                                  TagControlInformation
+    )
+{
+    PADAPTER                                    Adapter;
+    PNET_BUFFER_LIST                            NetBufferList;
+    NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO   csumInfo;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    if (Bounce != NULL) {
+        NetBufferList = ReceiverSlabCopy(&Receiver->Bounce, Bounce, Mdl, Offset, Length);
+    } else {
+        NetBufferList = ReceiverCopyPacket(Receiver, Mdl, Offset, Length);
+        if (NetBufferList == NULL)
+            NetBufferList = ReceiverAllocateNetBufferList(Receiver,
+                                                          Mdl,
+                                                          Offset,
+                                                          Length);
+    }
+    if (NetBufferList == NULL)
+        goto fail1;
+
+    NetBufferList->SourceHandle = Adapter->NdisAdapterHandle;
+
+    csumInfo.Value = 0;
+
+    csumInfo.Receive.IpChecksumSucceeded = Flags.IpChecksumSucceeded;
+    csumInfo.Receive.IpChecksumFailed = Flags.IpChecksumFailed;
+
+    csumInfo.Receive.TcpChecksumSucceeded = Flags.TcpChecksumSucceeded;
+    csumInfo.Receive.TcpChecksumFailed = Flags.TcpChecksumFailed;
+
+    csumInfo.Receive.UdpChecksumSucceeded = Flags.UdpChecksumSucceeded;
+    csumInfo.Receive.UdpChecksumFailed = Flags.UdpChecksumFailed;
+
+    NET_BUFFER_LIST_INFO(NetBufferList, TcpIpChecksumNetBufferListInfo) = (PVOID)(ULONG_PTR)csumInfo.Value;
+
+    // The VLAN ID has already been checked by __ReceiverVlanAccept()
+    if (TagControlInformation != 0) {
+        NDIS_NET_BUFFER_LIST_8021Q_INFO Ieee8021QInfo;
+
+        Ieee8021QInfo.Value = NULL;
+
+        UNPACK_TAG_CONTROL_INFORMATION(TagControlInformation,
+                                       Ieee8021QInfo.TagHeader.UserPriority,
+                                       Ieee8021QInfo.TagHeader.CanonicalFormatId,
+                                       Ieee8021QInfo.TagHeader.VlanId);
+
+        NET_BUFFER_LIST_INFO(NetBufferList, Ieee8021QNetBufferListInfo) = Ieee8021QInfo.Value;
+    }
+
+    return NetBufferList;
+
+fail1:
+    return NULL;
+}
+
+typedef enum _RECEIVER_VLAN_VERDICT {
+    RECEIVER_VLAN_UNTAGGED,
+    RECEIVER_VLAN_ACCEPTED,
+    RECEIVER_VLAN_FILTERED,
+    RECEIVER_VLAN_INVALID
+} RECEIVER_VLAN_VERDICT;
+
+// Checked against the packet's tag before anything is allocated for it
+// so that frames for other VLANs cost no more than a bit test.
+static FORCEINLINE RECEIVER_VLAN_VERDICT
+__ReceiverVlanAccept(
+    IN  PRECEIVER   Receiver,
+    IN  USHORT      TagControlInformation
+    )
+{
+    ULONG           VlanId;
+
+    VlanId = TagControlInformation & 0xFFF;
+
+    if (VlanId == 0)
+        return RECEIVER_VLAN_UNTAGGED;
+
+    if (VlanId == RECEIVER_VLAN_ID_COUNT - 1)
+        return RECEIVER_VLAN_INVALID;
+
+    if ((Receiver->VlanFilter.Bitmap[VlanId / 32] & (1ul << (VlanId % 32))) == 0)
+        return RECEIVER_VLAN_FILTERED;
+
+    return RECEIVER_VLAN_ACCEPTED;
+}
+
+static FORCEINLINE ULONG64
+__ReceiverMulticastKey(
+    IN  PETHERNET_ADDRESS   Address
+    )
+{
+    return ((ULONG64)Address->Byte[0] << 40) |
+           ((ULONG64)Address->Byte[1] << 32) |
+           ((ULONG64)Address->Byte[2] << 24) |
+           ((ULONG64)Address->Byte[3] << 16) |
+           ((ULONG64)Address->Byte[4] << 8) |
+           ((ULONG64)Address->Byte[5]);
+}
+
+static FORCEINLINE ULONG
+__ReceiverMulticastHash(
+    IN  PRECEIVER_MULTICAST_FILTER  Filter,
+    IN  ULONG64                     Key
+    )
+{
+    return (ULONG)((Key * 0x9E3779B97F4A7C15ull) >> Filter->Shift);
+}
+
+static BOOLEAN
+ReceiverMulticastLookup(
+    IN  PRECEIVER_MULTICAST_FILTER  Filter,
+    IN  ULONG64                     Key
+    )
+{
+    ULONG                           Index;
+
+    for (Index = __ReceiverMulticastHash(Filter, Key);
+         Filter->Table[Index] != 0;
+         Index = (Index + 1) & (Filter->Size - 1))
+        if (Filter->Table[Index] == Key)
+            return TRUE;
+
+    return FALSE;
+}
+
+static PETHERNET_UNTAGGED_HEADER
+ReceiverGetEthernetHeader(
+    IN  PXENVIF_RECEIVER_PACKET     Packet
+    )
+{
+    PXENVIF_PACKET_INFO             Info;
+    PMDL                            Mdl;
+    PUCHAR                          StartVa;
+
+    Info = &Packet->Info;
+    Mdl = &Packet->Mdl;
+
+    if (Packet->Offset + Info->EthernetHeader.Offset + sizeof (ETHERNET_UNTAGGED_HEADER) > Mdl->ByteCount)
+        return NULL;
+
+    StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+    if (StartVa == NULL)
+        return NULL;
+
+    return (PETHERNET_UNTAGGED_HEADER)(StartVa + Packet->Offset + Info->EthernetHeader.Offset);
+}
+
+// Record the EtherType, in network byte order, for the
+// NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE hint. It is left as 0 for LLC
+// frames and for those whose tag the backend did not strip.
+static FORCEINLINE VOID
+__ReceiverSetFrameType(
+    IN  PNET_BUFFER_LIST            NetBufferList,
+    IN  PXENVIF_RECEIVER_PACKET     Packet,
+    IN  PETHERNET_UNTAGGED_HEADER   EthernetHeader OPTIONAL
+    )
+{
+    USHORT                          FrameType;
+
+    if (EthernetHeader == NULL || Packet->Info.LLCSnapHeader.Length != 0)
+        return;
+
+    FrameType = NTOHS(EthernetHeader->TypeOrLength);
+    if (FrameType < RECEIVER_MINIMUM_ETHERTYPE || FrameType == ETHERTYPE_TPID)
+        return;
+
+    NET_BUFFER_LIST_INFO(NetBufferList, NetBufferListFrameType) =
+        (PVOID)(ULONG_PTR)EthernetHeader->TypeOrLength;
+}
+
+// Frames that passed a filter which is not exact carry this in the
+// miniport's bits of their NET_BUFFER_LIST flags so that indications
+// holding them go up without NDIS_RECEIVE_FLAGS_PERFECT_FILTERED.
+#define RECEIVER_NBL_FLAG_IMPERFECT 0x00001000
+
+C_ASSERT((RECEIVER_NBL_FLAG_IMPERFECT & ~NBL_FLAGS_MINIPORT_RESERVED) == 0);
+
+static FORCEINLINE VOID
+__ReceiverSetPerfectFiltered(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  BOOLEAN             Perfect
+    )
+{
+    if (Perfect)
+        NET_BUFFER_LIST_FLAGS(NetBufferList) &= ~RECEIVER_NBL_FLAG_IMPERFECT;
+    else
+        NET_BUFFER_LIST_FLAGS(NetBufferList) |= RECEIVER_NBL_FLAG_IMPERFECT;
+}
+
+static FORCEINLINE BOOLEAN
+__ReceiverIsPerfectFiltered(
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    return (NET_BUFFER_LIST_FLAGS(NetBufferList) & RECEIVER_NBL_FLAG_IMPERFECT) ? FALSE : TRUE;
+}
+
+// Checked before anything is allocated for the packet so that frames for
+// groups nobody joined cost no more than a table probe.
+static FORCEINLINE BOOLEAN
+__ReceiverMulticastAccept(
+    IN  PRECEIVER_MULTICAST_FILTER  Filter OPTIONAL,
+    IN  PETHERNET_ADDRESS           DestinationAddress
+    )
+{
+    if (Filter == NULL)
+        return FALSE;
+
+    return ReceiverMulticastLookup(Filter, __ReceiverMulticastKey(DestinationAddress));
+}
+
+// Add the credit accrued since the bucket was last refilled
+static FORCEINLINE VOID
+__ReceiverStormRefill(
+    IN  PRECEIVER_STORM_BUCKET  Bucket,
+    IN  LARGE_INTEGER           Now
+    )
+{
+    ULONG64                     Elapsed;
+
+    // Another CPU may have refilled it with a later timestamp
+    if (Now.QuadPart <= Bucket->Last.QuadPart)
+        return;
+
+    Elapsed = Now.QuadPart - Bucket->Last.QuadPart;
+    Bucket->Last = Now;
+
+    // Also guards the multiplication below against overflow
+    if (Elapsed >= (Bucket->Capacity - Bucket->Credit) / Bucket->Rate)
+        Bucket->Credit = Bucket->Capacity;
+    else
+        Bucket->Credit += Elapsed * Bucket->Rate;
+}
+
+// Software receive coalescing. Consecutive in-order segments of the same
+// TCP flow are merged into the NET_BUFFER_LIST of the first segment: the
+// payload of each further segment is described by an MDL chained onto the
+// first segment's MDL and its packet is threaded onto the first packet's
+// ListEntry.Flink so that ReceiverGroSplit() can return it.
+typedef struct _RECEIVER_GRO {
+    PNET_BUFFER_LIST        NetBufferList;  // NULL if no flow is open
+    PXENVIF_RECEIVER_PACKET Packet;
+    PIP_HEADER              IpHeader;
+    PTCP_HEADER             TcpHeader;
+    PMDL                    *TailMdl;
+    PLIST_ENTRY             TailEntry;
+    ULONG                   SegmentSize;
+    ULONG                   Length;         // Of the IP packet
+    ULONG                   Seq;
+    ULONG                   Count;
+} RECEIVER_GRO, *PRECEIVER_GRO;
+
+#define RECEIVER_GRO_MAXIMUM_LENGTH 0xFFFF
+
+// Locates the headers and payload of a TCP segment that is a candidate for
+// coalescing.
+static BOOLEAN
+ReceiverGroParse(
+    IN  PRECEIVER               Receiver,
+    IN  PXENVIF_RECEIVER_PACKET Packet,
+    OUT PIP_HEADER              *IpHeader,
+    OUT PTCP_HEADER             *TcpHeader,
+    OUT PUCHAR                  *Payload,
+    OUT PULONG                  PayloadLength
+    )
+{
+    PADAPTER                    Adapter;
+    PXENVIF_PACKET_INFO         Info;
+    PMDL                        Mdl;
+    PUCHAR                      StartVa;
+    ULONG                       IpLength;
+    ULONG                       HeaderLength;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    Info = &Packet->Info;
+    Mdl = &Packet->Mdl;
+
+    if (Info->TcpHeader.Length == 0 ||
+        Info->IpOptions.Length != 0 ||
+        Info->Flags.IsAFragment ||
+        Packet->MaximumSegmentSize != 0)
+        return FALSE;
+
+    // The backend must have validated the segment as its checksum is not
+    // recalculated once other segments are appended.
+    if (!Packet->Flags.TcpChecksumSucceeded)
+        return FALSE;
+
+    // Only single fragment packets with no trailing padding
+    if (Mdl->Next != NULL ||
+        Packet->Offset + Packet->Length != Mdl->ByteCount ||
+        Info->TcpHeader.Offset + Info->TcpHeader.Length > Packet->Length)
+        return FALSE;
+
+    StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+    if (StartVa == NULL)
+        return FALSE;
+
+    StartVa += Packet->Offset;
+
+    *IpHeader = (PIP_HEADER)(StartVa + Info->IpHeader.Offset);
+    *TcpHeader = (PTCP_HEADER)(StartVa + Info->TcpHeader.Offset);
+
+    if ((*IpHeader)->Version == 4) {
+        if (!Adapter->Properties.grov4)
+            return FALSE;
+
+        IpLength = NTOHS((*IpHeader)->Version4.PacketLength);
+    } else {
+        ASSERT3U((*IpHeader)->Version, ==, 6);
+
+        if (!Adapter->Properties.grov6)
+            return FALSE;
+
+        IpLength = IPV6_HEADER_LENGTH(&(*IpHeader)->Version6) +
+                   NTOHS((*IpHeader)->Version6.PayloadLength);
+    }
+
+    if (Info->IpHeader.Offset + IpLength != Packet->Length)
+        return FALSE;
+
+    HeaderLength = Info->TcpHeader.Offset + TCP_HEADER_LENGTH(*TcpHeader);
+    if (HeaderLength >= Packet->Length)
+        return FALSE;
+
+    // Anything other than a plain data segment ends coalescing
+    if (((*TcpHeader)->Flags & ~(TCP_ACK | TCP_PSH)) != 0 ||
+        !((*TcpHeader)->Flags & TCP_ACK))
+        return FALSE;
+
+    *Payload = StartVa + HeaderLength;
+    *PayloadLength = Packet->Length - HeaderLength;
+
+    return TRUE;
+}
+
+// Closes the open flow, if any, rewriting the IP length of the first
+// segment to cover everything merged into it.
+static VOID
+ReceiverGroFlush(
+    IN  PRECEIVER       Receiver,
+    IN  PRECEIVER_GRO   Gro
+    )
+{
+    if (Gro->NetBufferList == NULL)
+        return;
+
+    if (Gro->Count > 1) {
+        PIP_HEADER  IpHeader = Gro->IpHeader;
+
+        if (IpHeader->Version == 4) {
+            USHORT  PacketLength;
+
+            PacketLength = HTONS((USHORT)Gro->Length);
+
+            IpHeader->Version4.Checksum = ChecksumUpdate(IpHeader->Version4.Checksum,
+                                                         IpHeader->Version4.PacketLength,
+                                                         PacketLength);
+            IpHeader->Version4.PacketLength = PacketLength;
+        } else {
+            IpHeader->Version6.PayloadLength = HTONS((USHORT)(Gro->Length -
+                                                              IPV6_HEADER_LENGTH(&IpHeader->Version6)));
+        }
+
+        ReceiverSetCoalesceInfo(Receiver, Gro->NetBufferList, Gro->Count);
+    }
+
+    Gro->NetBufferList = NULL;
+}
+
+// Opens a flow with Packet as its first segment if it is a candidate for
+// coalescing.
+static VOID
+ReceiverGroStart(
+    IN  PRECEIVER               Receiver,
+    IN  PRECEIVER_GRO           Gro,
+    IN  PXENVIF_RECEIVER_PACKET Packet,
+    IN  PNET_BUFFER_LIST        NetBufferList
+    )
+{
+    PIP_HEADER                  IpHeader;
+    PTCP_HEADER                 TcpHeader;
+    PUCHAR                      Payload;
+    ULONG                       PayloadLength;
+
+    ASSERT3P(Gro->NetBufferList, ==, NULL);
+
+    if (!ReceiverGroParse(Receiver, Packet, &IpHeader, &TcpHeader, &Payload, &PayloadLength))
+        return;
+
+    // A pushed segment would be closed again immediately
+    if (TcpHeader->Flags & TCP_PSH)
+        return;
+
+    ASSERT3P(Packet->ListEntry.Flink, ==, NULL);
+
+    Gro->NetBufferList = NetBufferList;
+    Gro->Packet = Packet;
+    Gro->IpHeader = IpHeader;
+    Gro->TcpHeader = TcpHeader;
+    Gro->TailMdl = &Packet->Mdl.Next;
+    Gro->TailEntry = &Packet->ListEntry;
+    Gro->SegmentSize = PayloadLength;
+    Gro->Length = Packet->Length - Packet->Info.IpHeader.Offset;
+    Gro->Seq = NTOHL(TcpHeader->Seq) + PayloadLength;
+    Gro->Count = 1;
+}
+
+static FORCEINLINE BOOLEAN
+__ReceiverGroSameFlow(
+    IN  PRECEIVER_GRO   Gro,
+    IN  PIP_HEADER      IpHeader,
+    IN  PTCP_HEADER     TcpHeader
+    )
+{
+    PIP_HEADER          First = Gro->IpHeader;
+    PTCP_HEADER         FirstTcp = Gro->TcpHeader;
+
+    if (IpHeader->Version != First->Version)
+        return FALSE;
+
+    if (IpHeader->Version == 4) {
+        if (IpHeader->Version4.TypeOfService != First->Version4.TypeOfService ||
+            IpHeader->Version4.TimeToLive != First->Version4.TimeToLive ||
+            IpHeader->Version4.FragmentOffsetAndFlags != First->Version4.FragmentOffsetAndFlags ||
+            IpHeader->Version4.SourceAddress.Dword[0] != First->Version4.SourceAddress.Dword[0] ||
+            IpHeader->Version4.DestinationAddress.Dword[0] != First->Version4.DestinationAddress.Dword[0])
+            return FALSE;
+    } else {
+        if (IpHeader->Version6.VCF != First->Version6.VCF ||
+            IpHeader->Version6.NextHeader != First->Version6.NextHeader ||
+            IpHeader->Version6.HopLimit != First->Version6.HopLimit ||
+            !RtlEqualMemory(&IpHeader->Version6.SourceAddress,
+                            &First->Version6.SourceAddress,
+                            IPV6_ADDRESS_LENGTH) ||
+            !RtlEqualMemory(&IpHeader->Version6.DestinationAddress,
+                            &First->Version6.DestinationAddress,
+                            IPV6_ADDRESS_LENGTH))
+            return FALSE;
+    }
+
+    // Options (e.g. timestamps) must match exactly as only those of the
+    // first segment are indicated.
+    if (TcpHeader->SourcePort != FirstTcp->SourcePort ||
+        TcpHeader->DestinationPort != FirstTcp->DestinationPort ||
+        TcpHeader->Ack != FirstTcp->Ack ||
+        TcpHeader->HeaderLength != FirstTcp->HeaderLength ||
+        !RtlEqualMemory(TcpHeader + 1,
+                        FirstTcp + 1,
+                        TCP_HEADER_LENGTH(TcpHeader) - sizeof (TCP_HEADER)))
+        return FALSE;
+
+    return TRUE;
+}
+
+// Appends Packet to the open flow if it is the next segment of it,
+// returning FALSE (having closed the flow) otherwise.
+static BOOLEAN
+ReceiverGroMerge(
+    IN  PRECEIVER               Receiver,
+    IN  PRECEIVER_GRO           Gro,
+    IN  PXENVIF_RECEIVER_PACKET Packet
+    )
+{
+    PADAPTER                    Adapter;
+    PIP_HEADER                  IpHeader;
+    PTCP_HEADER                 TcpHeader;
+    PUCHAR                      Payload;
+    ULONG                       PayloadLength;
+    PNET_BUFFER                 NetBuffer;
+    PMDL                        Mdl;
+
+    if (Gro->NetBufferList == NULL)
+        return FALSE;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    if (Packet->TagControlInformation != Gro->Packet->TagControlInformation)
+        goto close;
+
+    if (!ReceiverGroParse(Receiver, Packet, &IpHeader, &TcpHeader, &Payload, &PayloadLength))
+        goto close;
+
+    if (!__ReceiverGroSameFlow(Gro, IpHeader, TcpHeader) ||
+        NTOHL(TcpHeader->Seq) != Gro->Seq ||
+        PayloadLength > Gro->SegmentSize ||
+        Gro->Length + PayloadLength > RECEIVER_GRO_MAXIMUM_LENGTH)
+        goto close;
+
+    Mdl = NdisAllocateMdl(Adapter->NdisAdapterHandle, Payload, PayloadLength);
+    if (Mdl == NULL)
+        goto close;
+
+    *Gro->TailMdl = Mdl;
+    Gro->TailMdl = &Mdl->Next;
+
+    ASSERT3P(Packet->ListEntry.Flink, ==, NULL);
+    Gro->TailEntry->Flink = &Packet->ListEntry;
+    Gro->TailEntry = &Packet->ListEntry;
+
+    NetBuffer = NET_BUFFER_LIST_FIRST_NB(Gro->NetBufferList);
+    NET_BUFFER_DATA_LENGTH(NetBuffer) += PayloadLength;
+
+    // Indicate the most recent window and any push
+    Gro->TcpHeader->Window = TcpHeader->Window;
+    Gro->TcpHeader->Flags |= TcpHeader->Flags & TCP_PSH;
+
+    Gro->Length += PayloadLength;
+    Gro->Seq += PayloadLength;
+    Gro->Count++;
+
+    // A short or pushed segment is the last of a burst
+    if (PayloadLength < Gro->SegmentSize || (TcpHeader->Flags & TCP_PSH))
+        ReceiverGroFlush(Receiver, Gro);
+
+    return TRUE;
+
+close:
+    ReceiverGroFlush(Receiver, Gro);
+
+    return FALSE;
+}
+
+// Sentinel target meaning 'indicate on the current CPU'
+#define RECEIVER_TARGET_NONE    ((ULONG)-1)
+
+static FORCEINLINE VOID
+__ReceiverSetTarget(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Target
+    )
+{
+    NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList)[1] = (PVOID)(ULONG_PTR)Target;
+}
+
+static FORCEINLINE ULONG
+__ReceiverGetTarget(
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    return (ULONG)(ULONG_PTR)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList)[1];
+}
+
+// Builds the hash input for Packet, returning FALSE if it cannot be
+// classified.
+static BOOLEAN
+ReceiverRssGetTuple(
+    IN  PRECEIVER_RSS           Rss,
+    IN  PXENVIF_RECEIVER_PACKET Packet,
+    OUT PTOEPLITZ_TUPLE         Tuple,
+    OUT PULONG                  Type
+    )
+{
+    PXENVIF_PACKET_INFO         Info;
+    PMDL                        Mdl;
+    PUCHAR                      StartVa;
+    PIP_HEADER                  IpHeader;
+    PUCHAR                      Input;
+    ULONG                       Length;
+
+    Info = &Packet->Info;
+    Mdl = &Packet->Mdl;
+    Input = Tuple->Data;
+
+    if (Info->IpHeader.Length == 0 || Info->Flags.IsAFragment)
+        goto none;
+
+    // The headers must lie within the first fragment
+    if (Packet->Offset + Info->IpHeader.Offset + Info->IpHeader.Length > Mdl->ByteCount)
+        goto none;
+
+    StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+    if (StartVa == NULL)
+        goto none;
+
+    StartVa += Packet->Offset;
+
+    IpHeader = (PIP_HEADER)(StartVa + Info->IpHeader.Offset);
+
+    if (IpHeader->Version == 4) {
+        RtlCopyMemory(&Input[0], &IpHeader->Version4.SourceAddress, IPV4_ADDRESS_LENGTH);
+        RtlCopyMemory(&Input[IPV4_ADDRESS_LENGTH], &IpHeader->Version4.DestinationAddress, IPV4_ADDRESS_LENGTH);
+        Length = 2 * IPV4_ADDRESS_LENGTH;
+
+        if (Info->TcpHeader.Length != 0 && (Rss->HashTypes & NDIS_HASH_TCP_IPV4))
+            *Type = NDIS_HASH_TCP_IPV4;
+        else if (Rss->HashTypes & NDIS_HASH_IPV4)
+            *Type = NDIS_HASH_IPV4;
+        else
+            goto none;
+    } else {
+        ASSERT3U(IpHeader->Version, ==, 6);
+
+        RtlCopyMemory(&Input[0], &IpHeader->Version6.SourceAddress, IPV6_ADDRESS_LENGTH);
+        RtlCopyMemory(&Input[IPV6_ADDRESS_LENGTH], &IpHeader->Version6.DestinationAddress, IPV6_ADDRESS_LENGTH);
+        Length = 2 * IPV6_ADDRESS_LENGTH;
+
+        if (Info->TcpHeader.Length != 0 && (Rss->HashTypes & NDIS_HASH_TCP_IPV6))
+            *Type = NDIS_HASH_TCP_IPV6;
+        else if (Rss->HashTypes & NDIS_HASH_IPV6)
+            *Type = NDIS_HASH_IPV6;
+        else
+            goto none;
+    }
+
+    if (*Type == NDIS_HASH_TCP_IPV4 || *Type == NDIS_HASH_TCP_IPV6) {
+        PTCP_HEADER TcpHeader;
+
+        if (Packet->Offset + Info->TcpHeader.Offset + Info->TcpHeader.Length > Mdl->ByteCount)
+            goto none;
+
+        TcpHeader = (PTCP_HEADER)(StartVa + Info->TcpHeader.Offset);
+
+        // Ports are hashed in network byte order, source first
+        RtlCopyMemory(&Input[Length], &TcpHeader->SourcePort, sizeof (USHORT));
+        Length += sizeof (USHORT);
+        RtlCopyMemory(&Input[Length], &TcpHeader->DestinationPort, sizeof (USHORT));
+        Length += sizeof (USHORT);
+    }
+
+    ASSERT3U(Length, <=, TOEPLITZ_MAXIMUM_INPUT_LENGTH);
+    Tuple->Length = Length;
+
+    return TRUE;
+
+none:
+    return FALSE;
+}
+
+#define RECEIVER_RSS_BATCH  16
+
+// Classification is done in batches so the hash kernel runs over a set of
+// tuples at a time rather than being called once per packet.
+typedef struct _RECEIVER_RSS_PENDING {
+    ULONG               Count;
+    PNET_BUFFER_LIST    NetBufferList[RECEIVER_RSS_BATCH];
+    ULONG               Type[RECEIVER_RSS_BATCH];
+    TOEPLITZ_TUPLE      Tuple[RECEIVER_RSS_BATCH];
+} RECEIVER_RSS_PENDING, *PRECEIVER_RSS_PENDING;
+
+static VOID
+ReceiverRssFlush(
+    IN  PRECEIVER_RSS           Rss,
+    IN  PRECEIVER_RSS_PENDING   Pending
+    )
+{
+    ULONG                       Hash[RECEIVER_RSS_BATCH];
+    ULONG                       Index;
+
+    if (Pending->Count == 0)
+        return;
+
+    ToeplitzHashBatch(Rss->ToeplitzKey, Pending->Tuple, Pending->Count, Hash);
+
+    for (Index = 0; Index < Pending->Count; Index++) {
+        PNET_BUFFER_LIST    NetBufferList = Pending->NetBufferList[Index];
+
+        NET_BUFFER_LIST_SET_HASH_VALUE(NetBufferList, Hash[Index]);
+        NET_BUFFER_LIST_SET_HASH_TYPE(NetBufferList, Pending->Type[Index]);
+        NET_BUFFER_LIST_SET_HASH_FUNCTION(NetBufferList, NdisHashFunctionToeplitz);
+
+        __ReceiverSetTarget(NetBufferList,
+                            Rss->BaseCpu + Rss->Table[Hash[Index] & (Rss->TableSize - 1)]);
+    }
+
+    Pending->Count = 0;
+}
+
+static VOID
+ReceiverRssClassify(
+    IN  PRECEIVER_RSS           Rss,
+    IN  PRECEIVER_RSS_PENDING   Pending,
+    IN  PXENVIF_RECEIVER_PACKET Packet,
+    IN  PNET_BUFFER_LIST        NetBufferList
+    )
+{
+    ULONG                       Index = Pending->Count;
+
+    __ReceiverSetTarget(NetBufferList, RECEIVER_TARGET_NONE);
+
+    if (!ReceiverRssGetTuple(Rss, Packet, &Pending->Tuple[Index], &Pending->Type[Index]))
+        return;
+
+    Pending->NetBufferList[Index] = NetBufferList;
+
+    if (++Pending->Count == RECEIVER_RSS_BATCH)
+        ReceiverRssFlush(Rss, Pending);
+}
+
+static FORCEINLINE ULONG
+__ReceiverGetHintKey(
+    IN  PNET_BUFFER_LIST            NetBufferList
+    )
+{
+    ULONG                           FrameType;
+    NDIS_NET_BUFFER_LIST_8021Q_INFO Ieee8021QInfo;
+
+    FrameType = (ULONG)(ULONG_PTR)NET_BUFFER_LIST_INFO(NetBufferList, NetBufferListFrameType);
+    if (FrameType == 0)
+        return 0;
+
+    Ieee8021QInfo.Value = NET_BUFFER_LIST_INFO(NetBufferList, Ieee8021QNetBufferListInfo);
+
+    return (FrameType << 16) | (ULONG)Ieee8021QInfo.TagHeader.VlanId;
+}
+
+// Must be called at DISPATCH_LEVEL.
+static VOID
+ReceiverIndicateSegment(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PADAPTER                Adapter;
+    PNET_BUFFER_LIST        Current;
+    PRECEIVER_PROCESSOR     Processor;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    for (Current = NetBufferList;
+         Current != NULL;
+         Current = NET_BUFFER_LIST_NEXT_NBL(Current))
+        if (!__ReceiverIsPerfectFiltered(Current))
+            break;
+
+    if (Current == NULL)
+        Flags |= NDIS_RECEIVE_FLAGS_PERFECT_FILTERED;
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor != NULL) {
+        Processor->Indications++;
+
+        if (Flags & NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE)
+            Processor->SingleEtherType++;
+        if (Flags & NDIS_RECEIVE_FLAGS_SINGLE_VLAN)
+            Processor->SingleVlan++;
+        if (Flags & NDIS_RECEIVE_FLAGS_PERFECT_FILTERED)
+            Processor->PerfectFiltered++;
+    }
+
+    NdisMIndicateReceiveNetBufferLists(Adapter->NdisAdapterHandle,
+                                       NetBufferList,
+                                       NDIS_DEFAULT_PORT_NUMBER,
+                                       Count,
+                                       Flags);
+
+    // Ownership comes straight back with NDIS_RECEIVE_FLAGS_RESOURCES
+    if (Flags & NDIS_RECEIVE_FLAGS_RESOURCES)
+        (VOID) __ReceiverReturnNetBufferLists(Receiver, NetBufferList, FALSE, NULL, NULL);
+}
+
+//
+// Indicate a chain, splitting it so that runs of at least
+// RECEIVER_HINT_MINIMUM_RUN packets with the same EtherType and VLAN go
+// up on their own with NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE and
+// NDIS_RECEIVE_FLAGS_SINGLE_VLAN, and shorter runs go up together
+// without them. The backend applies the packet filter exactly, as is the
+// VLAN filter above, so an indication is NDIS_RECEIVE_FLAGS_PERFECT_FILTERED
+// unless it holds a multicast frame passed by the receiver's own hash
+// filter or a frame whose tag the backend did not strip and so was never
+// checked against the VLAN filter.
+// Must be called at DISPATCH_LEVEL.
+//
+static VOID
+ReceiverIndicatePackets(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PNET_BUFFER_LIST        Segment;
+    ULONG                   SegmentCount;
+    PNET_BUFFER_LIST        *Link;
+    PNET_BUFFER_LIST        *RunLink;   // To the first of the trailing run
+    ULONG                   RunCount;
+    ULONG                   RunKey;
+    ULONG                   Hints;
+    ULONG                   Indicated;
+
+    Hints = NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE |
+            NDIS_RECEIVE_FLAGS_SINGLE_VLAN;
+
+    Segment = NetBufferList;
+    SegmentCount = 0;
+    Link = &Segment;
+
+    RunLink = &Segment;
+    RunCount = 0;
+    RunKey = 0;
+
+    Indicated = 0;
+
+    while (*Link != NULL) {
+        PNET_BUFFER_LIST    Current;
+        ULONG               Key;
+
+        Current = *Link;
+        Key = __ReceiverGetHintKey(Current);
+
+        if (Key != 0 && RunCount != 0 && Key == RunKey) {
+            RunCount++;
+            SegmentCount++;
+
+            // Long enough to go up on its own; indicate what precedes it
+            if (RunCount == RECEIVER_HINT_MINIMUM_RUN &&
+                SegmentCount > RunCount) {
+                PNET_BUFFER_LIST    Run;
+
+                Run = *RunLink;
+                *RunLink = NULL;
+
+                ReceiverIndicateSegment(Receiver, Segment, SegmentCount - RunCount, Flags);
+                Indicated += SegmentCount - RunCount;
+
+                Segment = Run;
+                SegmentCount = RunCount;
+                RunLink = &Segment;
+            }
+        } else {
+            // The end of a homogeneous segment long enough to go up alone
+            if (SegmentCount != 0 &&
+                SegmentCount == RunCount &&
+                RunCount >= RECEIVER_HINT_MINIMUM_RUN) {
+                *Link = NULL;
+
+                ReceiverIndicateSegment(Receiver, Segment, SegmentCount, Flags | Hints);
+                Indicated += SegmentCount;
+
+                Segment = Current;
+                SegmentCount = 0;
+                Link = &Segment;
+            }
+
+            RunLink = Link;
+            RunKey = Key;
+            RunCount = (Key != 0) ? 1 : 0;
+            SegmentCount++;
+        }
+
+        Link = &NET_BUFFER_LIST_NEXT_NBL(Current);
+    }
+
+    ASSERT(SegmentCount != 0);
+
+    if (SegmentCount == RunCount)
+        Flags |= Hints;
+
+    ReceiverIndicateSegment(Receiver, Segment, SegmentCount, Flags);
+    Indicated += SegmentCount;
+
+    ASSERT3U(Indicated, ==, Count);
+}
+
+static VOID
+ReceiverQueueDpc(
+    IN  PKDPC           Dpc,
+    IN  PVOID           Context,
+    IN  PVOID           Argument1,
+    IN  PVOID           Argument2
+    )
+{
+    PRECEIVER           Receiver = Context;
+    PRECEIVER_QUEUE     Queue;
+    PNET_BUFFER_LIST    NetBufferList;
+    ULONG               Count;
+
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    ASSERT(Receiver != NULL);
+
+    Queue = CONTAINING_RECORD(Dpc, RECEIVER_QUEUE, Dpc);
+
+    KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+
+    NetBufferList = Queue->Head;
+    Count = Queue->Count;
+
+    Queue->Head = NULL;
+    Queue->Tail = &Queue->Head;
+    Queue->Count = 0;
+
+    KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+
+    if (Count == 0)
+        return;
+
+    ReceiverIndicatePackets(Receiver,
+                            NetBufferList,
+                            Count,
+                            NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL);
+}
+
+// Must be called at DISPATCH_LEVEL.
+static VOID
+ReceiverQueuePackets(
+    IN  PRECEIVER           Receiver,
+    IN  ULONG               Target,
+    IN  PNET_BUFFER_LIST    HeadNetBufferList,
+    IN  PNET_BUFFER_LIST    *TailNetBufferList,
+    IN  ULONG               Count
+    )
+{
+    PRECEIVER_QUEUE         Queue;
+
+    ASSERT3U(Target, <, Receiver->ProcessorCount);
+    Queue = &Receiver->Processor[Target].Queue;
+
+    KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+
+    *Queue->Tail = HeadNetBufferList;
+    Queue->Tail = TailNetBufferList;
+    Queue->Count += Count;
+
+    KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+
+    // Does nothing if the DPC is already queued
+    (VOID) KeInsertQueueDpc(&Queue->Dpc, NULL, NULL);
+}
+
+// Hand off any packets that RSS has assigned to other CPUs, leaving the
+// ones to be indicated here in the chain.
+// Must be called at DISPATCH_LEVEL.
+static VOID
+ReceiverSteerPackets(
+    IN      PRECEIVER           Receiver,
+    IN OUT  PNET_BUFFER_LIST    *NetBufferList,
+    IN OUT  PULONG              Count
+    )
+{
+    ULONG                       Current;
+    PNET_BUFFER_LIST            HeadNetBufferList;
+    PNET_BUFFER_LIST            *TailNetBufferList;
+    ULONG                       LocalCount;
+    PNET_BUFFER_LIST            RunHead;
+    PNET_BUFFER_LIST            *RunTail;
+    ULONG                       RunTarget;
+    ULONG                       RunCount;
+    ULONG                       Steered;
+    PRECEIVER_PROCESSOR         Processor;
+
+    Current = __GetCurrentProcessorIndex();
+
+    HeadNetBufferList = *NetBufferList;
+    *NetBufferList = NULL;
+    TailNetBufferList = NetBufferList;
+    LocalCount = 0;
+
+    RunHead = NULL;
+    RunTail = &RunHead;
+    RunTarget = RECEIVER_TARGET_NONE;
+    RunCount = 0;
+
+    Steered = 0;
+
+    // Consecutive packets for the same CPU are handed over together
+    while (HeadNetBufferList != NULL) {
+        PNET_BUFFER_LIST    Next;
+        ULONG               Target;
+
+        Next = NET_BUFFER_LIST_NEXT_NBL(HeadNetBufferList);
+        NET_BUFFER_LIST_NEXT_NBL(HeadNetBufferList) = NULL;
+
+        Target = __ReceiverGetTarget(HeadNetBufferList);
+
+        if (Target >= Receiver->ProcessorCount || Target == Current) {
+            *TailNetBufferList = HeadNetBufferList;
+            TailNetBufferList = &NET_BUFFER_LIST_NEXT_NBL(HeadNetBufferList);
+            LocalCount++;
+        } else {
+            if (RunCount != 0 && Target != RunTarget) {
+                ReceiverQueuePackets(Receiver, RunTarget, RunHead, RunTail, RunCount);
+                Steered += RunCount;
+
+                RunHead = NULL;
+                RunTail = &RunHead;
+                RunCount = 0;
+            }
+
+            *RunTail = HeadNetBufferList;
+            RunTail = &NET_BUFFER_LIST_NEXT_NBL(HeadNetBufferList);
+            RunTarget = Target;
+            RunCount++;
+        }
+
+        HeadNetBufferList = Next;
+    }
+
+    if (RunCount != 0) {
+        ReceiverQueuePackets(Receiver, RunTarget, RunHead, RunTail, RunCount);
+        Steered += RunCount;
+    }
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor != NULL)
+        Processor->Steered += Steered;
+
+    ASSERT3U(LocalCount + Steered, ==, *Count);
+    *Count = LocalCount;
+}
+
+static VOID
+ReceiverPushPackets(
+    IN  PRECEIVER           Receiver,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  BOOLEAN             LowResources,
+    IN  BOOLEAN             Steer
+    )
+{
+    ULONG                   Flags;
+    LONG                    InNDIS;
+
+    InNDIS = Receiver->InNDIS;
+
+    Flags = NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL;
+    if (LowResources) {
+        PRECEIVER_PROCESSOR Processor;
+
+        Flags |= NDIS_RECEIVE_FLAGS_RESOURCES;
+
+        Processor = __ReceiverGetProcessor(Receiver);
+        if (Processor != NULL)
+            Processor->LowResources += Count;
+    } else {
+        InNDIS = __InterlockedAdd(&Receiver->InNDIS, Count);
+    }
+
+    for (;;) {
+        LONG    InNDISMax;
+
+        InNDISMax = Receiver->InNDISMax;
+        KeMemoryBarrier();
+
+        if (InNDIS <= InNDISMax)
+            break;
+
+        if (InterlockedCompareExchange(&Receiver->InNDISMax, InNDIS, InNDISMax) == InNDISMax)
+            break;
+    }
+
+    // Packets indicated with NDIS_RECEIVE_FLAGS_RESOURCES must be
+    // reclaimed here so they are never steered.
+    if (Steer && !LowResources) {
+        ReceiverSteerPackets(Receiver, &NetBufferList, &Count);
+        if (Count == 0)
+            return;
+    }
+
+    ReceiverIndicatePackets(Receiver, NetBufferList, Count, Flags);
+}
+
+// Append everything on Source to Destination, leaving Source empty
+static FORCEINLINE VOID
+__ReceiverMoveList(
+    IN  PLIST_ENTRY Destination,
+    IN  PLIST_ENTRY Source
+    )
+{
+    if (IsListEmpty(Source))
+        return;
+
+    Source->Flink->Blink = Destination->Blink;
+    Destination->Blink->Flink = Source->Flink;
+
+    Source->Blink->Flink = Destination;
+    Destination->Blink = Source->Blink;
+
+    InitializeListHead(Source);
+}
+
+// Must be called at DISPATCH_LEVEL.
+static VOID
+ReceiverRecordProcessingTime(
+    IN  PRECEIVER           Receiver,
+    IN  LARGE_INTEGER       Start,
+    IN  BOOLEAN             Deferred
+    )
+{
+    PRECEIVER_PROCESSOR     Processor;
+    ULONG64                 Elapsed;
+    ULONG                   Index;
+
+    Processor = __ReceiverGetProcessor(Receiver);
+    if (Processor == NULL || Receiver->Frequency == 0)
+        return;
+
+    Elapsed = KeQueryPerformanceCounter(NULL).QuadPart - Start.QuadPart;
+    Elapsed = (Elapsed * 1000000ull) / Receiver->Frequency;
+
+    // Bucket 0 is under 16us; each after it covers twice the time
+    Index = 0;
+    Elapsed >>= 4;
+    while (Elapsed != 0 && Index < RECEIVER_TIME_HISTOGRAM_SIZE - 1) {
+        Elapsed >>= 1;
+        Index++;
+    }
+
+    Processor->ProcessingTime[Index]++;
+
+    if (Deferred)
+        Processor->Deferred++;
+}
+
+// The checksum flags of a protocol the backend has not validated, but
+// whose checksum it says is present.
+#define RECEIVER_CHECKSUM_UNCHECKED(_Flags, _Protocol)      \
+        (!(_Flags)._Protocol ## ChecksumSucceeded &&       \
+         !(_Flags)._Protocol ## ChecksumFailed &&          \
+         (_Flags)._Protocol ## ChecksumPresent)
+
+//
+// Validate the checksums the stack has enabled receive offload for but the
+// backend left unchecked, so that the stack does not have to. Fragments
+// and coalesced packets, whose checksums cover more than the packet, are
+// left alone. Returns the number of checksums checked and adds those that
+// failed to Failed.
+//
+static ULONG
+ReceiverValidateChecksums(
+    IN      PRECEIVER                   Receiver,
+    IN      PXENVIF_RECEIVER_PACKET     Packet,
+    IN OUT  PULONG                      Failed
+    )
+{
+    PADAPTER                            Adapter;
+    PXENVIF_PACKET_INFO                 Info;
+    PXENVIF_CHECKSUM_FLAGS              Flags;
+    PMDL                                Mdl;
+    PUCHAR                              StartVa;
+    PIP_HEADER                          IpHeader;
+    ULONG                               IpLength;
+    BOOLEAN                             Tcp;
+    BOOLEAN                             Udp;
+    ULONG                               Offset;
+    ULONG                               Length;
+    UCHAR                               Protocol;
+    ULONG                               Sum;
+    ULONG                               Checked;
+    NTSTATUS                            status;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    Info = &Packet->Info;
+    Flags = &Packet->Flags;
+    Mdl = &Packet->Mdl;
+    Checked = 0;
+
+    if (Info->IpHeader.Length == 0 ||
+        Info->Flags.IsAFragment ||
+        Packet->MaximumSegmentSize != 0)
+        goto done;
+
+    // The headers must lie within the first fragment
+    if (Packet->Offset + Info->IpHeader.Offset + Info->IpHeader.Length +
+        Info->IpOptions.Length > Mdl->ByteCount)
+        goto done;
+
+    StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+    if (StartVa == NULL)
+        goto done;
+
+    StartVa += Packet->Offset;
+
+    IpHeader = (PIP_HEADER)(StartVa + Info->IpHeader.Offset);
+
+    if (IpHeader->Version == 4) {
+        if (Adapter->Offload.Checksum.IPv4Receive.IpChecksum &&
+            RECEIVER_CHECKSUM_UNCHECKED(*Flags, Ip)) {
+            Sum = ChecksumAdd(0,
+                              IpHeader,
+                              Info->IpHeader.Length + Info->IpOptions.Length);
+
+            if (Sum == 0xFFFF) {
+                Flags->IpChecksumSucceeded = 1;
+            } else {
+                Flags->IpChecksumFailed = 1;
+                (*Failed)++;
+            }
+
+            Checked++;
+        }
+
+        IpLength = NTOHS(IpHeader->Version4.PacketLength);
+        Tcp = Adapter->Offload.Checksum.IPv4Receive.TcpChecksum ? TRUE : FALSE;
+        Udp = Adapter->Offload.Checksum.IPv4Receive.UdpChecksum ? TRUE : FALSE;
+    } else {
+        ASSERT3U(IpHeader->Version, ==, 6);
+
+        IpLength = sizeof (IPV6_HEADER) + NTOHS(IpHeader->Version6.PayloadLength);
+        Tcp = Adapter->Offload.Checksum.IPv6Receive.TcpChecksum ? TRUE : FALSE;
+        Udp = Adapter->Offload.Checksum.IPv6Receive.UdpChecksum ? TRUE : FALSE;
+    }
+
+    if (Info->TcpHeader.Length != 0 &&
+        Tcp && RECEIVER_CHECKSUM_UNCHECKED(*Flags, Tcp)) {
+        Offset = Info->TcpHeader.Offset;
+        Length = Info->TcpHeader.Length;
+        Protocol = IPPROTO_TCP;
+    } else if (Info->UdpHeader.Length != 0 &&
+               Udp && RECEIVER_CHECKSUM_UNCHECKED(*Flags, Udp)) {
+        Offset = Info->UdpHeader.Offset;
+        Length = Info->UdpHeader.Length;
+        Protocol = IPPROTO_UDP;
+    } else {
+        goto done;
+    }
+
+    if (Packet->Offset + Offset + Length > Mdl->ByteCount ||
+        Info->IpHeader.Offset + IpLength <= Offset ||
+        Info->IpHeader.Offset + IpLength > Packet->Length)
+        goto done;
+
+    // A UDP checksum of 0 over IPv4 means there is none
+    if (Protocol == IPPROTO_UDP &&
+        IpHeader->Version == 4 &&
+        ((PUDP_HEADER)(StartVa + Offset))->Checksum == 0)
+        goto done;
+
+    // Anything after the IP datagram is padding
+    Length = Info->IpHeader.Offset + IpLength - Offset;
+
+    Sum = ChecksumPseudoHeader(IpHeader, Protocol, Length);
+
+    status = ChecksumAddMdl(Mdl, Packet->Offset + Offset, Length, &Sum);
+    if (!NT_SUCCESS(status))
+        goto done;
+
+    if (Protocol == IPPROTO_TCP) {
+        if (Sum == 0xFFFF) {
+            Flags->TcpChecksumSucceeded = 1;
+        } else {
+            Flags->TcpChecksumFailed = 1;
+            (*Failed)++;
+        }
+    } else {
+        if (Sum == 0xFFFF) {
+            Flags->UdpChecksumSucceeded = 1;
+        } else {
+            Flags->UdpChecksumFailed = 1;
+            (*Failed)++;
+        }
+    }
+
+    Checked++;
+
+done:
+    return Checked;
+}
+
+//
+// Process packets from the head of the list until it is empty or the
+// budget set by ReceiverEnable() is spent, leaving the rest in the list.
+// Returns TRUE if the list was drained.
+// Must be called at DISPATCH_LEVEL.
+//
+static BOOLEAN
+ReceiverProcessPackets(
+    IN  PRECEIVER           Receiver,
+    IN  PLIST_ENTRY         List
+    )
+{
+    PNET_BUFFER_LIST        HeadNetBufferList;
+    PNET_BUFFER_LIST        *TailNetBufferList;
+    ULONG                   Count;
+    BOOLEAN                 LowResources;
+    LIST_ENTRY              Return;
+    LARGE_INTEGER           Now;
+    RECEIVER_RSS            Rss;
+    RECEIVER_RSS_PENDING    Pending;
+    BOOLEAN                 Steer;
+    RECEIVER_GRO            Gro;
+    BOOLEAN                 Coalesce;
+    PADAPTER                Adapter;
+    ULONG                   Bounced;
+    ULONG                   VlanAccepted;
+    ULONG                   VlanFiltered;
+    ULONG                   VlanInvalid;
+    BOOLEAN                 MulticastFilterEnabled;
+    PRECEIVER_MULTICAST_FILTER  MulticastFilter;
+    ULONG                   MulticastFiltered;
+    BOOLEAN                 StormControl;
+    ULONG                   Allowed[ETHERNET_ADDRESS_TYPE_COUNT];
+    ULONG                   Used[ETHERNET_ADDRESS_TYPE_COUNT];
+    ULONG                   Suppressed[ETHERNET_ADDRESS_TYPE_COUNT];
+    ULONG                   Type;
+    ULONG                   Processed;
+    BOOLEAN                 Deferred;
+    BOOLEAN                 Validate;
+    ULONG                   ChecksumChecked;
+    ULONG                   ChecksumFailed;
+
+    LowResources = FALSE;
+    InitializeListHead(&Return);
+
+    Now = KeQueryPerformanceCounter(NULL);
+
+    // Take a snapshot so the lock is not held while indicating
+    KeAcquireSpinLockAtDpcLevel(&Receiver->RssLock);
+    Rss = Receiver->Rss;
+    KeReleaseSpinLockFromDpcLevel(&Receiver->RssLock);
+
+    Steer = Rss.Enabled;
+    Pending.Count = 0;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    Coalesce = (Adapter->Properties.grov4 || Adapter->Properties.grov6) ? TRUE : FALSE;
+    Gro.NetBufferList = NULL;
+
+    Validate = Adapter->Properties.sw_csum ? TRUE : FALSE;
+    ChecksumChecked = 0;
+    ChecksumFailed = 0;
+
+    Bounced = 0;
+    VlanAccepted = 0;
+    VlanFiltered = 0;
+    VlanInvalid = 0;
+
+    // ReceiverSetMulticastAddresses() flushes DPCs before freeing a
+    // filter so it remains valid until this returns.
+    MulticastFilterEnabled = Receiver->MulticastFilterEnabled;
+    KeMemoryBarrier();
+    MulticastFilter = Receiver->MulticastFilter;
+    MulticastFiltered = 0;
+
+    // Work out how many frames of each limited class may be indicated
+    // now; what is used is charged to the buckets at the end so the lock
+    // is only taken twice.
+    StormControl = Receiver->StormControl;
+    if (StormControl) {
+        KeAcquireSpinLockAtDpcLevel(&Receiver->StormLock);
+
+        for (Type = 0; Type < ETHERNET_ADDRESS_TYPE_COUNT; Type++) {
+            PRECEIVER_STORM_BUCKET  Bucket = &Receiver->Storm[Type];
+
+            Allowed[Type] = 0;
+            Used[Type] = 0;
+            Suppressed[Type] = 0;
+
+            if (Bucket->Rate == 0)
+                continue;
+
+            __ReceiverStormRefill(Bucket, Now);
+            Allowed[Type] = (ULONG)(Bucket->Credit / Bucket->Cost);
+        }
+
+        KeReleaseSpinLockFromDpcLevel(&Receiver->StormLock);
+    }
+
+    Processed = 0;
+    Deferred = FALSE;
+
+again:
+    HeadNetBufferList = NULL;
+    TailNetBufferList = &HeadNetBufferList;
+    Count = 0;
+
+    while (!IsListEmpty(List)) {
+        PLIST_ENTRY                     ListEntry;
+        PXENVIF_RECEIVER_PACKET         Packet;
+        PMDL                            Mdl;
+        ULONG                           Offset;
+        ULONG                           Length;
+        XENVIF_CHECKSUM_FLAGS           Flags;
+        USHORT                          TagControlInformation;
+        PRECEIVER_SLAB_BUFFER           Bounce;
+        PNET_BUFFER_LIST                NetBufferList;
+        PETHERNET_UNTAGGED_HEADER       EthernetHeader;
+        BOOLEAN                         Perfect;
+
+        Packet = CONTAINING_RECORD(List->Flink, XENVIF_RECEIVER_PACKET, ListEntry);
+
+        // Reading the clock is not free so only do it every so often
+        if ((Receiver->Budget != 0 && Processed == Receiver->Budget) ||
+            (Receiver->BudgetTime != 0 &&
+             Processed % RECEIVER_BUDGET_CHECK_INTERVAL == 0 &&
+             Processed != 0 &&
+             (ULONG64)(KeQueryPerformanceCounter(NULL).QuadPart - Now.QuadPart) >= Receiver->BudgetTime)) {
+            Deferred = TRUE;
+            break;
+        }
+
+        Processed++;
+
+        switch (__ReceiverVlanAccept(Receiver, Packet->TagControlInformation)) {
+        case RECEIVER_VLAN_UNTAGGED:
+            break;
+
+        case RECEIVER_VLAN_ACCEPTED:
+            VlanAccepted++;
+            break;
+
+        case RECEIVER_VLAN_FILTERED:
+            VlanFiltered++;
+
+            (VOID) RemoveHeadList(List);
+            InsertTailList(&Return, &Packet->ListEntry);
+            continue;
+
+        case RECEIVER_VLAN_INVALID:
+            VlanInvalid++;
+
+            (VOID) RemoveHeadList(List);
+            InsertTailList(&Return, &Packet->ListEntry);
+            continue;
+        }
+
+        EthernetHeader = ReceiverGetEthernetHeader(Packet);
+
+        // A tag left in the frame was not seen by the VLAN filter
+        Perfect = (EthernetHeader != NULL &&
+                   EthernetHeader->TypeOrLength != HTONS(ETHERTYPE_TPID)) ? TRUE : FALSE;
+
+        if (MulticastFilterEnabled || StormControl) {
+            Type = (EthernetHeader != NULL) ?
+                   GET_ETHERNET_ADDRESS_TYPE(&EthernetHeader->DestinationAddress) :
+                   ETHERNET_ADDRESS_UNICAST;
+
+            if (MulticastFilterEnabled &&
+                Type == ETHERNET_ADDRESS_MULTICAST &&
+                !__ReceiverMulticastAccept(MulticastFilter, &EthernetHeader->DestinationAddress)) {
+                MulticastFiltered++;
+
+                (VOID) RemoveHeadList(List);
+                InsertTailList(&Return, &Packet->ListEntry);
+                continue;
+            }
+
+            // The backend passes every group while the hash filter is on
+            if (MulticastFilterEnabled && Type == ETHERNET_ADDRESS_MULTICAST)
+                Perfect = FALSE;
+
+            if (StormControl && Receiver->Storm[Type].Rate != 0) {
+                if (Used[Type] == Allowed[Type]) {
+                    Suppressed[Type]++;
+
+                    (VOID) RemoveHeadList(List);
+                    InsertTailList(&Return, &Packet->ListEntry);
+                    continue;
+                }
+
+                Used[Type]++;
+            }
+        }
+
+        // Over the limit, copy frames so their packets need not be held
+        // and only fall back to NDIS_RECEIVE_FLAGS_RESOURCES when the
+        // bounce slab runs dry. Count does not yet include this frame.
+        Bounce = NULL;
+        if (!LowResources &&
+            Receiver->InNDIS + (LONG)Count >= Receiver->InNDISLimit) {
+            Bounce = __ReceiverSlabGet(&Receiver->Bounce, Packet->Length);
+            if (Bounce == NULL)
+                break;
+        }
+
+        ListEntry = RemoveHeadList(List);
+        ASSERT3P(ListEntry, ==, &Packet->ListEntry);
+
+        RtlZeroMemory(ListEntry, sizeof (LIST_ENTRY));
+
+        // Done first so that segments the backend did not validate may
+        // still be coalesced
+        if (Validate)
+            ChecksumChecked += ReceiverValidateChecksums(Receiver, Packet, &ChecksumFailed);
+
+        if (Bounce == NULL && Coalesce && ReceiverGroMerge(Receiver, &Gro, Packet))
+            continue;
+
+        Mdl = &Packet->Mdl;
+        Offset = Packet->Offset;
+        Length = Packet->Length;
+        Flags = Packet->Flags;
+        TagControlInformation = Packet->TagControlInformation;
+
+        NetBufferList = ReceiverReceivePacket(Receiver, Bounce, Mdl, Offset, Length, Flags, TagControlInformation);
+
+        if (NetBufferList != NULL) {
+            if (Bounce != NULL)
+                Bounced++;
+
+            __ReceiverSetTimestamp(NetBufferList, Now);
+            __ReceiverSetFrameType(NetBufferList, Packet, EthernetHeader);
+            __ReceiverSetPerfectFiltered(NetBufferList, Perfect);
+
+            ReceiverSetCoalesceInfo(Receiver, NetBufferList, __ReceiverGetSegmentCount(Packet));
+
+            if (Steer)
+                ReceiverRssClassify(&Rss, &Pending, Packet, NetBufferList);
+
+            // A copied frame no longer needs its packet
+            if (__ReceiverGetSlab(Receiver, NetBufferList) != NULL)
+                InsertTailList(&Return, &Packet->ListEntry);
+            else if (Coalesce)
+                ReceiverGroStart(Receiver, &Gro, Packet, NetBufferList);
+
+            *TailNetBufferList = NetBufferList;
+            TailNetBufferList = &NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+            Count++;
+        } else {
+            InsertTailList(&Return, &Packet->ListEntry);
+        }
+    }
+
+    if (Coalesce)
+        ReceiverGroFlush(Receiver, &Gro);
+
+    if (Steer)
+        ReceiverRssFlush(&Rss, &Pending);
+
+    if (Count != 0) {
+        ASSERT(HeadNetBufferList != NULL);
+
+        ReceiverPushPackets(Receiver, HeadNetBufferList, Count, LowResources, Steer);
+    }
+
+    if (!Deferred && !IsListEmpty(List)) {
+        ASSERT(!LowResources);
+        LowResources = TRUE;
+        goto again;
+    }
+
+    if (StormControl) {
+        KeAcquireSpinLockAtDpcLevel(&Receiver->StormLock);
+
+        for (Type = 0; Type < ETHERNET_ADDRESS_TYPE_COUNT; Type++) {
+            PRECEIVER_STORM_BUCKET  Bucket = &Receiver->Storm[Type];
+            ULONG64                 Charge;
+
+            if (Used[Type] == 0)
+                continue;
+
+            // A concurrent caller may have drawn on the same credit
+            Charge = (ULONG64)Used[Type] * Bucket->Cost;
+            Bucket->Credit = (Bucket->Credit > Charge) ? Bucket->Credit - Charge : 0;
+        }
+
+        KeReleaseSpinLockFromDpcLevel(&Receiver->StormLock);
+    }
+
+    if (Bounced != 0 ||
+        VlanAccepted != 0 || VlanFiltered != 0 || VlanInvalid != 0 ||
+        MulticastFiltered != 0 ||
+        ChecksumChecked != 0 ||
+        (StormControl &&
+         (Suppressed[ETHERNET_ADDRESS_BROADCAST] != 0 ||
+          Suppressed[ETHERNET_ADDRESS_MULTICAST] != 0))) {
+        PRECEIVER_PROCESSOR Processor;
+
+        Processor = __ReceiverGetProcessor(Receiver);
+        if (Processor != NULL) {
+            Processor->Bounced += Bounced;
+            Processor->VlanAccepted += VlanAccepted;
+            Processor->VlanFiltered += VlanFiltered;
+            Processor->VlanInvalid += VlanInvalid;
+            Processor->MulticastFiltered += MulticastFiltered;
+            Processor->ChecksumChecked += ChecksumChecked;
+            Processor->ChecksumFailed += ChecksumFailed;
+
+            if (StormControl) {
+                Processor->BroadcastSuppressed += Suppressed[ETHERNET_ADDRESS_BROADCAST];
+                Processor->MulticastSuppressed += Suppressed[ETHERNET_ADDRESS_MULTICAST];
+            }
+        }
+    }
+
+    ReceiverReturnPackets(Receiver, &Return);
+
+    ReceiverRecordProcessingTime(Receiver, Now, Deferred);
+
+    return !Deferred;
+}
+
+static VOID
+ReceiverBacklogDpc(
+    IN  PKDPC           Dpc,
+    IN  PVOID           Context,
+    IN  PVOID           Argument1,
+    IN  PVOID           Argument2
+    )
+{
+    PRECEIVER           Receiver = Context;
+    LIST_ENTRY          List;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    ASSERT(Receiver != NULL);
+
+    InitializeListHead(&List);
+
+    KeAcquireSpinLockAtDpcLevel(&Receiver->BacklogLock);
+    ASSERT(Receiver->BacklogActive);
+    __ReceiverMoveList(&List, &Receiver->Backlog);
+    KeReleaseSpinLockFromDpcLevel(&Receiver->BacklogLock);
+
+    (VOID) ReceiverProcessPackets(Receiver, &List);
+
+    KeAcquireSpinLockAtDpcLevel(&Receiver->BacklogLock);
+
+    // Anything that arrived meanwhile goes after what is left over
+    __ReceiverMoveList(&List, &Receiver->Backlog);
+    __ReceiverMoveList(&Receiver->Backlog, &List);
+
+    if (IsListEmpty(&Receiver->Backlog))
+        Receiver->BacklogActive = FALSE;
+    else
+        (VOID) KeInsertQueueDpc(&Receiver->BacklogDpc, NULL, NULL);
+
+    KeReleaseSpinLockFromDpcLevel(&Receiver->BacklogLock);
+}
+
+//
+// Called by the backend with a list of packets. Whatever does not fit in
+// the budget is left on the backlog for ReceiverBacklogDpc(), which is
+// queued behind any other DPCs on this CPU so they are not starved. Once
+// there is a backlog, newly arrived packets join the end of it to keep
+// them in order.
+// Must be called at DISPATCH_LEVEL.
+//
+VOID
+ReceiverReceivePackets(
+    IN  PRECEIVER           Receiver,
+    IN  PLIST_ENTRY         List
+    )
+{
+    KeAcquireSpinLockAtDpcLevel(&Receiver->BacklogLock);
+
+    if (Receiver->BacklogActive) {
+        __ReceiverMoveList(&Receiver->Backlog, List);
+        KeReleaseSpinLockFromDpcLevel(&Receiver->BacklogLock);
+        return;
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&Receiver->BacklogLock);
+
+    if (ReceiverProcessPackets(Receiver, List))
+        return;
+
+    KeAcquireSpinLockAtDpcLevel(&Receiver->BacklogLock);
+
+    __ReceiverMoveList(&Receiver->Backlog, List);
+
+    // Another caller may have run over its budget while the lock was
+    // dropped, in which case its DPC will pick this up too
+    if (!Receiver->BacklogActive) {
+        Receiver->BacklogActive = TRUE;
+        (VOID) KeInsertQueueDpc(&Receiver->BacklogDpc, NULL, NULL);
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&Receiver->BacklogLock);
+}
+
+// Limit frames of the given address class to Rate per second, with bursts
+// of up to a tenth of a second's worth (but at least
+// RECEIVER_STORM_MINIMUM_BURST). A Rate of 0 removes the limit.
+static VOID
+ReceiverConfigureStormControl(
+    IN  PRECEIVER               Receiver,
+    IN  ETHERNET_ADDRESS_TYPE   Type,
+    IN  ULONG                   Rate
+    )
+{
+    PRECEIVER_STORM_BUCKET      Bucket;
+    LARGE_INTEGER               Frequency;
+    LARGE_INTEGER               Now;
+    ULONG                       Burst;
+    ULONG                       Index;
+    BOOLEAN                     StormControl;
+    KIRQL                       Irql;
+
+    Now = KeQueryPerformanceCounter(&Frequency);
+
+    Burst = Rate / 10;
+    if (Burst < RECEIVER_STORM_MINIMUM_BURST)
+        Burst = RECEIVER_STORM_MINIMUM_BURST;
+
+    KeAcquireSpinLock(&Receiver->StormLock, &Irql);
+
+    Bucket = &Receiver->Storm[Type];
+
+    Bucket->Rate = Rate;
+    Bucket->Cost = Frequency.QuadPart;
+    Bucket->Capacity = (ULONG64)Burst * Frequency.QuadPart;
+    Bucket->Credit = Bucket->Capacity;
+    Bucket->Last = Now;
+
+    StormControl = FALSE;
+    for (Index = 0; Index < ETHERNET_ADDRESS_TYPE_COUNT; Index++)
+        if (Receiver->Storm[Index].Rate != 0)
+            StormControl = TRUE;
+
+    Receiver->StormControl = StormControl;
+
+    KeReleaseSpinLock(&Receiver->StormLock, Irql);
+
+    if (Rate != 0)
+        Info("%s: %u/s (burst %u)\n",
+             (Type == ETHERNET_ADDRESS_BROADCAST) ? "BROADCAST" : "MULTICAST",
+             Rate,
+             Burst);
+}
+
+VOID
+ReceiverEnable(
+    IN  PRECEIVER   Receiver
+    )
+{
+    PADAPTER        Adapter;
+    ULONG           Limit;
+    ULONG           Factor;
+    LARGE_INTEGER   Frequency;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    VIF(QueryReceiverRingSize,
+        Adapter->VifInterface,
+        &Receiver->RingSize);
+
+    // Start generously; ReceiverUpdateWatermark() will shrink it if the
+    // stack returns packets promptly.
+    Limit = Adapter->Properties.rx_in_flight_limit;
+    if (Limit == 0)
+        Limit = Receiver->RingSize * RECEIVER_IN_NDIS_MAX_RINGS;
+
+    if (Limit != 0)
+        Receiver->InNDISLimit = (LONG)Limit;
+
+    Receiver->LastUpdate = KeQueryPerformanceCounter(NULL);
+
+    Receiver->CopyBreak = 0;
+    if (Adapter->Properties.rx_copy_break > 0 &&
+        (Receiver->Copy.Buffer != NULL ||
+         ReceiverSlabAllocate(Receiver,
+                              &Receiver->Copy,
+                              RECEIVER_COPY_BUFFER_SIZE,
+                              RECEIVER_COPY_BUFFER_COUNT) == NDIS_STATUS_SUCCESS)) {
+        Receiver->CopyBreak = Adapter->Properties.rx_copy_break;
+        if (Receiver->CopyBreak > RECEIVER_COPY_BUFFER_SIZE)
+            Receiver->CopyBreak = RECEIVER_COPY_BUFFER_SIZE;
+    }
+
+    Factor = Adapter->Properties.rx_prewarm_factor;
+    if (Factor > RECEIVER_PREWARM_MAXIMUM_FACTOR)
+        Factor = RECEIVER_PREWARM_MAXIMUM_FACTOR;
+
+    Receiver->PrewarmTarget = Receiver->RingSize * Factor;
+    ReceiverPrewarm(Receiver, Receiver->PrewarmTarget);
+
+    // A ring's worth of full-sized frames. Without it frames over the
+    // limit are indicated with NDIS_RECEIVE_FLAGS_RESOURCES.
+    if (Receiver->Bounce.Buffer == NULL && Receiver->RingSize != 0)
+        (VOID) ReceiverSlabAllocate(Receiver,
+                                    &Receiver->Bounce,
+                                    Adapter->MaximumFrameSize,
+                                    Receiver->RingSize);
+
+    Receiver->Budget = Adapter->Properties.rx_budget;
+
+    (VOID) KeQueryPerformanceCounter(&Frequency);
+    Receiver->Frequency = Frequency.QuadPart;
+    Receiver->BudgetTime = ((ULONG64)Adapter->Properties.rx_budget_time * Frequency.QuadPart) / 1000000ull;
+
+    ReceiverConfigureStormControl(Receiver,
+                                  ETHERNET_ADDRESS_BROADCAST,
+                                  Adapter->Properties.rx_broadcast_limit);
+    ReceiverConfigureStormControl(Receiver,
+                                  ETHERNET_ADDRESS_MULTICAST,
+                                  Adapter->Properties.rx_multicast_limit);
+
+    Info("RingSize = %u InNDISLimit = %d%s CopyBreak = %u Budget = %u/%uus\n",
+         Receiver->RingSize,
+         Receiver->InNDISLimit,
+         (Adapter->Properties.rx_in_flight_limit != 0) ? " (fixed)" : "",
+         Receiver->CopyBreak,
+         Adapter->Properties.rx_budget,
+         Adapter->Properties.rx_budget_time);
+}
+
+//
+// Re-size the in-flight watermark from the rate and latency at which the
+// stack has returned packets since the last call. By Little's law the
+// average number of packets held by the stack is the total latency
+// accrued divided by the elapsed time; allow twice that, plus a ring's
+// worth for bursts, bounded by a multiple of the ring size.
+//
+VOID
+ReceiverUpdateWatermark(
+    IN  PRECEIVER       Receiver
+    )
+{
+    PADAPTER            Adapter;
+    LARGE_INTEGER       Frequency;
+    LARGE_INTEGER       Now;
+    ULONG64             Elapsed;
+    ULONG64             Returned;
+    ULONG64             ReturnLatency;
+    ULONG64             LowResources;
+    ULONG64             Bounced;
+    ULONG64             Count;
+    ULONG64             Latency;
+    ULONG64             Target;
+    LONG                Minimum;
+    LONG                Maximum;
+    LONG                Limit;
+    ULONG               Index;
+
+    Adapter = CONTAINING_RECORD(Receiver, ADAPTER, Receiver);
+
+    if (Receiver->Processor == NULL || Receiver->RingSize == 0)
+        return;
+
+    Now = KeQueryPerformanceCounter(&Frequency);
+
+    Returned = 0;
+    ReturnLatency = 0;
+    LowResources = 0;
+    Bounced = 0;
+
+    for (Index = 0; Index < Receiver->ProcessorCount; Index++) {
+        PRECEIVER_PROCESSOR Processor;
+
+        Processor = &Receiver->Processor[Index];
+
+        Returned += __ReceiverReadCounter(&Processor->Returned);
+        ReturnLatency += __ReceiverReadCounter(&Processor->ReturnLatency);
+        LowResources += __ReceiverReadCounter(&Processor->LowResources);
+        Bounced += __ReceiverReadCounter(&Processor->Bounced);
+    }
+
+    Elapsed = Now.QuadPart - Receiver->LastUpdate.QuadPart;
+    Count = Returned - Receiver->LastReturned;
+    Latency = ReturnLatency - Receiver->LastReturnLatency;
+
+    if (Elapsed == 0 || Frequency.QuadPart == 0)
+        return;
+
+    Receiver->ReturnRate = (ULONG)((Count * Frequency.QuadPart) / Elapsed);
+    Receiver->ReturnLatency = (Count != 0) ?
+                              (ULONG)(((Latency / Count) * 1000000ull) / Frequency.QuadPart) :
+                              0;
+
+    Minimum = (LONG)(Receiver->RingSize * RECEIVER_IN_NDIS_MIN_RINGS);
+    Maximum = (LONG)(Receiver->RingSize * RECEIVER_IN_NDIS_MAX_RINGS);
+
+    Target = ((2 * Latency) / Elapsed) + Receiver->RingSize;
+
+    Limit = Receiver->InNDISLimit;
+
+    // If we had to fall back to copying then grow quickly
+    if (LowResources != Receiver->LastLowResources ||
+        Bounced != Receiver->LastBounced)
+        if (Target < (ULONG64)Limit + (Limit / 2))
+            Target = (ULONG64)Limit + (Limit / 2);
+
+    // Grow immediately, but shrink gradually
+    if (Target < (ULONG64)Limit)
+        Target = (Target + Limit) / 2;
+
+    if (Target > (ULONG64)Maximum)
+        Target = Maximum;
+    if (Target < (ULONG64)Minimum)
+        Target = Minimum;
+
+    Receiver->LastUpdate = Now;
+    Receiver->LastReturned = Returned;
+    Receiver->LastReturnLatency = ReturnLatency;
+    Receiver->LastLowResources = LowResources;
+    Receiver->LastBounced = Bounced;
+
+    if (Adapter->Properties.rx_in_flight_limit != 0)
+        return;
+
+    if ((LONG)Target != Limit)
+        Trace("InNDISLimit %d -> %d (rate %u/s latency %uus)\n",
+              Limit,
+              (LONG)Target,
+              Receiver->ReturnRate,
+              Receiver->ReturnLatency);
+
+    Receiver->InNDISLimit = (LONG)Target;
+}
+
+// Replace the whole VLAN filter. Each word is written atomically so a
+// receive racing with the update sees either the old or the new
+// membership of any given VLAN.
+VOID
+ReceiverSetVlanFilter(
+    IN  PRECEIVER               Receiver,
+    IN  PRECEIVER_VLAN_FILTER   Filter
+    )
+{
+    ULONG                       Index;
+    ULONG                       Count;
+
+    Count = 0;
+    for (Index = 0; Index < ARRAYSIZE(Filter->Bitmap); Index++) {
+        ULONG   Bitmap;
+
+        Bitmap = Filter->Bitmap[Index];
+
+        // VLAN IDs 0 and 0xFFF are not subject to the filter
+        if (Index == 0)
+            Bitmap &= ~1ul;
+        if (Index == ARRAYSIZE(Filter->Bitmap) - 1)
+            Bitmap &= ~(1ul << 31);
+
+        (VOID) InterlockedExchange((PLONG)&Receiver->VlanFilter.Bitmap[Index], (LONG)Bitmap);
+
+        while (Bitmap != 0) {
+            Bitmap &= Bitmap - 1;
+            Count++;
+        }
+    }
+
+    Info("%u VLAN(s)\n", Count);
+}
+
+VOID
+ReceiverQueryVlanFilter(
+    IN  PRECEIVER               Receiver,
+    OUT PRECEIVER_VLAN_FILTER   Filter
+    )
+{
+    RtlCopyMemory(Filter, &Receiver->VlanFilter, sizeof (RECEIVER_VLAN_FILTER));
+}
+
+// OID_GEN_VLAN_ID and the VlanID keyword name a single VLAN; 0 means none.
+NDIS_STATUS
+ReceiverSetVlanId(
+    IN  PRECEIVER           Receiver,
+    IN  ULONG               VlanId
+    )
+{
+    RECEIVER_VLAN_FILTER    Filter;
+
+    if (VlanId >= RECEIVER_VLAN_ID_COUNT - 1)
+        return NDIS_STATUS_INVALID_DATA;
+
+    RtlZeroMemory(&Filter, sizeof (RECEIVER_VLAN_FILTER));
+
+    if (VlanId != 0)
+        Filter.Bitmap[VlanId / 32] |= 1ul << (VlanId % 32);
+
+    ReceiverSetVlanFilter(Receiver, &Filter);
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+// The lowest VLAN ID in the filter, or 0 if it is empty
+ULONG
+ReceiverQueryVlanId(
+    IN  PRECEIVER   Receiver
+    )
+{
+    ULONG           Index;
+
+    for (Index = 0; Index < ARRAYSIZE(Receiver->VlanFilter.Bitmap); Index++) {
+        ULONG   Bitmap;
+        ULONG   Bit;
+
+        Bitmap = Receiver->VlanFilter.Bitmap[Index];
+        if (Bitmap == 0)
+            continue;
+
+        for (Bit = 0; (Bitmap & (1ul << Bit)) == 0; Bit++)
+            ;
+
+        return (Index * 32) + Bit;
+    }
+
+    return 0;
+}
+
+// Replace the multicast list held for filtering in software. Must be
+// called at PASSIVE_LEVEL.
+NDIS_STATUS
+ReceiverSetMulticastAddresses(
+    IN  PRECEIVER                   Receiver,
+    IN  PETHERNET_ADDRESS           Address OPTIONAL,
+    IN  ULONG                       Count
+    )
+{
+    PRECEIVER_MULTICAST_FILTER      Filter;
+    PRECEIVER_MULTICAST_FILTER      Old;
+    ULONG                           Size;
+    ULONG                           Shift;
+    ULONG                           Index;
+    NDIS_STATUS                     ndisStatus;
+
+    ASSERT(IMPLY(Count != 0, Address != NULL));
+
+    Filter = NULL;
+    if (Count == 0)
+        goto done;
+
+    // At most half full
+    Size = 64;
+    Shift = 64 - 6;
+    while (Size < 2 * Count) {
+        Size <<= 1;
+        --Shift;
+    }
+
+    Filter = ExAllocatePoolWithTag(NonPagedPool,
+                                   FIELD_OFFSET(RECEIVER_MULTICAST_FILTER, Table) +
+                                   (sizeof (ULONG64) * Size),
+                                   ' TEN');
+
+    ndisStatus = NDIS_STATUS_RESOURCES;
+    if (Filter == NULL)
+        goto fail1;
+
+    RtlZeroMemory(Filter,
+                  FIELD_OFFSET(RECEIVER_MULTICAST_FILTER, Table) +
+                  (sizeof (ULONG64) * Size));
+
+    Filter->Size = Size;
+    Filter->Shift = Shift;
+
+    for (Index = 0; Index < Count; Index++) {
+        ULONG64 Key;
+        ULONG   Slot;
+
+        ndisStatus = NDIS_STATUS_INVALID_DATA;
+        if (GET_ETHERNET_ADDRESS_TYPE(&Address[Index]) != ETHERNET_ADDRESS_MULTICAST)
+            goto fail2;
+
+        Key = __ReceiverMulticastKey(&Address[Index]);
+
+        for (Slot = __ReceiverMulticastHash(Filter, Key);
+             Filter->Table[Slot] != 0 && Filter->Table[Slot] != Key;
+             Slot = (Slot + 1) & (Size - 1))
+            ;
+
+        if (Filter->Table[Slot] == 0) {
+            Filter->Table[Slot] = Key;
+            Filter->Count++;
+        }
+    }
+
+done:
+    Old = InterlockedExchangePointer((PVOID *)&Receiver->MulticastFilter, Filter);
+
+    if (Old != NULL) {
+        // Wait for any receive that may still be looking at it
+        KeFlushQueuedDpcs();
+        ExFreePool(Old);
+    }
+
+    Trace("%u address(es)\n", (Filter != NULL) ? Filter->Count : 0);
+
+    return NDIS_STATUS_SUCCESS;
+
+fail2:
+    Error("fail2\n");
+
+    ExFreePool(Filter);
+
+fail1:
+    Error("fail1 (%08x)\n", ndisStatus);
+
+    return ndisStatus;
+}
+
+// As VIF(QueryMulticastAddresses): if Address is NULL or too small, only
+// the number of addresses is returned in Count.
+VOID
+ReceiverQueryMulticastAddresses(
+    IN      PRECEIVER                   Receiver,
+    OUT     PETHERNET_ADDRESS           Address OPTIONAL,
+    IN OUT  PULONG                      Count
+    )
+{
+    PRECEIVER_MULTICAST_FILTER          Filter;
+    ULONG                               Index;
+    ULONG                               Slot;
+
+    // Only changed by OID requests, which NDIS serializes with this one
+    Filter = Receiver->MulticastFilter;
+
+    if (Filter == NULL) {
+        *Count = 0;
+        return;
+    }
+
+    if (Address == NULL || *Count < Filter->Count) {
+        *Count = Filter->Count;
+        return;
+    }
+
+    Index = 0;
+    for (Slot = 0; Slot < Filter->Size; Slot++) {
+        ULONG64 Key;
+
+        Key = Filter->Table[Slot];
+        if (Key == 0)
+            continue;
+
+        Address[Index].Byte[0] = (UCHAR)(Key >> 40);
+        Address[Index].Byte[1] = (UCHAR)(Key >> 32);
+        Address[Index].Byte[2] = (UCHAR)(Key >> 24);
+        Address[Index].Byte[3] = (UCHAR)(Key >> 16);
+        Address[Index].Byte[4] = (UCHAR)(Key >> 8);
+        Address[Index].Byte[5] = (UCHAR)Key;
+        Index++;
+    }
+    ASSERT3U(Index, ==, Filter->Count);
+
+    *Count = Index;
+}
+
+// While enabled, multicast frames whose group is not in the list set by
+// ReceiverSetMulticastAddresses() are dropped.
+VOID
+ReceiverEnableMulticastFilter(
+    IN  PRECEIVER   Receiver,
+    IN  BOOLEAN     Enable
+    )
+{
+    if (Receiver->MulticastFilterEnabled == Enable)
+        return;
+
+    Receiver->MulticastFilterEnabled = Enable;
+    KeMemoryBarrier();
+
+    Info("%s\n", (Enable) ? "ENABLED" : "DISABLED");
+}
+
+//
+// Shrink the NET_BUFFER_LIST cache after a burst. The smallest number of
+// full magazines the depot held over the last interval were never needed
+// in that time so free them, but keep what ReceiverEnable() pre-warmed.
+// If non-paged pool is low free everything in the depot straight away.
+// Magazines loaded on a CPU are bounded at two per CPU and are left alone.
+//
+VOID
+ReceiverTrim(
+    IN  PRECEIVER       Receiver
+    )
+{
+    LIST_ENTRY          List;
+    BOOLEAN             LowMemory;
+    ULONG               HighWater;
+    ULONG               Excess;
+    ULONG               Count;
+    KIRQL               Irql;
+
+    if (Receiver->Processor == NULL)
+        return;
+
+    LowMemory = (Receiver->LowMemoryEvent != NULL &&
+                 KeReadStateEvent(Receiver->LowMemoryEvent) != 0);
+
+    if (!LowMemory && ++Receiver->TrimTicks < RECEIVER_TRIM_INTERVAL)
+        return;
+
+    Receiver->TrimTicks = 0;
+
+    HighWater = (LowMemory) ?
+                0 :
+                (Receiver->PrewarmTarget + RECEIVER_MAGAZINE_SIZE - 1) / RECEIVER_MAGAZINE_SIZE;
+
+    InitializeListHead(&List);
+
+    KeAcquireSpinLock(&Receiver->DepotLock, &Irql);
+
+    Excess = (LowMemory) ? Receiver->FullDepotCount : Receiver->FullDepotMinimum;
+    if (Receiver->FullDepotCount - Excess < HighWater)
+        Excess = (Receiver->FullDepotCount > HighWater) ?
+                 Receiver->FullDepotCount - HighWater :
+                 0;
+
+    // Most recently returned magazines are at the tail; the head is
+    // reused first and so is the warmest.
+    while (Excess-- != 0) {
+        ASSERT(!IsListEmpty(&Receiver->FullDepot));
+        InsertTailList(&List, RemoveTailList(&Receiver->FullDepot));
+        --Receiver->FullDepotCount;
+    }
+
+    Receiver->FullDepotMinimum = Receiver->FullDepotCount;
+
+    // Empty magazines are cheap to re-allocate
+    while (!IsListEmpty(&Receiver->EmptyDepot))
+        InsertTailList(&List, RemoveHeadList(&Receiver->EmptyDepot));
+
+    KeReleaseSpinLock(&Receiver->DepotLock, Irql);
+
+    Count = ReceiverFreeMagazines(&List);
+    Receiver->Trimmed += Count;
+
+    if (LowMemory)
+        Receiver->LowMemory++;
+
+    if (Count != 0)
+        Trace("freed %u NET_BUFFER_LISTs%s\n",
+              Count,
+              (LowMemory) ? " (low memory)" : "");
+}
+
+VOID
+ReceiverQueryStatistics(
+    IN  PRECEIVER               Receiver,
+    OUT PRECEIVER_STATISTICS    Statistics
+    )
+{
+    ULONG                       Index;
+    ULONG                       Bucket;
+
+    RtlZeroMemory(Statistics, sizeof (RECEIVER_STATISTICS));
+
+    Statistics->RingSize = Receiver->RingSize;
+    Statistics->InNDIS = Receiver->InNDIS;
+    Statistics->InNDISMax = Receiver->InNDISMax;
+    Statistics->InNDISLimit = Receiver->InNDISLimit;
+    Statistics->ReturnRate = Receiver->ReturnRate;
+    Statistics->ReturnLatency = Receiver->ReturnLatency;
+    Statistics->CacheSize = Receiver->FullDepotCount * RECEIVER_MAGAZINE_SIZE;
+    Statistics->Trimmed = Receiver->Trimmed;
+    Statistics->LowMemory = Receiver->LowMemory;
+
+    for (Index = 0; Index < Receiver->ProcessorCount; Index++) {
+        PRECEIVER_PROCESSOR Processor;
+
+        Processor = &Receiver->Processor[Index];
+
+        Statistics->LowResources += __ReceiverReadCounter(&Processor->LowResources);
+        Statistics->CacheHit += __ReceiverReadCounter(&Processor->CacheHit);
+        Statistics->CacheMiss += __ReceiverReadCounter(&Processor->CacheMiss);
+        Statistics->Released += __ReceiverReadCounter(&Processor->Released);
+        Statistics->Steered += __ReceiverReadCounter(&Processor->Steered);
+        Statistics->Coalesced += __ReceiverReadCounter(&Processor->Coalesced);
+        Statistics->CoalescedSegments += __ReceiverReadCounter(&Processor->CoalescedSegments);
+        Statistics->Copied += __ReceiverReadCounter(&Processor->Copied);
+        Statistics->Bounced += __ReceiverReadCounter(&Processor->Bounced);
+        Statistics->VlanAccepted += __ReceiverReadCounter(&Processor->VlanAccepted);
+        Statistics->VlanFiltered += __ReceiverReadCounter(&Processor->VlanFiltered);
+        Statistics->VlanInvalid += __ReceiverReadCounter(&Processor->VlanInvalid);
+        Statistics->MulticastFiltered += __ReceiverReadCounter(&Processor->MulticastFiltered);
+        Statistics->BroadcastSuppressed += __ReceiverReadCounter(&Processor->BroadcastSuppressed);
+        Statistics->MulticastSuppressed += __ReceiverReadCounter(&Processor->MulticastSuppressed);
+        Statistics->Indications += __ReceiverReadCounter(&Processor->Indications);
+        Statistics->SingleEtherType += __ReceiverReadCounter(&Processor->SingleEtherType);
+        Statistics->SingleVlan += __ReceiverReadCounter(&Processor->SingleVlan);
+        Statistics->PerfectFiltered += __ReceiverReadCounter(&Processor->PerfectFiltered);
+        Statistics->Deferred += __ReceiverReadCounter(&Processor->Deferred);
+        Statistics->ChecksumChecked += __ReceiverReadCounter(&Processor->ChecksumChecked);
+        Statistics->ChecksumFailed += __ReceiverReadCounter(&Processor->ChecksumFailed);
+
+        for (Bucket = 0; Bucket < RECEIVER_TIME_HISTOGRAM_SIZE; Bucket++)
+            Statistics->ProcessingTime[Bucket] +=
+                __ReceiverReadCounter(&Processor->ProcessingTime[Bucket]);
+    }
+}
+
+VOID
+ReceiverDisable(
+    IN  PRECEIVER   Receiver
+    )
+{
+    // Finish off anything deferred by ReceiverReceivePackets(). The
+    // backlog DPC re-queues itself until the backlog is empty.
+    while (Receiver->BacklogActive)
+        KeFlushQueuedDpcs();
+
+    // Make sure nothing steered to another CPU is still waiting to be
+    // indicated once the backend has stopped.
+    KeFlushQueuedDpcs();
+
+    // Give back what ReceiverEnable() pre-warmed; it will be refilled on
+    // restart.
+    ReceiverTrimDepot(Receiver);
+}
+
+ULONG
+ReceiverQueryRssQueueCount(
+    IN  PRECEIVER   Receiver
+    )
+{
+    return Receiver->ProcessorCount;
+}
+
+NDIS_STATUS
+ReceiverSetRssParameters(
+    IN  PRECEIVER                       Receiver,
+    IN  PNDIS_RECEIVE_SCALE_PARAMETERS  Parameters,
+    IN  ULONG                           Length
+    )
+{
+    RECEIVER_RSS                        Rss;
+    KIRQL                               Irql;
+    NDIS_STATUS                         ndisStatus;
+
+    ndisStatus = NDIS_STATUS_INVALID_LENGTH;
+    if (Length < NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_1)
+        goto fail1;
+
+    ndisStatus = NDIS_STATUS_INVALID_PARAMETER;
+    if (Parameters->Header.Type != NDIS_OBJECT_TYPE_RSS_PARAMETERS ||
+        Parameters->Header.Revision < NDIS_RECEIVE_SCALE_PARAMETERS_REVISION_1 ||
+        Parameters->Header.Size < NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_1)
+        goto fail2;
+
+    KeAcquireSpinLock(&Receiver->RssLock, &Irql);
+    Rss = Receiver->Rss;
+    KeReleaseSpinLock(&Receiver->RssLock, Irql);
+
+    if (Parameters->Flags & NDIS_RSS_PARAM_FLAG_DISABLE_RSS) {
+        Rss.Enabled = FALSE;
+        goto done;
+    }
+
+    if (!(Parameters->Flags & NDIS_RSS_PARAM_FLAG_BASE_CPU_UNCHANGED))
+        Rss.BaseCpu = Parameters->BaseCpuNumber;
+
+    if (!(Parameters->Flags & NDIS_RSS_PARAM_FLAG_HASH_INFO_UNCHANGED)) {
+        ULONG   Function;
+
+        Function = NDIS_RSS_HASH_FUNC_FROM_HASH_INFO(Parameters->HashInformation);
+        Rss.HashTypes = NDIS_RSS_HASH_TYPE_FROM_HASH_INFO(Parameters->HashInformation);
+
+        if (Function != 0 && Function != NdisHashFunctionToeplitz)
+            goto fail3;
+
+        if (Function == 0)
+            Rss.HashTypes = 0;
+    }
+
+    if (!(Parameters->Flags & NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED)) {
+        ULONG   Size = Parameters->IndirectionTableSize;
+
+        // The table is indexed by masking the hash so must be a power of 2
+        if (Size == 0 ||
+            Size > sizeof (Rss.Table) ||
+            (Size & (Size - 1)) != 0 ||
+            Parameters->IndirectionTableOffset > Length ||
+            Size > Length - Parameters->IndirectionTableOffset)
+            goto fail4;
+
+        RtlCopyMemory(Rss.Table,
+                      (PUCHAR)Parameters + Parameters->IndirectionTableOffset,
+                      Size);
+        Rss.TableSize = Size;
+    }
+
+    if (!(Parameters->Flags & NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED)) {
+        ULONG   Size = Parameters->HashSecretKeySize;
+
+        if (Size == 0 ||
+            Size > sizeof (Rss.Key) ||
+            Parameters->HashSecretKeyOffset > Length ||
+            Size > Length - Parameters->HashSecretKeyOffset)
+            goto fail5;
+
+        RtlCopyMemory(Rss.Key,
+                      (PUCHAR)Parameters + Parameters->HashSecretKeyOffset,
+                      Size);
+        Rss.KeySize = Size;
+
+        if (Receiver->ToeplitzKey == NULL) {
+            Receiver->ToeplitzKey = ExAllocatePoolWithTag(NonPagedPool,
+                                                          2 * sizeof (TOEPLITZ_KEY),
+                                                          ' TEN');
+
+            ndisStatus = NDIS_STATUS_RESOURCES;
+            if (Receiver->ToeplitzKey == NULL)
+                goto fail6;
+        }
+
+        // Build into whichever key the receive path is not using
+        Rss.ToeplitzKey = (Rss.ToeplitzKey == &Receiver->ToeplitzKey[0]) ?
+                          &Receiver->ToeplitzKey[1] :
+                          &Receiver->ToeplitzKey[0];
+
+        ToeplitzSetKey(Rss.ToeplitzKey, Rss.Key, Rss.KeySize);
+    }
+
+    Rss.Enabled = (Rss.HashTypes != 0 &&
+                   Rss.TableSize != 0 &&
+                   Rss.KeySize != 0);
+
+done:
+    KeAcquireSpinLock(&Receiver->RssLock, &Irql);
+    Receiver->Rss = Rss;
+    KeReleaseSpinLock(&Receiver->RssLock, Irql);
+
+    // Receive snapshots are only held for the duration of a DPC so once
+    // queued DPCs have drained the other key is free to be rebuilt.
+    KeFlushQueuedDpcs();
+
+    Info("RSS %s (BaseCpu = %u HashTypes = %08x TableSize = %u KeySize = %u)\n",
+         (Rss.Enabled) ? "ENABLED" : "DISABLED",
+         Rss.BaseCpu,
+         Rss.HashTypes,
+         Rss.TableSize,
+         Rss.KeySize);
+
+    return NDIS_STATUS_SUCCESS;
+
+fail6:
+    Error("fail6\n");
+
+fail5:
+    Error("fail5\n");
+
+fail4:
+    Error("fail4\n");
+
+fail3:
+    Error("fail3\n");
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", ndisStatus);
+
+    return ndisStatus;
+}
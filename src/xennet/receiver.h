@@ -31,13 +31,256 @@
 
 #pragma once
 
+#define RECEIVER_MAGAZINE_SIZE  64
+
+typedef struct _RECEIVER_MAGAZINE {
+    LIST_ENTRY          ListEntry;
+    ULONG               Count;
+    PNET_BUFFER_LIST    NetBufferList[RECEIVER_MAGAZINE_SIZE];
+} RECEIVER_MAGAZINE, *PRECEIVER_MAGAZINE;
+
+// Packets steered to a CPU by RSS, indicated from that CPU's DPC. Written
+// by whichever CPU is processing the backend's receive callback.
+typedef struct DECLSPEC_CACHEALIGN _RECEIVER_QUEUE {
+    KSPIN_LOCK          Lock;
+    PNET_BUFFER_LIST    Head;
+    PNET_BUFFER_LIST    *Tail;
+    ULONG               Count;
+    KDPC                Dpc;
+} RECEIVER_QUEUE, *PRECEIVER_QUEUE;
+
+#define RECEIVER_TIME_HISTOGRAM_SIZE    8
+
+// Per-CPU receive state, one block per CPU in its own cache line(s).
+//
+// The magazines and the counters are only written at DISPATCH_LEVEL by
+// the owning CPU, so updating them needs no lock. ReceiverQueryStatistics
+// and ReceiverUpdateWatermark read every CPU's counters without a lock
+// through __ReceiverReadCounter(), which cannot return a torn value on
+// x86; the totals may still lag updates in progress on other CPUs.
+//
+// Queue is the exception. Any CPU handling the backend's receive callback
+// may append to it, so its list and count are only touched under
+// Queue->Lock, and its DPC is targeted at the owning CPU.
+typedef struct DECLSPEC_CACHEALIGN _RECEIVER_PROCESSOR {
+    PRECEIVER_MAGAZINE  Loaded;
+    PRECEIVER_MAGAZINE  Previous;
+    ULONG64             CacheHit;
+    ULONG64             CacheMiss;
+    ULONG64             Released;
+    ULONG64             LowResources;
+    ULONG64             Returned;
+    ULONG64             ReturnLatency;
+    ULONG64             Steered;
+    ULONG64             Coalesced;
+    ULONG64             CoalescedSegments;
+    ULONG64             Copied;
+    ULONG64             Bounced;
+    ULONG64             VlanAccepted;
+    ULONG64             VlanFiltered;
+    ULONG64             VlanInvalid;
+    ULONG64             MulticastFiltered;
+    ULONG64             BroadcastSuppressed;
+    ULONG64             MulticastSuppressed;
+    ULONG64             Indications;
+    ULONG64             SingleEtherType;
+    ULONG64             SingleVlan;
+    ULONG64             PerfectFiltered;
+    ULONG64             Deferred;
+    ULONG64             ProcessingTime[RECEIVER_TIME_HISTOGRAM_SIZE];
+    ULONG64             ChecksumChecked;
+    ULONG64             ChecksumFailed;
+    RECEIVER_QUEUE      Queue;
+} RECEIVER_PROCESSOR, *PRECEIVER_PROCESSOR;
+
+// Frames are copied into a slab buffer, so that the backend's packet can
+// be returned straight away, if they are small (copy-break) or if the
+// in-flight limit has been reached (bounce). Each buffer has its own MDL
+// and NET_BUFFER_LIST.
+typedef struct _RECEIVER_SLAB_BUFFER {
+    SLIST_ENTRY         ListEntry;
+    PNET_BUFFER_LIST    NetBufferList;
+    PMDL                Mdl;
+} RECEIVER_SLAB_BUFFER, *PRECEIVER_SLAB_BUFFER;
+
+typedef struct _RECEIVER_SLAB {
+    SLIST_HEADER            FreeList;
+    NDIS_HANDLE             NetBufferListPool;
+    PRECEIVER_SLAB_BUFFER   Buffer;
+    PUCHAR                  Data;
+    ULONG                   Size;
+    ULONG                   Count;
+} RECEIVER_SLAB, *PRECEIVER_SLAB;
+
+#define RECEIVER_COPY_BUFFER_SIZE   256
+#define RECEIVER_COPY_BUFFER_COUNT  512
+
+#define RECEIVER_VLAN_ID_COUNT      4096
+
+// Set and returned by OID_XENNET_VLAN_FILTER. Bit n of the bitmap is set
+// if frames tagged with VLAN ID n are to be indicated. VLAN ID 0 (priority
+// tagged) is always accepted and 0xFFF is reserved so their bits are
+// ignored.
+typedef struct _RECEIVER_VLAN_FILTER {
+    ULONG   Bitmap[RECEIVER_VLAN_ID_COUNT / 32];
+} RECEIVER_VLAN_FILTER, *PRECEIVER_VLAN_FILTER;
+
+// Token bucket limiting the rate at which frames of one address class
+// are indicated. Credit is in performance counter ticks times frames per
+// second, so refilling needs no division and one frame costs the counter
+// frequency.
+typedef struct _RECEIVER_STORM_BUCKET {
+    ULONG           Rate;       // Frames per second, 0 if unlimited
+    ULONG64         Cost;
+    ULONG64         Capacity;
+    ULONG64         Credit;
+    LARGE_INTEGER   Last;
+} RECEIVER_STORM_BUCKET, *PRECEIVER_STORM_BUCKET;
+
+// Multicast list too long for the backend to filter. Addresses are packed
+// into 48 bits and held in an open addressed table at most half full; a
+// multicast address always has the group bit set so no entry is ever 0.
+typedef struct _RECEIVER_MULTICAST_FILTER {
+    ULONG   Count;
+    ULONG   Size;
+    ULONG   Shift;
+    ULONG64 Table[1];
+} RECEIVER_MULTICAST_FILTER, *PRECEIVER_MULTICAST_FILTER;
+
+typedef struct _RECEIVER_RSS {
+    BOOLEAN         Enabled;
+    ULONG           HashTypes;
+    ULONG           BaseCpu;
+    UCHAR           Key[NDIS_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION_1];
+    ULONG           KeySize;
+    UCHAR           Table[NDIS_RSS_INDIRECTION_TABLE_MAX_SIZE_REVISION_1];
+    ULONG           TableSize;
+    PTOEPLITZ_KEY   ToeplitzKey;
+} RECEIVER_RSS, *PRECEIVER_RSS;
+
+// Returned by OID_XENNET_RECEIVER_STATISTICS. ReturnRate is in packets
+// per second and ReturnLatency in microseconds, both measured over the
+// last watermark update interval. Coalesced counts indications that carry
+// more than one TCP segment, whether merged by the backend or by the
+// receiver, and CoalescedSegments the segments they carry. Copied counts
+// frames indicated from the copy-break slab and Bounced those indicated
+// from the bounce slab because the in-flight limit had been reached;
+// LowResources counts those that had to be indicated with
+// NDIS_RECEIVE_FLAGS_RESOURCES because the bounce slab was exhausted.
+// CacheSize is the number of NET_BUFFER_LISTs in the depot (those loaded
+// on a CPU are not included), Trimmed the number freed by ReceiverTrim()
+// and LowMemory the number of times it found non-paged pool low.
+// VlanAccepted counts frames indicated with a VLAN ID; VlanFiltered those
+// dropped because their VLAN is not in the filter and VlanInvalid those
+// dropped because they carry the reserved VLAN ID. MulticastFiltered
+// counts frames dropped because their group is not in a multicast list
+// too long for the backend. BroadcastSuppressed and MulticastSuppressed
+// count frames dropped because they exceeded the configured rate.
+// Indications counts calls to NdisMIndicateReceiveNetBufferLists() and
+// SingleEtherType, SingleVlan and PerfectFiltered those that carried the
+// corresponding NDIS_RECEIVE_FLAGS_ hint. Deferred counts the times the
+// receive budget ran out with packets left over, and ProcessingTime is a
+// histogram of the time taken by each pass over the packets: bucket 0 is
+// under 16us, bucket n under 16us << n, and the last is everything above.
+// ChecksumChecked counts checksums the backend left unchecked that were
+// validated by the receiver and ChecksumFailed those found to be wrong.
+typedef struct _RECEIVER_STATISTICS {
+    ULONG   RingSize;
+    LONG    InNDIS;
+    LONG    InNDISMax;
+    LONG    InNDISLimit;
+    ULONG   ReturnRate;
+    ULONG   ReturnLatency;
+    ULONG64 LowResources;
+    ULONG64 CacheHit;
+    ULONG64 CacheMiss;
+    ULONG64 Released;
+    ULONG64 Steered;
+    ULONG64 Coalesced;
+    ULONG64 CoalescedSegments;
+    ULONG64 Copied;
+    ULONG64 Bounced;
+    ULONG   CacheSize;
+    ULONG64 Trimmed;
+    ULONG64 LowMemory;
+    ULONG64 VlanAccepted;
+    ULONG64 VlanFiltered;
+    ULONG64 VlanInvalid;
+    ULONG64 MulticastFiltered;
+    ULONG64 BroadcastSuppressed;
+    ULONG64 MulticastSuppressed;
+    ULONG64 Indications;
+    ULONG64 SingleEtherType;
+    ULONG64 SingleVlan;
+    ULONG64 PerfectFiltered;
+    ULONG64 Deferred;
+    ULONG64 ProcessingTime[RECEIVER_TIME_HISTOGRAM_SIZE];
+    ULONG64 ChecksumChecked;
+    ULONG64 ChecksumFailed;
+} RECEIVER_STATISTICS, *PRECEIVER_STATISTICS;
+
 typedef struct _RECEIVER {
     NDIS_HANDLE             NetBufferListPool;
-    PNET_BUFFER_LIST        PutList;
-    PNET_BUFFER_LIST        GetList[MAXIMUM_PROCESSORS];
+    PRECEIVER_PROCESSOR     Processor;
+    ULONG                   ProcessorCount;
+    KSPIN_LOCK              DepotLock;
+    LIST_ENTRY              FullDepot;
+    LIST_ENTRY              EmptyDepot;
+    ULONG                   FullDepotCount;
+    ULONG                   FullDepotMinimum;   // Since the last trim
+
+    // Cache trimming, driven by ReceiverTrim()
+    ULONG                   PrewarmTarget;
+    ULONG                   TrimTicks;
+    ULONG64                 Trimmed;
+    ULONG64                 LowMemory;
+    PKEVENT                 LowMemoryEvent;
+    HANDLE                  LowMemoryHandle;
+
+    XENVIF_OFFLOAD_OPTIONS  OffloadOptions;
+    RECEIVER_VLAN_FILTER    VlanFilter;
+    PRECEIVER_MULTICAST_FILTER  MulticastFilter;
+    BOOLEAN                 MulticastFilterEnabled;
+
+    // Storm control, indexed by ETHERNET_ADDRESS_TYPE
+    KSPIN_LOCK              StormLock;
+    RECEIVER_STORM_BUCKET   Storm[ETHERNET_ADDRESS_TYPE_COUNT];
+    BOOLEAN                 StormControl;
+
+    // Receive budget; packets beyond it are deferred to BacklogDpc
+    ULONG                   Budget;         // Packets, 0 if unlimited
+    ULONG64                 BudgetTime;     // Counter ticks, 0 if unlimited
+    ULONG64                 Frequency;
+    KSPIN_LOCK              BacklogLock;
+    LIST_ENTRY              Backlog;
+    BOOLEAN                 BacklogActive;
+    KDPC                    BacklogDpc;
+
+    KSPIN_LOCK              RssLock;
+    RECEIVER_RSS            Rss;
+    PTOEPLITZ_KEY           ToeplitzKey;    // Two, alternately used by Rss
+
+    // Slabs, allocated by ReceiverEnable()
+    ULONG                   CopyBreak;
+    RECEIVER_SLAB           Copy;
+    RECEIVER_SLAB           Bounce;
+
+    // In-flight watermark, recalculated by ReceiverUpdateWatermark()
+    LONG                    InNDISLimit;
+    ULONG                   RingSize;
+    LARGE_INTEGER           LastUpdate;
+    ULONG64                 LastReturned;
+    ULONG64                 LastReturnLatency;
+    ULONG64                 LastLowResources;
+    ULONG64                 LastBounced;
+    ULONG                   ReturnRate;
+    ULONG                   ReturnLatency;
+
+    // Written by every CPU that indicates or returns packets so keep
+    // them away from the read-mostly fields above.
+    DECLSPEC_CACHEALIGN
     LONG                    InNDIS;
     LONG                    InNDISMax;
-    XENVIF_OFFLOAD_OPTIONS  OffloadOptions;
 } RECEIVER, *PRECEIVER;
 
 VOID
@@ -67,6 +310,93 @@ ReceiverReturnNetBufferLists (
     IN  ULONG               ReturnFlags
     );
 
+VOID
+ReceiverReceivePackets(
+    IN  PRECEIVER   Receiver,
+    IN  PLIST_ENTRY List
+    );
+
+VOID
+ReceiverEnable(
+    IN  PRECEIVER   Receiver
+    );
+
+VOID
+ReceiverDisable(
+    IN  PRECEIVER   Receiver
+    );
+
+ULONG
+ReceiverQueryRssQueueCount(
+    IN  PRECEIVER   Receiver
+    );
+
+NDIS_STATUS
+ReceiverSetRssParameters(
+    IN  PRECEIVER                       Receiver,
+    IN  PNDIS_RECEIVE_SCALE_PARAMETERS  Parameters,
+    IN  ULONG                           Length
+    );
+
+VOID
+ReceiverUpdateWatermark(
+    IN  PRECEIVER   Receiver
+    );
+
+VOID
+ReceiverSetVlanFilter(
+    IN  PRECEIVER               Receiver,
+    IN  PRECEIVER_VLAN_FILTER   Filter
+    );
+
+VOID
+ReceiverQueryVlanFilter(
+    IN  PRECEIVER               Receiver,
+    OUT PRECEIVER_VLAN_FILTER   Filter
+    );
+
+NDIS_STATUS
+ReceiverSetVlanId(
+    IN  PRECEIVER   Receiver,
+    IN  ULONG       VlanId
+    );
+
+ULONG
+ReceiverQueryVlanId(
+    IN  PRECEIVER   Receiver
+    );
+
+NDIS_STATUS
+ReceiverSetMulticastAddresses(
+    IN  PRECEIVER           Receiver,
+    IN  PETHERNET_ADDRESS   Address OPTIONAL,
+    IN  ULONG               Count
+    );
+
+VOID
+ReceiverQueryMulticastAddresses(
+    IN      PRECEIVER           Receiver,
+    OUT     PETHERNET_ADDRESS   Address OPTIONAL,
+    IN OUT  PULONG              Count
+    );
+
+VOID
+ReceiverEnableMulticastFilter(
+    IN  PRECEIVER   Receiver,
+    IN  BOOLEAN     Enable
+    );
+
+VOID
+ReceiverTrim(
+    IN  PRECEIVER   Receiver
+    );
+
+VOID
+ReceiverQueryStatistics(
+    IN  PRECEIVER               Receiver,
+    OUT PRECEIVER_STATISTICS    Statistics
+    );
+
 VOID
 ReceiverWaitForPacketReturn(
     IN  PRECEIVER   Receiver,
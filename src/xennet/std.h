@@ -42,4 +42,12 @@
 #include <ndis.h>
 #include <ntstrsafe.h>
 
+// Marks a function using instructions beyond the baseline the compiler
+// targets. MSVC emits any intrinsic anywhere so needs no marking; the
+// user-mode test build defines this so gcc builds only these functions
+// for the extension, keeping it out of the code that runs without it.
+#if !defined(DECLSPEC_TARGET)
+#define DECLSPEC_TARGET(_Isa)
+#endif
+
 extern PULONG InitSafeBootMode;
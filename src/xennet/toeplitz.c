@@ -0,0 +1,267 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#if defined(_M_AMD64)
+#include <intrin.h>
+#include <wmmintrin.h>
+#endif
+
+#pragma warning(disable:4711)
+
+ULONG
+ToeplitzHash(
+    IN  const UCHAR *Key,
+    IN  ULONG       KeyLength,
+    IN  const UCHAR *Input,
+    IN  ULONG       Length
+    )
+{
+    ULONG           Result;
+    ULONG           Window;
+    ULONG           KeyIndex;
+    ULONG           Index;
+
+    // The window holds the 32 key bits aligned with the current input bit
+    Window = 0;
+    for (KeyIndex = 0; KeyIndex < sizeof (ULONG); KeyIndex++) {
+        Window <<= 8;
+        if (KeyIndex < KeyLength)
+            Window |= Key[KeyIndex];
+    }
+
+    Result = 0;
+    for (Index = 0; Index < Length; Index++) {
+        UCHAR   Next;
+        LONG    Bit;
+
+        Next = (KeyIndex < KeyLength) ? Key[KeyIndex] : 0;
+        KeyIndex++;
+
+        for (Bit = 7; Bit >= 0; --Bit) {
+            if (Input[Index] & (1 << Bit))
+                Result ^= Window;
+
+            Window = (Window << 1) | ((Next >> Bit) & 1);
+        }
+    }
+
+    return Result;
+}
+
+// Returns the 64 key bits starting at byte Offset, zero-filled past the
+// end of the key.
+static FORCEINLINE ULONG64
+__ToeplitzKeyBits(
+    IN  const UCHAR *Key,
+    IN  ULONG       KeyLength,
+    IN  ULONG       Offset
+    )
+{
+    ULONG64         Bits;
+    ULONG           Index;
+
+    Bits = 0;
+    for (Index = Offset; Index < Offset + sizeof (ULONG64); Index++) {
+        Bits <<= 8;
+        if (Index < KeyLength)
+            Bits |= Key[Index];
+    }
+
+    return Bits;
+}
+
+static BOOLEAN
+__ToeplitzHaveClmul(
+    VOID
+    )
+{
+#if defined(_M_AMD64)
+    int     Registers[4];
+
+    // CPUID.01H:ECX.PCLMULQDQ[bit 1]. XMM state needs no saving in x64
+    // kernel code so no other feature needs checking.
+    __cpuid(Registers, 1);
+
+    return (Registers[2] & (1 << 1)) ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+VOID
+ToeplitzSetKey(
+    OUT PTOEPLITZ_KEY   ToeplitzKey,
+    IN  const UCHAR     *Key,
+    IN  ULONG           KeyLength
+    )
+{
+    ULONG               Index;
+
+    for (Index = 0; Index < TOEPLITZ_MAXIMUM_INPUT_LENGTH; Index++) {
+        ULONG64 Bits;
+        ULONG   Value;
+        LONG    Bit;
+
+        Bits = __ToeplitzKeyBits(Key, KeyLength, Index);
+
+        // Input bit 7 - Bit of this byte selects the 32 key bits
+        // starting Bit places into the window
+        for (Bit = 0; Bit < 8; Bit++)
+            ToeplitzKey->Table[Index][1 << (7 - Bit)] = (ULONG)(Bits >> (32 - Bit));
+
+        ToeplitzKey->Table[Index][0] = 0;
+
+        for (Value = 1; Value < 256; Value++) {
+            ULONG   Lowest = Value & (~Value + 1);
+
+            if (Value == Lowest)
+                continue;
+
+            ToeplitzKey->Table[Index][Value] = ToeplitzKey->Table[Index][Value & ~Lowest] ^
+                                               ToeplitzKey->Table[Index][Lowest];
+        }
+    }
+
+    for (Index = 0; Index < ARRAYSIZE(ToeplitzKey->Window); Index++) {
+        ULONG64 Bits;
+        ULONG64 Reversed;
+        ULONG   Bit;
+
+        Bits = __ToeplitzKeyBits(Key, KeyLength, Index * sizeof (ULONG));
+
+        Reversed = 0;
+        for (Bit = 0; Bit < 64; Bit++) {
+            Reversed = (Reversed << 1) | (Bits & 1);
+            Bits >>= 1;
+        }
+
+        ToeplitzKey->Window[Index] = Reversed;
+    }
+
+    ToeplitzKey->Clmul = __ToeplitzHaveClmul();
+}
+
+static FORCEINLINE ULONG
+__ToeplitzHashTable(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  const UCHAR     *Input,
+    IN  ULONG           Length
+    )
+{
+    ULONG               Result;
+    ULONG               Index;
+
+    Result = 0;
+    for (Index = 0; Index < Length; Index++)
+        Result ^= ToeplitzKey->Table[Index][Input[Index]];
+
+    return Result;
+}
+
+#if defined(_M_AMD64)
+static FORCEINLINE ULONG
+__ToeplitzReverse32(
+    IN  ULONG   Value
+    )
+{
+    Value = ((Value >> 1) & 0x55555555) | ((Value & 0x55555555) << 1);
+    Value = ((Value >> 2) & 0x33333333) | ((Value & 0x33333333) << 2);
+    Value = ((Value >> 4) & 0x0F0F0F0F) | ((Value & 0x0F0F0F0F) << 4);
+
+    return _byteswap_ulong(Value);
+}
+
+// With W the 64 key bits starting at the same offset as a 32-bit
+// big-endian chunk D of the input, stored bit-reversed, bits 31 to 62 of
+// the carry-less product W * D are the bit-reversed hash contribution of
+// the chunk. Reversal is linear so it is undone once at the end.
+static FORCEINLINE DECLSPEC_TARGET("pclmul") ULONG
+__ToeplitzHashClmul(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  const UCHAR     *Input,
+    IN  ULONG           Length
+    )
+{
+    ULONG               Result;
+    ULONG               Index;
+
+    Result = 0;
+    for (Index = 0; Index < Length; Index += sizeof (ULONG)) {
+        ULONG   Data;
+        ULONG   Byte;
+        __m128i Product;
+
+        Data = 0;
+        for (Byte = Index; Byte < Index + sizeof (ULONG); Byte++) {
+            Data <<= 8;
+            if (Byte < Length)
+                Data |= Input[Byte];
+        }
+
+        Product = _mm_clmulepi64_si128(_mm_cvtsi64_si128((LONG64)ToeplitzKey->Window[Index / sizeof (ULONG)]),
+                                       _mm_cvtsi32_si128((int)Data),
+                                       0x00);
+
+        Result ^= (ULONG)((ULONG64)_mm_cvtsi128_si64(Product) >> 31);
+    }
+
+    return __ToeplitzReverse32(Result);
+}
+#endif
+
+VOID
+ToeplitzHashBatch(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  PTOEPLITZ_TUPLE Tuple,
+    IN  ULONG           Count,
+    OUT PULONG          Hash
+    )
+{
+    ULONG               Index;
+
+#if defined(_M_AMD64)
+    if (ToeplitzKey->Clmul) {
+        for (Index = 0; Index < Count; Index++) {
+            ASSERT3U(Tuple[Index].Length, <=, TOEPLITZ_MAXIMUM_INPUT_LENGTH);
+            Hash[Index] = __ToeplitzHashClmul(ToeplitzKey, Tuple[Index].Data, Tuple[Index].Length);
+        }
+
+        return;
+    }
+#endif
+
+    for (Index = 0; Index < Count; Index++) {
+        ASSERT3U(Tuple[Index].Length, <=, TOEPLITZ_MAXIMUM_INPUT_LENGTH);
+        Hash[Index] = __ToeplitzHashTable(ToeplitzKey, Tuple[Index].Data, Tuple[Index].Length);
+    }
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+// Longest RSS input: IPv6 source and destination addresses plus TCP ports
+#define TOEPLITZ_MAXIMUM_INPUT_LENGTH   36
+
+typedef struct _TOEPLITZ_TUPLE {
+    UCHAR   Data[TOEPLITZ_MAXIMUM_INPUT_LENGTH];
+    ULONG   Length;
+} TOEPLITZ_TUPLE, *PTOEPLITZ_TUPLE;
+
+// Per-key state built by ToeplitzSetKey(). Table[i][b] is the hash
+// contribution of byte value b at input offset i, so hashing an input
+// costs one lookup per byte. Window[i] holds the 64 key bits starting at
+// input offset 4 * i, bit-reversed, for the carry-less multiply path,
+// which is used in preference to the table when the CPU supports it.
+typedef struct _TOEPLITZ_KEY {
+    ULONG       Table[TOEPLITZ_MAXIMUM_INPUT_LENGTH][256];
+    ULONG64     Window[TOEPLITZ_MAXIMUM_INPUT_LENGTH / sizeof (ULONG)];
+    BOOLEAN     Clmul;
+} TOEPLITZ_KEY, *PTOEPLITZ_KEY;
+
+// Toeplitz hash as specified for NDIS Receive Side Scaling.
+// Key must be at least Length + 4 bytes long for the whole of Input to
+// contribute; any shortfall is treated as zero bits. This is the bitwise
+// reference; the receive path uses ToeplitzHashBatch().
+ULONG
+ToeplitzHash(
+    IN  const UCHAR *Key,
+    IN  ULONG       KeyLength,
+    IN  const UCHAR *Input,
+    IN  ULONG       Length
+    );
+
+VOID
+ToeplitzSetKey(
+    OUT PTOEPLITZ_KEY   ToeplitzKey,
+    IN  const UCHAR     *Key,
+    IN  ULONG           KeyLength
+    );
+
+// Hashes Count tuples, which must be no longer than
+// TOEPLITZ_MAXIMUM_INPUT_LENGTH, into Hash[0 .. Count - 1].
+VOID
+ToeplitzHashBatch(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  PTOEPLITZ_TUPLE Tuple,
+    IN  ULONG           Count,
+    OUT PULONG          Hash
+    );
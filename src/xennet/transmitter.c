@@ -33,15 +33,89 @@
 
 #pragma warning(disable:4711)
 
+// 802.1p priorities from video up are flushed without staging
+#define TRANSMITTER_URGENT_PRIORITY 5
+
+// Longest frame prefix examined for a flow hash: a tagged Ethernet header,
+// an IPv4 header with options and the TCP or UDP ports.
+#define TRANSMITTER_HASH_HEADER_LENGTH  (sizeof (ETHERNET_TAGGED_HEADER) + \
+                                         MAXIMUM_IPV4_HEADER_LENGTH +      \
+                                         sizeof (ULONG))
+
+// Held in the context area of each NET_BUFFER_LIST allocated from
+// SegmentPool. A segment's data is its own copy of the headers, described
+// by HeaderMdl, followed by its share of the payload in the original
+// pages: PayloadMdl if the share starts part way into an MDL, otherwise
+// the original MDL itself.
+typedef struct _TRANSMITTER_SEGMENT {
+    PMDL        PayloadMdl;
+    MDL         HeaderMdl;
+    PFN_NUMBER  HeaderPfn[2];   // Header may straddle a page boundary
+    UCHAR       Header[GSO_MAXIMUM_HEADER_LENGTH];
+} TRANSMITTER_SEGMENT, *PTRANSMITTER_SEGMENT;
+
+C_ASSERT(ADDRESS_AND_SIZE_TO_SPAN_PAGES(PAGE_SIZE - 1, GSO_MAXIMUM_HEADER_LENGTH) <=
+         RTL_FIELD_SIZE(TRANSMITTER_SEGMENT, HeaderPfn) / sizeof (PFN_NUMBER));
+
+// NET_BUFFER_LIST context requested for each segment
+#define TRANSMITTER_SEGMENT_CONTEXT_SIZE                                    \
+        ((sizeof (TRANSMITTER_SEGMENT) + MEMORY_ALLOCATION_ALIGNMENT - 1) & \
+         ~(MEMORY_ALLOCATION_ALIGNMENT - 1))
+
+C_ASSERT(TRANSMITTER_SEGMENT_CONTEXT_SIZE <= MAXUSHORT);
+
+static KDEFERRED_ROUTINE TransmitterFlushDpc;
+
 NDIS_STATUS
 TransmitterInitialize(
-    IN  PTRANSMITTER    Transmitter,
-    IN  PADAPTER        Adapter
+    IN  PTRANSMITTER                Transmitter,
+    IN  PADAPTER                    Adapter
     )
 {
+    NET_BUFFER_LIST_POOL_PARAMETERS poolParameters;
+    ULONG                           Index;
+
     Transmitter->Adapter = Adapter;
+    Transmitter->QueueCount = 1;
+
+    for (Index = 0; Index < TRANSMITTER_MAXIMUM_QUEUES; Index++) {
+        PTRANSMITTER_QUEUE  Queue = &Transmitter->Queue[Index];
+
+        Queue->Transmitter = Transmitter;
+        Queue->Index = Index;
+
+        KeInitializeSpinLock(&Queue->Lock);
+        Queue->StagedTail = &Queue->StagedHead;
+
+        // Queued from a send made at DISPATCH_LEVEL, this runs as soon as
+        // the CPU has finished whatever DPC or other DISPATCH_LEVEL work
+        // issued the send, so that work's sends go to the backend together.
+        KeInitializeDpc(&Queue->FlushDpc, TransmitterFlushDpc, Queue);
+    }
+
+    NdisZeroMemory(&poolParameters, sizeof(NET_BUFFER_LIST_POOL_PARAMETERS));
+    poolParameters.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
+    poolParameters.Header.Revision =
+        NET_BUFFER_LIST_POOL_PARAMETERS_REVISION_1;
+    poolParameters.Header.Size = sizeof(poolParameters);
+    poolParameters.ProtocolId = 0;
+    poolParameters.ContextSize = TRANSMITTER_SEGMENT_CONTEXT_SIZE;
+    poolParameters.fAllocateNetBuffer = TRUE;
+    poolParameters.PoolTag = ' TEN';
+
+    Transmitter->SegmentPool =
+        NdisAllocateNetBufferListPool(Adapter->NdisAdapterHandle,
+                                      &poolParameters);
+
+    if (Transmitter->SegmentPool == NULL)
+        goto fail1;
 
     return NDIS_STATUS_SUCCESS;
+
+fail1:
+    Error("fail1\n");
+
+    return NDIS_STATUS_RESOURCES;
 }
 
 VOID
@@ -49,7 +123,11 @@ TransmitterEnable(
     IN  PTRANSMITTER    Transmitter
     )
 {
+    PADAPTER                            Adapter = Transmitter->Adapter;
     XENVIF_TRANSMITTER_PACKET_METADATA  Metadata;
+    LARGE_INTEGER                       Frequency;
+    ULONG                               Count;
+    ULONG                               Index;
 
     Metadata.OffsetOffset = (LONG_PTR)&NET_BUFFER_CURRENT_MDL_OFFSET((PNET_BUFFER)NULL) -
                             (LONG_PTR)&NET_BUFFER_MINIPORT_RESERVED((PNET_BUFFER)NULL);
@@ -59,8 +137,56 @@ TransmitterEnable(
                          (LONG_PTR)&NET_BUFFER_MINIPORT_RESERVED((PNET_BUFFER)NULL);
 
     VIF(UpdatePacketMetadata,
-        Transmitter->Adapter->VifInterface,
+        Adapter->VifInterface,
         &Metadata);
+
+    (VOID) KeQueryPerformanceCounter(&Frequency);
+    Transmitter->Frequency = Frequency.QuadPart;
+
+    Transmitter->Batch = Adapter->Properties.tx_batch;
+    Transmitter->BatchTime = ((ULONG64)Adapter->Properties.tx_batch_time * Frequency.QuadPart) / 1000000ull;
+
+    Count = 1;
+    if (Adapter->VifInterfaceVersion >= VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES)
+        VIF(QueryTransmitterQueueCount,
+            Adapter->VifInterface,
+            &Count);
+
+    if (Count > TRANSMITTER_MAXIMUM_QUEUES)
+        Count = TRANSMITTER_MAXIMUM_QUEUES;
+    if (Count > (ULONG)Adapter->Properties.tx_queues)
+        Count = (ULONG)Adapter->Properties.tx_queues;
+    if (Count == 0)
+        Count = 1;
+
+    Transmitter->QueueCount = Count;
+
+    for (Index = 0; Index < Count; Index++) {
+        PTRANSMITTER_QUEUE  Queue = &Transmitter->Queue[Index];
+
+        ASSERT3P(Queue->StagedHead, ==, NULL);
+
+        if (Adapter->VifInterfaceVersion >= VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES)
+            VIF(QueryTransmitterQueueRingSize,
+                Adapter->VifInterface,
+                Index,
+                &Queue->RingSize);
+        else
+            VIF(QueryTransmitterRingSize,
+                Adapter->VifInterface,
+                &Queue->RingSize);
+
+        // Never hold back more than half a ring
+        Queue->Batch = Transmitter->Batch;
+        if (Queue->RingSize != 0 && Queue->Batch > Queue->RingSize / 2)
+            Queue->Batch = Queue->RingSize / 2;
+    }
+
+    Info("Queues = %u RingSize = %u Batch = %u/%uus\n",
+         Transmitter->QueueCount,
+         Transmitter->Queue[0].RingSize,
+         Transmitter->Queue[0].Batch,
+         Adapter->Properties.tx_batch_time);
 }
 
 VOID 
@@ -71,6 +197,9 @@ TransmitterDelete (
     ASSERT(Transmitter != NULL);
 
     if (*Transmitter) {
+        if ((*Transmitter)->SegmentPool != NULL)
+            NdisFreeNetBufferListPool((*Transmitter)->SegmentPool);
+
         ExFreePool(*Transmitter);
         *Transmitter = NULL;
     }
@@ -78,6 +207,7 @@ TransmitterDelete (
 
 typedef struct _NET_BUFFER_LIST_RESERVED {
     LONG    Reference;
+    ULONG   Queue;
 } NET_BUFFER_LIST_RESERVED, *PNET_BUFFER_LIST_RESERVED;
 
 C_ASSERT(sizeof (NET_BUFFER_LIST_RESERVED) <= RTL_FIELD_SIZE(NET_BUFFER_LIST, MiniportReserved));
@@ -89,19 +219,165 @@ typedef struct _NET_BUFFER_RESERVED {
 
 C_ASSERT(sizeof (NET_BUFFER_RESERVED) <= RTL_FIELD_SIZE(NET_BUFFER, MiniportReserved));
 
+#define TRANSMITTER_COMPLETION_CHAINS   4
+
+typedef struct _TRANSMITTER_COMPLETION_CHAIN {
+    NDIS_STATUS         Status;
+    PNET_BUFFER_LIST    Head;
+    PNET_BUFFER_LIST    *Tail;
+    ULONG               Count;
+} TRANSMITTER_COMPLETION_CHAIN, *PTRANSMITTER_COMPLETION_CHAIN;
+
+// NET_BUFFER_LISTs finished by one callback, chained by status so that
+// each chain goes back to NDIS in a single call. Each NET_BUFFER_LIST
+// carries its own status, so once every chain is taken any further
+// status simply shares the last one.
+typedef struct _TRANSMITTER_COMPLETION {
+    ULONG                           Count;
+    TRANSMITTER_COMPLETION_CHAIN    Chain[TRANSMITTER_COMPLETION_CHAINS];
+} TRANSMITTER_COMPLETION, *PTRANSMITTER_COMPLETION;
+
+//
+// Release what a segment holds and return the NET_BUFFER_LIST it was cut
+// from.
+//
+static PNET_BUFFER_LIST
+TransmitterFreeSegment(
+    IN  PNET_BUFFER_LIST    Segment
+    )
+{
+    PTRANSMITTER_SEGMENT    Context;
+    PNET_BUFFER             NetBuffer;
+    PNET_BUFFER_LIST        NetBufferList;
+
+    Context = (PTRANSMITTER_SEGMENT)NET_BUFFER_LIST_CONTEXT_DATA_START(Segment);
+
+    NetBufferList = Segment->ParentNetBufferList;
+    Segment->ParentNetBufferList = NULL;
+
+    if (Context->PayloadMdl != NULL) {
+        MmPrepareMdlForReuse(Context->PayloadMdl);
+        IoFreeMdl(Context->PayloadMdl);
+        Context->PayloadMdl = NULL;
+    }
+
+    NetBuffer = NET_BUFFER_LIST_FIRST_NB(Segment);
+    NET_BUFFER_FIRST_MDL(NetBuffer) = NULL;
+    NET_BUFFER_CURRENT_MDL(NetBuffer) = NULL;
+    NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) = 0;
+    NET_BUFFER_DATA_LENGTH(NetBuffer) = 0;
+
+    NdisFreeNetBufferListContext(Segment, TRANSMITTER_SEGMENT_CONTEXT_SIZE);
+    NdisFreeNetBufferList(Segment);
+
+    return NetBufferList;
+}
+
+//
+// Called when the last packet of a NET_BUFFER_LIST has been completed or
+// aborted. The NET_BUFFER_LIST is added to Completion, to go back to NDIS
+// with whatever status its packets left, unless it is a segment, in which
+// case it is freed and the NET_BUFFER_LIST it was cut from loses a
+// reference instead.
+//
 static VOID
-TransmitterAbortNetBufferList(
-    IN  PTRANSMITTER        Transmitter,
-    IN  PNET_BUFFER_LIST    NetBufferList
+TransmitterReturnNetBufferList(
+    IN      PTRANSMITTER                                Transmitter,
+    IN      PNET_BUFFER_LIST                            NetBufferList,
+    IN OUT  PTRANSMITTER_COMPLETION                     Completion
     )
 {
+    PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO   LargeSendInfo;
+    NDIS_STATUS                                         Status;
+    PTRANSMITTER_COMPLETION_CHAIN                       Chain;
+    ULONG                                               Index;
+
     ASSERT3P(NET_BUFFER_LIST_NEXT_NBL(NetBufferList), ==, NULL);
 
-    NET_BUFFER_LIST_STATUS(NetBufferList) = NDIS_STATUS_NOT_ACCEPTED;
+    if (NetBufferList->NdisPoolHandle == Transmitter->SegmentPool) {
+        NDIS_STATUS                 ndisStatus;
+        PNET_BUFFER_LIST_RESERVED   ListReserved;
+
+        ndisStatus = NET_BUFFER_LIST_STATUS(NetBufferList);
+
+        NetBufferList = TransmitterFreeSegment(NetBufferList);
+        ASSERT(NetBufferList != NULL);
+
+        if (ndisStatus != NDIS_STATUS_SUCCESS)
+            NET_BUFFER_LIST_STATUS(NetBufferList) = ndisStatus;
+
+        ListReserved = (PNET_BUFFER_LIST_RESERVED)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList);
+
+        ASSERT(ListReserved->Reference != 0);
+        if (InterlockedDecrement(&ListReserved->Reference) != 0)
+            return;
+    }
+
+    LargeSendInfo = (PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
+                                                                                             TcpLargeSendNetBufferListInfo);
+
+    // Only LSOv2 is advertised, and its completion carries no TcpPayload
+    if (LargeSendInfo->LsoV2Transmit.MSS != 0)
+        LargeSendInfo->LsoV2TransmitComplete.Reserved = 0;
+
+    Status = NET_BUFFER_LIST_STATUS(NetBufferList);
+
+    for (Index = 0; Index < Completion->Count; Index++)
+        if (Completion->Chain[Index].Status == Status)
+            break;
+
+    if (Index == Completion->Count) {
+        if (Completion->Count < TRANSMITTER_COMPLETION_CHAINS) {
+            Chain = &Completion->Chain[Completion->Count++];
 
-    NdisMSendNetBufferListsComplete(Transmitter->Adapter->NdisAdapterHandle,
-                                    NetBufferList,
-                                    NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL);
+            Chain->Status = Status;
+            Chain->Head = NULL;
+            Chain->Tail = &Chain->Head;
+            Chain->Count = 0;
+        } else {
+            Chain = &Completion->Chain[TRANSMITTER_COMPLETION_CHAINS - 1];
+        }
+    } else {
+        Chain = &Completion->Chain[Index];
+    }
+
+    *Chain->Tail = NetBufferList;
+    Chain->Tail = &NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+    Chain->Count++;
+}
+
+//
+// Hand everything gathered in Completion back to NDIS, one call per chain.
+// Must be called at DISPATCH_LEVEL.
+//
+static VOID
+TransmitterCompleteNetBufferLists(
+    IN  PTRANSMITTER            Transmitter,
+    IN  PTRANSMITTER_COMPLETION Completion
+    )
+{
+    ULONG                       Count;
+    ULONG                       Index;
+
+    if (Completion->Count == 0)
+        return;
+
+    Count = 0;
+    for (Index = 0; Index < Completion->Count; Index++) {
+        PTRANSMITTER_COMPLETION_CHAIN   Chain = &Completion->Chain[Index];
+
+        ASSERT(Chain->Head != NULL);
+        Count += Chain->Count;
+
+        NdisMSendNetBufferListsComplete(Transmitter->Adapter->NdisAdapterHandle,
+                                        Chain->Head,
+                                        NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL);
+    }
+
+    (VOID) InterlockedExchangeAdd64(&Transmitter->Completions, Completion->Count);
+    (VOID) InterlockedExchangeAdd64(&Transmitter->CompletedNetBufferLists, Count);
+
+    Completion->Count = 0;
 }
 
 VOID
@@ -110,6 +386,10 @@ TransmitterAbortPackets(
     IN  PXENVIF_TRANSMITTER_PACKET  Packet
     )
 {
+    TRANSMITTER_COMPLETION          Completion;
+
+    Completion.Count = 0;
+
     while (Packet != NULL) {
         PXENVIF_TRANSMITTER_PACKET  Next;
         PNET_BUFFER_RESERVED        Reserved;
@@ -126,12 +406,953 @@ TransmitterAbortPackets(
 
         ListReserved = (PNET_BUFFER_LIST_RESERVED)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList);
 
+        NET_BUFFER_LIST_STATUS(NetBufferList) = NDIS_STATUS_NOT_ACCEPTED;
+
         ASSERT(ListReserved->Reference != 0);
         if (InterlockedDecrement(&ListReserved->Reference) == 0)
-            TransmitterAbortNetBufferList(Transmitter, NetBufferList);
+            TransmitterReturnNetBufferList(Transmitter, NetBufferList, &Completion);
 
         Packet = Next;
     }
+
+    TransmitterCompleteNetBufferLists(Transmitter, &Completion);
+}
+
+// Must be called with Queue->Lock held.
+static VOID
+TransmitterRecordFlush(
+    IN  PTRANSMITTER_QUEUE          Queue,
+    IN  ULONG                       Count,
+    IN  TRANSMITTER_FLUSH_REASON    Reason
+    )
+{
+    PTRANSMITTER                    Transmitter = Queue->Transmitter;
+    ULONG64                         Elapsed;
+    ULONG                           Index;
+
+    Queue->Packets += Count;
+    Queue->Flushes++;
+    Queue->Flush[Reason]++;
+
+    if (Transmitter->Frequency == 0)
+        return;
+
+    Elapsed = KeQueryPerformanceCounter(NULL).QuadPart - Queue->StagedStart.QuadPart;
+    Elapsed = (Elapsed * 1000000ull) / Transmitter->Frequency;
+
+    // Bucket 0 is under 4us; each after it covers twice the time
+    Index = 0;
+    Elapsed >>= 2;
+    while (Elapsed != 0 && Index < TRANSMITTER_LATENCY_HISTOGRAM_SIZE - 1) {
+        Elapsed >>= 1;
+        Index++;
+    }
+
+    Queue->Latency[Index] += Count;
+}
+
+static FORCEINLINE NTSTATUS
+__TransmitterQueuePackets(
+    IN  PTRANSMITTER_QUEUE          Queue,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    )
+{
+    PADAPTER                        Adapter = Queue->Transmitter->Adapter;
+
+    if (Adapter->VifInterfaceVersion < VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES) {
+        ASSERT3U(Queue->Index, ==, 0);
+
+        return VIF(QueuePackets,
+                   Adapter->VifInterface,
+                   HeadPacket);
+    }
+
+    return VIF(QueueTransmitterPackets,
+               Adapter->VifInterface,
+               Queue->Index,
+               HeadPacket);
+}
+
+//
+// Pass everything staged on the queue to the backend. Only one CPU
+// flushes a queue at a time, so chains reach the ring in the order they
+// were staged; anything staged meanwhile, including by a send made from a
+// completion inside QueuePackets, is picked up by the flushing CPU before
+// it returns.
+// Must be called at DISPATCH_LEVEL.
+//
+static VOID
+__TransmitterFlush(
+    IN  PTRANSMITTER_QUEUE          Queue,
+    IN  TRANSMITTER_FLUSH_REASON    Reason
+    )
+{
+    KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+
+    if (Queue->Flushing) {
+        KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+        return;
+    }
+
+    Queue->Flushing = TRUE;
+
+    for (;;) {
+        PXENVIF_TRANSMITTER_PACKET  HeadPacket;
+        NTSTATUS                    status;
+
+        HeadPacket = Queue->StagedHead;
+        if (HeadPacket == NULL)
+            break;
+
+        TransmitterRecordFlush(Queue, Queue->StagedCount, Reason);
+
+        Queue->StagedHead = NULL;
+        Queue->StagedTail = &Queue->StagedHead;
+        Queue->StagedCount = 0;
+
+        KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+
+        status = __TransmitterQueuePackets(Queue, HeadPacket);
+        if (!NT_SUCCESS(status))
+            TransmitterAbortPackets(Queue->Transmitter, HeadPacket);
+
+        KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+    }
+
+    Queue->Flushing = FALSE;
+
+    KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+}
+
+static VOID
+TransmitterFlushDpc(
+    IN  PKDPC           Dpc,
+    IN  PVOID           Context,
+    IN  PVOID           Argument1,
+    IN  PVOID           Argument2
+    )
+{
+    PTRANSMITTER_QUEUE  Queue = Context;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    ASSERT(Queue != NULL);
+
+    __TransmitterFlush(Queue, TRANSMITTER_FLUSH_DEFERRED);
+}
+
+//
+// Add a chain of packets to those staged on a queue and decide whether
+// they can wait for more. Sends made at PASSIVE_LEVEL are flushed at once
+// since nothing else will be sent before the flush DPC would run anyway.
+// Must be called at DISPATCH_LEVEL.
+//
+static VOID
+TransmitterStagePackets(
+    IN  PTRANSMITTER_QUEUE          Queue,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket,
+    IN  PXENVIF_TRANSMITTER_PACKET  *TailPacket,
+    IN  ULONG                       Count,
+    IN  BOOLEAN                     Urgent,
+    IN  BOOLEAN                     AtDispatch
+    )
+{
+    PTRANSMITTER                    Transmitter = Queue->Transmitter;
+    TRANSMITTER_FLUSH_REASON        Reason;
+    LARGE_INTEGER                   Now;
+
+    Now = KeQueryPerformanceCounter(NULL);
+
+    KeAcquireSpinLockAtDpcLevel(&Queue->Lock);
+
+    if (Queue->StagedHead == NULL)
+        Queue->StagedStart = Now;
+
+    *Queue->StagedTail = HeadPacket;
+    Queue->StagedTail = TailPacket;
+    Queue->StagedCount += Count;
+
+    if (Queue->Batch == 0 || !AtDispatch)
+        Reason = TRANSMITTER_FLUSH_IMMEDIATE;
+    else if (Urgent)
+        Reason = TRANSMITTER_FLUSH_URGENT;
+    else if (Queue->StagedCount >= Queue->Batch)
+        Reason = TRANSMITTER_FLUSH_FULL;
+    else if ((ULONG64)(Now.QuadPart - Queue->StagedStart.QuadPart) >= Transmitter->BatchTime)
+        Reason = TRANSMITTER_FLUSH_EXPIRED;
+    else
+        Reason = TRANSMITTER_FLUSH_REASON_COUNT;
+
+    KeReleaseSpinLockFromDpcLevel(&Queue->Lock);
+
+    if (Reason != TRANSMITTER_FLUSH_REASON_COUNT)
+        __TransmitterFlush(Queue, Reason);
+    else
+        (VOID) KeInsertQueueDpc(&Queue->FlushDpc, NULL, NULL);
+}
+
+//
+// Pass anything still staged to the backend; called before the backend
+// is disabled.
+//
+VOID
+TransmitterFlush(
+    IN  PTRANSMITTER    Transmitter
+    )
+{
+    ULONG               Index;
+    KIRQL               Irql;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    for (Index = 0; Index < Transmitter->QueueCount; Index++)
+        __TransmitterFlush(&Transmitter->Queue[Index], TRANSMITTER_FLUSH_IMMEDIATE);
+    KeLowerIrql(Irql);
+
+    // Let any queued flush DPC find nothing to do
+    KeFlushQueuedDpcs();
+
+    for (Index = 0; Index < Transmitter->QueueCount; Index++)
+        ASSERT3P(Transmitter->Queue[Index].StagedHead, ==, NULL);
+}
+
+VOID
+TransmitterQueryStatistics(
+    IN  PTRANSMITTER            Transmitter,
+    OUT PTRANSMITTER_STATISTICS Statistics
+    )
+{
+    ULONG                       Index;
+
+    RtlZeroMemory(Statistics, sizeof (TRANSMITTER_STATISTICS));
+
+    Statistics->QueueCount = Transmitter->QueueCount;
+
+    for (Index = 0; Index < TRANSMITTER_MAXIMUM_QUEUES; Index++) {
+        PTRANSMITTER_QUEUE  Queue = &Transmitter->Queue[Index];
+        ULONG               Bucket;
+        KIRQL               Irql;
+
+        KeAcquireSpinLock(&Queue->Lock, &Irql);
+
+        Statistics->Packets += Queue->Packets;
+        Statistics->Flushes += Queue->Flushes;
+
+        for (Bucket = 0; Bucket < TRANSMITTER_FLUSH_REASON_COUNT; Bucket++)
+            Statistics->Flush[Bucket] += Queue->Flush[Bucket];
+
+        for (Bucket = 0; Bucket < TRANSMITTER_LATENCY_HISTOGRAM_SIZE; Bucket++)
+            Statistics->Latency[Bucket] += Queue->Latency[Bucket];
+
+        Statistics->QueuePackets[Index] = Queue->Packets;
+
+        KeReleaseSpinLock(&Queue->Lock, Irql);
+
+        Statistics->QueueCompleted[Index] = (ULONG64)Queue->Completed;
+
+        Statistics->Segmented += (ULONG64)Queue->Segmented;
+        Statistics->Segments += (ULONG64)Queue->Segments;
+        Statistics->SegmentFailures += (ULONG64)Queue->SegmentFailures;
+        Statistics->Checksummed += (ULONG64)Queue->Checksummed;
+    }
+
+    Statistics->Completions = (ULONG64)Transmitter->Completions;
+    Statistics->CompletedNetBufferLists = (ULONG64)Transmitter->CompletedNetBufferLists;
+}
+
+//
+// The backend's offload options, with those it lacks added where the
+// transmitter can do the work itself: checksums are calculated here and
+// large sends segmented here, for each IP version whose TCP checksum
+// either the backend or the transmitter can calculate.
+//
+VOID
+TransmitterQueryOffloadOptions(
+    IN  PTRANSMITTER            Transmitter,
+    OUT PXENVIF_OFFLOAD_OPTIONS Options
+    )
+{
+    PADAPTER                    Adapter = Transmitter->Adapter;
+    XENVIF_OFFLOAD_OPTIONS      Software;
+
+    VIF(QueryOffloadOptions,
+        Adapter->VifInterface,
+        Options);
+
+    Software.Value = 0;
+
+    if (Adapter->Properties.sw_csum) {
+        if (!Options->OffloadIpVersion4HeaderChecksum)
+            Software.OffloadIpVersion4HeaderChecksum = 1;
+
+        if (!Options->OffloadIpVersion4TcpChecksum)
+            Software.OffloadIpVersion4TcpChecksum = 1;
+
+        if (!Options->OffloadIpVersion4UdpChecksum)
+            Software.OffloadIpVersion4UdpChecksum = 1;
+
+        if (!Options->OffloadIpVersion6TcpChecksum)
+            Software.OffloadIpVersion6TcpChecksum = 1;
+
+        if (!Options->OffloadIpVersion6UdpChecksum)
+            Software.OffloadIpVersion6UdpChecksum = 1;
+    }
+
+    if (Adapter->Properties.tx_gso) {
+        if (!Options->OffloadIpVersion4LargePacket &&
+            (Options->OffloadIpVersion4TcpChecksum || Software.OffloadIpVersion4TcpChecksum))
+            Software.OffloadIpVersion4LargePacket = 1;
+
+        if (!Options->OffloadIpVersion6LargePacket &&
+            (Options->OffloadIpVersion6TcpChecksum || Software.OffloadIpVersion6TcpChecksum))
+            Software.OffloadIpVersion6LargePacket = 1;
+    }
+
+    if (Software.Value != Transmitter->SoftwareOffloadOptions.Value)
+        Info("software offload options: %04x\n", Software.Value);
+
+    Transmitter->SoftwareOffloadOptions = Software;
+    Options->Value |= Software.Value;
+}
+
+//
+// Largest send that may be offloaded for the given IP version. Only valid
+// after TransmitterQueryOffloadOptions().
+//
+VOID
+TransmitterQueryLargePacketSize(
+    IN  PTRANSMITTER    Transmitter,
+    IN  UCHAR           Version,
+    OUT PULONG          Size
+    )
+{
+    PADAPTER            Adapter = Transmitter->Adapter;
+
+    if ((Version == 4 && Transmitter->SoftwareOffloadOptions.OffloadIpVersion4LargePacket) ||
+        (Version == 6 && Transmitter->SoftwareOffloadOptions.OffloadIpVersion6LargePacket)) {
+        *Size = GSO_MAXIMUM_SIZE;
+        return;
+    }
+
+    VIF(QueryLargePacketSize,
+        Adapter->VifInterface,
+        Version,
+        Size);
+}
+
+
+static FORCEINLINE ULONG
+__TransmitterHashMix(
+    IN  ULONG   Hash,
+    IN  ULONG   Value
+    )
+{
+    return (Hash ^ Value) * 0x01000193;
+}
+
+static FORCEINLINE ULONG
+__TransmitterHashFinal(
+    IN  ULONG   Hash
+    )
+{
+    Hash ^= Hash >> 16;
+    Hash *= 0x85ebca6b;
+    Hash ^= Hash >> 13;
+    Hash *= 0xc2b2ae35;
+    Hash ^= Hash >> 16;
+
+    return Hash;
+}
+
+//
+// Hash the IP addresses and, unless the packet is a fragment, the TCP or
+// UDP ports of a frame. Frames that are not IP hash to 0. Only used to
+// keep a flow on one queue, so it need not match the RSS hash.
+//
+static ULONG
+TransmitterHashFlow(
+    IN  PNET_BUFFER     NetBuffer
+    )
+{
+    UCHAR               Buffer[TRANSMITTER_HASH_HEADER_LENGTH];
+    PUCHAR              Header;
+    PETHERNET_HEADER    EthernetHeader;
+    ULONG               Length;
+    ULONG               Offset;
+    USHORT              Type;
+    UCHAR               Protocol;
+    ULONG               Hash;
+    ULONG               Index;
+
+    Length = NET_BUFFER_DATA_LENGTH(NetBuffer);
+    if (Length > TRANSMITTER_HASH_HEADER_LENGTH)
+        Length = TRANSMITTER_HASH_HEADER_LENGTH;
+
+    if (Length < sizeof (ETHERNET_UNTAGGED_HEADER))
+        return 0;
+
+    Header = NdisGetDataBuffer(NetBuffer, Length, Buffer, 1, 0);
+    if (Header == NULL)
+        return 0;
+
+    EthernetHeader = (PETHERNET_HEADER)Header;
+
+    if (ETHERNET_HEADER_IS_TAGGED(EthernetHeader)) {
+        if (Length < sizeof (ETHERNET_TAGGED_HEADER))
+            return 0;
+
+        Type = NTOHS(EthernetHeader->Tagged.TypeOrLength);
+        Offset = sizeof (ETHERNET_TAGGED_HEADER);
+    } else {
+        Type = NTOHS(EthernetHeader->Untagged.TypeOrLength);
+        Offset = sizeof (ETHERNET_UNTAGGED_HEADER);
+    }
+
+    Hash = 0;
+
+    switch (Type) {
+    case ETHERTYPE_IPV4: {
+        PIPV4_HEADER    IpHeader;
+
+        if (Offset + sizeof (IPV4_HEADER) > Length)
+            return 0;
+
+        IpHeader = (PIPV4_HEADER)(Header + Offset);
+
+        Hash = __TransmitterHashMix(Hash, IpHeader->SourceAddress.Dword[0]);
+        Hash = __TransmitterHashMix(Hash, IpHeader->DestinationAddress.Dword[0]);
+
+        Protocol = IpHeader->Protocol;
+        if (IPV4_IS_A_FRAGMENT(NTOHS(IpHeader->FragmentOffsetAndFlags)))
+            Protocol = IPPROTO_NONE;
+
+        Offset += IPV4_HEADER_LENGTH(IpHeader);
+        break;
+    }
+    case ETHERTYPE_IPV6: {
+        PIPV6_HEADER    IpHeader;
+
+        if (Offset + sizeof (IPV6_HEADER) > Length)
+            return 0;
+
+        IpHeader = (PIPV6_HEADER)(Header + Offset);
+
+        for (Index = 0; Index < ARRAYSIZE(IpHeader->SourceAddress.Dword); Index++) {
+            Hash = __TransmitterHashMix(Hash, IpHeader->SourceAddress.Dword[Index]);
+            Hash = __TransmitterHashMix(Hash, IpHeader->DestinationAddress.Dword[Index]);
+        }
+
+        // Extension headers are not followed
+        Protocol = IpHeader->NextHeader;
+
+        Offset += sizeof (IPV6_HEADER);
+        break;
+    }
+    default:
+        return 0;
+    }
+
+    // Source and destination ports are the first 4 bytes of either header
+    if ((Protocol == IPPROTO_TCP || Protocol == IPPROTO_UDP) &&
+        Offset + sizeof (ULONG) <= Length)
+        Hash = __TransmitterHashMix(Hash, *(ULONG UNALIGNED *)(Header + Offset));
+
+    return __TransmitterHashFinal(Hash);
+}
+
+//
+// Keep each flow on one queue: use the stack's hash if it supplied one,
+// otherwise hash the frame's headers.
+//
+static FORCEINLINE ULONG
+__TransmitterSelectQueue(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               QueueCount
+    )
+{
+    ULONG                   Hash;
+
+    if (QueueCount == 1)
+        return 0;
+
+    if (NET_BUFFER_LIST_GET_HASH_TYPE(NetBufferList) != 0)
+        Hash = NET_BUFFER_LIST_GET_HASH_VALUE(NetBufferList);
+    else
+        Hash = TransmitterHashFlow(NET_BUFFER_LIST_FIRST_NB(NetBufferList));
+
+    return (ULONG)(((ULONG64)Hash * QueueCount) >> 32);
+}
+
+//
+// Copy Length bytes to the data of a NET_BUFFER, Offset bytes in.
+//
+static NDIS_STATUS
+TransmitterWriteNetBuffer(
+    IN  PNET_BUFFER NetBuffer,
+    IN  ULONG       Offset,
+    IN  const VOID  *Data,
+    IN  ULONG       Length
+    )
+{
+    const UCHAR     *Next = Data;
+    PMDL            Mdl;
+
+    Mdl = NET_BUFFER_CURRENT_MDL(NetBuffer);
+    Offset += NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer);
+
+    while (Length != 0) {
+        PUCHAR  StartVa;
+        ULONG   ByteCount;
+
+        if (Mdl == NULL)
+            return NDIS_STATUS_INVALID_PACKET;
+
+        ByteCount = MmGetMdlByteCount(Mdl);
+        if (Offset >= ByteCount) {
+            Offset -= ByteCount;
+            Mdl = Mdl->Next;
+            continue;
+        }
+
+        StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        if (StartVa == NULL)
+            return NDIS_STATUS_RESOURCES;
+
+        ByteCount -= Offset;
+        if (ByteCount > Length)
+            ByteCount = Length;
+
+        RtlCopyMemory(StartVa + Offset, Next, ByteCount);
+
+        Next += ByteCount;
+        Length -= ByteCount;
+        Offset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    return NDIS_STATUS_SUCCESS;
+}
+
+// The checksum for a header whose checksum field currently holds Old,
+// given the sum of everything it covers including that field.
+static FORCEINLINE USHORT
+__TransmitterFinishChecksum(
+    IN  ULONG   Sum,
+    IN  USHORT  Old
+    )
+{
+    USHORT      Complement = (USHORT)~Old;
+
+    return (USHORT)~ChecksumAdd(Sum, &Complement, sizeof (USHORT));
+}
+
+//
+// Calculate the checksums named in Software, which the stack asked to be
+// offloaded and the backend cannot calculate, and write them into the
+// frame. The stack leaves checksum fields to be filled in by the miniport
+// when it offloads them, and whatever they hold is disregarded.
+//
+static NDIS_STATUS
+TransmitterCalculateChecksums(
+    IN  PNET_BUFFER             NetBuffer,
+    IN  XENVIF_OFFLOAD_OPTIONS  Software
+    )
+{
+    UCHAR                       Buffer[GSO_MAXIMUM_HEADER_LENGTH];
+    PUCHAR                      Header;
+    PETHERNET_HEADER            EthernetHeader;
+    PIP_HEADER                  IpHeader;
+    ULONG                       Length;
+    ULONG                       IpHeaderOffset;
+    ULONG                       IpLength;
+    ULONG                       Offset;
+    USHORT                      Type;
+    UCHAR                       Protocol;
+    ULONG                       ChecksumOffset;
+    ULONG                       Sum;
+    USHORT                      Checksum;
+    NTSTATUS                    status;
+    NDIS_STATUS                 ndisStatus;
+
+    Length = NET_BUFFER_DATA_LENGTH(NetBuffer);
+    if (Length > GSO_MAXIMUM_HEADER_LENGTH)
+        Length = GSO_MAXIMUM_HEADER_LENGTH;
+
+    ndisStatus = NDIS_STATUS_INVALID_PACKET;
+
+    if (Length < sizeof (ETHERNET_UNTAGGED_HEADER))
+        goto fail1;
+
+    Header = NdisGetDataBuffer(NetBuffer, Length, Buffer, 1, 0);
+    if (Header == NULL)
+        goto fail2;
+
+    EthernetHeader = (PETHERNET_HEADER)Header;
+
+    if (ETHERNET_HEADER_IS_TAGGED(EthernetHeader)) {
+        IpHeaderOffset = sizeof (ETHERNET_TAGGED_HEADER);
+        Type = NTOHS(EthernetHeader->Tagged.TypeOrLength);
+    } else {
+        IpHeaderOffset = sizeof (ETHERNET_UNTAGGED_HEADER);
+        Type = NTOHS(EthernetHeader->Untagged.TypeOrLength);
+    }
+
+    IpHeader = (PIP_HEADER)(Header + IpHeaderOffset);
+
+    if (Type == ETHERTYPE_IPV4) {
+        ULONG   HeaderLength;
+
+        if (IpHeaderOffset + sizeof (IPV4_HEADER) > Length ||
+            IpHeader->Version != 4)
+            goto fail3;
+
+        HeaderLength = IPV4_HEADER_LENGTH(&IpHeader->Version4);
+        if (HeaderLength < sizeof (IPV4_HEADER) ||
+            IpHeaderOffset + HeaderLength > Length)
+            goto fail4;
+
+        if (Software.OffloadIpVersion4HeaderChecksum) {
+            Sum = ChecksumAdd(0, IpHeader, HeaderLength);
+            Checksum = __TransmitterFinishChecksum(Sum, IpHeader->Version4.Checksum);
+
+            ndisStatus = TransmitterWriteNetBuffer(NetBuffer,
+                                                   IpHeaderOffset + FIELD_OFFSET(IPV4_HEADER, Checksum),
+                                                   &Checksum,
+                                                   sizeof (USHORT));
+            if (ndisStatus != NDIS_STATUS_SUCCESS)
+                goto fail5;
+
+            ndisStatus = NDIS_STATUS_INVALID_PACKET;
+        }
+
+        IpLength = NTOHS(IpHeader->Version4.PacketLength);
+        Protocol = IpHeader->Version4.Protocol;
+        Offset = IpHeaderOffset + HeaderLength;
+
+        if (IPV4_IS_A_FRAGMENT(NTOHS(IpHeader->Version4.FragmentOffsetAndFlags)))
+            Protocol = IPPROTO_NONE;
+    } else if (Type == ETHERTYPE_IPV6) {
+        if (IpHeaderOffset + sizeof (IPV6_HEADER) > Length ||
+            IpHeader->Version != 6)
+            goto fail3;
+
+        IpLength = sizeof (IPV6_HEADER) + NTOHS(IpHeader->Version6.PayloadLength);
+        Protocol = IpHeader->Version6.NextHeader;
+        Offset = IpHeaderOffset + sizeof (IPV6_HEADER);
+
+        while (Protocol == IPPROTO_HOP_OPTIONS ||
+               Protocol == IPPROTO_DST_OPTIONS ||
+               Protocol == IPPROTO_ROUTING) {
+            PIPV6_OPTION_HEADER Option;
+
+            if (Offset + sizeof (IPV6_OPTION_HEADER) > Length)
+                goto fail4;
+
+            Option = (PIPV6_OPTION_HEADER)(Header + Offset);
+
+            // Hdr Ext Len counts the 8-octet units after the first
+            Protocol = Option->NextHeader;
+            Offset += (Option->PayloadLength + 1) * 8;
+        }
+    } else {
+        goto fail3;
+    }
+
+    if (Protocol == IPPROTO_TCP &&
+        (Software.OffloadIpVersion4TcpChecksum || Software.OffloadIpVersion6TcpChecksum))
+        ChecksumOffset = FIELD_OFFSET(TCP_HEADER, Checksum);
+    else if (Protocol == IPPROTO_UDP &&
+             (Software.OffloadIpVersion4UdpChecksum || Software.OffloadIpVersion6UdpChecksum))
+        ChecksumOffset = FIELD_OFFSET(UDP_HEADER, Checksum);
+    else
+        return NDIS_STATUS_SUCCESS;
+
+    if (Offset + ChecksumOffset + sizeof (USHORT) > Length ||
+        IpHeaderOffset + IpLength <= Offset ||
+        IpHeaderOffset + IpLength > NET_BUFFER_DATA_LENGTH(NetBuffer))
+        goto fail6;
+
+    // Anything after the IP datagram is padding
+    Length = IpHeaderOffset + IpLength - Offset;
+
+    Sum = ChecksumPseudoHeader(IpHeader, Protocol, Length);
+
+    status = ChecksumAddMdl(NET_BUFFER_CURRENT_MDL(NetBuffer),
+                            NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) + Offset,
+                            Length,
+                            &Sum);
+    if (!NT_SUCCESS(status)) {
+        ndisStatus = NDIS_STATUS_RESOURCES;
+        goto fail7;
+    }
+
+    Checksum = __TransmitterFinishChecksum(Sum,
+                                           *(USHORT UNALIGNED *)(Header + Offset + ChecksumOffset));
+
+    // A UDP checksum of 0 means there is none
+    if (Protocol == IPPROTO_UDP && Checksum == 0)
+        Checksum = 0xFFFF;
+
+    ndisStatus = TransmitterWriteNetBuffer(NetBuffer,
+                                           Offset + ChecksumOffset,
+                                           &Checksum,
+                                           sizeof (USHORT));
+    if (ndisStatus != NDIS_STATUS_SUCCESS)
+        goto fail8;
+
+    return NDIS_STATUS_SUCCESS;
+
+fail8:
+    Error("fail8\n");
+
+fail7:
+    Error("fail7\n");
+
+fail6:
+    Error("fail6\n");
+
+fail5:
+    Error("fail5\n");
+
+fail4:
+    Error("fail4\n");
+
+fail3:
+    Error("fail3\n");
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", ndisStatus);
+
+    return ndisStatus;
+}
+
+//
+// Cut a large TCP send that the backend cannot segment into MSS-sized
+// frames. Each frame is a NET_BUFFER_LIST from SegmentPool holding a copy
+// of the headers, fixed up by GsoBuildHeader(), in front of its share of
+// the original pages. The IPv4 header checksum is complete and the TCP
+// checksum is finished by the backend or, if it cannot, calculated here.
+// On success the frames are added to the chain at *TailPacket and
+// NetBufferList gains a reference for each; on failure nothing is sent.
+//
+static NDIS_STATUS
+TransmitterSegmentNetBuffer(
+    IN      PTRANSMITTER_QUEUE                          Queue,
+    IN      PNET_BUFFER_LIST                            NetBufferList,
+    IN      PNET_BUFFER                                 NetBuffer,
+    IN      PXENVIF_TRANSMITTER_PACKET                  Template,
+    IN OUT  PXENVIF_TRANSMITTER_PACKET                  **TailPacket,
+    IN OUT  PULONG                                      Count
+    )
+{
+    PTRANSMITTER                                        Transmitter = Queue->Transmitter;
+    PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO   LargeSendInfo;
+    PNET_BUFFER_LIST_RESERVED                           ListReserved;
+    UCHAR                                               Buffer[GSO_MAXIMUM_HEADER_LENGTH];
+    GSO_TEMPLATE                                        Gso;
+    PUCHAR                                              Header;
+    ULONG                                               Length;
+    UCHAR                                               IpVersion;
+    BOOLEAN                                             SoftwareChecksum;
+    PXENVIF_TRANSMITTER_PACKET                          HeadPacket;
+    PXENVIF_TRANSMITTER_PACKET                          *LocalTail;
+    PMDL                                                Mdl;
+    ULONG                                               Offset;
+    ULONG                                               Index;
+    NDIS_STATUS                                         ndisStatus;
+
+    LargeSendInfo = (PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
+                                                                                             TcpLargeSendNetBufferListInfo);
+
+    IpVersion = (LargeSendInfo->LsoV2Transmit.IPVersion == NDIS_TCP_LARGE_SEND_OFFLOAD_IPv4) ? 4 : 6;
+
+    SoftwareChecksum = (IpVersion == 4) ?
+                       Transmitter->SoftwareOffloadOptions.OffloadIpVersion4TcpChecksum :
+                       Transmitter->SoftwareOffloadOptions.OffloadIpVersion6TcpChecksum;
+
+    Length = NET_BUFFER_DATA_LENGTH(NetBuffer);
+    if (Length > GSO_MAXIMUM_HEADER_LENGTH)
+        Length = GSO_MAXIMUM_HEADER_LENGTH;
+
+    ndisStatus = NDIS_STATUS_INVALID_PACKET;
+
+    Header = NdisGetDataBuffer(NetBuffer, Length, Buffer, 1, 0);
+    if (Header == NULL)
+        goto fail1;
+
+    if (!GsoPrepare(&Gso,
+                    Header,
+                    Length,
+                    NET_BUFFER_DATA_LENGTH(NetBuffer),
+                    IpVersion,
+                    LargeSendInfo->LsoV2Transmit.TcpHeaderOffset,
+                    LargeSendInfo->LsoV2Transmit.MSS))
+        goto fail2;
+
+    HeadPacket = NULL;
+    LocalTail = &HeadPacket;
+
+    Mdl = NET_BUFFER_CURRENT_MDL(NetBuffer);
+    Offset = NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer) + Gso.HeaderLength;
+
+    for (Index = 0; Index < Gso.SegmentCount; Index++) {
+        PNET_BUFFER_LIST            Segment;
+        PTRANSMITTER_SEGMENT        Context;
+        PNET_BUFFER                 SegmentBuffer;
+        PNET_BUFFER_LIST_RESERVED   SegmentReserved;
+        PNET_BUFFER_RESERVED        Reserved;
+        PXENVIF_TRANSMITTER_PACKET  Packet;
+        ULONG                       PayloadLength;
+
+        // Find the MDL holding the first byte of this segment's payload
+        while (Mdl != NULL && Offset >= MmGetMdlByteCount(Mdl)) {
+            Offset -= MmGetMdlByteCount(Mdl);
+            Mdl = Mdl->Next;
+        }
+
+        ndisStatus = NDIS_STATUS_INVALID_PACKET;
+        if (Mdl == NULL)
+            goto fail3;
+
+        ndisStatus = NDIS_STATUS_RESOURCES;
+
+        Segment = NdisAllocateNetBufferAndNetBufferList(Transmitter->SegmentPool,
+                                                        TRANSMITTER_SEGMENT_CONTEXT_SIZE,
+                                                        0,
+                                                        NULL,
+                                                        0,
+                                                        0);
+        if (Segment == NULL)
+            goto fail3;
+
+        Segment->ParentNetBufferList = NetBufferList;
+        NET_BUFFER_LIST_STATUS(Segment) = NDIS_STATUS_SUCCESS;
+
+        Context = (PTRANSMITTER_SEGMENT)NET_BUFFER_LIST_CONTEXT_DATA_START(Segment);
+        Context->PayloadMdl = NULL;
+
+        PayloadLength = GsoBuildHeader(&Gso, Index, Context->Header);
+
+        // The TCP checksum field already holds the pseudo-header sum so
+        // summing it along with the rest of the segment gives the
+        // checksum
+        if (SoftwareChecksum) {
+            PTCP_HEADER TcpHeader;
+            ULONG       Sum;
+            NTSTATUS    status;
+
+            TcpHeader = (PTCP_HEADER)(Context->Header + Gso.TcpHeaderOffset);
+
+            Sum = ChecksumAdd(0, TcpHeader, Gso.HeaderLength - Gso.TcpHeaderOffset);
+
+            status = ChecksumAddMdl(Mdl, Offset, PayloadLength, &Sum);
+            if (!NT_SUCCESS(status)) {
+                (VOID) TransmitterFreeSegment(Segment);
+                goto fail3;
+            }
+
+            TcpHeader->Checksum = (USHORT)~Sum;
+        }
+
+        MmInitializeMdl(&Context->HeaderMdl, Context->Header, Gso.HeaderLength);
+        MmBuildMdlForNonPagedPool(&Context->HeaderMdl);
+
+        if (Offset == 0) {
+            Context->HeaderMdl.Next = Mdl;
+        } else {
+            PUCHAR  Va = (PUCHAR)MmGetMdlVirtualAddress(Mdl) + Offset;
+            ULONG   ByteCount = MmGetMdlByteCount(Mdl) - Offset;
+
+            Context->PayloadMdl = IoAllocateMdl(Va, ByteCount, FALSE, FALSE, NULL);
+            if (Context->PayloadMdl == NULL) {
+                (VOID) TransmitterFreeSegment(Segment);
+                goto fail3;
+            }
+
+            IoBuildPartialMdl(Mdl, Context->PayloadMdl, Va, ByteCount);
+            Context->PayloadMdl->Next = Mdl->Next;
+
+            Context->HeaderMdl.Next = Context->PayloadMdl;
+        }
+
+        SegmentBuffer = NET_BUFFER_LIST_FIRST_NB(Segment);
+        NET_BUFFER_FIRST_MDL(SegmentBuffer) = &Context->HeaderMdl;
+        NET_BUFFER_CURRENT_MDL(SegmentBuffer) = &Context->HeaderMdl;
+        NET_BUFFER_CURRENT_MDL_OFFSET(SegmentBuffer) = 0;
+        NET_BUFFER_DATA_LENGTH(SegmentBuffer) = Gso.HeaderLength + PayloadLength;
+
+        SegmentReserved = (PNET_BUFFER_LIST_RESERVED)NET_BUFFER_LIST_MINIPORT_RESERVED(Segment);
+        SegmentReserved->Reference = 1;
+        SegmentReserved->Queue = Queue->Index;
+
+        Reserved = (PNET_BUFFER_RESERVED)NET_BUFFER_MINIPORT_RESERVED(SegmentBuffer);
+        RtlZeroMemory(Reserved, sizeof (NET_BUFFER_RESERVED));
+
+        Reserved->NetBufferList = Segment;
+
+        Packet = &Reserved->Packet;
+        Packet->Send = Template->Send;
+
+        Packet->Send.OffloadOptions.OffloadIpVersion4HeaderChecksum = 0;
+        Packet->Send.OffloadOptions.OffloadIpVersion4LargePacket = 0;
+        Packet->Send.OffloadOptions.OffloadIpVersion4TcpChecksum = 0;
+        Packet->Send.OffloadOptions.OffloadIpVersion6LargePacket = 0;
+        Packet->Send.OffloadOptions.OffloadIpVersion6TcpChecksum = 0;
+        Packet->Send.MaximumSegmentSize = 0;
+
+        if (!SoftwareChecksum) {
+            if (IpVersion == 4)
+                Packet->Send.OffloadOptions.OffloadIpVersion4TcpChecksum = 1;
+            else
+                Packet->Send.OffloadOptions.OffloadIpVersion6TcpChecksum = 1;
+        }
+
+        *LocalTail = Packet;
+        LocalTail = &Packet->Next;
+
+        Offset += PayloadLength;
+    }
+
+    ListReserved = (PNET_BUFFER_LIST_RESERVED)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList);
+    ListReserved->Reference += Gso.SegmentCount;
+
+    **TailPacket = HeadPacket;
+    *TailPacket = LocalTail;
+    *Count += Gso.SegmentCount;
+
+    (VOID) InterlockedIncrement64(&Queue->Segmented);
+    (VOID) InterlockedExchangeAdd64(&Queue->Segments, Gso.SegmentCount);
+
+    return NDIS_STATUS_SUCCESS;
+
+fail3:
+    Error("fail3\n");
+
+    while (HeadPacket != NULL) {
+        PXENVIF_TRANSMITTER_PACKET  Next;
+        PNET_BUFFER_RESERVED        Reserved;
+
+        Next = HeadPacket->Next;
+
+        Reserved = CONTAINING_RECORD(HeadPacket, NET_BUFFER_RESERVED, Packet);
+        (VOID) TransmitterFreeSegment(Reserved->NetBufferList);
+
+        HeadPacket = Next;
+    }
+
+fail2:
+    Error("fail2\n");
+
+fail1:
+    Error("fail1 (%08x)\n", ndisStatus);
+
+    (VOID) InterlockedIncrement64(&Queue->SegmentFailures);
+
+    return ndisStatus;
 }
 
 VOID
@@ -142,14 +1363,30 @@ TransmitterSendNetBufferLists(
     IN  ULONG                   SendFlags
     )
 {
-    PXENVIF_TRANSMITTER_PACKET  HeadPacket;
-    PXENVIF_TRANSMITTER_PACKET  *TailPacket;
+    PXENVIF_TRANSMITTER_PACKET  HeadPacket[TRANSMITTER_MAXIMUM_QUEUES];
+    PXENVIF_TRANSMITTER_PACKET  *TailPacket[TRANSMITTER_MAXIMUM_QUEUES];
+    ULONG                       Count[TRANSMITTER_MAXIMUM_QUEUES];
+    BOOLEAN                     Urgent[TRANSMITTER_MAXIMUM_QUEUES];
+    ULONG                       Checksummed[TRANSMITTER_MAXIMUM_QUEUES];
+    ULONG                       QueueCount;
+    ULONG                       Index;
+    TRANSMITTER_COMPLETION      Completion;
     KIRQL                       Irql;
 
     UNREFERENCED_PARAMETER(PortNumber);
 
-    HeadPacket = NULL;
-    TailPacket = &HeadPacket;
+    QueueCount = Transmitter->QueueCount;
+    ASSERT3U(QueueCount, <=, TRANSMITTER_MAXIMUM_QUEUES);
+
+    for (Index = 0; Index < QueueCount; Index++) {
+        HeadPacket[Index] = NULL;
+        TailPacket[Index] = &HeadPacket[Index];
+        Count[Index] = 0;
+        Urgent[Index] = FALSE;
+        Checksummed[Index] = 0;
+    }
+
+    Completion.Count = 0;
 
     if (!NDIS_TEST_SEND_AT_DISPATCH_LEVEL(SendFlags)) {
         ASSERT3U(NDIS_CURRENT_IRQL(), <=, DISPATCH_LEVEL);
@@ -165,6 +1402,7 @@ TransmitterSendNetBufferLists(
         PNDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO          ChecksumInfo;
         PNDIS_NET_BUFFER_LIST_8021Q_INFO                    Ieee8021QInfo;
         PNET_BUFFER                                         NetBuffer;
+        XENVIF_OFFLOAD_OPTIONS                              Software;
 
         ListNext = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
         NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
@@ -172,6 +1410,12 @@ TransmitterSendNetBufferLists(
         ListReserved = (PNET_BUFFER_LIST_RESERVED)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList);
         RtlZeroMemory(ListReserved, sizeof (NET_BUFFER_LIST_RESERVED));
 
+        // Left alone unless a packet is aborted or cannot be segmented
+        NET_BUFFER_LIST_STATUS(NetBufferList) = NDIS_STATUS_SUCCESS;
+
+        Index = __TransmitterSelectQueue(NetBufferList, QueueCount);
+        ListReserved->Queue = Index;
+
         LargeSendInfo = (PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
                                                                                                  TcpLargeSendNetBufferListInfo);
         ChecksumInfo = (PNDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
@@ -187,9 +1431,6 @@ TransmitterSendNetBufferLists(
             Reserved = (PNET_BUFFER_RESERVED)NET_BUFFER_MINIPORT_RESERVED(NetBuffer);
             RtlZeroMemory(Reserved, sizeof (NET_BUFFER_RESERVED));
 
-            Reserved->NetBufferList = NetBufferList;
-            ListReserved->Reference++;
-
             Packet = &Reserved->Packet;
 
             if (ChecksumInfo->Transmit.IsIPv4) {
@@ -211,11 +1452,14 @@ TransmitterSendNetBufferLists(
                     Packet->Send.OffloadOptions.OffloadIpVersion6UdpChecksum = 1;
             }
 
-            if (Ieee8021QInfo->TagHeader.UserPriority != 0) {
+            if (Ieee8021QInfo->TagHeader.UserPriority >= TRANSMITTER_URGENT_PRIORITY)
+                Urgent[Index] = TRUE;
+
+            if (Ieee8021QInfo->TagHeader.UserPriority != 0 ||
+                Ieee8021QInfo->TagHeader.VlanId != 0) {
                 Packet->Send.OffloadOptions.OffloadTagManipulation = 1;
 
                 ASSERT3U(Ieee8021QInfo->TagHeader.CanonicalFormatId, ==, 0);
-                ASSERT3U(Ieee8021QInfo->TagHeader.VlanId, ==, 0);
 
                 PACK_TAG_CONTROL_INFORMATION(Packet->Send.TagControlInformation,
                                              Ieee8021QInfo->TagHeader.UserPriority,
@@ -236,50 +1480,81 @@ TransmitterSendNetBufferLists(
 
             Packet->Send.OffloadOptions.Value &= Transmitter->OffloadOptions.Value;
 
+            Software.Value = Packet->Send.OffloadOptions.Value &
+                             Transmitter->SoftwareOffloadOptions.Value;
+
+            if (Software.OffloadIpVersion4LargePacket ||
+                Software.OffloadIpVersion6LargePacket) {
+                NDIS_STATUS ndisStatus;
+
+                ndisStatus = TransmitterSegmentNetBuffer(&Transmitter->Queue[Index],
+                                                         NetBufferList,
+                                                         NetBuffer,
+                                                         Packet,
+                                                         &TailPacket[Index],
+                                                         &Count[Index]);
+                if (ndisStatus != NDIS_STATUS_SUCCESS)
+                    NET_BUFFER_LIST_STATUS(NetBufferList) = ndisStatus;
+
+                NetBuffer = NET_BUFFER_NEXT_NB(NetBuffer);
+                continue;
+            }
+
+            if (Software.Value != 0) {
+                NDIS_STATUS ndisStatus;
+
+                ndisStatus = TransmitterCalculateChecksums(NetBuffer, Software);
+                if (ndisStatus != NDIS_STATUS_SUCCESS) {
+                    NET_BUFFER_LIST_STATUS(NetBufferList) = ndisStatus;
+
+                    NetBuffer = NET_BUFFER_NEXT_NB(NetBuffer);
+                    continue;
+                }
+
+                Packet->Send.OffloadOptions.Value &= ~Software.Value;
+                Checksummed[Index]++;
+            }
+
+            Reserved->NetBufferList = NetBufferList;
+            ListReserved->Reference++;
+
             ASSERT3P(Packet->Next, ==, NULL);
-            *TailPacket = Packet;
-            TailPacket = &Packet->Next;
+            *TailPacket[Index] = Packet;
+            TailPacket[Index] = &Packet->Next;
+            Count[Index]++;
 
             NetBuffer = NET_BUFFER_NEXT_NB(NetBuffer);
         }
 
-        NetBufferList = ListNext;
-    }
-
-    if (HeadPacket != NULL) {
-        NTSTATUS    status; 
+        // Nothing is staged until every list has been walked, so a list
+        // none of whose large sends could be segmented can go straight back
+        if (ListReserved->Reference == 0) {
+            ASSERT(NET_BUFFER_LIST_STATUS(NetBufferList) != NDIS_STATUS_SUCCESS);
+            TransmitterReturnNetBufferList(Transmitter, NetBufferList, &Completion);
+        }
 
-        status = VIF(QueuePackets,
-                     Transmitter->Adapter->VifInterface,
-                     HeadPacket);
-        if (!NT_SUCCESS(status))
-            TransmitterAbortPackets(Transmitter, HeadPacket);
+        NetBufferList = ListNext;
     }
 
-    NDIS_LOWER_IRQL(Irql, DISPATCH_LEVEL);
-}
-
-static VOID
-TransmitterCompleteNetBufferList(
-    IN  PTRANSMITTER                                    Transmitter,
-    IN  PNET_BUFFER_LIST                                NetBufferList
-    )
-{
-    PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO   LargeSendInfo;
-
-    ASSERT3P(NET_BUFFER_LIST_NEXT_NBL(NetBufferList), ==, NULL);
+    TransmitterCompleteNetBufferLists(Transmitter, &Completion);
 
-    LargeSendInfo = (PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
-                                                                                             TcpLargeSendNetBufferListInfo);
+    for (Index = 0; Index < QueueCount; Index++) {
+        if (Checksummed[Index] != 0)
+            (VOID) InterlockedExchangeAdd64(&Transmitter->Queue[Index].Checksummed,
+                                            Checksummed[Index]);
 
-    if (LargeSendInfo->LsoV2Transmit.MSS != 0)
-        LargeSendInfo->LsoV2TransmitComplete.Reserved = 0;
+        if (HeadPacket[Index] == NULL)
+            continue;
 
-    NET_BUFFER_LIST_STATUS(NetBufferList) = NDIS_STATUS_SUCCESS;
+        TransmitterStagePackets(&Transmitter->Queue[Index],
+                                HeadPacket[Index],
+                                TailPacket[Index],
+                                Count[Index],
+                                Urgent[Index],
+                                (BOOLEAN)(Irql == DISPATCH_LEVEL));
+    }
 
-    NdisMSendNetBufferListsComplete(Transmitter->Adapter->NdisAdapterHandle,
-                                    NetBufferList,
-                                    NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL);
+    NDIS_LOWER_IRQL(Irql, DISPATCH_LEVEL);
 }
 
 VOID
@@ -288,6 +1563,13 @@ TransmitterCompletePackets(
     IN  PXENVIF_TRANSMITTER_PACKET  Packet
     )
 {
+    ULONG                           Completed[TRANSMITTER_MAXIMUM_QUEUES];
+    ULONG                           Index;
+    TRANSMITTER_COMPLETION          Completion;
+
+    RtlZeroMemory(Completed, sizeof (Completed));
+    Completion.Count = 0;
+
     while (Packet != NULL) {
         PXENVIF_TRANSMITTER_PACKET  Next;
         PNET_BUFFER_RESERVED        Reserved;
@@ -304,10 +1586,21 @@ TransmitterCompletePackets(
 
         ListReserved = (PNET_BUFFER_LIST_RESERVED)NET_BUFFER_LIST_MINIPORT_RESERVED(NetBufferList);
 
+        // The NET_BUFFER_LIST is gone once the last reference is dropped
+        ASSERT3U(ListReserved->Queue, <, TRANSMITTER_MAXIMUM_QUEUES);
+        Completed[ListReserved->Queue]++;
+
         ASSERT(ListReserved->Reference != 0);
         if (InterlockedDecrement(&ListReserved->Reference) == 0)
-            TransmitterCompleteNetBufferList(Transmitter, NetBufferList);
+            TransmitterReturnNetBufferList(Transmitter, NetBufferList, &Completion);
 
         Packet = Next;
     }
+
+    TransmitterCompleteNetBufferLists(Transmitter, &Completion);
+
+    for (Index = 0; Index < TRANSMITTER_MAXIMUM_QUEUES; Index++)
+        if (Completed[Index] != 0)
+            (VOID) InterlockedExchangeAdd64(&Transmitter->Queue[Index].Completed,
+                                            Completed[Index]);
 }
@@ -31,10 +31,104 @@
 
 #pragma once
 
-typedef struct _TRANSMITTER {
+#define TRANSMITTER_LATENCY_HISTOGRAM_SIZE  8
+
+// Most backend transmit rings used; further rings are left idle
+#define TRANSMITTER_MAXIMUM_QUEUES  8
+
+typedef enum _TRANSMITTER_FLUSH_REASON {
+    TRANSMITTER_FLUSH_IMMEDIATE = 0,    // Staging disabled or send at PASSIVE_LEVEL
+    TRANSMITTER_FLUSH_URGENT,           // High 802.1p priority
+    TRANSMITTER_FLUSH_FULL,             // Batch limit reached
+    TRANSMITTER_FLUSH_EXPIRED,          // Batch time limit reached
+    TRANSMITTER_FLUSH_DEFERRED,         // End of the DISPATCH_LEVEL burst
+    TRANSMITTER_FLUSH_REASON_COUNT
+} TRANSMITTER_FLUSH_REASON, *PTRANSMITTER_FLUSH_REASON;
+
+// Returned by OID_XENNET_TRANSMITTER_STATISTICS. Flushes counts the
+// packet chains passed to the backend, each of which costs at most one
+// notification, and Flush breaks them down by TRANSMITTER_FLUSH_REASON.
+// Latency is a histogram of the time packets spent staged, charging every
+// packet in a chain with the age of the oldest: bucket 0 is under 4us,
+// bucket n under 4us << n, and the last is everything above.
+// QueuePackets and QueueCompleted count the packets sent and completed on
+// each of the QueueCount queues in use. Segmented counts large sends cut
+// up by the driver because the backend cannot, Segments the frames that
+// produced and SegmentFailures the large sends dropped for want of
+// resources or because their headers could not be parsed. Checksummed
+// counts frames whose checksums the driver calculated because the backend
+// cannot.
+// Completions counts calls to NdisMSendNetBufferListsComplete() and
+// CompletedNetBufferLists the NET_BUFFER_LISTs they returned, so their
+// ratio is the average completion batch.
+typedef struct _TRANSMITTER_STATISTICS {
+    ULONG64 Packets;
+    ULONG64 Flushes;
+    ULONG64 Flush[TRANSMITTER_FLUSH_REASON_COUNT];
+    ULONG64 Latency[TRANSMITTER_LATENCY_HISTOGRAM_SIZE];
+    ULONG   QueueCount;
+    ULONG64 QueuePackets[TRANSMITTER_MAXIMUM_QUEUES];
+    ULONG64 QueueCompleted[TRANSMITTER_MAXIMUM_QUEUES];
+    ULONG64 Segmented;
+    ULONG64 Segments;
+    ULONG64 SegmentFailures;
+    ULONG64 Checksummed;
+    ULONG64 Completions;
+    ULONG64 CompletedNetBufferLists;
+} TRANSMITTER_STATISTICS, *PTRANSMITTER_STATISTICS;
+
+typedef struct _TRANSMITTER TRANSMITTER, *PTRANSMITTER;
+
+// Packets staged for one backend transmit ring until a flush. Each queue
+// occupies its own cache line(s) so that CPUs sending different flows do
+// not contend.
+typedef struct DECLSPEC_CACHEALIGN _TRANSMITTER_QUEUE {
+    PTRANSMITTER                Transmitter;
+    ULONG                       Index;
+    ULONG                       RingSize;
+    ULONG                       Batch;      // Packets, 0 if not staging
+    KSPIN_LOCK                  Lock;
+    PXENVIF_TRANSMITTER_PACKET  StagedHead;
+    PXENVIF_TRANSMITTER_PACKET  *StagedTail;
+    ULONG                       StagedCount;
+    LARGE_INTEGER               StagedStart;
+    BOOLEAN                     Flushing;
+    KDPC                        FlushDpc;
+    ULONG64                     Packets;
+    ULONG64                     Flushes;
+    ULONG64                     Flush[TRANSMITTER_FLUSH_REASON_COUNT];
+    ULONG64                     Latency[TRANSMITTER_LATENCY_HISTOGRAM_SIZE];
+    LONG64                      Completed;
+    LONG64                      Segmented;
+    LONG64                      Segments;
+    LONG64                      SegmentFailures;
+    LONG64                      Checksummed;
+} TRANSMITTER_QUEUE, *PTRANSMITTER_QUEUE;
+
+struct _TRANSMITTER {
     PADAPTER                Adapter;
     XENVIF_OFFLOAD_OPTIONS  OffloadOptions;
-} TRANSMITTER, *PTRANSMITTER;
+
+    // Offloads advertised to NDIS that the backend lacks and the
+    // transmitter performs itself, set by TransmitterQueryOffloadOptions().
+    // Segments come from SegmentPool.
+    XENVIF_OFFLOAD_OPTIONS  SoftwareOffloadOptions;
+    NDIS_HANDLE             SegmentPool;
+
+    ULONG                   Batch;          // Packets, 0 if not staging
+    ULONG64                 BatchTime;      // Counter ticks
+    ULONG64                 Frequency;
+
+    // Queues in use, set by TransmitterEnable(). Backends older than
+    // VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES have just the one.
+    ULONG                   QueueCount;
+    TRANSMITTER_QUEUE       Queue[TRANSMITTER_MAXIMUM_QUEUES];
+
+    // Written by every completion callback, so placed after the queues,
+    // which fill whole cache lines, clear of the fields read when sending.
+    LONG64                  Completions;
+    LONG64                  CompletedNetBufferLists;
+};
 
 VOID 
 TransmitterCleanup (
@@ -65,6 +159,36 @@ TransmitterSendNetBufferLists (
     IN  ULONG               SendFlags
     );
 
+VOID
+TransmitterAbortPackets(
+    IN  PTRANSMITTER                Transmitter,
+    IN  PXENVIF_TRANSMITTER_PACKET  Packet
+    );
+
+VOID
+TransmitterQueryOffloadOptions(
+    IN  PTRANSMITTER            Transmitter,
+    OUT PXENVIF_OFFLOAD_OPTIONS Options
+    );
+
+VOID
+TransmitterQueryLargePacketSize(
+    IN  PTRANSMITTER    Transmitter,
+    IN  UCHAR           Version,
+    OUT PULONG          Size
+    );
+
+VOID
+TransmitterFlush(
+    IN  PTRANSMITTER    Transmitter
+    );
+
+VOID
+TransmitterQueryStatistics(
+    IN  PTRANSMITTER            Transmitter,
+    OUT PTRANSMITTER_STATISTICS Statistics
+    );
+
 VOID
 TransmitterCompletePackets(
     IN  PTRANSMITTER                Transmitter,
@@ -0,0 +1,853 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Drives the receive or transmit path over the mock backend from one or
+// more threads, each acting as its own processor, and reports packets
+// per second, nanoseconds of thread time per packet and allocations per
+// packet. Every figure includes the mock backend's own work, such as
+// copying received frames into its buffers.
+//
+// bench -m rx|tx [-t threads] [-p processors] [-b batch] [-n packets]
+//       [-l payload] [-q queues] [-v version] [-g segments] [-k depth] [-w]
+//       [-u] [-o property=value ...]
+//
+// -v sets the interface version the mock backend offers, e.g. 14 to
+// compare returning receive packets one at a time with returning them in
+// lists.
+//
+// -g makes each receive batch trains of that many in-order segments of
+// each flow, checksummed by the backend, so that running with and without
+// -o grov4=1 shows what software coalescing saves per segment and how
+// many segments each indicated NET_BUFFER_LIST carries.
+//
+// -k makes NDIS keep the last depth NET_BUFFER_LISTs indicated on each
+// processor, returning the oldest as new ones arrive, as a stack slow to
+// return them would, and everything it keeps whenever the backend runs
+// out of packets (a stall). The rx report then shows how many backend
+// packets were held on average. With small frames, e.g.
+//
+// bench -m rx -l 0 -k 256 -o rx_copy_break=0
+// bench -m rx -l 0 -k 256 -o rx_copy_break=128
+//
+// compares holding the backend's packets for as long as NDIS holds the
+// frames with copying the frames and returning the packets at once.
+//
+// -w runs everything twice, first with ReceivePrewarmFactor=0 and then
+// as configured, to show what pre-warming the NET_BUFFER_LIST cache saves
+// while the stack first fills up. A short run with NDIS holding a ring's
+// worth on each processor, e.g.
+//
+// bench -m rx -t 4 -n 1024 -k 256 -o rx_copy_break=0 -o rx_prewarm_factor=4 -w
+//
+// shows how many of them come from the pool, as cache misses, with each.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "harness.h"
+
+#define BENCH_FLOWS     16
+
+typedef enum _BENCH_MODE {
+    BENCH_RECEIVE,
+    BENCH_TRANSMIT
+} BENCH_MODE;
+
+typedef struct _BENCH_FREE_LIST {
+    KSPIN_LOCK          Lock;
+    PNET_BUFFER_LIST    Head;
+    ULONG               Count;
+} DECLSPEC_CACHEALIGN BENCH_FREE_LIST, *PBENCH_FREE_LIST;
+
+typedef struct _BENCH_THREAD {
+    pthread_t           Thread;
+    ULONG               Index;
+    PADAPTER            Adapter;
+    PFRAME              Frame[BENCH_FLOWS];
+    PFRAME              *Batch;
+    PFRAME              *Train;
+    ULONG               Window;
+    BENCH_FREE_LIST     Free;
+    ULONG64             Packets;
+    ULONG64             Start;
+    ULONG64             End;
+    ULONG64             Held;       // Backend packets held, summed over batches
+    ULONG64             Batches;
+    ULONG64             Stalls;     // Batches the backend had no room for
+} BENCH_THREAD, *PBENCH_THREAD;
+
+typedef struct _BENCH_HOLD {
+    KSPIN_LOCK          Lock;
+    PNET_BUFFER_LIST    Head;
+    PNET_BUFFER_LIST    *Tail;
+    ULONG               Count;
+} DECLSPEC_CACHEALIGN BENCH_HOLD, *PBENCH_HOLD;
+
+static BENCH_MODE           BenchMode = BENCH_RECEIVE;
+static ULONG                BenchThreads = 1;
+static ULONG                BenchProcessors;
+static ULONG                BenchBatch = 64;
+static ULONG64              BenchPackets = 1000000;
+static ULONG                BenchPayload = ETHERNET_MTU - sizeof (IPV4_HEADER) - sizeof (TCP_HEADER);
+static ULONG                BenchSegments;
+static ULONG                BenchDepth;
+static PBENCH_HOLD          BenchHold;      // One per processor
+static BOOLEAN              BenchUdp;
+static BOOLEAN              BenchCompareCold;
+
+static pthread_barrier_t    BenchBarrier;
+
+static VOID
+BenchUsage(
+    VOID
+    )
+{
+    fprintf(stderr,
+            "usage: bench -m rx|tx [-t threads] [-p processors] [-b batch] [-n packets]\n"
+            "             [-l payload] [-q queues] [-v version] [-g segments] [-k depth] [-w]\n"
+            "             [-u] [-o property=value ...]\n");
+    exit(2);
+}
+
+static VOID
+BenchBuildFrames(
+    IN  PBENCH_THREAD   Thread
+    )
+{
+    ULONG               Index;
+
+    for (Index = 0; Index < BENCH_FLOWS; Index++) {
+        FRAME_PARAMETERS    Parameters;
+
+        FrameDefaultParameters(&Parameters);
+
+        if (BenchMode == BENCH_TRANSMIT) {
+            ETHERNET_ADDRESS    Address = Parameters.SourceAddress;
+
+            Parameters.SourceAddress = Parameters.DestinationAddress;
+            Parameters.DestinationAddress = Address;
+        }
+
+        Parameters.Protocol = BenchUdp ? IPPROTO_UDP : IPPROTO_TCP;
+        Parameters.SourcePort = (USHORT)(40000 + (Thread->Index * BENCH_FLOWS) + Index);
+        Parameters.PayloadLength = BenchPayload;
+
+        Thread->Frame[Index] = FrameAllocate();
+        FrameBuild(Thread->Frame[Index], &Parameters);
+    }
+
+    Thread->Batch = calloc(BenchBatch, sizeof (PFRAME));
+    SHIM_CHECK(Thread->Batch != NULL);
+
+    if (BenchSegments == 0) {
+        for (Index = 0; Index < BenchBatch; Index++)
+            Thread->Batch[Index] = Thread->Frame[Index % BENCH_FLOWS];
+
+        return;
+    }
+
+    Thread->Train = calloc(BenchBatch, sizeof (PFRAME));
+    SHIM_CHECK(Thread->Train != NULL);
+
+    // Each slot of the batch is its own segment: the Segment'th of its
+    // flow's train
+    for (Index = 0; Index < BenchBatch; Index++) {
+        ULONG               Flow = (Index / BenchSegments) % BENCH_FLOWS;
+        ULONG               Segment = Index % BenchSegments;
+        FRAME_PARAMETERS    Parameters;
+
+        FrameDefaultParameters(&Parameters);
+
+        Parameters.SourcePort = (USHORT)(40000 + (Thread->Index * BENCH_FLOWS) + Flow);
+        Parameters.Seq = Segment * BenchPayload;
+        Parameters.TcpFlags = TCP_ACK;
+        Parameters.PayloadLength = BenchPayload;
+
+        Thread->Train[Index] = FrameAllocate();
+        FrameBuild(Thread->Train[Index], &Parameters);
+
+        Thread->Train[Index]->Flags.IpChecksumSucceeded = 1;
+        Thread->Train[Index]->Flags.TcpChecksumSucceeded = 1;
+
+        Thread->Batch[Index] = Thread->Train[Index];
+    }
+}
+
+// Keeps what is indicated on this processor, giving back whatever is
+// beyond the last BenchDepth NET_BUFFER_LISTs
+static BOOLEAN
+BenchHoldReceive(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PBENCH_HOLD             Hold;
+    PNET_BUFFER_LIST        Release;
+    PNET_BUFFER_LIST        *Tail;
+
+    UNREFERENCED_PARAMETER(Argument);
+    UNREFERENCED_PARAMETER(Flags);
+
+    Hold = &BenchHold[KeGetCurrentProcessorNumber()];
+
+    KeAcquireSpinLockAtDpcLevel(&Hold->Lock);
+
+    *Hold->Tail = NetBufferList;
+    while (*Hold->Tail != NULL)
+        Hold->Tail = &NET_BUFFER_LIST_NEXT_NBL(*Hold->Tail);
+    Hold->Count += Count;
+
+    Release = NULL;
+    Tail = &Release;
+    while (Hold->Count > BenchDepth) {
+        *Tail = Hold->Head;
+        Hold->Head = NET_BUFFER_LIST_NEXT_NBL(Hold->Head);
+        Tail = &NET_BUFFER_LIST_NEXT_NBL(*Tail);
+        --Hold->Count;
+    }
+    *Tail = NULL;
+
+    if (Hold->Head == NULL)
+        Hold->Tail = &Hold->Head;
+
+    KeReleaseSpinLockFromDpcLevel(&Hold->Lock);
+
+    if (Release != NULL)
+        ReceiverReturnNetBufferLists(&Adapter->Receiver,
+                                     Release,
+                                     NDIS_RETURN_FLAGS_DISPATCH_LEVEL);
+
+    return TRUE;
+}
+
+// Gives back everything kept on a processor
+// Must be called at DISPATCH_LEVEL.
+static VOID
+BenchHoldFlush(
+    IN  PADAPTER        Adapter,
+    IN  ULONG           Index
+    )
+{
+    PBENCH_HOLD         Hold = &BenchHold[Index];
+    PNET_BUFFER_LIST    Release;
+
+    KeAcquireSpinLockAtDpcLevel(&Hold->Lock);
+
+    Release = Hold->Head;
+
+    Hold->Head = NULL;
+    Hold->Tail = &Hold->Head;
+    Hold->Count = 0;
+
+    KeReleaseSpinLockFromDpcLevel(&Hold->Lock);
+
+    if (Release != NULL)
+        ReceiverReturnNetBufferLists(&Adapter->Receiver,
+                                     Release,
+                                     NDIS_RETURN_FLAGS_DISPATCH_LEVEL);
+}
+
+static VOID
+BenchReturnSend(
+    IN  PVOID               Argument,
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    PBENCH_FREE_LIST        Free = Argument;
+
+    KeAcquireSpinLockAtDpcLevel(&Free->Lock);
+    NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = Free->Head;
+    Free->Head = NetBufferList;
+    Free->Count++;
+    KeReleaseSpinLockFromDpcLevel(&Free->Lock);
+}
+
+static VOID
+BenchAllocateSends(
+    IN  PBENCH_THREAD   Thread
+    )
+{
+    ULONG               Index;
+
+    KeInitializeSpinLock(&Thread->Free.Lock);
+
+    // Enough for a batch to be staged, one in flight and one being built
+    Thread->Window = BenchBatch * 4;
+
+    for (Index = 0; Index < Thread->Window; Index++) {
+        PNET_BUFFER_LIST    NetBufferList;
+
+        NetBufferList = HarnessAllocateSend(Thread->Frame[Index % BENCH_FLOWS],
+                                            0,
+                                            BenchReturnSend,
+                                            &Thread->Free);
+
+        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = Thread->Free.Head;
+        Thread->Free.Head = NetBufferList;
+        Thread->Free.Count++;
+    }
+}
+
+static VOID
+BenchFreeSends(
+    IN  PBENCH_THREAD   Thread
+    )
+{
+    SHIM_CHECK(Thread->Free.Count == Thread->Window);
+
+    while (Thread->Free.Head != NULL) {
+        PNET_BUFFER_LIST    NetBufferList = Thread->Free.Head;
+
+        Thread->Free.Head = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+
+        HarnessFreeSend(NetBufferList);
+    }
+
+    Thread->Free.Count = 0;
+}
+
+// Must be called at DISPATCH_LEVEL
+static ULONG
+BenchTransmitBatch(
+    IN  PBENCH_THREAD   Thread,
+    IN  ULONG           Count
+    )
+{
+    PNET_BUFFER_LIST    Head;
+    PNET_BUFFER_LIST    *Tail;
+    ULONG               Taken;
+
+    KeAcquireSpinLockAtDpcLevel(&Thread->Free.Lock);
+
+    Head = NULL;
+    Tail = &Head;
+    for (Taken = 0; Taken < Count && Thread->Free.Head != NULL; Taken++) {
+        PNET_BUFFER_LIST    NetBufferList = Thread->Free.Head;
+
+        Thread->Free.Head = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+
+        *Tail = NetBufferList;
+        Tail = &NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+    }
+    Thread->Free.Count -= Taken;
+
+    KeReleaseSpinLockFromDpcLevel(&Thread->Free.Lock);
+
+    if (Head != NULL)
+        TransmitterSendNetBufferLists(Thread->Adapter->Transmitter,
+                                      Head,
+                                      0,
+                                      NDIS_SEND_FLAGS_DISPATCH_LEVEL);
+
+    return Taken;
+}
+
+static PVOID
+BenchThread(
+    IN  PVOID       Argument
+    )
+{
+    PBENCH_THREAD   Thread = Argument;
+
+    ShimSetCurrentProcessor(Thread->Index);
+
+    pthread_barrier_wait(&BenchBarrier);
+
+    Thread->Start = ShimQueryClock();
+
+    while (Thread->Packets < BenchPackets) {
+        ULONG   Count;
+        ULONG   Done;
+        KIRQL   Irql;
+
+        Count = BenchBatch;
+        if (Count > BenchPackets - Thread->Packets)
+            Count = (ULONG)(BenchPackets - Thread->Packets);
+
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+        if (BenchMode == BENCH_RECEIVE)
+            Done = MockVifReceivePackets(Thread->Adapter->VifInterface,
+                                         Thread->Batch,
+                                         Count);
+        else
+            Done = BenchTransmitBatch(Thread, Count);
+
+        if (BenchMode == BENCH_RECEIVE) {
+            Thread->Held += MockVifOutstandingPackets(Thread->Adapter->VifInterface);
+            Thread->Batches++;
+
+            // The backend has run dry while NDIS holds its packets; the
+            // stack gets round to returning what it has
+            if (Done < Count && BenchHold != NULL) {
+                BenchHoldFlush(Thread->Adapter, Thread->Index);
+                Thread->Stalls++;
+            }
+        }
+
+        // Runs whatever DPCs the batch queued to this processor
+        KeLowerIrql(Irql);
+
+        Thread->Packets += Done;
+
+        // Everything is held elsewhere; let the other threads run
+        if (Done == 0)
+            sched_yield();
+    }
+
+    Thread->End = ShimQueryClock();
+
+    return NULL;
+}
+
+// The upper bound in microseconds of the latency bucket holding the
+// Percent'th percentile of staged packets, or 0 if it is the open-ended
+// last bucket.
+static ULONG
+BenchLatencyPercentile(
+    IN  PTRANSMITTER_STATISTICS Transmitter,
+    IN  ULONG                   Percent
+    )
+{
+    ULONG64                     Total;
+    ULONG64                     Sum;
+    ULONG                       Bucket;
+
+    Total = 0;
+    for (Bucket = 0; Bucket < TRANSMITTER_LATENCY_HISTOGRAM_SIZE; Bucket++)
+        Total += Transmitter->Latency[Bucket];
+
+    Sum = 0;
+    for (Bucket = 0; Bucket < TRANSMITTER_LATENCY_HISTOGRAM_SIZE - 1; Bucket++) {
+        Sum += Transmitter->Latency[Bucket];
+        if (Sum * 100 >= Total * Percent)
+            return 4u << Bucket;
+    }
+
+    return 0;
+}
+
+static VOID
+BenchReport(
+    IN  PADAPTER            Adapter,
+    IN  PBENCH_THREAD       Thread,
+    IN  PSHIM_ALLOCATIONS   Before,
+    IN  PSHIM_ALLOCATIONS   After
+    )
+{
+    MOCK_VIF_STATISTICS     Vif;
+    HARNESS_STATISTICS      Harness;
+    ULONG64                 Packets;
+    ULONG64                 ThreadTime;
+    ULONG64                 Start;
+    ULONG64                 End;
+    LONG64                  Allocations;
+    ULONG64                 Held;
+    ULONG64                 Batches;
+    ULONG64                 Stalls;
+    ULONG                   Index;
+
+    Packets = 0;
+    Held = 0;
+    Batches = 0;
+    Stalls = 0;
+    ThreadTime = 0;
+    Start = Thread[0].Start;
+    End = Thread[0].End;
+    for (Index = 0; Index < BenchThreads; Index++) {
+        Packets += Thread[Index].Packets;
+        ThreadTime += Thread[Index].End - Thread[Index].Start;
+        Held += Thread[Index].Held;
+        Batches += Thread[Index].Batches;
+        Stalls += Thread[Index].Stalls;
+
+        if (Thread[Index].Start < Start)
+            Start = Thread[Index].Start;
+        if (Thread[Index].End > End)
+            End = Thread[Index].End;
+    }
+
+    Allocations = ShimAllocationCount(After) - ShimAllocationCount(Before);
+
+    printf("%s: version %u threads %u processors %u batch %u packets %llu frame %u\n",
+           (BenchMode == BENCH_RECEIVE) ? "rx" : "tx",
+           Adapter->VifInterfaceVersion,
+           BenchThreads,
+           BenchProcessors,
+           BenchBatch,
+           Packets,
+           Thread[0].Frame[0]->Length);
+
+    printf("%s: %.0f packets/s %.1f ns/packet %.4f allocations/packet\n",
+           (BenchMode == BENCH_RECEIVE) ? "rx" : "tx",
+           (double)Packets * SHIM_CLOCK_FREQUENCY / (double)(End - Start),
+           (double)ThreadTime / (double)Packets,
+           (double)Allocations / (double)Packets);
+
+    MockVifQueryStatistics(Adapter->VifInterface, &Vif);
+    HarnessQueryStatistics(&Harness);
+
+    if (BenchMode == BENCH_RECEIVE) {
+        RECEIVER_STATISTICS Receiver;
+
+        ReceiverQueryStatistics(&Adapter->Receiver, &Receiver);
+
+        printf("rx: prewarm factor %d cache hits %llu misses %llu NET_BUFFER_LISTs from the pool %lld\n",
+               Adapter->Properties.rx_prewarm_factor,
+               Receiver.CacheHit,
+               Receiver.CacheMiss,
+               After->NetBufferLists - Before->NetBufferLists);
+
+        printf("rx: indications %llu (%.1f packets each) returns %llu (%.1f packets each) shortfall %llu low-resources %llu\n",
+               Harness.Indications,
+               (Harness.Indications != 0) ?
+               (double)Harness.IndicatedNetBufferLists / (double)Harness.Indications : 0.0,
+               Vif.ReturnPacketCalls + Vif.ReturnPacketsCalls,
+               (Vif.ReturnPacketCalls + Vif.ReturnPacketsCalls != 0) ?
+               (double)Vif.ReturnedPackets / (double)(Vif.ReturnPacketCalls + Vif.ReturnPacketsCalls) : 0.0,
+               Vif.ReceiveShortfall,
+               Harness.ResourceIndications);
+
+        printf("rx: coalesced %llu (%.1f segments each) %.2f segments/indication\n",
+               Receiver.Coalesced,
+               (Receiver.Coalesced != 0) ?
+               (double)Receiver.CoalescedSegments / (double)Receiver.Coalesced : 0.0,
+               (Harness.IndicatedNetBufferLists != 0) ?
+               (double)Vif.ReceivedPackets / (double)Harness.IndicatedNetBufferLists : 0.0);
+
+        // Sampled after each batch, so over all threads' backend packets
+        printf("rx: copied %llu (%.1f%%) bounced %llu backend packets held %.1f on average stalls %llu\n",
+               Receiver.Copied,
+               (Packets != 0) ? (100.0 * (double)Receiver.Copied) / (double)Packets : 0.0,
+               Receiver.Bounced,
+               (Batches != 0) ? (double)Held / (double)Batches : 0.0,
+               Stalls);
+    } else {
+        TRANSMITTER_STATISTICS  Transmitter;
+        ULONG64                 Notifications;
+        ULONG                   Queue;
+        ULONG                   Latency;
+
+        TransmitterQueryStatistics(Adapter->Transmitter, &Transmitter);
+
+        // The driver's own count of its completion batches
+        SHIM_CHECK(Transmitter.Completions == Harness.SendCompletions);
+        SHIM_CHECK(Transmitter.CompletedNetBufferLists == Harness.SendCompletedNetBufferLists);
+
+        Notifications = 0;
+        for (Queue = 0; Queue < MOCK_VIF_MAXIMUM_QUEUES; Queue++)
+            Notifications += Vif.Notifications[Queue];
+
+        printf("tx: notifications %llu (%.1f packets each) completions %llu (%.1f packets each) send-completes %llu (%.1f NET_BUFFER_LISTs each)\n",
+               Notifications,
+               (Notifications != 0) ?
+               (double)Transmitter.Packets / (double)Notifications : 0.0,
+               Vif.CompleteCalls,
+               (Vif.CompleteCalls != 0) ?
+               (double)Vif.CompletedPackets / (double)Vif.CompleteCalls : 0.0,
+               Transmitter.Completions,
+               (Transmitter.Completions != 0) ?
+               (double)Transmitter.CompletedNetBufferLists / (double)Transmitter.Completions : 0.0);
+
+        Latency = BenchLatencyPercentile(&Transmitter, 99);
+
+        printf("tx: flushes %llu (immediate %llu urgent %llu full %llu expired %llu deferred %llu) %.3f notifications/packet p99 staged ",
+               Transmitter.Flushes,
+               Transmitter.Flush[TRANSMITTER_FLUSH_IMMEDIATE],
+               Transmitter.Flush[TRANSMITTER_FLUSH_URGENT],
+               Transmitter.Flush[TRANSMITTER_FLUSH_FULL],
+               Transmitter.Flush[TRANSMITTER_FLUSH_EXPIRED],
+               Transmitter.Flush[TRANSMITTER_FLUSH_DEFERRED],
+               (Transmitter.Packets != 0) ?
+               (double)Notifications / (double)Transmitter.Packets : 0.0);
+
+        if (Latency != 0)
+            printf("< %uus\n", Latency);
+        else
+            printf(">= %uus\n", 4u << (TRANSMITTER_LATENCY_HISTOGRAM_SIZE - 2));
+
+        // How evenly the flows spread and whether each ring drains as fast
+        // as it fills
+        for (Queue = 0; Queue < Transmitter.QueueCount; Queue++)
+            printf("tx: queue %u: packets %llu (%.1f%%) completed %llu notifications %llu (%.1f packets each)\n",
+                   Queue,
+                   Transmitter.QueuePackets[Queue],
+                   (Transmitter.Packets != 0) ?
+                   (100.0 * (double)Transmitter.QueuePackets[Queue]) / (double)Transmitter.Packets : 0.0,
+                   Transmitter.QueueCompleted[Queue],
+                   Vif.Notifications[Queue],
+                   (Vif.Notifications[Queue] != 0) ?
+                   (double)Vif.QueuedPackets[Queue] / (double)Vif.Notifications[Queue] : 0.0);
+    }
+
+    if (Adapter->Poller.Threshold != 0) {
+        POLLER_STATISTICS   Poller;
+
+        PollerQueryStatistics(&Adapter->Poller, &Poller);
+
+        printf("poller: events %llu (%llu polled) polls %llu rearms %llu yields %llu polled packets %llu\n",
+               Poller.Events,
+               Poller.PolledEvents,
+               Poller.Polls,
+               Poller.Rearms,
+               Poller.Yields,
+               Poller.PolledPackets);
+    }
+}
+
+// Brings up an adapter, runs the benchmark threads over it, reports and
+// tears everything down again
+static VOID
+BenchRun(
+    IN  PPROPERTIES             Properties,
+    IN  PMOCK_VIF_CONFIGURATION Configuration
+    )
+{
+    PADAPTER                    Adapter;
+    PBENCH_THREAD               Thread;
+    SHIM_ALLOCATIONS            Before;
+    SHIM_ALLOCATIONS            After;
+    ULONG                       Index;
+
+    HarnessInitialize(BenchProcessors, 0);
+
+    Adapter = HarnessCreateAdapter(Properties, Configuration);
+
+    if (BenchDepth != 0) {
+        BenchHold = calloc(BenchProcessors, sizeof (BENCH_HOLD));
+        SHIM_CHECK(BenchHold != NULL);
+
+        for (Index = 0; Index < BenchProcessors; Index++) {
+            KeInitializeSpinLock(&BenchHold[Index].Lock);
+            BenchHold[Index].Tail = &BenchHold[Index].Head;
+        }
+
+        HarnessSetReceiveHook(BenchHoldReceive, NULL);
+    }
+
+    Thread = calloc(BenchThreads, sizeof (BENCH_THREAD));
+    SHIM_CHECK(Thread != NULL);
+
+    for (Index = 0; Index < BenchThreads; Index++) {
+        Thread[Index].Index = Index;
+        Thread[Index].Adapter = Adapter;
+
+        BenchBuildFrames(&Thread[Index]);
+
+        if (BenchMode == BENCH_TRANSMIT)
+            BenchAllocateSends(&Thread[Index]);
+    }
+
+    pthread_barrier_init(&BenchBarrier, NULL, BenchThreads + 1);
+
+    for (Index = 0; Index < BenchThreads; Index++)
+        SHIM_CHECK(pthread_create(&Thread[Index].Thread,
+                                  NULL,
+                                  BenchThread,
+                                  &Thread[Index]) == 0);
+
+    ShimQueryAllocations(&Before);
+
+    pthread_barrier_wait(&BenchBarrier);
+
+    for (Index = 0; Index < BenchThreads; Index++)
+        pthread_join(Thread[Index].Thread, NULL);
+
+    // Anything still staged or queued to a processor whose thread has
+    // finished
+    ShimRunAllDpcs();
+
+    ShimQueryAllocations(&After);
+
+    BenchReport(Adapter, Thread, &Before, &After);
+
+    if (BenchDepth != 0) {
+        KIRQL   Irql;
+
+        HarnessSetReceiveHook(NULL, NULL);
+
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+        for (Index = 0; Index < BenchProcessors; Index++)
+            BenchHoldFlush(Adapter, Index);
+        KeLowerIrql(Irql);
+
+        free(BenchHold);
+    }
+
+    HarnessDestroyAdapter(Adapter);
+
+    for (Index = 0; Index < BenchThreads; Index++) {
+        ULONG   Flow;
+
+        if (BenchMode == BENCH_TRANSMIT)
+            BenchFreeSends(&Thread[Index]);
+
+        for (Flow = 0; Flow < BENCH_FLOWS; Flow++)
+            FrameFree(Thread[Index].Frame[Flow]);
+
+        if (Thread[Index].Train != NULL) {
+            ULONG   Slot;
+
+            for (Slot = 0; Slot < BenchBatch; Slot++)
+                FrameFree(Thread[Index].Train[Slot]);
+
+            free(Thread[Index].Train);
+        }
+
+        free(Thread[Index].Batch);
+    }
+
+    free(Thread);
+    pthread_barrier_destroy(&BenchBarrier);
+
+    HarnessTeardown();
+}
+
+int
+main(
+    IN  int                 argc,
+    IN  char                **argv
+    )
+{
+    PROPERTIES              Properties;
+    MOCK_VIF_CONFIGURATION  Configuration;
+    int                     Option;
+
+    HarnessDefaultProperties(&Properties);
+    MockVifDefaultConfiguration(&Configuration);
+
+    while ((Option = getopt(argc, argv, "m:t:p:b:n:l:q:v:g:k:wuo:")) != -1) {
+        switch (Option) {
+        case 'm':
+            if (strcmp(optarg, "rx") == 0)
+                BenchMode = BENCH_RECEIVE;
+            else if (strcmp(optarg, "tx") == 0)
+                BenchMode = BENCH_TRANSMIT;
+            else
+                BenchUsage();
+            break;
+
+        case 't':
+            BenchThreads = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'p':
+            BenchProcessors = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'b':
+            BenchBatch = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'n':
+            BenchPackets = strtoull(optarg, NULL, 0);
+            break;
+
+        case 'l':
+            BenchPayload = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'q':
+            Configuration.QueueCount = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'v':
+            Configuration.Version = (ULONG)strtoul(optarg, NULL, 0);
+            if (Configuration.Version < VIF_INTERFACE_VERSION_MIN ||
+                Configuration.Version > VIF_INTERFACE_VERSION)
+                BenchUsage();
+            break;
+
+        case 'g':
+            BenchSegments = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'k':
+            BenchDepth = (ULONG)strtoul(optarg, NULL, 0);
+            break;
+
+        case 'w':
+            BenchCompareCold = TRUE;
+            break;
+
+        case 'u':
+            BenchUdp = TRUE;
+            break;
+
+        case 'o':
+            if (!HarnessSetProperty(&Properties, optarg)) {
+                fprintf(stderr, "unknown property: %s\n", optarg);
+                BenchUsage();
+            }
+            break;
+
+        default:
+            BenchUsage();
+        }
+    }
+
+    if (BenchThreads == 0 || BenchBatch == 0 || BenchPackets == 0)
+        BenchUsage();
+
+    // Trains are of TCP segments received from the backend
+    if (BenchSegments != 0 && (BenchMode != BENCH_RECEIVE || BenchUdp))
+        BenchUsage();
+
+    if ((BenchDepth != 0 || BenchCompareCold) && BenchMode != BENCH_RECEIVE)
+        BenchUsage();
+
+    if (BenchProcessors < BenchThreads)
+        BenchProcessors = BenchThreads;
+
+    // Room for a batch from every thread on each processor's ring
+    if (Configuration.ReceiverRingSize < BenchBatch * 2)
+        Configuration.ReceiverRingSize = BenchBatch * 2;
+
+    if (BenchCompareCold) {
+        PROPERTIES  Cold = Properties;
+
+        SHIM_CHECK(HarnessSetProperty(&Cold, "rx_prewarm_factor=0"));
+        BenchRun(&Cold, &Configuration);
+    }
+
+    BenchRun(&Properties, &Configuration);
+
+    return 0;
+}
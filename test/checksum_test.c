@@ -0,0 +1,317 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Differential tests of the checksum kernels against the byte-at-a-time
+// reference in frame.c: every length from 0 to a few pages at random
+// alignments, and random MDL chains whose fragments split the data at
+// odd and even offsets. The driver source is included so the SSE2 and
+// AVX2 paths can be selected directly.
+//
+// checksum_test [iterations [seed]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/xennet/checksum.c"
+
+#include "shim.h"
+#include "frame.h"
+
+#define CHECKSUM_TEST_MAXIMUM_LENGTH    (3 * PAGE_SIZE)
+#define CHECKSUM_TEST_MAXIMUM_FRAGMENTS 16
+#define CHECKSUM_TEST_ALIGNMENT         64
+
+static ULONG64  ChecksumTestState;
+static ULONG    ChecksumTestFailures;
+
+static ULONG
+ChecksumTestRandom(
+    IN  ULONG   Limit
+    )
+{
+    // xorshift64*
+    ChecksumTestState ^= ChecksumTestState >> 12;
+    ChecksumTestState ^= ChecksumTestState << 25;
+    ChecksumTestState ^= ChecksumTestState >> 27;
+
+    return (ULONG)(((ChecksumTestState * 2685821657736338717ull) >> 32) % Limit);
+}
+
+static VOID
+ChecksumTestFill(
+    IN  PUCHAR  Data,
+    IN  ULONG   Length
+    )
+{
+    ULONG       Index;
+    ULONG       Pattern = ChecksumTestRandom(4);
+
+    for (Index = 0; Index < Length; Index++) {
+        switch (Pattern) {
+        case 0:
+            // All ones pushes the accumulators hardest
+            Data[Index] = 0xFF;
+            break;
+
+        case 1:
+            Data[Index] = 0;
+            break;
+
+        default:
+            Data[Index] = (UCHAR)ChecksumTestRandom(256);
+            break;
+        }
+    }
+}
+
+static VOID
+ChecksumTestCheck(
+    IN  const CHAR  *What,
+    IN  ULONG       Length,
+    IN  ULONG       Alignment,
+    IN  ULONG       Expected,
+    IN  ULONG       Actual
+    )
+{
+    if (Expected == Actual)
+        return;
+
+    fprintf(stderr, "%s: length %u alignment %u: expected %04x got %04x\n",
+            What, Length, Alignment, Expected, Actual);
+    ChecksumTestFailures++;
+}
+
+static VOID
+ChecksumTestKernels(
+    IN  PUCHAR  Buffer,
+    IN  ULONG   Length,
+    IN  ULONG   Alignment
+    )
+{
+    PUCHAR      Data = Buffer + Alignment;
+    ULONG       Sum;
+    ULONG       Expected;
+
+    ChecksumTestFill(Data, Length);
+
+    Expected = FrameChecksum(0, Data, Length);
+
+    ChecksumTestCheck("sse2", Length, Alignment, Expected,
+                      __ChecksumAdd(Data, Length, FALSE));
+
+    if (ChecksumAvx2)
+        ChecksumTestCheck("avx2", Length, Alignment, Expected,
+                          __ChecksumAdd(Data, Length, TRUE));
+
+    Sum = ChecksumTestRandom(0x10000);
+    ChecksumTestCheck("ChecksumAdd", Length, Alignment,
+                      FrameChecksum(Sum, Data, Length),
+                      ChecksumAdd(Sum, Data, Length));
+}
+
+static VOID
+ChecksumTestMdl(
+    IN  PUCHAR  Data,
+    IN  ULONG   Length
+    )
+{
+    PMDL        Mdl[CHECKSUM_TEST_MAXIMUM_FRAGMENTS];
+    PUCHAR      Buffer[CHECKSUM_TEST_MAXIMUM_FRAGMENTS];
+    ULONG       Split[CHECKSUM_TEST_MAXIMUM_FRAGMENTS + 1];
+    ULONG       Count;
+    ULONG       Index;
+    ULONG       Offset;
+    ULONG       Total;
+    ULONG       Sum;
+    ULONG       Expected;
+    NTSTATUS    status;
+
+    ChecksumTestFill(Data, Length);
+
+    // Fragment boundaries, unsorted; zero-length fragments are allowed
+    Count = 1 + ChecksumTestRandom(CHECKSUM_TEST_MAXIMUM_FRAGMENTS);
+    Split[0] = 0;
+    for (Index = 1; Index < Count; Index++)
+        Split[Index] = ChecksumTestRandom(Length + 1);
+    Split[Count] = Length;
+
+    for (Index = 1; Index < Count; Index++) {
+        ULONG   Next;
+
+        for (Next = Index + 1; Next < Count; Next++) {
+            if (Split[Next] < Split[Index]) {
+                ULONG   Value = Split[Index];
+
+                Split[Index] = Split[Next];
+                Split[Next] = Value;
+            }
+        }
+    }
+
+    // Each fragment in its own buffer at its own alignment
+    for (Index = 0; Index < Count; Index++) {
+        ULONG   Size = Split[Index + 1] - Split[Index];
+        ULONG   Alignment = ChecksumTestRandom(CHECKSUM_TEST_ALIGNMENT);
+
+        Buffer[Index] = malloc(Size + CHECKSUM_TEST_ALIGNMENT);
+        SHIM_CHECK(Buffer[Index] != NULL);
+
+        memcpy(Buffer[Index] + Alignment, Data + Split[Index], Size);
+
+        Mdl[Index] = IoAllocateMdl(Buffer[Index] + Alignment, Size, FALSE, FALSE, NULL);
+        SHIM_CHECK(Mdl[Index] != NULL);
+        MmBuildMdlForNonPagedPool(Mdl[Index]);
+
+        if (Index != 0)
+            Mdl[Index - 1]->Next = Mdl[Index];
+    }
+
+    Offset = ChecksumTestRandom(Length + 1);
+    Total = ChecksumTestRandom(Length - Offset + 1);
+    Sum = ChecksumTestRandom(0x10000);
+
+    Expected = FrameChecksum(Sum, Data + Offset, Total);
+
+    status = ChecksumAddMdl(Mdl[0], Offset, Total, &Sum);
+    SHIM_CHECK(NT_SUCCESS(status));
+
+    if (Sum != Expected) {
+        fprintf(stderr, "ChecksumAddMdl%s: offset %u length %u fragments",
+                ChecksumAvx2 ? " (avx2)" : "",
+                Offset, Total);
+        for (Index = 0; Index < Count; Index++)
+            fprintf(stderr, " %u", Split[Index + 1] - Split[Index]);
+        fprintf(stderr, ": expected %04x got %04x\n", Expected, Sum);
+
+        ChecksumTestFailures++;
+    }
+
+    // Running off the end of the chain must fail
+    ShimSetDebugLevel(SHIM_DEBUG_QUIET);
+    status = ChecksumAddMdl(Mdl[0], Offset, Length - Offset + 1, &Sum);
+    ShimSetDebugLevel(DPFLTR_ERROR_LEVEL);
+    SHIM_CHECK(status == STATUS_INVALID_PARAMETER);
+
+    for (Index = 0; Index < Count; Index++) {
+        IoFreeMdl(Mdl[Index]);
+        free(Buffer[Index]);
+    }
+}
+
+static VOID
+ChecksumTestFallback(
+    VOID
+    )
+{
+    static const CHAR   *Routine[] = {
+        "RtlGetEnabledExtendedFeatures",
+        "KeSaveExtendedProcessorState",
+        "KeRestoreExtendedProcessorState"
+    };
+    BOOLEAN             Avx2 = ChecksumAvx2;
+    ULONG               Index;
+
+    // Without any one of the extended state routines only SSE2 is used
+    for (Index = 0; Index < ARRAYSIZE(Routine); Index++) {
+        ShimSetSystemRoutineHidden(Routine[Index], TRUE);
+        ChecksumInitialize();
+        SHIM_CHECK(!ChecksumAvx2);
+        ShimSetSystemRoutineHidden(Routine[Index], FALSE);
+    }
+
+    ChecksumInitialize();
+    SHIM_CHECK(ChecksumAvx2 == Avx2);
+}
+
+int
+main(
+    IN  int     argc,
+    IN  char    **argv
+    )
+{
+    ULONG       Iterations;
+    ULONG64     Seed;
+    PUCHAR      Buffer;
+    ULONG       Length;
+    ULONG       Alignment;
+    ULONG       Iteration;
+    BOOLEAN     Avx2;
+
+    Iterations = (argc > 1) ? (ULONG)strtoul(argv[1], NULL, 0) : 2000;
+    Seed = (argc > 2) ? strtoull(argv[2], NULL, 0) : (ULONG64)time(NULL);
+
+    printf("checksum_test: %u iterations seed %llu\n", Iterations, Seed);
+    ChecksumTestState = Seed | 1;
+
+    ShimInitialize(1, 0);
+    ChecksumInitialize();
+
+    Avx2 = ChecksumAvx2;
+    printf("checksum_test: avx2 %s\n", Avx2 ? "available" : "not available");
+
+    Buffer = malloc(CHECKSUM_TEST_MAXIMUM_LENGTH + CHECKSUM_TEST_ALIGNMENT);
+    SHIM_CHECK(Buffer != NULL);
+
+    // Every length across the kernels' block sizes at every alignment
+    for (Length = 0; Length <= 256; Length++)
+        for (Alignment = 0; Alignment < CHECKSUM_TEST_ALIGNMENT; Alignment++)
+            ChecksumTestKernels(Buffer, Length, Alignment);
+
+    for (Iteration = 0; Iteration < Iterations; Iteration++) {
+        Length = ChecksumTestRandom(CHECKSUM_TEST_MAXIMUM_LENGTH + 1);
+        Alignment = ChecksumTestRandom(CHECKSUM_TEST_ALIGNMENT);
+
+        ChecksumTestKernels(Buffer, Length, Alignment);
+
+        // The same chain with and without AVX2
+        ChecksumAvx2 = FALSE;
+        ChecksumTestMdl(Buffer, Length);
+
+        ChecksumAvx2 = Avx2;
+        if (Avx2)
+            ChecksumTestMdl(Buffer, Length);
+    }
+
+    ChecksumTestFallback();
+
+    free(Buffer);
+    ShimTeardown();
+
+    if (ChecksumTestFailures != 0) {
+        printf("checksum_test: %u failures\n", ChecksumTestFailures);
+        return 1;
+    }
+
+    printf("checksum_test: passed\n");
+    return 0;
+}
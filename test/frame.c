@@ -0,0 +1,315 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+
+#include <ndis.h>
+
+#include "frame.h"
+
+VOID
+FrameDefaultParameters(
+    OUT PFRAME_PARAMETERS   Parameters
+    )
+{
+    static const ETHERNET_ADDRESS   Destination = {{ 0x00, 0x16, 0x3e, 0x00, 0x00, 0x01 }};
+    static const ETHERNET_ADDRESS   Source = {{ 0x00, 0x16, 0x3e, 0x00, 0x00, 0x02 }};
+
+    RtlZeroMemory(Parameters, sizeof (FRAME_PARAMETERS));
+
+    Parameters->DestinationAddress = Destination;
+    Parameters->SourceAddress = Source;
+    Parameters->IpVersion = 4;
+    Parameters->Protocol = IPPROTO_TCP;
+    Parameters->SourceIpAddress = 0x0a000002;
+    Parameters->DestinationIpAddress = 0x0a000001;
+    Parameters->SourcePort = 40000;
+    Parameters->DestinationPort = 5001;
+    Parameters->Seq = 1;
+    Parameters->TcpFlags = TCP_ACK | TCP_PSH;
+    Parameters->PayloadLength = ETHERNET_MTU - sizeof (IPV4_HEADER) - sizeof (TCP_HEADER);
+}
+
+PFRAME
+FrameAllocate(
+    VOID
+    )
+{
+    PFRAME  Frame;
+
+    Frame = calloc(1, sizeof (FRAME));
+    if (Frame == NULL)
+        abort();
+
+    return Frame;
+}
+
+VOID
+FrameFree(
+    IN  PFRAME  Frame
+    )
+{
+    free(Frame);
+}
+
+ULONG
+FrameChecksum(
+    IN  ULONG       Sum,
+    IN  const VOID  *Data,
+    IN  ULONG       Length
+    )
+{
+    const UCHAR     *Byte = Data;
+    ULONG           Index;
+
+    // Even bytes are the low half of each 16-bit word in memory
+    for (Index = 0; Index < Length; Index++) {
+        Sum += (Index & 1) ? (ULONG)Byte[Index] << 8 : Byte[Index];
+        Sum = (Sum & 0xFFFF) + (Sum >> 16);
+    }
+
+    return Sum;
+}
+
+static ULONG
+FramePseudoHeaderChecksum(
+    IN  const IP_HEADER *IpHeader,
+    IN  UCHAR           Protocol,
+    IN  ULONG           Length
+    )
+{
+    PSEUDO_HEADER       PseudoHeader;
+
+    RtlZeroMemory(&PseudoHeader, sizeof (PseudoHeader));
+
+    if (IpHeader->Version == 4) {
+        PseudoHeader.Version4.SourceAddress = IpHeader->Version4.SourceAddress;
+        PseudoHeader.Version4.DestinationAddress = IpHeader->Version4.DestinationAddress;
+        PseudoHeader.Version4.Protocol = Protocol;
+        PseudoHeader.Version4.Length = HTONS((USHORT)Length);
+
+        return FrameChecksum(0, &PseudoHeader.Version4, sizeof (IPV4_PSEUDO_HEADER));
+    }
+
+    PseudoHeader.Version6.SourceAddress = IpHeader->Version6.SourceAddress;
+    PseudoHeader.Version6.DestinationAddress = IpHeader->Version6.DestinationAddress;
+    PseudoHeader.Version6.NextHeader = Protocol;
+    PseudoHeader.Version6.Length = HTONS((USHORT)Length);
+
+    return FrameChecksum(0, &PseudoHeader.Version6, sizeof (IPV6_PSEUDO_HEADER));
+}
+
+VOID
+FrameBuild(
+    OUT PFRAME              Frame,
+    IN  PFRAME_PARAMETERS   Parameters
+    )
+{
+    PETHERNET_UNTAGGED_HEADER   EthernetHeader;
+    PIP_HEADER                  IpHeader;
+    ULONG                       IpHeaderLength;
+    ULONG                       TransportHeaderLength;
+    ULONG                       TransportLength;
+    PUCHAR                      Payload;
+    PUSHORT                     Checksum;
+    ULONG                       Sum;
+    ULONG                       Offset;
+    ULONG                       Index;
+
+    RtlZeroMemory(Frame, FIELD_OFFSET(FRAME, Data));
+
+    IpHeaderLength = (Parameters->IpVersion == 4) ?
+                     sizeof (IPV4_HEADER) :
+                     sizeof (IPV6_HEADER);
+    TransportHeaderLength = (Parameters->Protocol == IPPROTO_TCP) ?
+                            sizeof (TCP_HEADER) + Parameters->TcpOptionsLength :
+                            sizeof (UDP_HEADER);
+    TransportLength = TransportHeaderLength + Parameters->PayloadLength;
+
+    Frame->Length = sizeof (ETHERNET_UNTAGGED_HEADER) + IpHeaderLength + TransportLength;
+    if (Frame->Length > FRAME_MAXIMUM_LENGTH)
+        abort();
+
+    Offset = 0;
+
+    EthernetHeader = (PETHERNET_UNTAGGED_HEADER)&Frame->Data[Offset];
+    EthernetHeader->DestinationAddress = Parameters->DestinationAddress;
+    EthernetHeader->SourceAddress = Parameters->SourceAddress;
+    EthernetHeader->TypeOrLength = HTONS((Parameters->IpVersion == 4) ?
+                                         ETHERTYPE_IPV4 :
+                                         ETHERTYPE_IPV6);
+
+    Frame->Info.EthernetHeader.Offset = Offset;
+    Frame->Info.EthernetHeader.Length = sizeof (ETHERNET_UNTAGGED_HEADER);
+    Offset += sizeof (ETHERNET_UNTAGGED_HEADER);
+
+    IpHeader = (PIP_HEADER)&Frame->Data[Offset];
+    RtlZeroMemory(IpHeader, IpHeaderLength);
+
+    if (Parameters->IpVersion == 4) {
+        PIPV4_HEADER    Version4 = &IpHeader->Version4;
+
+        Version4->Version = 4;
+        Version4->HeaderLength = sizeof (IPV4_HEADER) >> 2;
+        Version4->PacketLength = HTONS((USHORT)(IpHeaderLength + TransportLength));
+        Version4->PacketID = HTONS((USHORT)Parameters->Seq);
+        Version4->FragmentOffsetAndFlags = HTONS(0x4000);
+        Version4->TimeToLive = 64;
+        Version4->Protocol = Parameters->Protocol;
+        Version4->SourceAddress.Dword[0] = HTONL(Parameters->SourceIpAddress);
+        Version4->DestinationAddress.Dword[0] = HTONL(Parameters->DestinationIpAddress);
+        Version4->Checksum = (USHORT)~FrameChecksum(0, Version4, sizeof (IPV4_HEADER));
+    } else {
+        PIPV6_HEADER    Version6 = &IpHeader->Version6;
+
+        Version6->VCF = HTONL(6u << 28);
+        Version6->PayloadLength = HTONS((USHORT)TransportLength);
+        Version6->NextHeader = Parameters->Protocol;
+        Version6->HopLimit = 64;
+        Version6->SourceAddress.Byte[0] = 0xfd;
+        Version6->SourceAddress.Dword[3] = HTONL(Parameters->SourceIpAddress);
+        Version6->DestinationAddress.Byte[0] = 0xfd;
+        Version6->DestinationAddress.Dword[3] = HTONL(Parameters->DestinationIpAddress);
+    }
+
+    Frame->Info.IpHeader.Offset = Offset;
+    Frame->Info.IpHeader.Length = IpHeaderLength;
+    Offset += IpHeaderLength;
+
+    if (Parameters->Protocol == IPPROTO_TCP) {
+        PTCP_HEADER TcpHeader = (PTCP_HEADER)&Frame->Data[Offset];
+
+        RtlZeroMemory(TcpHeader, sizeof (TCP_HEADER));
+
+        TcpHeader->SourcePort = HTONS(Parameters->SourcePort);
+        TcpHeader->DestinationPort = HTONS(Parameters->DestinationPort);
+        TcpHeader->Seq = HTONL(Parameters->Seq);
+        TcpHeader->Ack = HTONL(1);
+        TcpHeader->HeaderLength = (UCHAR)(TransportHeaderLength >> 2);
+        TcpHeader->Flags = Parameters->TcpFlags;
+        TcpHeader->Window = HTONS(0xFFFF);
+
+        Frame->Info.TcpHeader.Offset = Offset;
+        Frame->Info.TcpHeader.Length = sizeof (TCP_HEADER);
+
+        RtlFillMemory(TcpHeader + 1, Parameters->TcpOptionsLength, TCPOPT_NOP);
+
+        if (Parameters->TcpOptionsLength != 0) {
+            Frame->Info.TcpOptions.Offset = Offset + sizeof (TCP_HEADER);
+            Frame->Info.TcpOptions.Length = Parameters->TcpOptionsLength;
+        }
+
+        Checksum = &TcpHeader->Checksum;
+    } else {
+        PUDP_HEADER UdpHeader = (PUDP_HEADER)&Frame->Data[Offset];
+
+        UdpHeader->SourcePort = HTONS(Parameters->SourcePort);
+        UdpHeader->DestinationPort = HTONS(Parameters->DestinationPort);
+        UdpHeader->PacketLength = HTONS((USHORT)TransportLength);
+        UdpHeader->Checksum = 0;
+
+        Frame->Info.UdpHeader.Offset = Offset;
+        Frame->Info.UdpHeader.Length = sizeof (UDP_HEADER);
+
+        Checksum = &UdpHeader->Checksum;
+    }
+
+    Frame->Info.Length = Offset + TransportHeaderLength;
+
+    Payload = &Frame->Data[Offset + TransportHeaderLength];
+    for (Index = 0; Index < Parameters->PayloadLength; Index++)
+        Payload[Index] = (UCHAR)(Parameters->PayloadSeed + Parameters->Seq + Index);
+
+    Sum = FramePseudoHeaderChecksum(IpHeader, Parameters->Protocol, TransportLength);
+
+    if (Parameters->PartialChecksum) {
+        *Checksum = (USHORT)Sum;
+    } else {
+        Sum = FrameChecksum(Sum, &Frame->Data[Offset], TransportLength);
+        *Checksum = (USHORT)~Sum;
+
+        // Zero means no checksum, so send the other zero
+        if (Parameters->Protocol == IPPROTO_UDP && *Checksum == 0)
+            *Checksum = 0xFFFF;
+    }
+}
+
+BOOLEAN
+FrameCheckChecksums(
+    IN  const UCHAR             *Data,
+    IN  ULONG                   Length
+    )
+{
+    const ETHERNET_HEADER       *EthernetHeader;
+    const IP_HEADER             *IpHeader;
+    ULONG                       Offset;
+    ULONG                       IpHeaderLength;
+    ULONG                       TransportLength;
+    UCHAR                       Protocol;
+    ULONG                       Sum;
+
+    EthernetHeader = (const ETHERNET_HEADER *)Data;
+    Offset = ETHERNET_HEADER_IS_TAGGED(EthernetHeader) ?
+             sizeof (ETHERNET_TAGGED_HEADER) :
+             sizeof (ETHERNET_UNTAGGED_HEADER);
+
+    if (Length < Offset + sizeof (IPV4_HEADER))
+        return FALSE;
+
+    IpHeader = (const IP_HEADER *)&Data[Offset];
+
+    if (IpHeader->Version == 4) {
+        IpHeaderLength = IPV4_HEADER_LENGTH(&IpHeader->Version4);
+
+        if (FrameChecksum(0, IpHeader, IpHeaderLength) != 0xFFFF)
+            return FALSE;
+
+        TransportLength = NTOHS(IpHeader->Version4.PacketLength) - IpHeaderLength;
+        Protocol = IpHeader->Version4.Protocol;
+    } else {
+        IpHeaderLength = sizeof (IPV6_HEADER);
+        TransportLength = NTOHS(IpHeader->Version6.PayloadLength);
+        Protocol = IpHeader->Version6.NextHeader;
+    }
+
+    Offset += IpHeaderLength;
+    if (Length < Offset + TransportLength)
+        return FALSE;
+
+    if (Protocol == IPPROTO_UDP && IpHeader->Version == 4 &&
+        ((const UDP_HEADER *)&Data[Offset])->Checksum == 0)
+        return TRUE;
+
+    Sum = FramePseudoHeaderChecksum(IpHeader, Protocol, TransportLength);
+    Sum = FrameChecksum(Sum, &Data[Offset], TransportLength);
+
+    return (Sum == 0xFFFF) ? TRUE : FALSE;
+}
@@ -0,0 +1,127 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Builds Ethernet frames carrying TCP or UDP over IPv4 or IPv6, as the
+// backend would hand them to the receiver or NDIS to the transmitter,
+// and checks them with a plain byte-at-a-time Internet checksum that
+// shares no code with the driver's.
+
+#ifndef _TEST_FRAME_H
+#define _TEST_FRAME_H
+
+#include <ndis.h>
+#include <ethernet.h>
+#include <tcpip.h>
+#include <vif_interface.h>
+
+// Big enough for the largest send NDIS may offload
+#define FRAME_MAXIMUM_LENGTH    (65536 + 256)
+
+typedef struct _FRAME_PARAMETERS {
+    ETHERNET_ADDRESS        DestinationAddress;
+    ETHERNET_ADDRESS        SourceAddress;
+    UCHAR                   IpVersion;          // 4 or 6
+    UCHAR                   Protocol;           // IPPROTO_TCP or IPPROTO_UDP
+
+    // In host order. IPv6 addresses are fd00::/64 with these as the last
+    // 32 bits.
+    ULONG                   SourceIpAddress;
+    ULONG                   DestinationIpAddress;
+
+    USHORT                  SourcePort;
+    USHORT                  DestinationPort;
+    ULONG                   Seq;
+    UCHAR                   TcpFlags;
+    ULONG                   TcpOptionsLength;   // Multiple of 4
+    ULONG                   PayloadLength;
+
+    // Payload byte n is PayloadSeed + Seq + n, so the segments of a TCP
+    // stream carry the bytes the unsegmented send would have.
+    UCHAR                   PayloadSeed;
+
+    // Leave the TCP or UDP checksum holding just the pseudo-header sum,
+    // as NDIS does for a send with checksum offload.
+    BOOLEAN                 PartialChecksum;
+} FRAME_PARAMETERS, *PFRAME_PARAMETERS;
+
+typedef struct _FRAME {
+    ULONG                   Length;
+    XENVIF_PACKET_INFO      Info;
+
+    // Passed with the frame when it is received
+    XENVIF_CHECKSUM_FLAGS   Flags;
+    USHORT                  TagControlInformation;
+    USHORT                  MaximumSegmentSize;
+
+    UCHAR                   Data[FRAME_MAXIMUM_LENGTH];
+} FRAME, *PFRAME;
+
+// A TCP/IPv4 frame with a 1460 byte payload between two fixed unicast
+// addresses.
+VOID
+FrameDefaultParameters(
+    OUT PFRAME_PARAMETERS   Parameters
+    );
+
+PFRAME
+FrameAllocate(
+    VOID
+    );
+
+VOID
+FrameFree(
+    IN  PFRAME  Frame
+    );
+
+VOID
+FrameBuild(
+    OUT PFRAME              Frame,
+    IN  PFRAME_PARAMETERS   Parameters
+    );
+
+// Uncomplemented, folded 16-bit sum in the same byte order convention as
+// checksum.h, computed a byte at a time.
+ULONG
+FrameChecksum(
+    IN  ULONG       Sum,
+    IN  const VOID  *Data,
+    IN  ULONG       Length
+    );
+
+// TRUE if the IPv4 header checksum (if any) and the TCP or UDP checksum
+// of Data are correct.
+BOOLEAN
+FrameCheckChecksums(
+    IN  const UCHAR *Data,
+    IN  ULONG       Length
+    );
+
+#endif  // _TEST_FRAME_H
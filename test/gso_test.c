@@ -0,0 +1,818 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Tests of large send segmentation against a reference segmenter written
+// from the RFCs, which shares no code with the driver and computes its
+// checksums with frame.c: first GsoPrepare() and GsoBuildHeader() alone
+// over a grid of header layouts, segment sizes and payload lengths and
+// over random cases, then the transmitter's software segmentation end to
+// end over the mock backend, with sends split into MDLs of various
+// sizes. The driver source is included so that its segments can be
+// compared byte for byte.
+//
+// gso_test [test ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/xennet/gso.c"
+
+#include "harness.h"
+
+typedef struct _GSO_TEST {
+    const CHAR  *Name;
+    VOID        (*Function)(VOID);
+} GSO_TEST, *PGSO_TEST;
+
+// A large send: the layout of its headers, what it carries and how it is
+// to be cut up
+typedef struct _GSO_TEST_CASE {
+    UCHAR   IpVersion;
+    BOOLEAN Tagged;
+    ULONG   ExtensionLength;        // IPv6 destination options, multiple of 8
+    ULONG   TcpOptionsLength;       // Multiple of 4
+    UCHAR   TcpFlags;
+    ULONG   PayloadLength;
+    ULONG   MaximumSegmentSize;
+} GSO_TEST_CASE, *PGSO_TEST_CASE;
+
+// The headers of a built send
+typedef struct _GSO_TEST_LAYOUT {
+    ULONG   IpHeaderOffset;
+    ULONG   TcpHeaderOffset;
+    ULONG   HeaderLength;
+} GSO_TEST_LAYOUT, *PGSO_TEST_LAYOUT;
+
+// Largest segment the reference is asked for
+#define GSO_TEST_MAXIMUM_SEGMENT_SIZE   9000
+
+#define GSO_TEST_SEGMENT_LENGTH     (GSO_MAXIMUM_HEADER_LENGTH + GSO_TEST_MAXIMUM_SEGMENT_SIZE)
+
+static UCHAR    GsoTestReference[GSO_TEST_SEGMENT_LENGTH];
+static UCHAR    GsoTestSegment[GSO_TEST_SEGMENT_LENGTH];
+
+static ULONG64  GsoTestState = 0x9E3779B97F4A7C15ull;
+
+static ULONG
+GsoTestRandom(
+    IN  ULONG   Limit
+    )
+{
+    // xorshift64*
+    GsoTestState ^= GsoTestState >> 12;
+    GsoTestState ^= GsoTestState << 25;
+    GsoTestState ^= GsoTestState >> 27;
+
+    return (ULONG)(((GsoTestState * 2685821657736338717ull) >> 32) % Limit);
+}
+
+// Most payload a send with this case's headers can carry within
+// GSO_MAXIMUM_SIZE, which counts the IPv6 fixed header too
+static ULONG
+GsoTestMaximumPayload(
+    IN  PGSO_TEST_CASE  Case
+    )
+{
+    ULONG               Length;
+
+    Length = (Case->IpVersion == 4) ? sizeof (IPV4_HEADER) : sizeof (IPV6_HEADER);
+    Length += Case->ExtensionLength + sizeof (TCP_HEADER) + Case->TcpOptionsLength;
+
+    return GSO_MAXIMUM_SIZE - Length;
+}
+
+static VOID
+GsoTestDescribe(
+    IN  PGSO_TEST_CASE  Case
+    )
+{
+    fprintf(stderr, "gso_test: IPv%u%s extension %u options %u flags %02x payload %u mss %u\n",
+            Case->IpVersion,
+            Case->Tagged ? " tagged" : "",
+            Case->ExtensionLength,
+            Case->TcpOptionsLength,
+            Case->TcpFlags,
+            Case->PayloadLength,
+            Case->MaximumSegmentSize);
+}
+
+// Opens a gap of Length bytes at Offset into Frame
+static VOID
+GsoTestInsert(
+    IN  PFRAME  Frame,
+    IN  ULONG   Offset,
+    IN  ULONG   Length
+    )
+{
+    SHIM_CHECK(Frame->Length + Length <= FRAME_MAXIMUM_LENGTH);
+
+    memmove(&Frame->Data[Offset + Length], &Frame->Data[Offset], Frame->Length - Offset);
+    RtlZeroMemory(&Frame->Data[Offset], Length);
+
+    Frame->Length += Length;
+}
+
+// Builds the send as NDIS would pass it for LSO, with the TCP checksum
+// holding the pseudo-header sum. The sequence number and IPv4 ID are
+// close enough to wrapping that a long send wraps both.
+static VOID
+GsoTestBuild(
+    IN  PGSO_TEST_CASE      Case,
+    OUT PFRAME              Frame,
+    OUT PGSO_TEST_LAYOUT    Layout
+    )
+{
+    FRAME_PARAMETERS        Parameters;
+    PIPV6_HEADER            Version6;
+    PTCP_HEADER             TcpHeader;
+
+    FrameDefaultParameters(&Parameters);
+    Parameters.IpVersion = Case->IpVersion;
+    Parameters.Seq = 0xFFFFFF00;
+    Parameters.TcpFlags = Case->TcpFlags;
+    Parameters.TcpOptionsLength = Case->TcpOptionsLength;
+    Parameters.PayloadLength = Case->PayloadLength;
+    Parameters.PayloadSeed = (UCHAR)Case->MaximumSegmentSize;
+    Parameters.PartialChecksum = TRUE;
+
+    FrameBuild(Frame, &Parameters);
+
+    Layout->IpHeaderOffset = sizeof (ETHERNET_UNTAGGED_HEADER);
+    Layout->TcpHeaderOffset = Layout->IpHeaderOffset +
+                              ((Case->IpVersion == 4) ? sizeof (IPV4_HEADER) : sizeof (IPV6_HEADER));
+
+    if (Case->ExtensionLength != 0) {
+        PUCHAR  Extension;
+
+        SHIM_CHECK(Case->IpVersion == 6);
+        SHIM_CHECK(Case->ExtensionLength % 8 == 0);
+
+        GsoTestInsert(Frame, Layout->TcpHeaderOffset, Case->ExtensionLength);
+
+        // Next Header, Hdr Ext Len and a PadN option filling the rest
+        Extension = &Frame->Data[Layout->TcpHeaderOffset];
+        Extension[0] = IPPROTO_TCP;
+        Extension[1] = (UCHAR)((Case->ExtensionLength / 8) - 1);
+        Extension[2] = 1;
+        Extension[3] = (UCHAR)(Case->ExtensionLength - 4);
+
+        Version6 = (PIPV6_HEADER)&Frame->Data[Layout->IpHeaderOffset];
+        Version6->NextHeader = IPPROTO_DST_OPTIONS;
+        Version6->PayloadLength = HTONS((USHORT)(NTOHS(Version6->PayloadLength) +
+                                                 Case->ExtensionLength));
+
+        Layout->TcpHeaderOffset += Case->ExtensionLength;
+    }
+
+    if (Case->Tagged) {
+        PETHERNET_TAGGED_HEADER Tagged;
+
+        GsoTestInsert(Frame, FIELD_OFFSET(ETHERNET_TAGGED_HEADER, Tag), sizeof (ETHERNET_TAG));
+
+        Tagged = (PETHERNET_TAGGED_HEADER)Frame->Data;
+        Tagged->Tag.ProtocolID = HTONS(ETHERTYPE_TPID);
+        Tagged->Tag.ControlInformation = HTONS(0x2064);
+
+        Layout->IpHeaderOffset += sizeof (ETHERNET_TAG);
+        Layout->TcpHeaderOffset += sizeof (ETHERNET_TAG);
+    }
+
+    TcpHeader = (PTCP_HEADER)&Frame->Data[Layout->TcpHeaderOffset];
+    Layout->HeaderLength = Layout->TcpHeaderOffset + TCP_HEADER_LENGTH(TcpHeader);
+}
+
+// The reference: segment Index of the send in Data as RFC 793 and RFCs
+// 791 and 8200 have it. Every segment carries a copy of the headers and
+// the next MaximumSegmentSize bytes of payload, its sequence number
+// advanced by the payload before it; FIN and PSH stay only on the last
+// and CWR only on the first; the IPv4 ID goes up by one per segment; the
+// IP lengths are set to match and the checksums are complete. Returns the
+// segment's length, or 0 if there is no such segment.
+static ULONG
+GsoTestReferenceSegment(
+    IN  const UCHAR         *Data,
+    IN  ULONG               Length,
+    IN  PGSO_TEST_LAYOUT    Layout,
+    IN  ULONG               MaximumSegmentSize,
+    IN  ULONG               Index,
+    OUT PUCHAR              Segment
+    )
+{
+    ULONG                   PayloadLength;
+    ULONG                   Start;
+    ULONG                   Count;
+    PIP_HEADER              IpHeader;
+    PTCP_HEADER             TcpHeader;
+    PSEUDO_HEADER           PseudoHeader;
+    ULONG                   TcpLength;
+    ULONG                   Sum;
+
+    PayloadLength = Length - Layout->HeaderLength;
+
+    Start = Index * MaximumSegmentSize;
+    if (Start >= PayloadLength)
+        return 0;
+
+    Count = PayloadLength - Start;
+    if (Count > MaximumSegmentSize)
+        Count = MaximumSegmentSize;
+
+    SHIM_CHECK(Layout->HeaderLength + Count <= GSO_TEST_SEGMENT_LENGTH);
+
+    memcpy(Segment, Data, Layout->HeaderLength);
+    memcpy(Segment + Layout->HeaderLength, Data + Layout->HeaderLength + Start, Count);
+
+    Length = Layout->HeaderLength + Count;
+
+    TcpHeader = (PTCP_HEADER)(Segment + Layout->TcpHeaderOffset);
+    TcpHeader->Seq = HTONL(NTOHL(TcpHeader->Seq) + Start);
+
+    if (Start + Count != PayloadLength)
+        TcpHeader->Flags &= ~(TCP_FIN | TCP_PSH);
+    if (Index != 0)
+        TcpHeader->Flags &= ~TCP_CWR;
+
+    IpHeader = (PIP_HEADER)(Segment + Layout->IpHeaderOffset);
+    TcpLength = Length - Layout->TcpHeaderOffset;
+
+    RtlZeroMemory(&PseudoHeader, sizeof (PseudoHeader));
+
+    if (IpHeader->Version == 4) {
+        PIPV4_HEADER    Version4 = &IpHeader->Version4;
+
+        Version4->PacketLength = HTONS((USHORT)(Length - Layout->IpHeaderOffset));
+        Version4->PacketID = HTONS((USHORT)(NTOHS(Version4->PacketID) + Index));
+        Version4->Checksum = 0;
+        Version4->Checksum = (USHORT)~FrameChecksum(0, Version4, IPV4_HEADER_LENGTH(Version4));
+
+        PseudoHeader.Version4.SourceAddress = Version4->SourceAddress;
+        PseudoHeader.Version4.DestinationAddress = Version4->DestinationAddress;
+        PseudoHeader.Version4.Protocol = IPPROTO_TCP;
+        PseudoHeader.Version4.Length = HTONS((USHORT)TcpLength);
+
+        Sum = FrameChecksum(0, &PseudoHeader.Version4, sizeof (IPV4_PSEUDO_HEADER));
+    } else {
+        PIPV6_HEADER    Version6 = &IpHeader->Version6;
+
+        Version6->PayloadLength = HTONS((USHORT)(Length - Layout->IpHeaderOffset - sizeof (IPV6_HEADER)));
+
+        PseudoHeader.Version6.SourceAddress = Version6->SourceAddress;
+        PseudoHeader.Version6.DestinationAddress = Version6->DestinationAddress;
+        PseudoHeader.Version6.NextHeader = IPPROTO_TCP;
+        PseudoHeader.Version6.Length = HTONS((USHORT)TcpLength);
+
+        Sum = FrameChecksum(0, &PseudoHeader.Version6, sizeof (IPV6_PSEUDO_HEADER));
+    }
+
+    TcpHeader->Checksum = 0;
+    TcpHeader->Checksum = (USHORT)~FrameChecksum(Sum, TcpHeader, TcpLength);
+
+    return Length;
+}
+
+// Checks that segment Index, Length bytes long, matches the reference
+static VOID
+GsoTestCheckSegment(
+    IN  PGSO_TEST_CASE      Case,
+    IN  PFRAME              Frame,
+    IN  PGSO_TEST_LAYOUT    Layout,
+    IN  ULONG               Index,
+    IN  const UCHAR         *Segment,
+    IN  ULONG               Length
+    )
+{
+    ULONG                   Expected;
+    ULONG                   Offset;
+
+    Expected = GsoTestReferenceSegment(Frame->Data,
+                                       Frame->Length,
+                                       Layout,
+                                       Case->MaximumSegmentSize,
+                                       Index,
+                                       GsoTestReference);
+
+    // frame.c does not follow IPv6 extension headers
+    if (Case->ExtensionLength == 0)
+        SHIM_CHECK(FrameCheckChecksums(GsoTestReference, Expected));
+
+    if (Length == Expected && memcmp(Segment, GsoTestReference, Length) == 0)
+        return;
+
+    for (Offset = 0; Offset < Length && Offset < Expected; Offset++)
+        if (Segment[Offset] != GsoTestReference[Offset])
+            break;
+
+    GsoTestDescribe(Case);
+    fprintf(stderr, "gso_test: segment %u: length %u expected %u, first difference at %u\n",
+            Index, Length, Expected, Offset);
+    SHIM_CHECK(FALSE);
+}
+
+// Cuts the case's send up with GsoPrepare() and GsoBuildHeader(), puts
+// each segment's payload after its headers and finishes its TCP checksum
+// as the backend would, and compares every segment with the reference.
+static VOID
+GsoTestSegmentCase(
+    IN  PGSO_TEST_CASE  Case,
+    IN  PFRAME          Frame
+    )
+{
+    GSO_TEST_LAYOUT     Layout;
+    GSO_TEMPLATE        Template;
+    ULONG               HeaderLength;
+    ULONG               Offset;
+    ULONG               Index;
+
+    GsoTestBuild(Case, Frame, &Layout);
+
+    HeaderLength = Frame->Length;
+    if (HeaderLength > GSO_MAXIMUM_HEADER_LENGTH)
+        HeaderLength = GSO_MAXIMUM_HEADER_LENGTH;
+
+    if (!GsoPrepare(&Template,
+                    Frame->Data,
+                    HeaderLength,
+                    Frame->Length,
+                    Case->IpVersion,
+                    Layout.TcpHeaderOffset,
+                    Case->MaximumSegmentSize)) {
+        GsoTestDescribe(Case);
+        SHIM_CHECK(FALSE);
+    }
+
+    SHIM_CHECK(Template.HeaderLength == Layout.HeaderLength);
+    SHIM_CHECK(Template.SegmentCount ==
+               (Case->PayloadLength + Case->MaximumSegmentSize - 1) / Case->MaximumSegmentSize);
+
+    Offset = Template.HeaderLength;
+    for (Index = 0; Index < Template.SegmentCount; Index++) {
+        ULONG       PayloadLength;
+        PTCP_HEADER TcpHeader;
+        ULONG       TcpLength;
+
+        PayloadLength = GsoBuildHeader(&Template, Index, GsoTestSegment);
+        SHIM_CHECK(PayloadLength != 0 && PayloadLength <= Case->MaximumSegmentSize);
+        SHIM_CHECK(Offset + PayloadLength <= Frame->Length);
+
+        memcpy(GsoTestSegment + Template.HeaderLength, &Frame->Data[Offset], PayloadLength);
+        Offset += PayloadLength;
+
+        // The checksum field already holds the pseudo-header sum
+        TcpHeader = (PTCP_HEADER)(GsoTestSegment + Template.TcpHeaderOffset);
+        TcpLength = Template.HeaderLength - Template.TcpHeaderOffset + PayloadLength;
+        TcpHeader->Checksum = (USHORT)~FrameChecksum(0, TcpHeader, TcpLength);
+
+        GsoTestCheckSegment(Case,
+                            Frame,
+                            &Layout,
+                            Index,
+                            GsoTestSegment,
+                            Template.HeaderLength + PayloadLength);
+    }
+
+    // Every byte of payload went out, once
+    SHIM_CHECK(Offset == Frame->Length);
+    SHIM_CHECK(GsoTestReferenceSegment(Frame->Data,
+                                       Frame->Length,
+                                       &Layout,
+                                       Case->MaximumSegmentSize,
+                                       Index,
+                                       GsoTestReference) == 0);
+}
+
+static const ULONG  GsoTestMaximumSegmentSize[] = { 1, 7, 536, 1220, 1448, 1460, 8960 };
+static const ULONG  GsoTestTcpOptionsLength[] = { 0, 12, 40 };
+
+// Payloads either side of one and several segments, and the largest
+// datagram, for every header layout and segment size
+static VOID
+GsoTestGrid(
+    VOID
+    )
+{
+    PFRAME          Frame;
+    ULONG           IpVersion;
+    ULONG           Tagged;
+    ULONG           ExtensionLength;
+    ULONG           Options;
+    ULONG           Size;
+    ULONG           Count;
+
+    Frame = FrameAllocate();
+
+    Count = 0;
+    for (IpVersion = 4; IpVersion <= 6; IpVersion += 2)
+    for (Tagged = 0; Tagged <= 1; Tagged++)
+    for (ExtensionLength = 0; ExtensionLength <= ((IpVersion == 6) ? 24 : 0); ExtensionLength += 8)
+    for (Options = 0; Options < ARRAYSIZE(GsoTestTcpOptionsLength); Options++)
+    for (Size = 0; Size < ARRAYSIZE(GsoTestMaximumSegmentSize); Size++) {
+        GSO_TEST_CASE   Case;
+        ULONG           Mss = GsoTestMaximumSegmentSize[Size];
+        ULONG           PayloadLength[6];
+        ULONG           Index;
+
+        Case.IpVersion = (UCHAR)IpVersion;
+        Case.Tagged = (BOOLEAN)Tagged;
+        Case.ExtensionLength = ExtensionLength;
+        Case.TcpOptionsLength = GsoTestTcpOptionsLength[Options];
+        Case.MaximumSegmentSize = Mss;
+
+        PayloadLength[0] = 1;
+        PayloadLength[1] = (Mss > 1) ? Mss - 1 : 2;
+        PayloadLength[2] = Mss;
+        PayloadLength[3] = Mss + 1;
+        PayloadLength[4] = (3 * Mss) + 5;
+        PayloadLength[5] = GsoTestMaximumPayload(&Case);
+
+        for (Index = 0; Index < ARRAYSIZE(PayloadLength); Index++) {
+            Case.PayloadLength = PayloadLength[Index];
+
+            // Flags that must be shared out, and flags that must not
+            Case.TcpFlags = (Count++ & 1) ?
+                            TCP_ACK :
+                            (TCP_ACK | TCP_PSH | TCP_FIN | TCP_CWR);
+
+            GsoTestSegmentCase(&Case, Frame);
+        }
+    }
+
+    printf("gso_test: %u cases\n", Count);
+
+    FrameFree(Frame);
+}
+
+#define GSO_TEST_RANDOM_CASES   2000
+
+static VOID
+GsoTestRandomCases(
+    VOID
+    )
+{
+    PFRAME          Frame;
+    ULONG           Count;
+
+    Frame = FrameAllocate();
+
+    for (Count = 0; Count < GSO_TEST_RANDOM_CASES; Count++) {
+        GSO_TEST_CASE   Case;
+
+        Case.IpVersion = GsoTestRandom(2) ? 6 : 4;
+        Case.Tagged = (BOOLEAN)GsoTestRandom(2);
+        Case.ExtensionLength = (Case.IpVersion == 6) ? GsoTestRandom(4) * 8 : 0;
+        Case.TcpOptionsLength = GsoTestRandom(11) * 4;
+        Case.TcpFlags = (UCHAR)GsoTestRandom(256);
+        Case.MaximumSegmentSize = 1 + GsoTestRandom(GSO_TEST_MAXIMUM_SEGMENT_SIZE);
+        Case.PayloadLength = 1 + GsoTestRandom(GsoTestMaximumPayload(&Case));
+
+        GsoTestSegmentCase(&Case, Frame);
+    }
+
+    FrameFree(Frame);
+}
+
+// TRUE if GsoPrepare() accepts the case's send, after Modify, if given,
+// has had a chance to spoil it.
+static BOOLEAN
+GsoTestAccepts(
+    IN  PGSO_TEST_CASE  Case,
+    IN  PFRAME          Frame,
+    IN  UCHAR           IpVersion,
+    IN  LONG            TcpHeaderAdjustment,
+    IN  VOID            (*Modify)(PFRAME, PGSO_TEST_LAYOUT) OPTIONAL
+    )
+{
+    GSO_TEST_LAYOUT     Layout;
+    GSO_TEMPLATE        Template;
+    ULONG               HeaderLength;
+
+    GsoTestBuild(Case, Frame, &Layout);
+
+    if (Modify != NULL)
+        Modify(Frame, &Layout);
+
+    HeaderLength = Frame->Length;
+    if (HeaderLength > GSO_MAXIMUM_HEADER_LENGTH)
+        HeaderLength = GSO_MAXIMUM_HEADER_LENGTH;
+
+    return GsoPrepare(&Template,
+                      Frame->Data,
+                      HeaderLength,
+                      Frame->Length,
+                      IpVersion,
+                      Layout.TcpHeaderOffset + TcpHeaderAdjustment,
+                      Case->MaximumSegmentSize);
+}
+
+static VOID
+GsoTestMakeUdp(
+    IN  PFRAME              Frame,
+    IN  PGSO_TEST_LAYOUT    Layout
+    )
+{
+    PIPV4_HEADER            IpHeader = (PIPV4_HEADER)&Frame->Data[Layout->IpHeaderOffset];
+
+    IpHeader->Protocol = IPPROTO_UDP;
+}
+
+static VOID
+GsoTestShortenTcpHeader(
+    IN  PFRAME              Frame,
+    IN  PGSO_TEST_LAYOUT    Layout
+    )
+{
+    PTCP_HEADER             TcpHeader = (PTCP_HEADER)&Frame->Data[Layout->TcpHeaderOffset];
+
+    TcpHeader->HeaderLength = 4;
+}
+
+// Sends that cannot be segmented are refused rather than mangled
+static VOID
+GsoTestReject(
+    VOID
+    )
+{
+    PFRAME          Frame;
+    GSO_TEST_CASE   Case;
+
+    Frame = FrameAllocate();
+
+    RtlZeroMemory(&Case, sizeof (Case));
+    Case.IpVersion = 4;
+    Case.TcpFlags = TCP_ACK;
+    Case.PayloadLength = 4000;
+    Case.MaximumSegmentSize = 1448;
+
+    SHIM_CHECK(GsoTestAccepts(&Case, Frame, 4, 0, NULL));
+
+    // The IP version, protocol and TCP header offset must agree with the
+    // headers
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 6, 0, NULL));
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 5, 0, NULL));
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, 4, NULL));
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, -4, NULL));
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, 0, GsoTestMakeUdp));
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, 0, GsoTestShortenTcpHeader));
+
+    Case.MaximumSegmentSize = 0;
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, 0, NULL));
+    Case.MaximumSegmentSize = 1448;
+
+    // Nothing to send
+    Case.PayloadLength = 0;
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, 0, NULL));
+
+    // Too large for one datagram
+    Case.PayloadLength = GsoTestMaximumPayload(&Case);
+    SHIM_CHECK(GsoTestAccepts(&Case, Frame, 4, 0, NULL));
+    Case.PayloadLength++;
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 4, 0, NULL));
+
+    // Headers too long to copy
+    Case.IpVersion = 6;
+    Case.PayloadLength = 4000;
+    Case.ExtensionLength = GSO_MAXIMUM_HEADER_LENGTH -
+                           sizeof (ETHERNET_UNTAGGED_HEADER) -
+                           sizeof (IPV6_HEADER) -
+                           sizeof (TCP_HEADER);
+    Case.ExtensionLength &= ~7;
+    SHIM_CHECK(GsoTestAccepts(&Case, Frame, 6, 0, NULL));
+    Case.ExtensionLength += 8;
+    SHIM_CHECK(!GsoTestAccepts(&Case, Frame, 6, 0, NULL));
+
+    FrameFree(Frame);
+}
+
+// Where the backend's packets are checked against the reference
+typedef struct _GSO_TEST_TRANSMIT {
+    PGSO_TEST_CASE      Case;
+    PFRAME              Frame;
+    GSO_TEST_LAYOUT     Layout;
+    ULONG               Next;
+} GSO_TEST_TRANSMIT, *PGSO_TEST_TRANSMIT;
+
+static VOID
+GsoTestTransmitPacket(
+    IN  PVOID                       Argument,
+    IN  ULONG                       Index,
+    IN  PXENVIF_TRANSMITTER_PACKET  Packet,
+    IN  PMDL                        Mdl,
+    IN  ULONG                       Offset,
+    IN  ULONG                       Length
+    )
+{
+    PGSO_TEST_TRANSMIT              Transmit = Argument;
+    ULONG                           Copied;
+
+    UNREFERENCED_PARAMETER(Index);
+
+    // No offloads are left for the backend
+    SHIM_CHECK(Packet->Send.OffloadOptions.Value == 0);
+    SHIM_CHECK(Length <= GSO_TEST_SEGMENT_LENGTH);
+
+    Copied = 0;
+    while (Copied < Length) {
+        PUCHAR  StartVa;
+        ULONG   Count;
+
+        SHIM_CHECK(Mdl != NULL);
+
+        if (Offset >= Mdl->ByteCount) {
+            Offset -= Mdl->ByteCount;
+            Mdl = Mdl->Next;
+            continue;
+        }
+
+        StartVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+
+        Count = Mdl->ByteCount - Offset;
+        if (Count > Length - Copied)
+            Count = Length - Copied;
+
+        memcpy(GsoTestSegment + Copied, StartVa + Offset, Count);
+
+        Copied += Count;
+        Offset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    GsoTestCheckSegment(Transmit->Case,
+                        Transmit->Frame,
+                        &Transmit->Layout,
+                        Transmit->Next++,
+                        GsoTestSegment,
+                        Length);
+}
+
+static const ULONG  GsoTestMdlLength[] = { 0, 1, 7, 54, 100, 1000, PAGE_SIZE };
+
+// The transmitter segments a large send itself when the backend cannot,
+// finishing the TCP checksum too when the backend cannot do that either,
+// whichever way the send is split into MDLs.
+static VOID
+GsoTestTransmit(
+    VOID
+    )
+{
+    static const ULONG      PayloadLength[] = { 1, 1448, 20000, 0 };
+    PADAPTER                Adapter;
+    PFRAME                  Frame;
+    GSO_TEST_TRANSMIT       Transmit;
+    TRANSMITTER_STATISTICS  Before;
+    TRANSMITTER_STATISTICS  After;
+    ULONG                   IpVersion;
+    ULONG                   Tagged;
+    ULONG                   Payload;
+    ULONG                   Split;
+
+    Frame = FrameAllocate();
+
+    HarnessInitialize(1, 0);
+
+    // The mock backend offers no offloads
+    Adapter = HarnessCreateAdapter(NULL, NULL);
+    SHIM_CHECK(Adapter->Transmitter->SoftwareOffloadOptions.OffloadIpVersion4LargePacket);
+    SHIM_CHECK(Adapter->Transmitter->SoftwareOffloadOptions.OffloadIpVersion6LargePacket);
+
+    MockVifSetTransmitHook(Adapter->VifInterface, GsoTestTransmitPacket, &Transmit);
+
+    for (IpVersion = 4; IpVersion <= 6; IpVersion += 2)
+    for (Tagged = 0; Tagged <= 1; Tagged++)
+    for (Payload = 0; Payload < ARRAYSIZE(PayloadLength); Payload++)
+    for (Split = 0; Split < ARRAYSIZE(GsoTestMdlLength); Split++) {
+        GSO_TEST_CASE                                       Case;
+        PNET_BUFFER_LIST                                    NetBufferList;
+        PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO   LargeSendInfo;
+        ULONG                                               Count;
+
+        RtlZeroMemory(&Case, sizeof (Case));
+        Case.IpVersion = (UCHAR)IpVersion;
+        Case.Tagged = (BOOLEAN)Tagged;
+        Case.ExtensionLength = (IpVersion == 6) ? 8 : 0;
+        Case.TcpOptionsLength = 12;
+        Case.TcpFlags = TCP_ACK | TCP_PSH;
+        Case.MaximumSegmentSize = 1448;
+        Case.PayloadLength = (PayloadLength[Payload] != 0) ?
+                             PayloadLength[Payload] :
+                             GsoTestMaximumPayload(&Case);
+
+        Transmit.Case = &Case;
+        Transmit.Frame = Frame;
+        Transmit.Next = 0;
+
+        GsoTestBuild(&Case, Frame, &Transmit.Layout);
+
+        NetBufferList = HarnessAllocateSend(Frame, GsoTestMdlLength[Split], NULL, NULL);
+
+        LargeSendInfo = (PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
+                                                                                                 TcpLargeSendNetBufferListInfo);
+        LargeSendInfo->LsoV2Transmit.Type = NDIS_TCP_LARGE_SEND_OFFLOAD_V2_TYPE;
+        LargeSendInfo->LsoV2Transmit.IPVersion = (IpVersion == 4) ?
+                                                 NDIS_TCP_LARGE_SEND_OFFLOAD_IPv4 :
+                                                 NDIS_TCP_LARGE_SEND_OFFLOAD_IPv6;
+        LargeSendInfo->LsoV2Transmit.TcpHeaderOffset = Transmit.Layout.TcpHeaderOffset;
+        LargeSendInfo->LsoV2Transmit.MSS = Case.MaximumSegmentSize;
+
+        TransmitterQueryStatistics(Adapter->Transmitter, &Before);
+
+        // At PASSIVE_LEVEL, so flushed and completed before it returns
+        TransmitterSendNetBufferLists(Adapter->Transmitter, NetBufferList, 0, 0);
+
+        TransmitterQueryStatistics(Adapter->Transmitter, &After);
+
+        Count = (Case.PayloadLength + Case.MaximumSegmentSize - 1) / Case.MaximumSegmentSize;
+
+        if (Transmit.Next != Count) {
+            GsoTestDescribe(&Case);
+            SHIM_CHECK(FALSE);
+        }
+
+        SHIM_CHECK(After.Segmented - Before.Segmented == 1);
+        SHIM_CHECK(After.Segments - Before.Segments == Count);
+        SHIM_CHECK(After.SegmentFailures == Before.SegmentFailures);
+        SHIM_CHECK(After.CompletedNetBufferLists - Before.CompletedNetBufferLists == 1);
+    }
+
+    MockVifSetTransmitHook(Adapter->VifInterface, NULL, NULL);
+
+    HarnessDestroyAdapter(Adapter);
+    HarnessTeardown();
+
+    FrameFree(Frame);
+}
+
+static GSO_TEST GsoTest[] = {
+    { "grid", GsoTestGrid },
+    { "random", GsoTestRandomCases },
+    { "reject", GsoTestReject },
+    { "transmit", GsoTestTransmit },
+};
+
+int
+main(
+    IN  int     argc,
+    IN  char    **argv
+    )
+{
+    ULONG       Index;
+    ULONG       Run;
+
+    // Keep what was printed if a check fails
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    Run = 0;
+    for (Index = 0; Index < ARRAYSIZE(GsoTest); Index++) {
+        PGSO_TEST   Test = &GsoTest[Index];
+
+        if (argc > 1) {
+            int Argument;
+
+            for (Argument = 1; Argument < argc; Argument++)
+                if (strcmp(argv[Argument], Test->Name) == 0)
+                    break;
+
+            if (Argument == argc)
+                continue;
+        }
+
+        printf("gso_test: %s\n", Test->Name);
+        Test->Function();
+        Run++;
+    }
+
+    if (Run == 0) {
+        fprintf(stderr, "gso_test: no such test\n");
+        return 2;
+    }
+
+    printf("gso_test: passed\n");
+    return 0;
+}
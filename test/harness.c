@@ -0,0 +1,660 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+typedef struct _HARNESS_PROCESSOR {
+    HARNESS_STATISTICS  Statistics;
+} DECLSPEC_CACHEALIGN HARNESS_PROCESSOR, *PHARNESS_PROCESSOR;
+
+static PHARNESS_PROCESSOR   HarnessProcessor;
+static ULONG                HarnessProcessorCount;
+static NDIS_HANDLE          HarnessSendPool;
+static HARNESS_RECEIVE      HarnessReceive;
+static PVOID                HarnessReceiveArgument;
+
+// Kept in the protocol reserved area of each send
+typedef struct _HARNESS_SEND_RESERVED {
+    HARNESS_SEND_COMPLETE   Function;
+    PVOID                   Argument;
+    PUCHAR                  Buffer;
+} HARNESS_SEND_RESERVED, *PHARNESS_SEND_RESERVED;
+
+C_ASSERT(sizeof (HARNESS_SEND_RESERVED) <= RTL_FIELD_SIZE(NET_BUFFER_LIST, ProtocolReserved));
+
+static FORCEINLINE PHARNESS_STATISTICS
+__HarnessGetStatistics(
+    VOID
+    )
+{
+    ULONG   Index = KeGetCurrentProcessorNumberEx(NULL);
+
+    SHIM_CHECK(Index < HarnessProcessorCount);
+    return &HarnessProcessor[Index].Statistics;
+}
+
+static VOID
+HarnessIndicateReceive(
+    IN  NDIS_HANDLE         NdisHandle,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PADAPTER                Adapter = (PADAPTER)NdisHandle;
+    PHARNESS_STATISTICS     Statistics;
+
+    Statistics = __HarnessGetStatistics();
+    Statistics->Indications++;
+    Statistics->IndicatedNetBufferLists += Count;
+
+    // The receiver takes these straight back
+    if (Flags & NDIS_RECEIVE_FLAGS_RESOURCES) {
+        Statistics->ResourceIndications++;
+        return;
+    }
+
+    if (HarnessReceive != NULL &&
+        HarnessReceive(HarnessReceiveArgument, Adapter, NetBufferList, Count, Flags))
+        return;
+
+    ReceiverReturnNetBufferLists(&Adapter->Receiver,
+                                 NetBufferList,
+                                 NDIS_TEST_RECEIVE_AT_DISPATCH_LEVEL(Flags) ?
+                                 NDIS_RETURN_FLAGS_DISPATCH_LEVEL :
+                                 0);
+}
+
+static VOID
+HarnessSendComplete(
+    IN  NDIS_HANDLE         NdisHandle,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Flags
+    )
+{
+    PHARNESS_STATISTICS     Statistics;
+
+    UNREFERENCED_PARAMETER(NdisHandle);
+    UNREFERENCED_PARAMETER(Flags);
+
+    Statistics = __HarnessGetStatistics();
+    Statistics->SendCompletions++;
+
+    while (NetBufferList != NULL) {
+        PNET_BUFFER_LIST        Next;
+        PHARNESS_SEND_RESERVED  Reserved;
+
+        Next = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+        NET_BUFFER_LIST_NEXT_NBL(NetBufferList) = NULL;
+
+        Statistics->SendCompletedNetBufferLists++;
+
+        Reserved = (PHARNESS_SEND_RESERVED)NET_BUFFER_LIST_PROTOCOL_RESERVED(NetBufferList);
+        if (Reserved->Function != NULL)
+            Reserved->Function(Reserved->Argument, NetBufferList);
+        else
+            HarnessFreeSend(NetBufferList);
+
+        NetBufferList = Next;
+    }
+}
+
+// The adapter's equivalent of AdapterVifCallback()
+static VOID
+HarnessVifCallback(
+    IN  PVOID                   Context,
+    IN  XENVIF_CALLBACK_TYPE    Type,
+    ...)
+{
+    PADAPTER                    Adapter = Context;
+    va_list                     Arguments;
+
+    va_start(Arguments, Type);
+
+    switch (Type) {
+    case XENVIF_CALLBACK_COMPLETE_PACKETS: {
+        PXENVIF_TRANSMITTER_PACKET HeadPacket;
+
+        HeadPacket = va_arg(Arguments, PXENVIF_TRANSMITTER_PACKET);
+
+        PollerCompletePackets(&Adapter->Poller, HeadPacket);
+        break;
+    }
+    case XENVIF_CALLBACK_RECEIVE_PACKETS: {
+        PLIST_ENTRY List;
+
+        List = va_arg(Arguments, PLIST_ENTRY);
+
+        PollerReceivePackets(&Adapter->Poller, List);
+        break;
+    }
+    default:
+        break;
+    }
+
+    va_end(Arguments);
+}
+
+VOID
+HarnessInitialize(
+    IN  ULONG                       ProcessorCount,
+    IN  ULONG                       GroupSize
+    )
+{
+    NET_BUFFER_LIST_POOL_PARAMETERS Parameters;
+
+    ShimInitialize(ProcessorCount, GroupSize);
+
+    HarnessProcessorCount = ProcessorCount;
+    SHIM_CHECK(posix_memalign((void **)&HarnessProcessor,
+                              64,
+                              sizeof (HARNESS_PROCESSOR) * ProcessorCount) == 0);
+    RtlZeroMemory(HarnessProcessor, sizeof (HARNESS_PROCESSOR) * ProcessorCount);
+
+    NdisZeroMemory(&Parameters, sizeof (Parameters));
+    Parameters.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
+    Parameters.Header.Revision = NET_BUFFER_LIST_POOL_PARAMETERS_REVISION_1;
+    Parameters.Header.Size = sizeof (Parameters);
+    Parameters.fAllocateNetBuffer = TRUE;
+    Parameters.PoolTag = 'SRAH';
+
+    HarnessSendPool = NdisAllocateNetBufferListPool(NULL, &Parameters);
+    SHIM_CHECK(HarnessSendPool != NULL);
+
+    ShimSetIndicateReceive(HarnessIndicateReceive);
+    ShimSetSendComplete(HarnessSendComplete);
+
+    ChecksumInitialize();
+}
+
+VOID
+HarnessTeardown(
+    VOID
+    )
+{
+    ShimSetIndicateReceive(NULL);
+    ShimSetSendComplete(NULL);
+
+    NdisFreeNetBufferListPool(HarnessSendPool);
+    HarnessSendPool = NULL;
+
+    free(HarnessProcessor);
+    HarnessProcessor = NULL;
+    HarnessProcessorCount = 0;
+
+    HarnessReceive = NULL;
+    HarnessReceiveArgument = NULL;
+
+    ShimTeardown();
+}
+
+VOID
+HarnessDefaultProperties(
+    OUT PPROPERTIES Properties
+    )
+{
+    RtlZeroMemory(Properties, sizeof (PROPERTIES));
+
+    Properties->ipv4_csum = 3;
+    Properties->tcpv4_csum = 3;
+    Properties->udpv4_csum = 3;
+    Properties->tcpv6_csum = 3;
+    Properties->udpv6_csum = 3;
+    Properties->need_csum_value = 1;
+    Properties->lsov4 = 1;
+    Properties->lsov6 = 1;
+    Properties->lrov4 = 1;
+    Properties->lrov6 = 1;
+    Properties->grov4 = 0;
+    Properties->grov6 = 0;
+    Properties->rx_in_flight_limit = 0;
+    Properties->rx_copy_break = 128;
+    Properties->rx_prewarm_factor = 2;
+    Properties->rss = 1;
+    Properties->vlan_id = 0;
+    Properties->rx_broadcast_limit = 0;
+    Properties->rx_multicast_limit = 0;
+    Properties->rx_budget = 256;
+    Properties->rx_budget_time = 100;
+    Properties->poll_threshold = 0;
+    Properties->tx_batch = 32;
+    Properties->tx_batch_time = 50;
+    Properties->tx_queues = TRANSMITTER_MAXIMUM_QUEUES;
+    Properties->tx_gso = 1;
+    Properties->sw_csum = 1;
+}
+
+#define HARNESS_PROPERTY(_Name) \
+        { #_Name, FIELD_OFFSET(PROPERTIES, _Name) }
+
+static const struct {
+    const CHAR  *Name;
+    ULONG       Offset;
+} HarnessProperty[] = {
+    HARNESS_PROPERTY(ipv4_csum),
+    HARNESS_PROPERTY(tcpv4_csum),
+    HARNESS_PROPERTY(udpv4_csum),
+    HARNESS_PROPERTY(tcpv6_csum),
+    HARNESS_PROPERTY(udpv6_csum),
+    HARNESS_PROPERTY(need_csum_value),
+    HARNESS_PROPERTY(lsov4),
+    HARNESS_PROPERTY(lsov6),
+    HARNESS_PROPERTY(lrov4),
+    HARNESS_PROPERTY(lrov6),
+    HARNESS_PROPERTY(grov4),
+    HARNESS_PROPERTY(grov6),
+    HARNESS_PROPERTY(rx_in_flight_limit),
+    HARNESS_PROPERTY(rx_copy_break),
+    HARNESS_PROPERTY(rx_prewarm_factor),
+    HARNESS_PROPERTY(rss),
+    HARNESS_PROPERTY(vlan_id),
+    HARNESS_PROPERTY(rx_broadcast_limit),
+    HARNESS_PROPERTY(rx_multicast_limit),
+    HARNESS_PROPERTY(rx_budget),
+    HARNESS_PROPERTY(rx_budget_time),
+    HARNESS_PROPERTY(poll_threshold),
+    HARNESS_PROPERTY(tx_batch),
+    HARNESS_PROPERTY(tx_batch_time),
+    HARNESS_PROPERTY(tx_queues),
+    HARNESS_PROPERTY(tx_gso),
+    HARNESS_PROPERTY(sw_csum)
+};
+
+#undef HARNESS_PROPERTY
+
+BOOLEAN
+HarnessSetProperty(
+    IN  PPROPERTIES Properties,
+    IN  const CHAR  *Assignment
+    )
+{
+    const CHAR      *Value;
+    ULONG           Index;
+
+    Value = strchr(Assignment, '=');
+    if (Value == NULL)
+        return FALSE;
+
+    for (Index = 0; Index < ARRAYSIZE(HarnessProperty); Index++) {
+        const CHAR  *Name = HarnessProperty[Index].Name;
+
+        if (strlen(Name) == (SIZE_T)(Value - Assignment) &&
+            strncmp(Name, Assignment, Value - Assignment) == 0) {
+            *(int *)((PUCHAR)Properties + HarnessProperty[Index].Offset) =
+                (int)strtol(Value + 1, NULL, 0);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// As OID_OFFLOAD_ENCAPSULATION sets them
+static VOID
+HarnessConfigureOffloads(
+    IN  PADAPTER            Adapter
+    )
+{
+    PPROPERTIES             Properties = &Adapter->Properties;
+    XENVIF_OFFLOAD_OPTIONS  Options;
+    PNDIS_OFFLOAD           Offload = &Adapter->Offload;
+
+    TransmitterQueryOffloadOptions(Adapter->Transmitter, &Options);
+
+    Adapter->Transmitter->OffloadOptions.Value = 0;
+    Adapter->Transmitter->OffloadOptions.OffloadTagManipulation = 1;
+
+    if (Properties->lsov4 && Options.OffloadIpVersion4LargePacket)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion4LargePacket = 1;
+
+    if (Properties->lsov6 && Options.OffloadIpVersion6LargePacket)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion6LargePacket = 1;
+
+    if ((Properties->ipv4_csum & 1) && Options.OffloadIpVersion4HeaderChecksum)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion4HeaderChecksum = 1;
+
+    if ((Properties->tcpv4_csum & 1) && Options.OffloadIpVersion4TcpChecksum)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion4TcpChecksum = 1;
+
+    if ((Properties->udpv4_csum & 1) && Options.OffloadIpVersion4UdpChecksum)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion4UdpChecksum = 1;
+
+    if ((Properties->tcpv6_csum & 1) && Options.OffloadIpVersion6TcpChecksum)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion6TcpChecksum = 1;
+
+    if ((Properties->udpv6_csum & 1) && Options.OffloadIpVersion6UdpChecksum)
+        Adapter->Transmitter->OffloadOptions.OffloadIpVersion6UdpChecksum = 1;
+
+    Adapter->Receiver.OffloadOptions.Value = 0;
+    Adapter->Receiver.OffloadOptions.OffloadTagManipulation = 1;
+
+    if (Properties->need_csum_value)
+        Adapter->Receiver.OffloadOptions.NeedChecksumValue = 1;
+
+    if (Properties->lrov4) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion4LargePacket = 1;
+        Adapter->Receiver.OffloadOptions.NeedLargePacketSplit = 1;
+    }
+
+    if (Properties->lrov6) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion6LargePacket = 1;
+        Adapter->Receiver.OffloadOptions.NeedLargePacketSplit = 1;
+    }
+
+    if (Properties->ipv4_csum & 2) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion4HeaderChecksum = 1;
+        Offload->Checksum.IPv4Receive.IpChecksum = 1;
+    }
+
+    if (Properties->tcpv4_csum & 2) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion4TcpChecksum = 1;
+        Offload->Checksum.IPv4Receive.TcpChecksum = 1;
+    }
+
+    if (Properties->udpv4_csum & 2) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion4UdpChecksum = 1;
+        Offload->Checksum.IPv4Receive.UdpChecksum = 1;
+    }
+
+    if (Properties->tcpv6_csum & 2) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion6TcpChecksum = 1;
+        Offload->Checksum.IPv6Receive.TcpChecksum = 1;
+    }
+
+    if (Properties->udpv6_csum & 2) {
+        Adapter->Receiver.OffloadOptions.OffloadIpVersion6UdpChecksum = 1;
+        Offload->Checksum.IPv6Receive.UdpChecksum = 1;
+    }
+
+    VIF(UpdateOffloadOptions,
+        Adapter->VifInterface,
+        Adapter->Receiver.OffloadOptions);
+}
+
+PADAPTER
+HarnessCreateAdapter(
+    IN  PPROPERTIES             Properties OPTIONAL,
+    IN  PMOCK_VIF_CONFIGURATION Configuration OPTIONAL
+    )
+{
+    MOCK_VIF_CONFIGURATION      DefaultConfiguration;
+    PADAPTER                    Adapter;
+    PXENVIF_VIF_INTERFACE       Interface;
+    NDIS_STATUS                 ndisStatus;
+    NTSTATUS                    status;
+
+    if (Configuration == NULL) {
+        MockVifDefaultConfiguration(&DefaultConfiguration);
+        Configuration = &DefaultConfiguration;
+    }
+
+    Adapter = calloc(1, sizeof (ADAPTER));
+    SHIM_CHECK(Adapter != NULL);
+
+    if (Properties != NULL)
+        Adapter->Properties = *Properties;
+    else
+        HarnessDefaultProperties(&Adapter->Properties);
+
+    Interface = MockVifCreate(Configuration);
+
+    Adapter->VifInterface = Interface;
+    Adapter->VifInterfaceVersion = Configuration->Version;
+    Adapter->NdisAdapterHandle = (NDIS_HANDLE)Adapter;
+
+    VIF(QueryMaximumFrameSize,
+        Adapter->VifInterface,
+        &Adapter->MaximumFrameSize);
+
+    Adapter->Transmitter = ExAllocatePoolWithTag(NonPagedPool, sizeof (TRANSMITTER), ' TEN');
+    SHIM_CHECK(Adapter->Transmitter != NULL);
+    RtlZeroMemory(Adapter->Transmitter, sizeof (TRANSMITTER));
+
+    ndisStatus = ReceiverInitialize(&Adapter->Receiver);
+    SHIM_CHECK(ndisStatus == NDIS_STATUS_SUCCESS);
+
+    ndisStatus = TransmitterInitialize(Adapter->Transmitter, Adapter);
+    SHIM_CHECK(ndisStatus == NDIS_STATUS_SUCCESS);
+
+    PollerInitialize(&Adapter->Poller, Adapter);
+
+    if (ReceiverSetVlanId(&Adapter->Receiver,
+                          (ULONG)Adapter->Properties.vlan_id) != NDIS_STATUS_SUCCESS)
+        SHIM_CHECK(FALSE);
+
+    // VIF() needs at least one argument besides the interface
+    Interface->Operations->VIF_Acquire(Interface->Context);
+
+    HarnessConfigureOffloads(Adapter);
+
+    status = VIF(Enable,
+                 Adapter->VifInterface,
+                 HarnessVifCallback,
+                 Adapter);
+    SHIM_CHECK(NT_SUCCESS(status));
+
+    TransmitterEnable(Adapter->Transmitter);
+    ReceiverEnable(&Adapter->Receiver);
+    PollerEnable(&Adapter->Poller,
+                 (ULONG)Adapter->Properties.poll_threshold);
+
+    Adapter->Enabled = TRUE;
+
+    return Adapter;
+}
+
+VOID
+HarnessDestroyAdapter(
+    IN  PADAPTER            Adapter
+    )
+{
+    PXENVIF_VIF_INTERFACE   Interface = Adapter->VifInterface;
+
+    SHIM_CHECK(KeGetCurrentIrql() == PASSIVE_LEVEL);
+
+    ShimRunAllDpcs();
+
+    TransmitterFlush(Adapter->Transmitter);
+    Interface->Operations->VIF_Disable(Interface->Context);
+    PollerDisable(&Adapter->Poller);
+    ReceiverDisable(&Adapter->Receiver);
+
+    ShimRunAllDpcs();
+
+    Adapter->Enabled = FALSE;
+
+    SHIM_CHECK(MockVifOutstandingPackets(Interface) == 0);
+
+    Interface->Operations->VIF_Release(Interface->Context);
+
+    TransmitterDelete(&Adapter->Transmitter);
+    ReceiverCleanup(&Adapter->Receiver);
+
+    MockVifDestroy(Interface);
+    free(Adapter);
+}
+
+VOID
+HarnessSetReceiveHook(
+    IN  HARNESS_RECEIVE Function,
+    IN  PVOID           Argument
+    )
+{
+    HarnessReceive = Function;
+    HarnessReceiveArgument = Argument;
+}
+
+PNET_BUFFER_LIST
+HarnessAllocateSend(
+    IN  PFRAME                  Frame,
+    IN  ULONG                   MdlLength,
+    IN  HARNESS_SEND_COMPLETE   Function OPTIONAL,
+    IN  PVOID                   Argument OPTIONAL
+    )
+{
+    PUCHAR                      Buffer;
+    PMDL                        Head;
+    PMDL                        *Tail;
+    ULONG                       Offset;
+    PNET_BUFFER_LIST            NetBufferList;
+    PHARNESS_SEND_RESERVED      Reserved;
+
+    SHIM_CHECK(Frame->Length != 0);
+
+    Buffer = malloc(Frame->Length);
+    SHIM_CHECK(Buffer != NULL);
+    memcpy(Buffer, Frame->Data, Frame->Length);
+
+    if (MdlLength == 0)
+        MdlLength = Frame->Length;
+
+    Head = NULL;
+    Tail = &Head;
+    for (Offset = 0; Offset < Frame->Length; Offset += MdlLength) {
+        ULONG   Length = Frame->Length - Offset;
+        PMDL    Mdl;
+
+        if (Length > MdlLength)
+            Length = MdlLength;
+
+        Mdl = NdisAllocateMdl(NULL, Buffer + Offset, Length);
+        SHIM_CHECK(Mdl != NULL);
+
+        *Tail = Mdl;
+        Tail = &Mdl->Next;
+    }
+
+    NetBufferList = NdisAllocateNetBufferAndNetBufferList(HarnessSendPool,
+                                                          0,
+                                                          0,
+                                                          Head,
+                                                          0,
+                                                          Frame->Length);
+    SHIM_CHECK(NetBufferList != NULL);
+
+    Reserved = (PHARNESS_SEND_RESERVED)NET_BUFFER_LIST_PROTOCOL_RESERVED(NetBufferList);
+    Reserved->Function = Function;
+    Reserved->Argument = Argument;
+    Reserved->Buffer = Buffer;
+
+    return NetBufferList;
+}
+
+VOID
+HarnessFreeSend(
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    PHARNESS_SEND_RESERVED  Reserved;
+    PMDL                    Mdl;
+
+    Reserved = (PHARNESS_SEND_RESERVED)NET_BUFFER_LIST_PROTOCOL_RESERVED(NetBufferList);
+
+    Mdl = NET_BUFFER_FIRST_MDL(NET_BUFFER_LIST_FIRST_NB(NetBufferList));
+    while (Mdl != NULL) {
+        PMDL    Next = Mdl->Next;
+
+        NdisFreeMdl(Mdl);
+        Mdl = Next;
+    }
+
+    free(Reserved->Buffer);
+    NdisFreeNetBufferList(NetBufferList);
+}
+
+ULONG
+HarnessCopyNetBuffer(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    OUT PUCHAR              Buffer,
+    IN  ULONG               Length
+    )
+{
+    PNET_BUFFER             NetBuffer;
+    PMDL                    Mdl;
+    ULONG                   Offset;
+    ULONG                   Remaining;
+    ULONG                   Copied;
+
+    NetBuffer = NET_BUFFER_LIST_FIRST_NB(NetBufferList);
+
+    Remaining = NET_BUFFER_DATA_LENGTH(NetBuffer);
+    SHIM_CHECK(Remaining <= Length);
+
+    Mdl = NET_BUFFER_CURRENT_MDL(NetBuffer);
+    Offset = NET_BUFFER_CURRENT_MDL_OFFSET(NetBuffer);
+
+    Copied = 0;
+    while (Remaining != 0) {
+        PUCHAR  Data;
+        ULONG   Count;
+
+        SHIM_CHECK(Mdl != NULL);
+
+        Data = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        SHIM_CHECK(Data != NULL);
+
+        Count = Mdl->ByteCount - Offset;
+        if (Count > Remaining)
+            Count = Remaining;
+
+        memcpy(Buffer + Copied, Data + Offset, Count);
+
+        Copied += Count;
+        Remaining -= Count;
+        Offset = 0;
+        Mdl = Mdl->Next;
+    }
+
+    return Copied;
+}
+
+VOID
+HarnessQueryStatistics(
+    OUT PHARNESS_STATISTICS Statistics
+    )
+{
+    ULONG                   Index;
+
+    RtlZeroMemory(Statistics, sizeof (HARNESS_STATISTICS));
+
+    for (Index = 0; Index < HarnessProcessorCount; Index++) {
+        PHARNESS_STATISTICS Processor = &HarnessProcessor[Index].Statistics;
+
+        Statistics->Indications += Processor->Indications;
+        Statistics->IndicatedNetBufferLists += Processor->IndicatedNetBufferLists;
+        Statistics->ResourceIndications += Processor->ResourceIndications;
+        Statistics->SendCompletions += Processor->SendCompletions;
+        Statistics->SendCompletedNetBufferLists += Processor->SendCompletedNetBufferLists;
+    }
+}
@@ -0,0 +1,152 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Brings up the receiver, transmitter and poller of an adapter over the
+// mock backend in the same order as AdapterInitialize(), with the
+// offloads configured as they would be after OID_OFFLOAD_ENCAPSULATION,
+// and stands in for NDIS above them: indicated NET_BUFFER_LISTs are
+// returned at once unless a receive hook keeps them, and completed sends
+// go to the function they were allocated with.
+
+#ifndef _TEST_HARNESS_H
+#define _TEST_HARNESS_H
+
+#include "common.h"
+
+#include "shim.h"
+#include "frame.h"
+#include "vif.h"
+
+typedef struct _HARNESS_STATISTICS {
+    ULONG64 Indications;
+    ULONG64 IndicatedNetBufferLists;
+    ULONG64 ResourceIndications;    // NDIS_RECEIVE_FLAGS_RESOURCES
+    ULONG64 SendCompletions;
+    ULONG64 SendCompletedNetBufferLists;
+} HARNESS_STATISTICS, *PHARNESS_STATISTICS;
+
+// Returns TRUE to keep the NET_BUFFER_LISTs, which must then be given
+// back with ReceiverReturnNetBufferLists(). Never called for
+// indications made with NDIS_RECEIVE_FLAGS_RESOURCES.
+typedef BOOLEAN
+(*HARNESS_RECEIVE)(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    );
+
+typedef VOID
+(*HARNESS_SEND_COMPLETE)(
+    IN  PVOID               Argument,
+    IN  PNET_BUFFER_LIST    NetBufferList
+    );
+
+// ProcessorCount simulated processors in groups of GroupSize (0 for a
+// single group).
+VOID
+HarnessInitialize(
+    IN  ULONG   ProcessorCount,
+    IN  ULONG   GroupSize
+    );
+
+VOID
+HarnessTeardown(
+    VOID
+    );
+
+// The defaults AdapterGetAdvancedSettings() reads in the absence of
+// registry values.
+VOID
+HarnessDefaultProperties(
+    OUT PPROPERTIES Properties
+    );
+
+// Sets the property named by an assignment such as "tx_batch=16".
+// Returns FALSE if there is no such property.
+BOOLEAN
+HarnessSetProperty(
+    IN  PPROPERTIES Properties,
+    IN  const CHAR  *Assignment
+    );
+
+PADAPTER
+HarnessCreateAdapter(
+    IN  PPROPERTIES             Properties OPTIONAL,
+    IN  PMOCK_VIF_CONFIGURATION Configuration OPTIONAL
+    );
+
+// Runs any outstanding DPCs and takes the adapter down as AdapterPause()
+// and AdapterHalt() would. Must be called at PASSIVE_LEVEL with no other
+// thread running.
+VOID
+HarnessDestroyAdapter(
+    IN  PADAPTER    Adapter
+    );
+
+VOID
+HarnessSetReceiveHook(
+    IN  HARNESS_RECEIVE Function,
+    IN  PVOID           Argument
+    );
+
+// A NET_BUFFER_LIST holding a copy of Frame, described by MDLs of at most
+// MdlLength bytes (0 for a single MDL). On completion it is passed to
+// Function, or freed if Function is NULL.
+PNET_BUFFER_LIST
+HarnessAllocateSend(
+    IN  PFRAME                  Frame,
+    IN  ULONG                   MdlLength,
+    IN  HARNESS_SEND_COMPLETE   Function OPTIONAL,
+    IN  PVOID                   Argument OPTIONAL
+    );
+
+VOID
+HarnessFreeSend(
+    IN  PNET_BUFFER_LIST    NetBufferList
+    );
+
+// Copies the data of a NET_BUFFER_LIST's first NET_BUFFER into Buffer,
+// returning its length.
+ULONG
+HarnessCopyNetBuffer(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    OUT PUCHAR              Buffer,
+    IN  ULONG               Length
+    );
+
+VOID
+HarnessQueryStatistics(
+    OUT PHARNESS_STATISTICS Statistics
+    );
+
+#endif  // _TEST_HARNESS_H
@@ -0,0 +1,481 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// User-mode stand-in for the parts of ndis.h that the xennet data path
+// and its headers use. Allocation and indication routines are
+// implemented in ../shim.c.
+
+#ifndef _TEST_NDIS_H
+#define _TEST_NDIS_H
+
+#include <ntddk.h>
+
+#define NDIS_SUPPORT_NDIS6      1
+#define NDIS_SUPPORT_NDIS620    1
+#define NDIS_SUPPORT_NDIS630    1
+
+typedef PVOID           NDIS_HANDLE, *PNDIS_HANDLE;
+typedef int             NDIS_STATUS, *PNDIS_STATUS;
+typedef ULONG           NDIS_OID, *PNDIS_OID;
+typedef ULONG           NDIS_PORT_NUMBER, *PNDIS_PORT_NUMBER;
+typedef UNICODE_STRING  NDIS_STRING, *PNDIS_STRING;
+
+#define NDIS_STATUS_SUCCESS             ((NDIS_STATUS)STATUS_SUCCESS)
+#define NDIS_STATUS_PENDING             ((NDIS_STATUS)STATUS_PENDING)
+#define NDIS_STATUS_NOT_ACCEPTED        ((NDIS_STATUS)0x00010003L)
+#define NDIS_STATUS_FAILURE             ((NDIS_STATUS)STATUS_UNSUCCESSFUL)
+#define NDIS_STATUS_RESOURCES           ((NDIS_STATUS)STATUS_INSUFFICIENT_RESOURCES)
+#define NDIS_STATUS_NOT_SUPPORTED       ((NDIS_STATUS)STATUS_NOT_SUPPORTED)
+#define NDIS_STATUS_MULTICAST_FULL      ((NDIS_STATUS)0xC0010009L)
+#define NDIS_STATUS_INVALID_PACKET      ((NDIS_STATUS)0xC001000FL)
+#define NDIS_STATUS_INVALID_LENGTH      ((NDIS_STATUS)0xC0010014L)
+#define NDIS_STATUS_INVALID_DATA        ((NDIS_STATUS)0xC0010015L)
+#define NDIS_STATUS_BUFFER_TOO_SHORT    ((NDIS_STATUS)0xC0010016L)
+#define NDIS_STATUS_INVALID_PARAMETER   ((NDIS_STATUS)STATUS_INVALID_PARAMETER)
+#define NDIS_STATUS_SEND_ABORTED        ((NDIS_STATUS)0xC0010027L)
+#define NDIS_STATUS_PAUSED              ((NDIS_STATUS)0xC023002AL)
+
+#define NdisZeroMemory(_Destination, _Length) \
+        RtlZeroMemory((_Destination), (_Length))
+#define NdisMoveMemory(_Destination, _Source, _Length) \
+        RtlCopyMemory((_Destination), (_Source), (_Length))
+#define NdisEqualMemory(_Destination, _Source, _Length) \
+        RtlEqualMemory((_Destination), (_Source), (_Length))
+
+#define NDIS_CURRENT_IRQL()                 KeGetCurrentIrql()
+#define NDIS_RAISE_IRQL_TO_DISPATCH(_Irql)  KeRaiseIrql(DISPATCH_LEVEL, (_Irql))
+#define NDIS_LOWER_IRQL(_OldIrql, _CurIrql) KeLowerIrql(_OldIrql)
+
+typedef struct _NDIS_OBJECT_HEADER {
+    UCHAR   Type;
+    UCHAR   Revision;
+    USHORT  Size;
+} NDIS_OBJECT_HEADER, *PNDIS_OBJECT_HEADER;
+
+#define NDIS_OBJECT_TYPE_DEFAULT        0x80
+#define NDIS_OBJECT_TYPE_RSS_PARAMETERS 0x89
+
+#define NDIS_DEFAULT_PORT_NUMBER        ((NDIS_PORT_NUMBER)0)
+
+// NET_BUFFER and NET_BUFFER_LIST
+
+typedef struct _NET_BUFFER NET_BUFFER, *PNET_BUFFER;
+typedef struct _NET_BUFFER_LIST NET_BUFFER_LIST, *PNET_BUFFER_LIST;
+
+struct _NET_BUFFER {
+    PNET_BUFFER     Next;
+    PMDL            CurrentMdl;
+    ULONG           CurrentMdlOffset;
+    ULONG           DataLength;
+    ULONG           DataOffset;
+    PMDL            MdlChain;
+    PVOID           ProtocolReserved[6];
+    PVOID           MiniportReserved[4];
+};
+
+typedef enum _NDIS_NET_BUFFER_LIST_INFO {
+    TcpIpChecksumNetBufferListInfo,
+    TcpOffloadBytesTransferred = TcpIpChecksumNetBufferListInfo,
+    IPsecOffloadV1NetBufferListInfo,
+    TcpLargeSendNetBufferListInfo,
+    TcpReceiveNoPush,
+    ClassificationHandleNetBufferListInfo,
+    Ieee8021QNetBufferListInfo,
+    NetBufferListCancelId,
+    MediaSpecificInformation,
+    NetBufferListFrameType,
+    NetBufferListProtocolId = NetBufferListFrameType,
+    NetBufferListHashValue,
+    NetBufferListHashInfo,
+    WfpNetBufferListInfo,
+    TcpRecvSegCoalesceInfo,
+    RscTcpTimestampDelta,
+    MaxNetBufferListInfo
+} NDIS_NET_BUFFER_LIST_INFO;
+
+struct _NET_BUFFER_LIST {
+    PNET_BUFFER_LIST    Next;
+    PNET_BUFFER         FirstNetBuffer;
+    PVOID               Context;
+    PNET_BUFFER_LIST    ParentNetBufferList;
+    NDIS_HANDLE         NdisPoolHandle;
+    PVOID               NdisReserved[2];
+    PVOID               ProtocolReserved[4];
+    PVOID               MiniportReserved[2];
+    PVOID               Scratch;
+    NDIS_HANDLE         SourceHandle;
+    ULONG               NblFlags;
+    LONG                ChildRefCount;
+    ULONG               Flags;
+    NDIS_STATUS         Status;
+    PVOID               NetBufferListInfo[MaxNetBufferListInfo];
+};
+
+#define NET_BUFFER_NEXT_NB(_NB)                 ((_NB)->Next)
+#define NET_BUFFER_FIRST_MDL(_NB)               ((_NB)->MdlChain)
+#define NET_BUFFER_CURRENT_MDL(_NB)             ((_NB)->CurrentMdl)
+#define NET_BUFFER_CURRENT_MDL_OFFSET(_NB)      ((_NB)->CurrentMdlOffset)
+#define NET_BUFFER_DATA_OFFSET(_NB)             ((_NB)->DataOffset)
+#define NET_BUFFER_DATA_LENGTH(_NB)             ((_NB)->DataLength)
+#define NET_BUFFER_MINIPORT_RESERVED(_NB)       ((_NB)->MiniportReserved)
+#define NET_BUFFER_PROTOCOL_RESERVED(_NB)       ((_NB)->ProtocolReserved)
+
+#define NET_BUFFER_LIST_NEXT_NBL(_NBL)          ((_NBL)->Next)
+#define NET_BUFFER_LIST_FIRST_NB(_NBL)          ((_NBL)->FirstNetBuffer)
+#define NET_BUFFER_LIST_FLAGS(_NBL)             ((_NBL)->Flags)
+
+#define NBL_FLAGS_MINIPORT_RESERVED             0x0000F000
+#define NET_BUFFER_LIST_STATUS(_NBL)            ((_NBL)->Status)
+#define NET_BUFFER_LIST_MINIPORT_RESERVED(_NBL) ((_NBL)->MiniportReserved)
+#define NET_BUFFER_LIST_PROTOCOL_RESERVED(_NBL) ((_NBL)->ProtocolReserved)
+#define NET_BUFFER_LIST_INFO(_NBL, _Id)         ((_NBL)->NetBufferListInfo[(_Id)])
+
+// The shim allocates the whole context area in one piece
+#define NET_BUFFER_LIST_CONTEXT_DATA_START(_NBL) ((PUCHAR)(_NBL)->Context)
+
+#define NDIS_MDL_LINKAGE(_Mdl)                  ((_Mdl)->Next)
+#define NdisGetNextMdl(_CurrentMdl, _NextMdl) \
+        do { *(_NextMdl) = (_CurrentMdl)->Next; } while (0)
+
+#define NDIS_HASH_FUNCTION_MASK     0x000000FF
+#define NDIS_HASH_TYPE_MASK         0x00FFFF00
+
+#define NdisHashFunctionToeplitz    0x00000001
+
+#define NDIS_HASH_IPV4              0x00000100
+#define NDIS_HASH_TCP_IPV4          0x00000200
+#define NDIS_HASH_IPV6              0x00000400
+#define NDIS_HASH_IPV6_EX           0x00000800
+#define NDIS_HASH_TCP_IPV6          0x00001000
+#define NDIS_HASH_TCP_IPV6_EX       0x00002000
+
+#define NDIS_RSS_HASH_FUNC_FROM_HASH_INFO(_HashInfo) \
+        ((_HashInfo) & NDIS_HASH_FUNCTION_MASK)
+#define NDIS_RSS_HASH_TYPE_FROM_HASH_INFO(_HashInfo) \
+        ((_HashInfo) & NDIS_HASH_TYPE_MASK)
+
+#define NET_BUFFER_LIST_GET_HASH_VALUE(_NBL) \
+        ((ULONG)(ULONG_PTR)NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashValue))
+#define NET_BUFFER_LIST_SET_HASH_VALUE(_NBL, _HashValue) \
+        (NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashValue) = (PVOID)(ULONG_PTR)(_HashValue))
+#define NET_BUFFER_LIST_GET_HASH_TYPE(_NBL) \
+        ((ULONG)(ULONG_PTR)NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashInfo) & NDIS_HASH_TYPE_MASK)
+#define NET_BUFFER_LIST_GET_HASH_FUNCTION(_NBL) \
+        ((ULONG)(ULONG_PTR)NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashInfo) & NDIS_HASH_FUNCTION_MASK)
+#define NET_BUFFER_LIST_SET_HASH_TYPE(_NBL, _HashType)                          \
+        (NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashInfo) =                  \
+         (PVOID)(((ULONG_PTR)NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashInfo) & \
+                  ~(ULONG_PTR)NDIS_HASH_TYPE_MASK) |                             \
+                 ((_HashType) & NDIS_HASH_TYPE_MASK)))
+#define NET_BUFFER_LIST_SET_HASH_FUNCTION(_NBL, _HashFunction)                  \
+        (NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashInfo) =                  \
+         (PVOID)(((ULONG_PTR)NET_BUFFER_LIST_INFO((_NBL), NetBufferListHashInfo) & \
+                  ~(ULONG_PTR)NDIS_HASH_FUNCTION_MASK) |                         \
+                 ((_HashFunction) & NDIS_HASH_FUNCTION_MASK)))
+
+// Per-NET_BUFFER_LIST information
+
+#define NDIS_TCP_LARGE_SEND_OFFLOAD_V1_TYPE 0
+#define NDIS_TCP_LARGE_SEND_OFFLOAD_V2_TYPE 1
+
+#define NDIS_TCP_LARGE_SEND_OFFLOAD_IPv4    0
+#define NDIS_TCP_LARGE_SEND_OFFLOAD_IPv6    1
+
+typedef struct _NDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO {
+    union {
+        struct {
+            ULONG   Unused:30;
+            ULONG   Type:1;
+            ULONG   Reserved2:1;
+        } Transmit;
+        struct {
+            ULONG   MSS:20;
+            ULONG   TcpHeaderOffset:10;
+            ULONG   Type:1;
+            ULONG   Reserved2:1;
+        } LsoV1Transmit;
+        struct {
+            ULONG   TcpPayload:30;
+            ULONG   Type:1;
+            ULONG   Reserved2:1;
+        } LsoV1TransmitComplete;
+        struct {
+            ULONG   MSS:20;
+            ULONG   TcpHeaderOffset:10;
+            ULONG   Type:1;
+            ULONG   Reserved2:1;
+            ULONG   IPVersion:2;
+            ULONG   Reserved3:30;
+        } LsoV2Transmit;
+        struct {
+            ULONG   Reserved:30;
+            ULONG   Type:1;
+            ULONG   Reserved2:1;
+        } LsoV2TransmitComplete;
+        PVOID   Value;
+    };
+} NDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO, *PNDIS_TCP_LARGE_SEND_OFFLOAD_NET_BUFFER_LIST_INFO;
+
+typedef struct _NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO {
+    union {
+        struct {
+            ULONG   IsIPv4:1;
+            ULONG   IsIPv6:1;
+            ULONG   TcpChecksum:1;
+            ULONG   UdpChecksum:1;
+            ULONG   IpHeaderChecksum:1;
+            ULONG   Reserved:11;
+            ULONG   TcpHeaderOffset:10;
+        } Transmit;
+        struct {
+            ULONG   TcpChecksumFailed:1;
+            ULONG   UdpChecksumFailed:1;
+            ULONG   IpChecksumFailed:1;
+            ULONG   TcpChecksumSucceeded:1;
+            ULONG   UdpChecksumSucceeded:1;
+            ULONG   IpChecksumSucceeded:1;
+            ULONG   Loopback:1;
+            ULONG   TcpChecksumValueInvalid:1;
+            ULONG   IpChecksumValueInvalid:1;
+        } Receive;
+        PVOID   Value;
+    };
+} NDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO, *PNDIS_TCP_IP_CHECKSUM_NET_BUFFER_LIST_INFO;
+
+typedef struct _NDIS_NET_BUFFER_LIST_8021Q_INFO {
+    union {
+        struct {
+            ULONG   UserPriority:3;
+            ULONG   CanonicalFormatId:1;
+            ULONG   VlanId:12;
+            ULONG   Reserved:16;
+        } TagHeader;
+        PVOID   Value;
+    };
+} NDIS_NET_BUFFER_LIST_8021Q_INFO, *PNDIS_NET_BUFFER_LIST_8021Q_INFO;
+
+typedef union _NDIS_RSC_NBL_INFO {
+    struct {
+        USHORT  CoalescedSegCount;
+        USHORT  DupAckCount;
+    } Info;
+    PVOID   Value;
+} NDIS_RSC_NBL_INFO, *PNDIS_RSC_NBL_INFO;
+
+#define NET_BUFFER_LIST_COALESCED_SEG_COUNT(_NBL) \
+        (((PNDIS_RSC_NBL_INFO)&NET_BUFFER_LIST_INFO((_NBL), TcpRecvSegCoalesceInfo))->Info.CoalescedSegCount)
+#define NET_BUFFER_LIST_DUP_ACK_COUNT(_NBL) \
+        (((PNDIS_RSC_NBL_INFO)&NET_BUFFER_LIST_INFO((_NBL), TcpRecvSegCoalesceInfo))->Info.DupAckCount)
+
+// Pools
+
+#define NET_BUFFER_LIST_POOL_PARAMETERS_REVISION_1  1
+
+typedef struct _NET_BUFFER_LIST_POOL_PARAMETERS {
+    NDIS_OBJECT_HEADER  Header;
+    UCHAR               ProtocolId;
+    BOOLEAN             fAllocateNetBuffer;
+    USHORT              ContextSize;
+    ULONG               PoolTag;
+    ULONG               DataSize;
+} NET_BUFFER_LIST_POOL_PARAMETERS, *PNET_BUFFER_LIST_POOL_PARAMETERS;
+
+NDIS_HANDLE NdisAllocateNetBufferListPool(NDIS_HANDLE NdisHandle,
+                                          PNET_BUFFER_LIST_POOL_PARAMETERS Parameters);
+VOID NdisFreeNetBufferListPool(NDIS_HANDLE PoolHandle);
+PNET_BUFFER_LIST NdisAllocateNetBufferList(NDIS_HANDLE PoolHandle,
+                                           USHORT ContextSize,
+                                           USHORT ContextBackFill);
+PNET_BUFFER_LIST NdisAllocateNetBufferAndNetBufferList(NDIS_HANDLE PoolHandle,
+                                                       USHORT ContextSize,
+                                                       USHORT ContextBackFill,
+                                                       PMDL MdlChain,
+                                                       ULONG DataOffset,
+                                                       SIZE_T DataLength);
+VOID NdisFreeNetBufferList(PNET_BUFFER_LIST NetBufferList);
+VOID NdisFreeNetBufferListContext(PNET_BUFFER_LIST NetBufferList,
+                                  USHORT ContextSize);
+PVOID NdisGetDataBuffer(PNET_BUFFER NetBuffer, ULONG BytesNeeded,
+                        PVOID Storage, ULONG AlignMultiple,
+                        ULONG AlignOffset);
+PMDL NdisAllocateMdl(NDIS_HANDLE NdisHandle, PVOID VirtualAddress,
+                     ULONG Length);
+VOID NdisFreeMdl(PMDL Mdl);
+
+// Indications
+
+#define NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL       0x00000001
+#define NDIS_RECEIVE_FLAGS_RESOURCES            0x00000002
+#define NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE    0x00000100
+#define NDIS_RECEIVE_FLAGS_SINGLE_VLAN          0x00000200
+#define NDIS_RECEIVE_FLAGS_PERFECT_FILTERED     0x00000400
+#define NDIS_RECEIVE_FLAGS_SINGLE_QUEUE         0x00000800
+
+#define NDIS_RETURN_FLAGS_DISPATCH_LEVEL        0x00000001
+#define NDIS_SEND_FLAGS_DISPATCH_LEVEL          0x00000001
+#define NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL 0x00000001
+
+#define NDIS_TEST_SEND_AT_DISPATCH_LEVEL(_Flags) \
+        (((_Flags) & NDIS_SEND_FLAGS_DISPATCH_LEVEL) ? TRUE : FALSE)
+#define NDIS_TEST_RETURN_AT_DISPATCH_LEVEL(_Flags) \
+        (((_Flags) & NDIS_RETURN_FLAGS_DISPATCH_LEVEL) ? TRUE : FALSE)
+#define NDIS_TEST_SEND_COMPLETE_AT_DISPATCH_LEVEL(_Flags) \
+        (((_Flags) & NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL) ? TRUE : FALSE)
+#define NDIS_TEST_RECEIVE_AT_DISPATCH_LEVEL(_Flags) \
+        (((_Flags) & NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL) ? TRUE : FALSE)
+
+VOID NdisMIndicateReceiveNetBufferLists(NDIS_HANDLE MiniportAdapterHandle,
+                                        PNET_BUFFER_LIST NetBufferLists,
+                                        NDIS_PORT_NUMBER PortNumber,
+                                        ULONG NumberOfNetBufferLists,
+                                        ULONG ReceiveFlags);
+VOID NdisMSendNetBufferListsComplete(NDIS_HANDLE MiniportAdapterHandle,
+                                     PNET_BUFFER_LIST NetBufferLists,
+                                     ULONG SendCompleteFlags);
+
+// Receive side scaling
+
+#define NDIS_RECEIVE_SCALE_PARAMETERS_REVISION_1        1
+#define NDIS_RSS_INDIRECTION_TABLE_MAX_SIZE_REVISION_1  128
+#define NDIS_RSS_HASH_SECRET_KEY_MAX_SIZE_REVISION_1    40
+
+#define NDIS_RSS_PARAM_FLAG_BASE_CPU_UNCHANGED      0x0001
+#define NDIS_RSS_PARAM_FLAG_HASH_INFO_UNCHANGED     0x0002
+#define NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED        0x0004
+#define NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED      0x0008
+#define NDIS_RSS_PARAM_FLAG_DISABLE_RSS             0x0010
+
+typedef struct _NDIS_RECEIVE_SCALE_PARAMETERS {
+    NDIS_OBJECT_HEADER  Header;
+    USHORT              Flags;
+    USHORT              BaseCpuNumber;
+    ULONG               HashInformation;
+    USHORT              IndirectionTableSize;
+    ULONG               IndirectionTableOffset;
+    USHORT              HashSecretKeySize;
+    ULONG               HashSecretKeyOffset;
+} NDIS_RECEIVE_SCALE_PARAMETERS, *PNDIS_RECEIVE_SCALE_PARAMETERS;
+
+#define NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_1 \
+        RTL_SIZEOF_THROUGH_FIELD(NDIS_RECEIVE_SCALE_PARAMETERS, HashSecretKeyOffset)
+#define RTL_SIZEOF_THROUGH_FIELD(_Type, _Field) \
+        (FIELD_OFFSET(_Type, _Field) + RTL_FIELD_SIZE(_Type, _Field))
+
+// Types that only appear in the adapter's prototypes
+
+typedef int NDIS_HALT_ACTION, NDIS_SHUTDOWN_ACTION;
+
+#define NDIS_ENCAPSULATION_IEEE_802_3   0x00000002
+
+typedef struct _NDIS_PNP_CAPABILITIES {
+    ULONG   Flags;
+} NDIS_PNP_CAPABILITIES, *PNDIS_PNP_CAPABILITIES;
+
+typedef struct _NDIS_TCP_IP_CHECKSUM_OFFLOAD {
+    struct {
+        ULONG   Encapsulation;
+        ULONG   IpOptionsSupported:2;
+        ULONG   TcpOptionsSupported:2;
+        ULONG   TcpChecksum:2;
+        ULONG   UdpChecksum:2;
+        ULONG   IpChecksum:2;
+    } IPv4Transmit, IPv4Receive;
+    struct {
+        ULONG   Encapsulation;
+        ULONG   IpExtensionHeadersSupported:2;
+        ULONG   TcpOptionsSupported:2;
+        ULONG   TcpChecksum:2;
+        ULONG   UdpChecksum:2;
+    } IPv6Transmit, IPv6Receive;
+} NDIS_TCP_IP_CHECKSUM_OFFLOAD, *PNDIS_TCP_IP_CHECKSUM_OFFLOAD;
+
+typedef struct _NDIS_TCP_LARGE_SEND_OFFLOAD_V2 {
+    struct {
+        ULONG   Encapsulation;
+        ULONG   MaxOffLoadSize;
+        ULONG   MinSegmentCount;
+    } IPv4;
+    struct {
+        ULONG   Encapsulation;
+        ULONG   MaxOffLoadSize;
+        ULONG   MinSegmentCount;
+        ULONG   IpExtensionHeadersSupported:2;
+        ULONG   TcpOptionsSupported:2;
+    } IPv6;
+} NDIS_TCP_LARGE_SEND_OFFLOAD_V2, *PNDIS_TCP_LARGE_SEND_OFFLOAD_V2;
+
+typedef struct _NDIS_OFFLOAD {
+    NDIS_OBJECT_HEADER              Header;
+    NDIS_TCP_IP_CHECKSUM_OFFLOAD    Checksum;
+    NDIS_TCP_LARGE_SEND_OFFLOAD_V2  LsoV2;
+    ULONG                           Flags;
+} NDIS_OFFLOAD, *PNDIS_OFFLOAD;
+
+typedef struct _NDIS_OID_REQUEST            NDIS_OID_REQUEST, *PNDIS_OID_REQUEST;
+typedef struct _NET_DEVICE_PNP_EVENT        NET_DEVICE_PNP_EVENT, *PNET_DEVICE_PNP_EVENT;
+typedef struct _NDIS_MINIPORT_PAUSE_PARAMETERS
+                                            NDIS_MINIPORT_PAUSE_PARAMETERS, *PNDIS_MINIPORT_PAUSE_PARAMETERS;
+typedef struct _NDIS_MINIPORT_RESTART_PARAMETERS
+                                            NDIS_MINIPORT_RESTART_PARAMETERS, *PNDIS_MINIPORT_RESTART_PARAMETERS;
+
+#define NdisInterfaceInternal   0
+#define NdisMedium802_3         0
+
+#define NDIS_MAC_OPTION_COPY_LOOKAHEAD_DATA             0x00000001
+#define NDIS_MAC_OPTION_TRANSFERS_NOT_PEND              0x00000008
+#define NDIS_MAC_OPTION_NO_LOOPBACK                     0x00000010
+#define NDIS_MAC_OPTION_8021P_PRIORITY                  0x00000040
+#define NDIS_MAC_OPTION_SUPPORTS_MAC_ADDRESS_OVERWRITE  0x00000080
+
+typedef VOID MINIPORT_UNLOAD(PDRIVER_OBJECT DriverObject);
+typedef VOID MINIPORT_CANCEL_OID_REQUEST(NDIS_HANDLE MiniportAdapterContext, PVOID RequestId);
+typedef VOID MINIPORT_CANCEL_SEND(NDIS_HANDLE MiniportAdapterContext, PVOID CancelId);
+typedef BOOLEAN MINIPORT_CHECK_FOR_HANG(NDIS_HANDLE MiniportAdapterContext);
+typedef VOID MINIPORT_HALT(NDIS_HANDLE MiniportAdapterContext, NDIS_HALT_ACTION HaltAction);
+typedef NDIS_STATUS MINIPORT_OID_REQUEST(NDIS_HANDLE MiniportAdapterContext, PNDIS_OID_REQUEST OidRequest);
+typedef NDIS_STATUS MINIPORT_PAUSE(NDIS_HANDLE MiniportAdapterContext,
+                                   PNDIS_MINIPORT_PAUSE_PARAMETERS PauseParameters);
+typedef VOID MINIPORT_DEVICE_PNP_EVENT_NOTIFY(NDIS_HANDLE MiniportAdapterContext,
+                                              PNET_DEVICE_PNP_EVENT NetDevicePnPEvent);
+typedef NDIS_STATUS MINIPORT_RESET(NDIS_HANDLE MiniportAdapterContext, PBOOLEAN AddressingReset);
+typedef NDIS_STATUS MINIPORT_RESTART(NDIS_HANDLE MiniportAdapterContext,
+                                     PNDIS_MINIPORT_RESTART_PARAMETERS RestartParameters);
+typedef VOID MINIPORT_RETURN_NET_BUFFER_LISTS(NDIS_HANDLE MiniportAdapterContext,
+                                              PNET_BUFFER_LIST NetBufferLists,
+                                              ULONG ReturnFlags);
+typedef VOID MINIPORT_SEND_NET_BUFFER_LISTS(NDIS_HANDLE MiniportAdapterContext,
+                                            PNET_BUFFER_LIST NetBufferList,
+                                            NDIS_PORT_NUMBER PortNumber,
+                                            ULONG SendFlags);
+typedef VOID MINIPORT_SHUTDOWN(NDIS_HANDLE MiniportAdapterContext,
+                               NDIS_SHUTDOWN_ACTION ShutdownAction);
+
+#endif  // _TEST_NDIS_H
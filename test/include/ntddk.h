@@ -0,0 +1,551 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// User-mode stand-in for the parts of the WDK kernel headers that the
+// xennet data path uses, so that receiver.c, transmitter.c and friends
+// can be built and exercised on Linux. Trivial routines are inline here;
+// anything that needs state (pool, DPC queues, the simulated processors)
+// is implemented in ../shim.c.
+
+#ifndef _TEST_NTDDK_H
+#define _TEST_NTDDK_H
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <string.h>
+
+// Basic types
+
+typedef void                VOID, *PVOID;
+typedef char                CHAR, *PCHAR;
+typedef char                CCHAR;
+typedef const char          *PCSTR;
+typedef unsigned char       UCHAR, *PUCHAR, BOOLEAN, *PBOOLEAN;
+typedef short               SHORT, *PSHORT;
+typedef unsigned short      USHORT, *PUSHORT;
+typedef int                 LONG, *PLONG;
+typedef unsigned int        ULONG, *PULONG, UINT, *PUINT;
+typedef long long           LONGLONG, LONG64, *PLONG64, LONG_PTR;
+typedef unsigned long long  ULONGLONG, ULONG64, *PULONG64, *PULONGLONG;
+typedef unsigned long long  ULONG_PTR, SIZE_T, *PSIZE_T, PFN_NUMBER, *PPFN_NUMBER;
+typedef unsigned short      WCHAR, *PWCHAR, *PWSTR;
+typedef const WCHAR         *PCWSTR;
+typedef int                 NTSTATUS;
+typedef UCHAR               KIRQL, *PKIRQL;
+typedef ULONG_PTR           KSPIN_LOCK, *PKSPIN_LOCK;
+typedef ULONG_PTR           KAFFINITY, *PKAFFINITY;
+typedef void                *HANDLE, **PHANDLE;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG   LowPart;
+        LONG    HighPart;
+    };
+    LONGLONG    QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _GUID {
+    ULONG   Data1;
+    USHORT  Data2;
+    USHORT  Data3;
+    UCHAR   Data4[8];
+} GUID;
+
+#define DEFINE_GUID(_Name, ...) \
+        static const GUID _Name = { __VA_ARGS__ }
+
+typedef struct _UNICODE_STRING {
+    USHORT  Length;
+    USHORT  MaximumLength;
+    PWSTR   Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+// Compiler and annotation glue
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define UNALIGNED
+#define TRUE    1
+#define FALSE   0
+
+#define FORCEINLINE                     inline
+#define __inline                        inline
+#define __forceinline                   inline
+#define DECLSPEC_ALIGN(_Alignment)      __attribute__((aligned(_Alignment)))
+#define SYSTEM_CACHE_ALIGNMENT_SIZE     64
+#define DECLSPEC_CACHEALIGN             DECLSPEC_ALIGN(SYSTEM_CACHE_ALIGNMENT_SIZE)
+#define DECLSPEC_TARGET(_Isa)           __attribute__((target(_Isa)))
+#define MEMORY_ALLOCATION_ALIGNMENT     16
+
+// gcc has no __FUNCTION__ string literal to paste into a format prefix
+#define __FUNCTION__                    __FILE__
+
+#define __annotation(...)               ((void)0)
+#define __analysis_assume(_Exp)         ((void)0)
+#define __drv_functionClass(_Class)
+#define _Function_class_(_Class)
+#define _IRQL_requires_(_Irql)
+#define _Use_decl_annotations_
+#define _ReturnAddress()                __builtin_return_address(0)
+
+#define C_ASSERT(_Exp)                  _Static_assert(_Exp, #_Exp)
+#define UNREFERENCED_PARAMETER(_P)      (void)(_P)
+
+#define NTDDI_VISTA     0x06000000
+#define NTDDI_WIN7      0x06010000
+#define NTDDI_WIN8      0x06020000
+
+#ifndef NTDDI_VERSION
+#define NTDDI_VERSION   NTDDI_WIN7
+#endif
+
+// Status codes
+
+#define NT_SUCCESS(_Status)             ((NTSTATUS)(_Status) >= 0)
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000)
+#define STATUS_PENDING                  ((NTSTATUS)0x00000103)
+#define STATUS_BUFFER_OVERFLOW          ((NTSTATUS)0x80000005)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000D)
+#define STATUS_NO_MEMORY                ((NTSTATUS)0xC0000017)
+#define STATUS_INSUFFICIENT_RESOURCES   ((NTSTATUS)0xC000009A)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BB)
+
+// Memory
+
+#define PAGE_SIZE   4096
+#define PAGE_SHIFT  12
+#define MAXUSHORT   0xffff
+#define MAXULONG    0xffffffff
+
+#define CONTAINING_RECORD(_Address, _Type, _Field) \
+        ((_Type *)((PCHAR)(_Address) - offsetof(_Type, _Field)))
+#define FIELD_OFFSET(_Type, _Field)     offsetof(_Type, _Field)
+#define RTL_FIELD_SIZE(_Type, _Field)   (sizeof (((_Type *)0)->_Field))
+#define ARRAYSIZE(_Array)               (sizeof (_Array) / sizeof ((_Array)[0]))
+
+#define RtlZeroMemory(_Destination, _Length) \
+        memset((_Destination), 0, (_Length))
+#define RtlFillMemory(_Destination, _Length, _Fill) \
+        memset((_Destination), (_Fill), (_Length))
+#define RtlCopyMemory(_Destination, _Source, _Length) \
+        memcpy((_Destination), (_Source), (_Length))
+#define RtlMoveMemory(_Destination, _Source, _Length) \
+        memmove((_Destination), (_Source), (_Length))
+#define RtlEqualMemory(_Destination, _Source, _Length) \
+        (memcmp((_Destination), (_Source), (_Length)) == 0)
+
+typedef enum _POOL_TYPE {
+    NonPagedPool,
+    PagedPool,
+    NonPagedPoolCacheAligned = 4,
+    NonPagedPoolNx = 512
+} POOL_TYPE;
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+VOID ExFreePool(PVOID P);
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag);
+
+// Doubly and singly linked lists
+
+typedef struct _LIST_ENTRY {
+    struct _LIST_ENTRY  *Flink;
+    struct _LIST_ENTRY  *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+static inline VOID
+InitializeListHead(
+    IN  PLIST_ENTRY ListHead
+    )
+{
+    ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+static inline BOOLEAN
+IsListEmpty(
+    IN  const LIST_ENTRY    *ListHead
+    )
+{
+    return (ListHead->Flink == ListHead) ? TRUE : FALSE;
+}
+
+static inline BOOLEAN
+RemoveEntryList(
+    IN  PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY     Flink = Entry->Flink;
+    PLIST_ENTRY     Blink = Entry->Blink;
+
+    Blink->Flink = Flink;
+    Flink->Blink = Blink;
+
+    return (Flink == Blink) ? TRUE : FALSE;
+}
+
+static inline PLIST_ENTRY
+RemoveHeadList(
+    IN  PLIST_ENTRY ListHead
+    )
+{
+    PLIST_ENTRY     Entry = ListHead->Flink;
+
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+static inline PLIST_ENTRY
+RemoveTailList(
+    IN  PLIST_ENTRY ListHead
+    )
+{
+    PLIST_ENTRY     Entry = ListHead->Blink;
+
+    RemoveEntryList(Entry);
+    return Entry;
+}
+
+static inline VOID
+InsertTailList(
+    IN  PLIST_ENTRY ListHead,
+    IN  PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY     Blink = ListHead->Blink;
+
+    Entry->Flink = ListHead;
+    Entry->Blink = Blink;
+    Blink->Flink = Entry;
+    ListHead->Blink = Entry;
+}
+
+static inline VOID
+InsertHeadList(
+    IN  PLIST_ENTRY ListHead,
+    IN  PLIST_ENTRY Entry
+    )
+{
+    PLIST_ENTRY     Flink = ListHead->Flink;
+
+    Entry->Flink = Flink;
+    Entry->Blink = ListHead;
+    Flink->Blink = Entry;
+    ListHead->Flink = Entry;
+}
+
+static inline VOID
+AppendTailList(
+    IN  PLIST_ENTRY ListHead,
+    IN  PLIST_ENTRY ListToAppend
+    )
+{
+    PLIST_ENTRY     ListEnd = ListHead->Blink;
+
+    ListHead->Blink->Flink = ListToAppend;
+    ListHead->Blink = ListToAppend->Blink;
+    ListToAppend->Blink->Flink = ListHead;
+    ListToAppend->Blink = ListEnd;
+}
+
+typedef struct _SLIST_ENTRY {
+    struct _SLIST_ENTRY *Next;
+} SLIST_ENTRY, *PSLIST_ENTRY;
+
+// Not the real layout: the shim serializes on Lock rather than relying on
+// a double-width compare-exchange.
+typedef struct DECLSPEC_ALIGN(16) _SLIST_HEADER {
+    PSLIST_ENTRY    Next;
+    volatile LONG   Lock;
+    USHORT          Depth;
+} SLIST_HEADER, *PSLIST_HEADER;
+
+VOID InitializeSListHead(PSLIST_HEADER ListHead);
+PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER ListHead, PSLIST_ENTRY ListEntry);
+PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER ListHead);
+PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER ListHead);
+USHORT QueryDepthSList(PSLIST_HEADER ListHead);
+
+// Interlocked operations
+
+#define InterlockedIncrement(_Target) \
+        __atomic_add_fetch((_Target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(_Target) \
+        __atomic_sub_fetch((_Target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedExchange(_Target, _Value) \
+        __atomic_exchange_n((_Target), (_Value), __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd(_Target, _Value) \
+        __atomic_fetch_add((_Target), (_Value), __ATOMIC_SEQ_CST)
+#define InterlockedOr(_Target, _Value) \
+        __atomic_fetch_or((_Target), (_Value), __ATOMIC_SEQ_CST)
+#define InterlockedAnd(_Target, _Value) \
+        __atomic_fetch_and((_Target), (_Value), __ATOMIC_SEQ_CST)
+#define InterlockedIncrement64  InterlockedIncrement
+#define InterlockedDecrement64  InterlockedDecrement
+#define InterlockedExchange64   InterlockedExchange
+#define InterlockedExchangeAdd64 InterlockedExchangeAdd
+#define InterlockedExchangePointer InterlockedExchange
+
+#define InterlockedCompareExchange(_Target, _Exchange, _Comperand)          \
+        __sync_val_compare_and_swap((_Target), (_Comperand), (_Exchange))
+#define InterlockedCompareExchange64 InterlockedCompareExchange
+#define InterlockedCompareExchangePointer(_Target, _Exchange, _Comperand)   \
+        ((PVOID)__sync_val_compare_and_swap((_Target),                      \
+                                            (PVOID)(_Comperand),            \
+                                            (PVOID)(_Exchange)))
+
+#define ReadNoFence64(_Source)  __atomic_load_n((_Source), __ATOMIC_RELAXED)
+
+#define KeMemoryBarrier()       __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+// IRQL and the simulated processors. Each thread that calls into the
+// driver acts as one processor (see ShimSetCurrentProcessor() in
+// ../shim.h); IRQL is tracked per thread.
+
+#define PASSIVE_LEVEL   0
+#define APC_LEVEL       1
+#define DISPATCH_LEVEL  2
+#define HIGH_LEVEL      15
+
+#define MAXIMUM_PROCESSORS      64
+#define ALL_PROCESSOR_GROUPS    0xffff
+
+typedef struct _PROCESSOR_NUMBER {
+    USHORT  Group;
+    UCHAR   Number;
+    UCHAR   Reserved;
+} PROCESSOR_NUMBER, *PPROCESSOR_NUMBER;
+
+KIRQL KeGetCurrentIrql(VOID);
+VOID KeRaiseIrql(KIRQL NewIrql, PKIRQL OldIrql);
+VOID KeLowerIrql(KIRQL NewIrql);
+
+ULONG KeGetCurrentProcessorNumber(VOID);
+ULONG KeGetCurrentProcessorNumberEx(PPROCESSOR_NUMBER ProcNumber);
+ULONG KeQueryActiveProcessorCount(PKAFFINITY ActiveProcessors);
+ULONG KeQueryActiveProcessorCountEx(USHORT GroupNumber);
+NTSTATUS KeGetProcessorNumberFromIndex(ULONG ProcIndex, PPROCESSOR_NUMBER ProcNumber);
+ULONG KeGetProcessorIndexFromNumber(PPROCESSOR_NUMBER ProcNumber);
+
+VOID KeInitializeSpinLock(PKSPIN_LOCK SpinLock);
+VOID KeAcquireSpinLock(PKSPIN_LOCK SpinLock, PKIRQL OldIrql);
+VOID KeReleaseSpinLock(PKSPIN_LOCK SpinLock, KIRQL NewIrql);
+VOID KeAcquireSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock);
+VOID KeReleaseSpinLockFromDpcLevel(PKSPIN_LOCK SpinLock);
+
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency);
+ULONGLONG KeQueryInterruptTime(VOID);
+
+// DPCs and timers. A DPC is queued to its target processor and runs when
+// that processor next drops below DISPATCH_LEVEL, or when the harness
+// drains the queues explicitly.
+
+typedef struct _KDPC KDPC, *PKDPC, *PRKDPC;
+
+typedef VOID KDEFERRED_ROUTINE(PKDPC Dpc, PVOID DeferredContext,
+                               PVOID SystemArgument1, PVOID SystemArgument2);
+typedef KDEFERRED_ROUTINE *PKDEFERRED_ROUTINE;
+
+typedef enum _KDPC_IMPORTANCE {
+    LowImportance,
+    MediumImportance,
+    HighImportance,
+    MediumHighImportance
+} KDPC_IMPORTANCE;
+
+struct _KDPC {
+    LIST_ENTRY          DpcListEntry;
+    PKDEFERRED_ROUTINE  DeferredRoutine;
+    PVOID               DeferredContext;
+    PVOID               SystemArgument1;
+    PVOID               SystemArgument2;
+    volatile LONG       Inserted;
+    LONG                TargetProcessor;    // -1 for the inserting processor
+    volatile LONG       Processor;          // whose queue it is on
+    KDPC_IMPORTANCE     Importance;
+    BOOLEAN             Threaded;
+};
+
+VOID KeInitializeDpc(PRKDPC Dpc, PKDEFERRED_ROUTINE DeferredRoutine, PVOID DeferredContext);
+VOID KeInitializeThreadedDpc(PRKDPC Dpc, PKDEFERRED_ROUTINE DeferredRoutine, PVOID DeferredContext);
+BOOLEAN KeInsertQueueDpc(PRKDPC Dpc, PVOID SystemArgument1, PVOID SystemArgument2);
+BOOLEAN KeRemoveQueueDpc(PRKDPC Dpc);
+VOID KeSetImportanceDpc(PRKDPC Dpc, KDPC_IMPORTANCE Importance);
+VOID KeSetTargetProcessorDpc(PRKDPC Dpc, CHAR Number);
+NTSTATUS KeSetTargetProcessorDpcEx(PKDPC Dpc, PPROCESSOR_NUMBER ProcNumber);
+VOID KeFlushQueuedDpcs(VOID);
+
+typedef struct _KTIMER {
+    LIST_ENTRY      TimerListEntry;
+    LONGLONG        DueTime;            // absolute, in shim clock ticks
+    LONG            Period;
+    PKDPC           Dpc;
+    BOOLEAN         Inserted;
+} KTIMER, *PKTIMER, *PRKTIMER;
+
+VOID KeInitializeTimer(PKTIMER Timer);
+BOOLEAN KeSetTimer(PKTIMER Timer, LARGE_INTEGER DueTime, PKDPC Dpc);
+BOOLEAN KeSetTimerEx(PKTIMER Timer, LARGE_INTEGER DueTime, LONG Period, PKDPC Dpc);
+BOOLEAN KeCancelTimer(PKTIMER Timer);
+BOOLEAN KeReadStateTimer(PKTIMER Timer);
+
+// Events
+
+typedef enum _EVENT_TYPE {
+    NotificationEvent,
+    SynchronizationEvent
+} EVENT_TYPE;
+
+typedef struct _KEVENT {
+    volatile LONG   State;
+} KEVENT, *PKEVENT, *PRKEVENT;
+
+VOID KeInitializeEvent(PRKEVENT Event, EVENT_TYPE Type, BOOLEAN State);
+LONG KeSetEvent(PRKEVENT Event, LONG Increment, BOOLEAN Wait);
+VOID KeClearEvent(PRKEVENT Event);
+LONG KeReadStateEvent(PRKEVENT Event);
+PKEVENT IoCreateNotificationEvent(PUNICODE_STRING EventName, PHANDLE EventHandle);
+NTSTATUS ZwClose(HANDLE Handle);
+
+// MDLs. A shim MDL always describes virtually contiguous memory so the
+// PFN array that follows a real MDL is never consulted.
+
+typedef struct _MDL {
+    struct _MDL *Next;
+    SHORT       Size;
+    SHORT       MdlFlags;
+    PVOID       MappedSystemVa;
+    PVOID       StartVa;
+    ULONG       ByteCount;
+    ULONG       ByteOffset;
+} MDL, *PMDL;
+
+#define MDL_MAPPED_TO_SYSTEM_VA     0x0001
+#define MDL_PAGES_LOCKED            0x0002
+#define MDL_SOURCE_IS_NONPAGED_POOL 0x0004
+#define MDL_PARTIAL                 0x0010
+
+typedef enum _MM_PAGE_PRIORITY {
+    LowPagePriority,
+    NormalPagePriority = 16,
+    HighPagePriority = 32
+} MM_PAGE_PRIORITY;
+
+#define MdlMappingNoExecute     0x40000000
+
+#define PAGE_ALIGN(_Va)         ((PVOID)((ULONG_PTR)(_Va) & ~(PAGE_SIZE - 1)))
+#define BYTE_OFFSET(_Va)        ((ULONG)((ULONG_PTR)(_Va) & (PAGE_SIZE - 1)))
+#define ADDRESS_AND_SIZE_TO_SPAN_PAGES(_Va, _Size) \
+        ((BYTE_OFFSET(_Va) + ((ULONG)(_Size)) + (PAGE_SIZE - 1)) >> PAGE_SHIFT)
+
+#define MmGetMdlByteCount(_Mdl)     ((_Mdl)->ByteCount)
+#define MmGetMdlByteOffset(_Mdl)    ((_Mdl)->ByteOffset)
+#define MmGetMdlVirtualAddress(_Mdl) \
+        ((PVOID)((PCHAR)(_Mdl)->StartVa + (_Mdl)->ByteOffset))
+#define MmGetSystemAddressForMdlSafe(_Mdl, _Priority)           \
+        (((_Mdl)->MdlFlags & (MDL_MAPPED_TO_SYSTEM_VA |         \
+                              MDL_SOURCE_IS_NONPAGED_POOL)) ?   \
+         (_Mdl)->MappedSystemVa :                               \
+         MmGetMdlVirtualAddress(_Mdl))
+
+VOID MmInitializeMdl(PMDL Mdl, PVOID BaseVa, SIZE_T Length);
+VOID MmBuildMdlForNonPagedPool(PMDL Mdl);
+VOID MmPrepareMdlForReuse(PMDL Mdl);
+PMDL IoAllocateMdl(PVOID VirtualAddress, ULONG Length, BOOLEAN SecondaryBuffer,
+                   BOOLEAN ChargeQuota, PVOID Irp);
+VOID IoFreeMdl(PMDL Mdl);
+VOID IoBuildPartialMdl(PMDL SourceMdl, PMDL TargetMdl, PVOID VirtualAddress,
+                       ULONG Length);
+
+// Extended processor state. The shim saves nothing: user-mode threads
+// already have their full register state preserved by the kernel.
+
+#define XSTATE_AVX          2
+#define XSTATE_MASK_AVX     (1ull << XSTATE_AVX)
+
+typedef struct _XSTATE_SAVE {
+    ULONG64     Mask;
+} XSTATE_SAVE, *PXSTATE_SAVE;
+
+ULONG64 RtlGetEnabledExtendedFeatures(ULONG64 FeatureMask);
+NTSTATUS KeSaveExtendedProcessorState(ULONG64 Mask, PXSTATE_SAVE XStateSave);
+VOID KeRestoreExtendedProcessorState(PXSTATE_SAVE XStateSave);
+PVOID MmGetSystemRoutineAddress(PUNICODE_STRING SystemRoutineName);
+
+// Miscellaneous run-time library
+
+VOID RtlInitUnicodeString(PUNICODE_STRING DestinationString, PCWSTR SourceString);
+ULONG RtlRandomEx(PULONG Seed);
+
+#define _byteswap_ushort(_Value)    __builtin_bswap16(_Value)
+#define _byteswap_ulong(_Value)     __builtin_bswap32(_Value)
+#define _byteswap_uint64(_Value)    __builtin_bswap64(_Value)
+
+// Debugger and bugcheck
+
+#define DPFLTR_IHVDRIVER_ID     77
+#define DPFLTR_DEFAULT_ID       101
+
+#define DPFLTR_ERROR_LEVEL      0
+#define DPFLTR_WARNING_LEVEL    1
+#define DPFLTR_TRACE_LEVEL      2
+#define DPFLTR_INFO_LEVEL       3
+
+ULONG vDbgPrintExWithPrefix(PCSTR Prefix, ULONG ComponentId, ULONG Level,
+                            PCSTR Format, va_list Arguments);
+NTSTATUS DbgSetDebugFilterState(ULONG ComponentId, ULONG Level, BOOLEAN State);
+VOID DbgBreakPoint(VOID);
+VOID DbgRaiseAssertionFailure(VOID) __attribute__((noreturn));
+VOID KeBugCheckEx(ULONG BugCheckCode, ULONG_PTR BugCheckParameter1,
+                  ULONG_PTR BugCheckParameter2, ULONG_PTR BugCheckParameter3,
+                  ULONG_PTR BugCheckParameter4) __attribute__((noreturn));
+
+#define __debugbreak()          DbgBreakPoint()
+
+// Driver objects, which only appear in prototypes
+
+typedef struct _DRIVER_OBJECT   DRIVER_OBJECT, *PDRIVER_OBJECT;
+typedef struct _DEVICE_OBJECT   DEVICE_OBJECT, *PDEVICE_OBJECT;
+
+typedef NTSTATUS DRIVER_INITIALIZE(PDRIVER_OBJECT DriverObject,
+                                   PUNICODE_STRING RegistryPath);
+
+typedef struct _INTERFACE {
+    USHORT  Size;
+    USHORT  Version;
+    PVOID   Context;
+    PVOID   InterfaceReference;
+    PVOID   InterfaceDereference;
+} INTERFACE, *PINTERFACE;
+
+#endif  // _TEST_NTDDK_H
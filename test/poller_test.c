@@ -0,0 +1,826 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Tests of the poller. The driver source is included so that its static
+// functions can be called directly; everything else runs over the mock
+// backend through the harness, on a manual clock and with transmit
+// completions made only when a test asks for them. Each test brings up
+// its own adapter and fails by aborting.
+//
+// The poll is stepped a pass at a time by taking its DPC off the queue
+// and calling the routine, so that a test can look at the poller between
+// passes. The threaded DPC is called at DISPATCH_LEVEL, as it runs when
+// threaded DPCs are disabled.
+//
+// poller_test [test ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/xennet/poller.c"
+
+#include "harness.h"
+
+typedef struct _POLLER_TEST {
+    const CHAR  *Name;
+    VOID        (*Function)(VOID);
+} POLLER_TEST, *PPOLLER_TEST;
+
+static PROPERTIES   PollerTestProperties;
+static PFRAME       PollerTestFrame;
+static ULONG64      PollerTestSent;
+
+#define POLLER_TEST_MAXIMUM_BATCH   256
+#define POLLER_TEST_THRESHOLD       32
+#define POLLER_TEST_TICKS_PER_US    (SHIM_CLOCK_FREQUENCY / 1000000)
+
+// Creates an adapter on ProcessorCount processors with the default
+// properties adjusted by any property assignments given, terminated by
+// NULL.
+static PADAPTER
+PollerTestCreateAdapter(
+    IN  ULONG                   ProcessorCount,
+    ...
+    )
+{
+    MOCK_VIF_CONFIGURATION      Configuration;
+    FRAME_PARAMETERS            Parameters;
+    va_list                     Arguments;
+    const CHAR                  *Assignment;
+
+    HarnessInitialize(ProcessorCount, 0);
+    HarnessDefaultProperties(&PollerTestProperties);
+    PollerTestSent = 0;
+
+    va_start(Arguments, ProcessorCount);
+    while ((Assignment = va_arg(Arguments, const CHAR *)) != NULL)
+        SHIM_CHECK(HarnessSetProperty(&PollerTestProperties, Assignment));
+    va_end(Arguments);
+
+    MockVifDefaultConfiguration(&Configuration);
+    Configuration.Completion = MOCK_VIF_COMPLETE_MANUAL;
+
+    FrameDefaultParameters(&Parameters);
+    PollerTestFrame = FrameAllocate();
+    FrameBuild(PollerTestFrame, &Parameters);
+
+    // Budgets in time only run out when a test moves the clock
+    ShimSetManualClock(TRUE);
+
+    return HarnessCreateAdapter(&PollerTestProperties, &Configuration);
+}
+
+static VOID
+PollerTestDestroyAdapter(
+    IN  PADAPTER    Adapter
+    )
+{
+    HARNESS_STATISTICS  Harness;
+
+    HarnessDestroyAdapter(Adapter);
+
+    // Every send has gone back to NDIS
+    HarnessQueryStatistics(&Harness);
+    SHIM_CHECK(Harness.SendCompletedNetBufferLists == PollerTestSent);
+
+    ShimSetManualClock(FALSE);
+
+    FrameFree(PollerTestFrame);
+    PollerTestFrame = NULL;
+
+    HarnessTeardown();
+}
+
+// Passes Count frames to the frontend in one receive callback. Must be
+// called at DISPATCH_LEVEL.
+static VOID
+PollerTestReceive(
+    IN  PADAPTER    Adapter,
+    IN  ULONG       Count
+    )
+{
+    PFRAME          Batch[POLLER_TEST_MAXIMUM_BATCH];
+    ULONG           Index;
+
+    SHIM_CHECK(Count <= POLLER_TEST_MAXIMUM_BATCH);
+
+    for (Index = 0; Index < Count; Index++)
+        Batch[Index] = PollerTestFrame;
+
+    SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, Batch, Count) == Count);
+}
+
+// Sends Count frames in one chain, which the backend holds until
+// PollerTestComplete(). Must be called at PASSIVE_LEVEL so that nothing
+// is staged.
+static VOID
+PollerTestSend(
+    IN  PADAPTER        Adapter,
+    IN  ULONG           Count
+    )
+{
+    PNET_BUFFER_LIST    Head;
+    PNET_BUFFER_LIST    *Tail;
+    ULONG               Index;
+
+    if (Count == 0)
+        return;
+
+    Head = NULL;
+    Tail = &Head;
+    for (Index = 0; Index < Count; Index++) {
+        *Tail = HarnessAllocateSend(PollerTestFrame, 0, NULL, NULL);
+        Tail = &NET_BUFFER_LIST_NEXT_NBL(*Tail);
+    }
+
+    PollerTestSent += Count;
+
+    TransmitterSendNetBufferLists(Adapter->Transmitter, Head, 0, 0);
+}
+
+// Completes everything sent in one completion callback. Must be called at
+// DISPATCH_LEVEL.
+static VOID
+PollerTestComplete(
+    IN  PADAPTER    Adapter
+    )
+{
+    MockVifCompletePackets(Adapter->VifInterface);
+}
+
+// Receives indicated and sends completed to NDIS so far
+static ULONG64
+PollerTestIndicated(
+    VOID
+    )
+{
+    HARNESS_STATISTICS  Harness;
+
+    HarnessQueryStatistics(&Harness);
+
+    return Harness.IndicatedNetBufferLists;
+}
+
+static ULONG64
+PollerTestCompleted(
+    VOID
+    )
+{
+    HARNESS_STATISTICS  Harness;
+
+    HarnessQueryStatistics(&Harness);
+
+    return Harness.SendCompletedNetBufferLists;
+}
+
+// Checks that the poller is handing everything to the callbacks, with
+// neither DPC queued
+static VOID
+PollerTestCheckIdle(
+    IN  PPOLLER Poller
+    )
+{
+    SHIM_CHECK(!Poller->Polling);
+    SHIM_CHECK(!Poller->Dpc.Inserted);
+    SHIM_CHECK(!Poller->ThreadedDpc.Inserted);
+    SHIM_CHECK(Poller->Passes == 0);
+    SHIM_CHECK(Poller->Pending == 0);
+    SHIM_CHECK(IsListEmpty(&Poller->Receive));
+    SHIM_CHECK(Poller->CompleteHead == NULL);
+}
+
+// Makes the next pass of the poll, checking that it was queued on the
+// given DPC and that the other was not queued. Must be called at
+// DISPATCH_LEVEL.
+static VOID
+PollerTestStep(
+    IN  PPOLLER Poller,
+    IN  BOOLEAN Threaded
+    )
+{
+    SHIM_CHECK(Poller->Polling);
+    SHIM_CHECK(!(Threaded ? Poller->Dpc.Inserted : Poller->ThreadedDpc.Inserted));
+
+    if (Threaded) {
+        SHIM_CHECK(KeRemoveQueueDpc(&Poller->ThreadedDpc));
+        PollerThreadedDpc(&Poller->ThreadedDpc, Poller, NULL, NULL);
+    } else {
+        SHIM_CHECK(KeRemoveQueueDpc(&Poller->Dpc));
+        PollerDpc(&Poller->Dpc, Poller, NULL, NULL);
+    }
+}
+
+// Threshold
+
+// Callbacks carrying fewer than the threshold's packets are processed in
+// the callback while the poller is idle; one carrying as many, whether
+// receives or completions, queues them and starts the poll DPC instead.
+// The first pass processes them and polls again, and a pass that finds
+// nothing hands back to the callbacks. A threshold of 0 leaves the
+// poller out of it altogether.
+static VOID
+PollerTestThreshold(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PPOLLER             Poller;
+    POLLER_STATISTICS   Statistics;
+    ULONG64             Indicated;
+    ULONG64             Completed;
+    KIRQL               Irql;
+
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=32", NULL);
+    Poller = &Adapter->Poller;
+    SHIM_CHECK(Poller->Threshold == POLLER_TEST_THRESHOLD);
+
+    PollerTestSend(Adapter, POLLER_TEST_THRESHOLD - 1);
+
+    Indicated = PollerTestIndicated();
+    Completed = PollerTestCompleted();
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    // Below the threshold
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD - 1);
+    SHIM_CHECK(PollerTestIndicated() == Indicated + POLLER_TEST_THRESHOLD - 1);
+    PollerTestCheckIdle(Poller);
+
+    PollerTestComplete(Adapter);
+    SHIM_CHECK(PollerTestCompleted() == Completed + POLLER_TEST_THRESHOLD - 1);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    // A completion callback at the threshold
+    PollerTestSend(Adapter, POLLER_TEST_THRESHOLD);
+
+    Indicated = PollerTestIndicated();
+    Completed = PollerTestCompleted();
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestComplete(Adapter);
+    SHIM_CHECK(PollerTestCompleted() == Completed);
+    SHIM_CHECK(Poller->Polling);
+    SHIM_CHECK(Poller->Pending == POLLER_TEST_THRESHOLD);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Polling);
+
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(PollerTestCompleted() == Completed + POLLER_TEST_THRESHOLD);
+    SHIM_CHECK(Poller->Passes == 1);
+
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    // And a receive callback
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+    SHIM_CHECK(PollerTestIndicated() == Indicated);
+    SHIM_CHECK(Poller->Pending == POLLER_TEST_THRESHOLD);
+
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(PollerTestIndicated() == Indicated + POLLER_TEST_THRESHOLD);
+
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Threshold == POLLER_TEST_THRESHOLD);
+    SHIM_CHECK(!Statistics.Polling);
+    SHIM_CHECK(Statistics.Events == 4);
+    SHIM_CHECK(Statistics.PolledEvents == 0);
+    SHIM_CHECK(Statistics.Packets == 2 * POLLER_TEST_THRESHOLD - 1);
+    SHIM_CHECK(Statistics.Completions == 2 * POLLER_TEST_THRESHOLD - 1);
+    SHIM_CHECK(Statistics.PolledPackets == 2 * POLLER_TEST_THRESHOLD);
+    SHIM_CHECK(Statistics.Polls == 4);
+    SHIM_CHECK(Statistics.Rearms == 2);
+    SHIM_CHECK(Statistics.Yields == 0);
+
+    PollerTestDestroyAdapter(Adapter);
+
+    // Off by default
+    Adapter = PollerTestCreateAdapter(1, NULL);
+    Poller = &Adapter->Poller;
+    SHIM_CHECK(Poller->Threshold == 0);
+
+    PollerTestSend(Adapter, POLLER_TEST_MAXIMUM_BATCH);
+
+    Indicated = PollerTestIndicated();
+    Completed = PollerTestCompleted();
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, POLLER_TEST_MAXIMUM_BATCH);
+    PollerTestComplete(Adapter);
+
+    SHIM_CHECK(PollerTestIndicated() == Indicated + POLLER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(PollerTestCompleted() == Completed + POLLER_TEST_MAXIMUM_BATCH);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Events == 0);
+
+    PollerTestDestroyAdapter(Adapter);
+}
+
+// Queueing
+
+// While the poller is running every callback only queues its packets,
+// however few it carries, and the next pass processes everything queued,
+// receives and completions alike.
+static VOID
+PollerTestQueue(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PPOLLER             Poller;
+    POLLER_STATISTICS   Statistics;
+    ULONG64             Indicated;
+    ULONG64             Completed;
+    KIRQL               Irql;
+
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=32", NULL);
+    Poller = &Adapter->Poller;
+
+    PollerTestSend(Adapter, 3);
+
+    Indicated = PollerTestIndicated();
+    Completed = PollerTestCompleted();
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+    SHIM_CHECK(Poller->Polling);
+
+    PollerTestReceive(Adapter, 1);
+    PollerTestReceive(Adapter, 1);
+    PollerTestComplete(Adapter);
+
+    SHIM_CHECK(PollerTestIndicated() == Indicated);
+    SHIM_CHECK(PollerTestCompleted() == Completed);
+    SHIM_CHECK(Poller->Pending == POLLER_TEST_THRESHOLD + 2 + 3);
+    SHIM_CHECK(Poller->CompleteHead != NULL);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Events == 4);
+    SHIM_CHECK(Statistics.PolledEvents == 3);
+    SHIM_CHECK(Statistics.Polls == 0);
+
+    // One pass for the lot
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(PollerTestIndicated() == Indicated + POLLER_TEST_THRESHOLD + 2);
+    SHIM_CHECK(PollerTestCompleted() == Completed + 3);
+    SHIM_CHECK(Poller->Pending == 0);
+    SHIM_CHECK(IsListEmpty(&Poller->Receive));
+    SHIM_CHECK(Poller->CompleteHead == NULL);
+    SHIM_CHECK(Poller->CompleteTail == &Poller->CompleteHead);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Polls == 1);
+    SHIM_CHECK(Statistics.PolledPackets == POLLER_TEST_THRESHOLD + 2 + 3);
+
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerTestDestroyAdapter(Adapter);
+}
+
+// Re-arming
+
+// A pass that processes something always polls again, however little it
+// found, and a poll only ends on a pass that finds nothing, which hands
+// processing back to the callbacks. The next poll starts afresh.
+static VOID
+PollerTestRearm(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PPOLLER             Poller;
+    POLLER_STATISTICS   Statistics;
+    ULONG64             Indicated;
+    ULONG               Pass;
+    KIRQL               Irql;
+
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=32", NULL);
+    Poller = &Adapter->Poller;
+
+    Indicated = PollerTestIndicated();
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+
+    // A frame arriving between passes keeps the poll going
+    for (Pass = 1; Pass <= 4; Pass++) {
+        PollerTestStep(Poller, FALSE);
+        SHIM_CHECK(Poller->Passes == Pass);
+
+        PollerTestReceive(Adapter, 1);
+    }
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Rearms == 0);
+
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(PollerTestIndicated() == Indicated + POLLER_TEST_THRESHOLD + 4);
+
+    // Nothing came: re-arm
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Polls == 6);
+    SHIM_CHECK(Statistics.Rearms == 1);
+
+    // The callbacks have it again...
+    PollerTestReceive(Adapter, 1);
+    SHIM_CHECK(PollerTestIndicated() == Indicated + POLLER_TEST_THRESHOLD + 5);
+    PollerTestCheckIdle(Poller);
+
+    // ... until the threshold is reached once more
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+    SHIM_CHECK(Poller->Polling);
+
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(Poller->Passes == 1);
+    SHIM_CHECK(Poller->Processed == POLLER_TEST_THRESHOLD);
+
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Rearms == 2);
+
+    PollerTestDestroyAdapter(Adapter);
+}
+
+// Yielding
+
+// A poll that has made POLLER_MAXIMUM_PASSES passes, or processed the
+// receiver's budget of packets, or run for its budget of time, makes its
+// next pass from the threaded DPC, which starts a new poll.
+static VOID
+PollerTestYield(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PPOLLER             Poller;
+    POLLER_STATISTICS   Statistics;
+    ULONG               Pass;
+    KIRQL               Irql;
+
+    // Passes, with budgets that are never reached
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=32", "rx_budget=0", "rx_budget_time=0", NULL);
+    Poller = &Adapter->Poller;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+
+    for (Pass = 1; Pass <= POLLER_MAXIMUM_PASSES; Pass++) {
+        PollerTestStep(Poller, FALSE);
+        PollerTestReceive(Adapter, 1);
+    }
+
+    SHIM_CHECK(Poller->Passes == 0);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Yields == 0);
+
+    PollerTestStep(Poller, TRUE);
+    SHIM_CHECK(Poller->Passes == 1);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Yields == 1);
+    SHIM_CHECK(Statistics.Rearms == 0);
+
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerTestDestroyAdapter(Adapter);
+
+    // Packets, counted across the passes of a poll
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=32", "rx_budget=64", "rx_budget_time=0", NULL);
+    Poller = &Adapter->Poller;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+    PollerTestStep(Poller, FALSE);
+
+    PollerTestReceive(Adapter, 63 - POLLER_TEST_THRESHOLD);
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(Poller->Processed == 63);
+
+    PollerTestReceive(Adapter, 1);
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(Poller->ThreadedDpc.Inserted);
+
+    // The threaded DPC may find nothing too
+    PollerTestStep(Poller, TRUE);
+    PollerTestCheckIdle(Poller);
+
+    // A single callback over the budget
+    PollerTestReceive(Adapter, 2 * 64);
+    PollerTestStep(Poller, FALSE);
+    PollerTestStep(Poller, TRUE);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Yields == 2);
+    SHIM_CHECK(Statistics.Rearms == 2);
+
+    PollerTestDestroyAdapter(Adapter);
+
+    // Time, from the start of the poll
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=32", "rx_budget=0", "rx_budget_time=100", NULL);
+    Poller = &Adapter->Poller;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, POLLER_TEST_THRESHOLD);
+    PollerTestStep(Poller, FALSE);
+
+    ShimAdvanceClock(100 * POLLER_TEST_TICKS_PER_US - 1);
+    PollerTestReceive(Adapter, 1);
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(Poller->Dpc.Inserted);
+
+    ShimAdvanceClock(1);
+    PollerTestReceive(Adapter, 1);
+    PollerTestStep(Poller, FALSE);
+    SHIM_CHECK(Poller->ThreadedDpc.Inserted);
+
+    // The new poll has the whole budget again
+    PollerTestReceive(Adapter, 1);
+    PollerTestStep(Poller, TRUE);
+    SHIM_CHECK(Poller->Dpc.Inserted);
+
+    PollerTestStep(Poller, FALSE);
+    PollerTestCheckIdle(Poller);
+
+    KeLowerIrql(Irql);
+
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Yields == 1);
+
+    PollerTestDestroyAdapter(Adapter);
+}
+
+// Disabling
+
+// PollerDisable() returns only once the poll DPCs, wherever they are
+// queued and however many budgets it takes, have processed everything the
+// callbacks queued and handed back to the callbacks.
+static VOID
+PollerTestDisable(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PPOLLER             Poller;
+    POLLER_STATISTICS   Statistics;
+    ULONG64             Indicated;
+    ULONG64             Completed;
+    KIRQL               Irql;
+
+    Adapter = PollerTestCreateAdapter(2, "poll_threshold=32", "rx_budget=64", NULL);
+    Poller = &Adapter->Poller;
+
+    PollerTestSend(Adapter, 16);
+
+    Indicated = PollerTestIndicated();
+    Completed = PollerTestCompleted();
+
+    // Leave the poll queued on processor 1
+    ShimSetCurrentProcessor(1);
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    PollerTestReceive(Adapter, 200);
+    PollerTestComplete(Adapter);
+
+    ShimSetCurrentProcessor(0);
+    KeLowerIrql(Irql);
+
+    SHIM_CHECK(Poller->Polling);
+    SHIM_CHECK(Poller->Dpc.Inserted);
+    SHIM_CHECK(ShimQueuedDpcs(1) != 0);
+    SHIM_CHECK(PollerTestIndicated() == Indicated);
+    SHIM_CHECK(PollerTestCompleted() == Completed);
+
+    PollerDisable(Poller);
+
+    PollerTestCheckIdle(Poller);
+    SHIM_CHECK(PollerTestIndicated() == Indicated + 200);
+    SHIM_CHECK(PollerTestCompleted() == Completed + 16);
+
+    // Over budget on the first pass, so finished by the threaded DPC
+    PollerQueryStatistics(Poller, &Statistics);
+    SHIM_CHECK(Statistics.Polls == 2);
+    SHIM_CHECK(Statistics.Yields == 1);
+    SHIM_CHECK(Statistics.Rearms == 1);
+
+    // Nothing to wait for
+    PollerDisable(Poller);
+    PollerTestCheckIdle(Poller);
+
+    PollerTestDestroyAdapter(Adapter);
+}
+
+// Load ramp
+
+#define POLLER_TEST_RAMP_THRESHOLD  16
+#define POLLER_TEST_RAMP_BURST      32
+#define POLLER_TEST_RAMP_TICKS      64
+
+// Offered load steps up from a frame per tick to a ring's worth, each
+// received in callbacks of up to POLLER_TEST_RAMP_BURST frames, as the
+// backend hands them over, and with half as many sends completed in one
+// callback. The poll DPC runs once per tick, after the tick's callbacks.
+// For each step the events taken per packet are printed, with how many of
+// the events only queued and the runs of the receive or completion path
+// (callbacks that processed their packets and poll passes that processed
+// something) per packet. Events per packet fall as load rises, and once
+// the poller is running processing runs fall faster still.
+static VOID
+PollerTestRamp(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PPOLLER             Poller;
+    POLLER_STATISTICS   Before;
+    POLLER_STATISTICS   After;
+    ULONG               Load;
+    ULONG               Tick;
+    ULONG               Remaining;
+    ULONG64             Events;
+    ULONG64             Packets;
+    ULONG64             Polls;
+    ULONG64             Runs;
+    double              EventsPerPacket;
+    double              RunsPerPacket;
+    double              Previous;
+    KIRQL               Irql;
+
+    Adapter = PollerTestCreateAdapter(1, "poll_threshold=16", NULL);
+    Poller = &Adapter->Poller;
+
+    Previous = 2.0;
+    for (Load = 1; Load <= POLLER_TEST_MAXIMUM_BATCH; Load *= 2) {
+        PollerQueryStatistics(Poller, &Before);
+
+        for (Tick = 0; Tick < POLLER_TEST_RAMP_TICKS; Tick++) {
+            PollerTestSend(Adapter, Load / 2);
+
+            KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+            for (Remaining = Load; Remaining != 0; ) {
+                ULONG   Count;
+
+                Count = (Remaining < POLLER_TEST_RAMP_BURST) ? Remaining : POLLER_TEST_RAMP_BURST;
+                PollerTestReceive(Adapter, Count);
+                Remaining -= Count;
+            }
+
+            if (Load / 2 != 0)
+                PollerTestComplete(Adapter);
+
+            // Runs the poll
+            KeLowerIrql(Irql);
+
+            PollerTestCheckIdle(Poller);
+        }
+
+        PollerQueryStatistics(Poller, &After);
+
+        Events = After.Events - Before.Events;
+        Packets = (After.Packets - Before.Packets) + (After.Completions - Before.Completions);
+        SHIM_CHECK(Packets == POLLER_TEST_RAMP_TICKS * (ULONG64)(Load + Load / 2));
+
+        // Every poll ends in a pass that finds nothing, and began with an
+        // event that only queued but is not counted as polled
+        Polls = After.Polls - Before.Polls;
+        Runs = (Events - (After.PolledEvents - Before.PolledEvents) - (After.Rearms - Before.Rearms)) +
+               (Polls - (After.Rearms - Before.Rearms));
+
+        EventsPerPacket = (double)Events / (double)Packets;
+        RunsPerPacket = (double)Runs / (double)Packets;
+
+        printf("  load %3u/tick: events/packet %.4f (%5.1f%% polled) runs/packet %.4f polls %llu\n",
+               Load,
+               EventsPerPacket,
+               (100.0 * (double)(After.PolledEvents - Before.PolledEvents)) / (double)Events,
+               RunsPerPacket,
+               Polls);
+
+        SHIM_CHECK(EventsPerPacket <= Previous);
+        Previous = EventsPerPacket;
+
+        if (Load < POLLER_TEST_RAMP_THRESHOLD) {
+            SHIM_CHECK(Polls == 0);
+            SHIM_CHECK(Runs == Events);
+        } else {
+            // One run a tick, whatever the load
+            SHIM_CHECK(Runs == POLLER_TEST_RAMP_TICKS);
+        }
+    }
+
+    PollerTestDestroyAdapter(Adapter);
+}
+
+static POLLER_TEST  PollerTest[] = {
+    { "threshold", PollerTestThreshold },
+    { "queue", PollerTestQueue },
+    { "rearm", PollerTestRearm },
+    { "yield", PollerTestYield },
+    { "disable", PollerTestDisable },
+    { "ramp", PollerTestRamp },
+};
+
+int
+main(
+    IN  int     argc,
+    IN  char    **argv
+    )
+{
+    ULONG       Index;
+    ULONG       Run;
+
+    // Keep what was printed if a check fails
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    Run = 0;
+    for (Index = 0; Index < ARRAYSIZE(PollerTest); Index++) {
+        PPOLLER_TEST    Test = &PollerTest[Index];
+
+        if (argc > 1) {
+            int Argument;
+
+            for (Argument = 1; Argument < argc; Argument++)
+                if (strcmp(argv[Argument], Test->Name) == 0)
+                    break;
+
+            if (Argument == argc)
+                continue;
+        }
+
+        printf("poller_test: %s\n", Test->Name);
+        Test->Function();
+        Run++;
+    }
+
+    if (Run == 0) {
+        fprintf(stderr, "poller_test: no such test\n");
+        return 2;
+    }
+
+    printf("poller_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,3845 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Tests of the receive path. The driver source is included so that its
+// static functions can be called directly; everything else runs over the
+// mock backend through the harness. Each test brings up its own adapter
+// with the number of processors it needs and fails by aborting.
+//
+// receiver_test [test ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../src/xennet/receiver.c"
+
+#include "harness.h"
+#include "toeplitz_vectors.h"
+
+typedef struct _RECEIVER_TEST {
+    const CHAR  *Name;
+    VOID        (*Function)(VOID);
+} RECEIVER_TEST, *PRECEIVER_TEST;
+
+static PROPERTIES   ReceiverTestProperties;
+
+// Creates an adapter on ProcessorCount processors (in groups of
+// GroupSize, 0 for one group) over a backend with the given configuration
+// (NULL for the default) and with the default properties adjusted by any
+// property assignments given, terminated by NULL.
+static PADAPTER
+ReceiverTestCreateAdapter(
+    IN  ULONG                   ProcessorCount,
+    IN  ULONG                   GroupSize,
+    IN  PMOCK_VIF_CONFIGURATION Configuration OPTIONAL,
+    ...
+    )
+{
+    va_list                     Arguments;
+    const CHAR                  *Assignment;
+
+    HarnessInitialize(ProcessorCount, GroupSize);
+    HarnessDefaultProperties(&ReceiverTestProperties);
+
+    va_start(Arguments, Configuration);
+    while ((Assignment = va_arg(Arguments, const CHAR *)) != NULL)
+        SHIM_CHECK(HarnessSetProperty(&ReceiverTestProperties, Assignment));
+    va_end(Arguments);
+
+    return HarnessCreateAdapter(&ReceiverTestProperties, Configuration);
+}
+
+static VOID
+ReceiverTestDestroyAdapter(
+    IN  PADAPTER    Adapter
+    )
+{
+    HarnessDestroyAdapter(Adapter);
+    HarnessTeardown();
+}
+
+#define RECEIVER_TEST_MAXIMUM_BATCH 256
+
+// Passes Count copies of Frame to the receiver in one callback on the
+// current processor, runs any DPCs that queued and returns the number the
+// backend had room for.
+static ULONG
+ReceiverTestReceive(
+    IN  PADAPTER    Adapter,
+    IN  PFRAME      Frame,
+    IN  ULONG       Count
+    )
+{
+    PFRAME          Batch[RECEIVER_TEST_MAXIMUM_BATCH];
+    ULONG           Received;
+    ULONG           Index;
+    KIRQL           Irql;
+
+    SHIM_CHECK(Count <= RECEIVER_TEST_MAXIMUM_BATCH);
+
+    for (Index = 0; Index < Count; Index++)
+        Batch[Index] = Frame;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    Received = MockVifReceivePackets(Adapter->VifInterface, Batch, Count);
+    KeLowerIrql(Irql);
+
+    return Received;
+}
+
+// NET_BUFFER_LISTs kept back from NDIS by ReceiverTestHold()
+typedef struct _RECEIVER_TEST_HELD {
+    PNET_BUFFER_LIST    Head;
+    PNET_BUFFER_LIST    *Tail;
+    ULONG               Count;
+    ULONG               Indications;
+    ULONG               Flags;      // Of the last indication
+} RECEIVER_TEST_HELD, *PRECEIVER_TEST_HELD;
+
+static BOOLEAN
+ReceiverTestHold(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_HELD     Held = Argument;
+
+    UNREFERENCED_PARAMETER(Adapter);
+
+    *Held->Tail = NetBufferList;
+    while (*Held->Tail != NULL)
+        Held->Tail = &NET_BUFFER_LIST_NEXT_NBL(*Held->Tail);
+
+    Held->Count += Count;
+    Held->Indications++;
+    Held->Flags = Flags;
+
+    return TRUE;
+}
+
+static VOID
+ReceiverTestHoldStart(
+    IN  PRECEIVER_TEST_HELD Held
+    )
+{
+    RtlZeroMemory(Held, sizeof (RECEIVER_TEST_HELD));
+    Held->Tail = &Held->Head;
+
+    HarnessSetReceiveHook(ReceiverTestHold, Held);
+}
+
+// Gives everything held back to the receiver in one call
+static VOID
+ReceiverTestHoldRelease(
+    IN  PADAPTER            Adapter,
+    IN  PRECEIVER_TEST_HELD Held
+    )
+{
+    if (Held->Head != NULL)
+        ReceiverReturnNetBufferLists(&Adapter->Receiver, Held->Head, 0);
+
+    Held->Head = NULL;
+    Held->Tail = &Held->Head;
+    Held->Count = 0;
+}
+
+// Magazine cache
+
+#define RECEIVER_TEST_CACHE_ROUNDS  2000
+
+typedef enum _RECEIVER_TEST_CACHE_PHASE {
+    RECEIVER_TEST_CACHE_LOCAL,  // Returned on the allocating processor
+    RECEIVER_TEST_CACHE_REMOTE, // Returned on the next processor
+} RECEIVER_TEST_CACHE_PHASE;
+
+typedef struct _RECEIVER_TEST_CACHE {
+    PRECEIVER                   Receiver;
+    ULONG                       Threads;
+    ULONG                       WorkingSet;
+    ULONG                       Rounds;
+    RECEIVER_TEST_CACHE_PHASE   Phase;
+    pthread_barrier_t           Barrier;
+    PNET_BUFFER_LIST            *NetBufferList;     // WorkingSet per thread
+} RECEIVER_TEST_CACHE, *PRECEIVER_TEST_CACHE;
+
+typedef struct _RECEIVER_TEST_CACHE_THREAD {
+    pthread_t               Thread;
+    PRECEIVER_TEST_CACHE    Cache;
+    ULONG                   Index;
+    ULONG64                 Elapsed;
+} RECEIVER_TEST_CACHE_THREAD, *PRECEIVER_TEST_CACHE_THREAD;
+
+static PVOID
+ReceiverTestCacheThread(
+    IN  PVOID                   Argument
+    )
+{
+    PRECEIVER_TEST_CACHE_THREAD Thread = Argument;
+    PRECEIVER_TEST_CACHE        Cache = Thread->Cache;
+    ULONG                       Next = (Thread->Index + 1) % Cache->Threads;
+    PNET_BUFFER_LIST            *Mine;
+    PNET_BUFFER_LIST            *Theirs;
+    ULONG                       Round;
+    ULONG64                     Start;
+    KIRQL                       Irql;
+
+    ShimSetCurrentProcessor(Thread->Index);
+
+    Mine = &Cache->NetBufferList[Thread->Index * Cache->WorkingSet];
+    Theirs = (Cache->Phase == RECEIVER_TEST_CACHE_REMOTE) ?
+             &Cache->NetBufferList[Next * Cache->WorkingSet] :
+             Mine;
+
+    // Each processor must have a cache of its own, whatever its group
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    SHIM_CHECK(__ReceiverGetProcessor(Cache->Receiver) ==
+               &Cache->Receiver->Processor[Thread->Index]);
+    KeLowerIrql(Irql);
+
+    pthread_barrier_wait(&Cache->Barrier);
+
+    // Time spent waiting for the other threads is not counted
+    for (Round = 0; Round < Cache->Rounds; Round++) {
+        ULONG   Index;
+
+        Start = ShimQueryClock();
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+        for (Index = 0; Index < Cache->WorkingSet; Index++) {
+            Mine[Index] = ReceiverAllocateNetBufferList(Cache->Receiver, NULL, 0, 0);
+            SHIM_CHECK(Mine[Index] != NULL);
+        }
+
+        KeLowerIrql(Irql);
+        Thread->Elapsed += ShimQueryClock() - Start;
+
+        // Every thread holds its whole working set at once, and in the
+        // remote phase the neighbour must have finished allocating before
+        // its NET_BUFFER_LISTs are freed
+        pthread_barrier_wait(&Cache->Barrier);
+
+        Start = ShimQueryClock();
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+        for (Index = 0; Index < Cache->WorkingSet; Index++)
+            ReceiverReleaseNetBufferList(Cache->Receiver, Theirs[Index], TRUE);
+
+        KeLowerIrql(Irql);
+        Thread->Elapsed += ShimQueryClock() - Start;
+
+        pthread_barrier_wait(&Cache->Barrier);
+    }
+
+    return NULL;
+}
+
+// Runs Threads processors allocating and freeing WorkingSet
+// NET_BUFFER_LISTs each and returns the number allocated from the pool.
+static LONG64
+ReceiverTestCacheRun(
+    IN  PRECEIVER                   Receiver,
+    IN  ULONG                       Threads,
+    IN  ULONG                       WorkingSet,
+    IN  ULONG                       Rounds,
+    IN  RECEIVER_TEST_CACHE_PHASE   Phase
+    )
+{
+    RECEIVER_TEST_CACHE             Cache;
+    PRECEIVER_TEST_CACHE_THREAD     Thread;
+    SHIM_ALLOCATIONS                Before;
+    SHIM_ALLOCATIONS                After;
+    ULONG64                         Elapsed;
+    ULONG                           Index;
+
+    Cache.Receiver = Receiver;
+    Cache.Threads = Threads;
+    Cache.WorkingSet = WorkingSet;
+    Cache.Rounds = Rounds;
+    Cache.Phase = Phase;
+    Cache.NetBufferList = calloc(Threads * WorkingSet, sizeof (PNET_BUFFER_LIST));
+    SHIM_CHECK(Cache.NetBufferList != NULL);
+    pthread_barrier_init(&Cache.Barrier, NULL, Threads);
+
+    Thread = calloc(Threads, sizeof (RECEIVER_TEST_CACHE_THREAD));
+    SHIM_CHECK(Thread != NULL);
+
+    ShimQueryAllocations(&Before);
+
+    for (Index = 0; Index < Threads; Index++) {
+        Thread[Index].Cache = &Cache;
+        Thread[Index].Index = Index;
+        SHIM_CHECK(pthread_create(&Thread[Index].Thread,
+                                  NULL,
+                                  ReceiverTestCacheThread,
+                                  &Thread[Index]) == 0);
+    }
+
+    Elapsed = 0;
+    for (Index = 0; Index < Threads; Index++) {
+        pthread_join(Thread[Index].Thread, NULL);
+        Elapsed += Thread[Index].Elapsed;
+    }
+
+    ShimQueryAllocations(&After);
+
+    // Nothing is ever given back to the pool while the cache has room
+    SHIM_CHECK(After.NetBufferListFrees == Before.NetBufferListFrees);
+
+    printf("  %2u threads working set %4u %s: %6.1f ns per allocate and free, %lld from the pool\n",
+           Threads,
+           WorkingSet,
+           (Phase == RECEIVER_TEST_CACHE_REMOTE) ? "remote" : "local ",
+           (double)Elapsed / ((double)Threads * Rounds * WorkingSet),
+           After.NetBufferLists - Before.NetBufferLists);
+
+    free(Thread);
+    pthread_barrier_destroy(&Cache.Barrier);
+    free(Cache.NetBufferList);
+
+    return After.NetBufferLists - Before.NetBufferLists;
+}
+
+// NET_BUFFER_LISTs come from the pool only while the total working set is
+// growing, whether they are returned on the processor that allocated them
+// or on another.
+static VOID
+ReceiverTestCache(
+    VOID
+    )
+{
+    static const ULONG  ThreadCount[] = { 1, 2, 4 };
+    ULONG               Index;
+
+    for (Index = 0; Index < ARRAYSIZE(ThreadCount); Index++) {
+        ULONG       Threads = ThreadCount[Index];
+        ULONG       WorkingSet = 4 * RECEIVER_MAGAZINE_SIZE;
+        PADAPTER    Adapter;
+        PRECEIVER   Receiver;
+        LONG64      Allocated;
+
+        Adapter = ReceiverTestCreateAdapter(Threads, 0, NULL,
+                                            "rx_prewarm_factor=0",
+                                            NULL);
+        Receiver = &Adapter->Receiver;
+
+        // Cold: everything comes from the pool
+        Allocated = ReceiverTestCacheRun(Receiver, Threads, WorkingSet, 1,
+                                         RECEIVER_TEST_CACHE_LOCAL);
+        SHIM_CHECK(Allocated == (LONG64)Threads * WorkingSet);
+
+        // Steady: nothing does
+        Allocated = ReceiverTestCacheRun(Receiver, Threads, WorkingSet,
+                                         RECEIVER_TEST_CACHE_ROUNDS,
+                                         RECEIVER_TEST_CACHE_LOCAL);
+        SHIM_CHECK(Allocated == 0);
+
+        if (Threads > 1) {
+            Allocated = ReceiverTestCacheRun(Receiver, Threads, WorkingSet,
+                                             RECEIVER_TEST_CACHE_ROUNDS,
+                                             RECEIVER_TEST_CACHE_REMOTE);
+            SHIM_CHECK(Allocated == 0);
+        }
+
+        // Growing: only the growth comes from the pool
+        Allocated = ReceiverTestCacheRun(Receiver, Threads, 2 * WorkingSet,
+                                         RECEIVER_TEST_CACHE_ROUNDS,
+                                         RECEIVER_TEST_CACHE_LOCAL);
+        SHIM_CHECK(Allocated == (LONG64)Threads * WorkingSet);
+
+        // Shrinking again
+        Allocated = ReceiverTestCacheRun(Receiver, Threads, WorkingSet,
+                                         RECEIVER_TEST_CACHE_ROUNDS,
+                                         RECEIVER_TEST_CACHE_LOCAL);
+        SHIM_CHECK(Allocated == 0);
+
+        ReceiverTestDestroyAdapter(Adapter);
+    }
+}
+
+// Per-CPU state
+
+// Each processor's block starts on its own cache line, the queue that
+// other processors write is on lines of its own, and the in-flight
+// counters every processor writes are kept away from the read-mostly
+// fields.
+static VOID
+ReceiverTestLayout(
+    VOID
+    )
+{
+    PADAPTER    Adapter;
+    PRECEIVER   Receiver;
+    ULONG       Index;
+
+    C_ASSERT(sizeof (RECEIVER_PROCESSOR) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0);
+    C_ASSERT(FIELD_OFFSET(RECEIVER_PROCESSOR, Queue) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0);
+    C_ASSERT(sizeof (RECEIVER_QUEUE) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0);
+    C_ASSERT(FIELD_OFFSET(RECEIVER, InNDIS) % SYSTEM_CACHE_ALIGNMENT_SIZE == 0);
+
+    Adapter = ReceiverTestCreateAdapter(6, 0, NULL, NULL);
+    Receiver = &Adapter->Receiver;
+
+    // Sized for the processors there are, not MAXIMUM_PROCESSORS
+    SHIM_CHECK(Receiver->ProcessorCount == KeQueryActiveProcessorCount(NULL));
+
+    for (Index = 0; Index < Receiver->ProcessorCount; Index++)
+        SHIM_CHECK((ULONG_PTR)&Receiver->Processor[Index] % SYSTEM_CACHE_ALIGNMENT_SIZE == 0);
+
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// The cost of the cache as the number of processors using it at once
+// grows. Every processor works only on its own cache lines except when a
+// magazine moves to or from the depot, once every RECEIVER_MAGAZINE_SIZE
+// NET_BUFFER_LISTs, so the cost per NET_BUFFER_LIST should stay flat
+// given as many real CPUs as threads.
+static VOID
+ReceiverTestContention(
+    VOID
+    )
+{
+    static const ULONG  ThreadCount[] = { 8, 16, 32 };
+    ULONG               Index;
+
+    for (Index = 0; Index < ARRAYSIZE(ThreadCount); Index++) {
+        ULONG       Threads = ThreadCount[Index];
+        ULONG       WorkingSet = 2 * RECEIVER_MAGAZINE_SIZE;
+        PADAPTER    Adapter;
+        PRECEIVER   Receiver;
+
+        Adapter = ReceiverTestCreateAdapter(Threads, 0, NULL, NULL);
+        Receiver = &Adapter->Receiver;
+
+        (VOID) ReceiverTestCacheRun(Receiver, Threads, WorkingSet, 1,
+                                    RECEIVER_TEST_CACHE_LOCAL);
+
+        SHIM_CHECK(ReceiverTestCacheRun(Receiver, Threads, WorkingSet,
+                                        RECEIVER_TEST_CACHE_ROUNDS / 4,
+                                        RECEIVER_TEST_CACHE_LOCAL) == 0);
+        SHIM_CHECK(ReceiverTestCacheRun(Receiver, Threads, WorkingSet,
+                                        RECEIVER_TEST_CACHE_ROUNDS / 4,
+                                        RECEIVER_TEST_CACHE_REMOTE) == 0);
+
+        ReceiverTestDestroyAdapter(Adapter);
+    }
+}
+
+// With 2, 3 and 4 processor groups, where group-relative processor
+// numbers repeat, every processor still gets its own cache: each one's
+// hits are exactly its own allocations.
+static VOID
+ReceiverTestGroups(
+    VOID
+    )
+{
+    static const struct {
+        ULONG   ProcessorCount;
+        ULONG   GroupSize;
+    } Configuration[] = {
+        { 8, 4 },
+        { 9, 3 },
+        { 8, 2 },
+    };
+    ULONG       Index;
+
+    for (Index = 0; Index < ARRAYSIZE(Configuration); Index++) {
+        ULONG       Threads = Configuration[Index].ProcessorCount;
+        ULONG       GroupSize = Configuration[Index].GroupSize;
+        ULONG       WorkingSet = 2 * RECEIVER_MAGAZINE_SIZE;
+        ULONG       Rounds = RECEIVER_TEST_CACHE_ROUNDS / 4;
+        PADAPTER    Adapter;
+        PRECEIVER   Receiver;
+        PULONG64    CacheHit;
+        ULONG       Processor;
+
+        printf("  %u groups of %u processors\n", Threads / GroupSize, GroupSize);
+
+        Adapter = ReceiverTestCreateAdapter(Threads, GroupSize, NULL, NULL);
+        Receiver = &Adapter->Receiver;
+
+        SHIM_CHECK(Receiver->ProcessorCount == Threads);
+
+        (VOID) ReceiverTestCacheRun(Receiver, Threads, WorkingSet, 1,
+                                    RECEIVER_TEST_CACHE_LOCAL);
+
+        CacheHit = calloc(Threads, sizeof (ULONG64));
+        SHIM_CHECK(CacheHit != NULL);
+
+        for (Processor = 0; Processor < Threads; Processor++)
+            CacheHit[Processor] = Receiver->Processor[Processor].CacheHit;
+
+        SHIM_CHECK(ReceiverTestCacheRun(Receiver, Threads, WorkingSet, Rounds,
+                                        RECEIVER_TEST_CACHE_LOCAL) == 0);
+
+        for (Processor = 0; Processor < Threads; Processor++)
+            SHIM_CHECK(Receiver->Processor[Processor].CacheHit - CacheHit[Processor] ==
+                       (ULONG64)Rounds * WorkingSet);
+
+        SHIM_CHECK(ReceiverTestCacheRun(Receiver, Threads, WorkingSet, Rounds,
+                                        RECEIVER_TEST_CACHE_REMOTE) == 0);
+
+        free(CacheHit);
+
+        ReceiverTestDestroyAdapter(Adapter);
+    }
+}
+
+// Packet returns
+
+#define RECEIVER_TEST_RETURN_BATCH  64
+#define RECEIVER_TEST_RETURN_ROUNDS 500
+
+// From interface version 15 packets go back to the backend a list at a
+// time: one call per return from NDIS, however many packets it carries,
+// and one for the frames dropped by each receive callback. Older backends
+// get a call per packet.
+static VOID
+ReceiverTestReturn(
+    VOID
+    )
+{
+    static const ULONG      Version[] = {
+        VIF_INTERFACE_VERSION_RETURN_PACKETS - 1,
+        VIF_INTERFACE_VERSION
+    };
+    ULONG                   Index;
+
+    for (Index = 0; Index < ARRAYSIZE(Version); Index++) {
+        BOOLEAN                 Batched;
+        MOCK_VIF_CONFIGURATION  Configuration;
+        FRAME_PARAMETERS        Parameters;
+        PFRAME                  Frame;
+        PADAPTER                Adapter;
+        RECEIVER_VLAN_FILTER    Filter;
+        RECEIVER_TEST_HELD      Held;
+        MOCK_VIF_STATISTICS     Before;
+        MOCK_VIF_STATISTICS     After;
+        RECEIVER_STATISTICS     Statistics;
+        ULONG64                 Elapsed;
+        ULONG                   Round;
+        ULONG                   Count;
+
+        Batched = (Version[Index] >= VIF_INTERFACE_VERSION_RETURN_PACKETS) ? TRUE : FALSE;
+
+        MockVifDefaultConfiguration(&Configuration);
+        Configuration.Version = Version[Index];
+
+        // No copy-break, so that every packet is held until NDIS returns it
+        Adapter = ReceiverTestCreateAdapter(1, 0, &Configuration,
+                                            "rx_copy_break=0",
+                                            NULL);
+
+        FrameDefaultParameters(&Parameters);
+        Frame = FrameAllocate();
+        FrameBuild(Frame, &Parameters);
+
+        // Returned by NDIS as soon as they are indicated
+        MockVifQueryStatistics(Adapter->VifInterface, &Before);
+        Count = ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_RETURN_BATCH);
+        SHIM_CHECK(Count == RECEIVER_TEST_RETURN_BATCH);
+        MockVifQueryStatistics(Adapter->VifInterface, &After);
+
+        SHIM_CHECK(After.ReturnedPackets - Before.ReturnedPackets == Count);
+        if (Batched) {
+            SHIM_CHECK(After.ReturnPacketCalls == Before.ReturnPacketCalls);
+            SHIM_CHECK(After.ReturnPacketsCalls - Before.ReturnPacketsCalls == 1);
+        } else {
+            SHIM_CHECK(After.ReturnPacketsCalls == Before.ReturnPacketsCalls);
+            SHIM_CHECK(After.ReturnPacketCalls - Before.ReturnPacketCalls == Count);
+        }
+
+        // Held over several indications and returned together
+        ReceiverTestHoldStart(&Held);
+
+        for (Round = 0; Round < 3; Round++)
+            SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_RETURN_BATCH) ==
+                       RECEIVER_TEST_RETURN_BATCH);
+
+        SHIM_CHECK(Held.Count == 3 * RECEIVER_TEST_RETURN_BATCH);
+        SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == Held.Count);
+
+        MockVifQueryStatistics(Adapter->VifInterface, &Before);
+        Count = Held.Count;
+        ReceiverTestHoldRelease(Adapter, &Held);
+        MockVifQueryStatistics(Adapter->VifInterface, &After);
+
+        SHIM_CHECK(After.ReturnedPackets - Before.ReturnedPackets == Count);
+        SHIM_CHECK(After.ReturnPacketsCalls - Before.ReturnPacketsCalls == (Batched ? 1 : 0));
+        SHIM_CHECK(After.ReturnPacketCalls - Before.ReturnPacketCalls == (Batched ? 0 : Count));
+        SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == 0);
+
+        // Dropped before anything is allocated for them
+        HarnessSetReceiveHook(NULL, NULL);
+
+        RtlZeroMemory(&Filter, sizeof (Filter));
+        ReceiverSetVlanFilter(&Adapter->Receiver, &Filter);
+        Frame->TagControlInformation = 5;
+
+        MockVifQueryStatistics(Adapter->VifInterface, &Before);
+        Count = ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_RETURN_BATCH);
+        MockVifQueryStatistics(Adapter->VifInterface, &After);
+
+        ReceiverQueryStatistics(&Adapter->Receiver, &Statistics);
+        SHIM_CHECK(Statistics.VlanFiltered == Count);
+
+        SHIM_CHECK(After.ReturnedPackets - Before.ReturnedPackets == Count);
+        SHIM_CHECK(After.ReturnPacketsCalls - Before.ReturnPacketsCalls == (Batched ? 1 : 0));
+        SHIM_CHECK(After.ReturnPacketCalls - Before.ReturnPacketCalls == (Batched ? 0 : Count));
+
+        Frame->TagControlInformation = 0;
+
+        // The cost of giving a batch back, from NDIS's call to the last
+        // packet reaching the backend
+        ReceiverTestHoldStart(&Held);
+
+        Elapsed = 0;
+        Count = 0;
+        for (Round = 0; Round < RECEIVER_TEST_RETURN_ROUNDS; Round++) {
+            ULONG64 Start;
+
+            SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_RETURN_BATCH) ==
+                       RECEIVER_TEST_RETURN_BATCH);
+            Count += Held.Count;
+
+            Start = ShimQueryClock();
+            ReceiverTestHoldRelease(Adapter, &Held);
+            Elapsed += ShimQueryClock() - Start;
+        }
+
+        HarnessSetReceiveHook(NULL, NULL);
+
+        printf("  version %u: %5.1f ns per packet returned\n",
+               Version[Index],
+               (double)Elapsed / (double)Count);
+
+        FrameFree(Frame);
+        ReceiverTestDestroyAdapter(Adapter);
+    }
+}
+
+// In-flight watermark
+
+#define RECEIVER_TEST_WATERMARK_TICK        100000ull   // 100us
+#define RECEIVER_TEST_WATERMARK_INTERVAL    1000        // Ticks per update
+#define RECEIVER_TEST_WATERMARK_MAX_LATENCY 64          // Ticks
+
+// NDIS holding every NET_BUFFER_LIST for the same number of ticks
+typedef struct _RECEIVER_TEST_WATERMARK {
+    PADAPTER            Adapter;
+    PFRAME              Frame;
+    ULONG64             Tick;
+    RECEIVER_TEST_HELD  Held[RECEIVER_TEST_WATERMARK_MAX_LATENCY];
+} RECEIVER_TEST_WATERMARK, *PRECEIVER_TEST_WATERMARK;
+
+// Gives back everything still held, early
+static VOID
+ReceiverTestWatermarkDrain(
+    IN  PRECEIVER_TEST_WATERMARK    Watermark
+    )
+{
+    ULONG                           Index;
+
+    HarnessSetReceiveHook(NULL, NULL);
+
+    for (Index = 0; Index < RECEIVER_TEST_WATERMARK_MAX_LATENCY; Index++)
+        ReceiverTestHoldRelease(Watermark->Adapter, &Watermark->Held[Index]);
+}
+
+// Receives Batch frames every tick, each returned Latency ticks later,
+// for the given number of watermark updates, and returns the limit after
+// the last.
+static LONG
+ReceiverTestWatermarkRun(
+    IN  PRECEIVER_TEST_WATERMARK    Watermark,
+    IN  ULONG                       Batch,
+    IN  ULONG                       Latency,
+    IN  ULONG                       Updates
+    )
+{
+    PADAPTER                        Adapter = Watermark->Adapter;
+    PRECEIVER                       Receiver = &Adapter->Receiver;
+    LONG                            Minimum;
+    LONG                            Maximum;
+    ULONG                           Update;
+
+    SHIM_CHECK(Latency < RECEIVER_TEST_WATERMARK_MAX_LATENCY);
+
+    Minimum = (LONG)(Receiver->RingSize * RECEIVER_IN_NDIS_MIN_RINGS);
+    Maximum = (LONG)(Receiver->RingSize * RECEIVER_IN_NDIS_MAX_RINGS);
+
+    for (Update = 0; Update < Updates; Update++) {
+        RECEIVER_STATISTICS Before;
+        RECEIVER_STATISTICS After;
+        ULONG               Tick;
+        LONG                Limit;
+        LONG                Floor;
+
+        ReceiverQueryStatistics(Receiver, &Before);
+
+        for (Tick = 0; Tick < RECEIVER_TEST_WATERMARK_INTERVAL; Tick++) {
+            PRECEIVER_TEST_HELD Held;
+
+            Held = &Watermark->Held[Watermark->Tick % RECEIVER_TEST_WATERMARK_MAX_LATENCY];
+
+            // Received Latency ticks ago, or never if Latency is 0
+            ReceiverTestHoldRelease(Adapter, Held);
+
+            if (Latency != 0) {
+                Held = &Watermark->Held[(Watermark->Tick + Latency) % RECEIVER_TEST_WATERMARK_MAX_LATENCY];
+                ReceiverTestHoldStart(Held);
+            } else {
+                HarnessSetReceiveHook(NULL, NULL);
+            }
+
+            // More than the ring holds when NDIS keeps too many
+            (VOID) ReceiverTestReceive(Adapter, Watermark->Frame, Batch);
+
+            ShimAdvanceClock(RECEIVER_TEST_WATERMARK_TICK);
+            Watermark->Tick++;
+        }
+
+        ReceiverUpdateWatermark(Receiver);
+
+        ReceiverQueryStatistics(Receiver, &After);
+        Limit = After.InNDISLimit;
+
+        // Within the bounds, and never shrunk by more than half the way
+        // to the minimum at once
+        SHIM_CHECK(Limit >= Minimum && Limit <= Maximum);
+        Floor = (Before.InNDISLimit + Minimum) / 2;
+        SHIM_CHECK(Limit >= Floor);
+
+        // ...and by at least half again when frames had to be copied,
+        // unless the limit is configured
+        if (Adapter->Properties.rx_in_flight_limit == 0 &&
+            (After.Bounced != Before.Bounced || After.LowResources != Before.LowResources))
+            SHIM_CHECK(Limit == Maximum ||
+                       Limit >= Before.InNDISLimit + Before.InNDISLimit / 2);
+    }
+
+    return Receiver->InNDISLimit;
+}
+
+// Runs each profile of return latency in turn on a manual clock, with
+// ReceiverTestWatermarkRun() checking every update against the bounds.
+static VOID
+ReceiverTestWatermark(
+    VOID
+    )
+{
+    static RECEIVER_TEST_WATERMARK  Watermark;
+    FRAME_PARAMETERS                Parameters;
+    PFRAME                          Large;
+    PFRAME                          Small;
+    RECEIVER_STATISTICS             Before;
+    RECEIVER_STATISTICS             After;
+    PADAPTER                        Adapter;
+    PRECEIVER                       Receiver;
+    LONG                            Ring;
+    LONG                            Limit;
+    LONG                            Previous;
+    ULONG                           Update;
+
+    RtlZeroMemory(&Watermark, sizeof (Watermark));
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL, NULL);
+    Receiver = &Adapter->Receiver;
+    Ring = (LONG)Receiver->RingSize;
+
+    // Full-sized frames hold their packets until NDIS returns them so at
+    // most a ring's worth can be in flight. Frames under the copy-break
+    // are copied and their packets returned at once, so NDIS can hold
+    // more of them than the limit allows.
+    FrameDefaultParameters(&Parameters);
+    Large = FrameAllocate();
+    FrameBuild(Large, &Parameters);
+
+    Parameters.PayloadLength = 16;
+    Small = FrameAllocate();
+    FrameBuild(Small, &Parameters);
+    SHIM_CHECK(Small->Length < Receiver->CopyBreak);
+
+    Watermark.Adapter = Adapter;
+    Watermark.Frame = Large;
+
+    ShimSetManualClock(TRUE);
+    ReceiverUpdateWatermark(Receiver);
+
+    // Returned at once: shrinks gradually to a ring
+    Previous = Receiver->InNDISLimit;
+    for (Update = 0; Update < 16; Update++) {
+        Limit = ReceiverTestWatermarkRun(&Watermark, 16, 0, 1);
+        SHIM_CHECK(Limit <= Previous);
+        Previous = Limit;
+    }
+    printf("  prompt:  limit %d\n", Limit);
+    SHIM_CHECK(Limit == Ring);
+
+    // More held than the limit allows: frames are bounced and it grows
+    // by at least half each update
+    ReceiverQueryStatistics(Receiver, &Before);
+    Watermark.Frame = Small;
+    Limit = ReceiverTestWatermarkRun(&Watermark, 16, 24, 4);
+    ReceiverTestWatermarkDrain(&Watermark);
+    Watermark.Frame = Large;
+    ReceiverQueryStatistics(Receiver, &After);
+    printf("  stalled: limit %d (%llu bounced)\n", Limit, After.Bounced - Before.Bounced);
+    SHIM_CHECK(After.Bounced != Before.Bounced);
+    SHIM_CHECK(Limit >= Ring + Ring / 2);
+
+    // 16 frames held for 12 ticks: 192 in flight, so twice that plus a
+    // ring once the profile has been seen for a whole interval
+    Previous = Receiver->InNDISLimit;
+    for (Update = 0; Update < 16; Update++) {
+        Limit = ReceiverTestWatermarkRun(&Watermark, 16, 12, 1);
+        if (Update != 0)
+            SHIM_CHECK(Limit <= Previous);
+        Previous = Limit;
+    }
+    ReceiverTestWatermarkDrain(&Watermark);
+    printf("  slow:    limit %d\n", Limit);
+    SHIM_CHECK(Limit == 2 * 16 * 12 + Ring);
+
+    // And back again
+    Limit = ReceiverTestWatermarkRun(&Watermark, 16, 0, 16);
+    printf("  prompt:  limit %d\n", Limit);
+    SHIM_CHECK(Limit == Ring);
+
+    ShimSetManualClock(FALSE);
+
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // A configured limit never moves
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_in_flight_limit=300",
+                                        NULL);
+
+    RtlZeroMemory(&Watermark, sizeof (Watermark));
+    Watermark.Adapter = Adapter;
+    Watermark.Frame = Small;
+
+    ShimSetManualClock(TRUE);
+
+    SHIM_CHECK(ReceiverTestWatermarkRun(&Watermark, 16, 0, 2) == 300);
+    SHIM_CHECK(ReceiverTestWatermarkRun(&Watermark, 16, 24, 2) == 300);
+    ReceiverTestWatermarkDrain(&Watermark);
+
+    ShimSetManualClock(FALSE);
+
+    ReceiverTestDestroyAdapter(Adapter);
+
+    FrameFree(Small);
+    FrameFree(Large);
+}
+
+// Copy-break
+
+// Frame lengths either side of each threshold tried
+static const ULONG  ReceiverTestCopyLength[] = {
+    60, 64, 127, 128, 129, 200, 255, 256, 257, 1514
+};
+
+// Receives frames of each length in turn, each in a callback of its own,
+// and holds their NET_BUFFER_LISTs. Those shorter than the threshold
+// (capped at a slab buffer) are copied and their packets go back to the
+// backend before NDIS returns anything; the rest are not copied and keep
+// their packets until then. What is indicated is the frame received,
+// even once the backend has reused the packets of those copied.
+static VOID
+ReceiverTestCopyBreakRun(
+    IN  PADAPTER            Adapter,
+    IN  ULONG               Threshold
+    )
+{
+    PRECEIVER               Receiver = &Adapter->Receiver;
+    PFRAME                  Frame[ARRAYSIZE(ReceiverTestCopyLength)];
+    UCHAR                   Data[ETHERNET_MAX];
+    FRAME_PARAMETERS        Parameters;
+    RECEIVER_TEST_HELD      Held;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    MOCK_VIF_STATISTICS     Vif;
+    PNET_BUFFER_LIST        NetBufferList;
+    ULONG64                 Returned;
+    ULONG                   Outstanding;
+    ULONG                   Copied;
+    ULONG                   Index;
+
+    SHIM_CHECK(Receiver->CopyBreak == Threshold);
+
+    ReceiverTestHoldStart(&Held);
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    Outstanding = 0;
+    Copied = 0;
+
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestCopyLength); Index++) {
+        ULONG   Length = ReceiverTestCopyLength[Index];
+        BOOLEAN Copy = (Length < Threshold) ? TRUE : FALSE;
+
+        FrameDefaultParameters(&Parameters);
+        Parameters.PayloadLength = Length - (sizeof (ETHERNET_UNTAGGED_HEADER) +
+                                             sizeof (IPV4_HEADER) +
+                                             sizeof (TCP_HEADER));
+        Parameters.PayloadSeed = (UCHAR)(Index * 37);
+
+        Frame[Index] = FrameAllocate();
+        FrameBuild(Frame[Index], &Parameters);
+        SHIM_CHECK(Frame[Index]->Length == Length);
+
+        MockVifQueryStatistics(Adapter->VifInterface, &Vif);
+        Returned = Vif.ReturnedPackets;
+
+        SHIM_CHECK(ReceiverTestReceive(Adapter, Frame[Index], 1) == 1);
+        SHIM_CHECK(Held.Count == Index + 1);
+
+        MockVifQueryStatistics(Adapter->VifInterface, &Vif);
+
+        if (Copy) {
+            Copied++;
+            SHIM_CHECK(Vif.ReturnedPackets - Returned == 1);
+        } else {
+            Outstanding++;
+            SHIM_CHECK(Vif.ReturnedPackets == Returned);
+        }
+
+        SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == Outstanding);
+    }
+
+    Index = 0;
+    for (NetBufferList = Held.Head;
+         NetBufferList != NULL;
+         NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList)) {
+        ULONG   Length = ReceiverTestCopyLength[Index];
+
+        SHIM_CHECK((__ReceiverGetSlab(Receiver, NetBufferList) == &Receiver->Copy) ==
+                   (Length < Threshold));
+
+        SHIM_CHECK(HarnessCopyNetBuffer(NetBufferList, Data, sizeof (Data)) == Length);
+        SHIM_CHECK(memcmp(Data, Frame[Index]->Data, Length) == 0);
+
+        Index++;
+    }
+    SHIM_CHECK(Index == ARRAYSIZE(ReceiverTestCopyLength));
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Copied - Before.Copied == Copied);
+    SHIM_CHECK(After.Bounced == Before.Bounced);
+
+    printf("  threshold %u: %u of %u copied\n",
+           Threshold,
+           Copied,
+           (ULONG)ARRAYSIZE(ReceiverTestCopyLength));
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestHoldRelease(Adapter, &Held);
+
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == 0);
+    SHIM_CHECK(Receiver->InNDIS == 0);
+
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestCopyLength); Index++)
+        FrameFree(Frame[Index]);
+}
+
+static VOID
+ReceiverTestCopyBreak(
+    VOID
+    )
+{
+    PADAPTER    Adapter;
+
+    // The default
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL, NULL);
+    ReceiverTestCopyBreakRun(Adapter, 128);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_copy_break=0",
+                                        NULL);
+    ReceiverTestCopyBreakRun(Adapter, 0);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // No more than fits in a slab buffer
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_copy_break=1000",
+                                        NULL);
+    ReceiverTestCopyBreakRun(Adapter, RECEIVER_COPY_BUFFER_SIZE);
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Bounce
+
+#define RECEIVER_TEST_BOUNCE_LIMIT  64
+#define RECEIVER_TEST_BOUNCE_BATCH  32
+
+// Receives Count frames numbered from First in batches, checking after
+// each that nothing went up with NDIS_RECEIVE_FLAGS_RESOURCES.
+static VOID
+ReceiverTestBounceReceive(
+    IN  PADAPTER            Adapter,
+    IN  PFRAME              *Frame,
+    IN  ULONG               First,
+    IN  ULONG               Count,
+    IN  PRECEIVER_TEST_HELD Held
+    )
+{
+    FRAME_PARAMETERS        Parameters;
+    HARNESS_STATISTICS      Harness;
+    ULONG64                 ResourceIndications;
+    ULONG                   Index;
+    KIRQL                   Irql;
+
+    HarnessQueryStatistics(&Harness);
+    ResourceIndications = Harness.ResourceIndications;
+
+    // Lengths spread over the whole range so that bounced frames of every
+    // size are checked
+    for (Index = First; Index < First + Count; Index++) {
+        FrameDefaultParameters(&Parameters);
+        Parameters.SourcePort = (USHORT)Index;
+        Parameters.PayloadSeed = (UCHAR)Index;
+        Parameters.PayloadLength = 1 + ((Index * 151) % (ETHERNET_MTU - sizeof (IPV4_HEADER) - sizeof (TCP_HEADER)));
+
+        FrameBuild(Frame[Index], &Parameters);
+    }
+
+    for (Index = First; Index < First + Count; Index += RECEIVER_TEST_BOUNCE_BATCH) {
+        ULONG   Batch;
+
+        Batch = First + Count - Index;
+        if (Batch > RECEIVER_TEST_BOUNCE_BATCH)
+            Batch = RECEIVER_TEST_BOUNCE_BATCH;
+
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+        SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, &Frame[Index], Batch) == Batch);
+        KeLowerIrql(Irql);
+
+        SHIM_CHECK((Held->Flags & NDIS_RECEIVE_FLAGS_RESOURCES) == 0);
+
+        HarnessQueryStatistics(&Harness);
+        SHIM_CHECK(Harness.ResourceIndications == ResourceIndications);
+    }
+}
+
+// NDIS holds on to more than the in-flight limit: the frames over it are
+// copied into the bounce slab and their packets go straight back to the
+// backend, so nothing needs NDIS_RECEIVE_FLAGS_RESOURCES until a ring's
+// worth of them are held. Every frame indicated is the one received, and
+// the slab is whole again once NDIS gives everything back.
+static VOID
+ReceiverTestBounce(
+    VOID
+    )
+{
+    PADAPTER                Adapter;
+    PRECEIVER               Receiver;
+    PFRAME                  *Frame;
+    UCHAR                   Data[ETHERNET_MAX];
+    RECEIVER_TEST_HELD      Held;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    HARNESS_STATISTICS      Harness;
+    ULONG64                 ResourceIndications;
+    PNET_BUFFER_LIST        NetBufferList;
+    ULONG                   RingSize;
+    ULONG                   Total;
+    ULONG                   Index;
+    KIRQL                   Irql;
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_copy_break=0",
+                                        "rx_in_flight_limit=64",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+    RingSize = Receiver->RingSize;
+
+    SHIM_CHECK(Receiver->InNDISLimit == RECEIVER_TEST_BOUNCE_LIMIT);
+    SHIM_CHECK(QueryDepthSList(&Receiver->Bounce.FreeList) == RingSize);
+
+    // As many as fill the bounce slab, and a batch more
+    Total = RECEIVER_TEST_BOUNCE_LIMIT + RingSize + RECEIVER_TEST_BOUNCE_BATCH;
+
+    Frame = calloc(Total, sizeof (PFRAME));
+    SHIM_CHECK(Frame != NULL);
+
+    for (Index = 0; Index < Total; Index++)
+        Frame[Index] = FrameAllocate();
+
+    ReceiverTestHoldStart(&Held);
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    ReceiverTestBounceReceive(Adapter,
+                              Frame,
+                              0,
+                              RECEIVER_TEST_BOUNCE_LIMIT + RingSize,
+                              &Held);
+
+    SHIM_CHECK(Held.Count == RECEIVER_TEST_BOUNCE_LIMIT + RingSize);
+    SHIM_CHECK(Receiver->InNDIS == (LONG)Held.Count);
+
+    // Only the packets of the frames under the limit are still held
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == RECEIVER_TEST_BOUNCE_LIMIT);
+    SHIM_CHECK(QueryDepthSList(&Receiver->Bounce.FreeList) == 0);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Bounced - Before.Bounced == RingSize);
+    SHIM_CHECK(After.LowResources == Before.LowResources);
+    SHIM_CHECK(After.Copied == Before.Copied);
+
+    Index = 0;
+    for (NetBufferList = Held.Head;
+         NetBufferList != NULL;
+         NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList)) {
+        PRECEIVER_SLAB  Slab;
+
+        Slab = __ReceiverGetSlab(Receiver, NetBufferList);
+        SHIM_CHECK(Slab == ((Index < RECEIVER_TEST_BOUNCE_LIMIT) ? NULL : &Receiver->Bounce));
+
+        SHIM_CHECK(HarnessCopyNetBuffer(NetBufferList, Data, sizeof (Data)) == Frame[Index]->Length);
+        SHIM_CHECK(memcmp(Data, Frame[Index]->Data, Frame[Index]->Length) == 0);
+
+        Index++;
+    }
+    SHIM_CHECK(Index == Held.Count);
+
+    // With the slab empty the next batch can only go up with
+    // NDIS_RECEIVE_FLAGS_RESOURCES, which gives it straight back
+    HarnessQueryStatistics(&Harness);
+    ResourceIndications = Harness.ResourceIndications;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface,
+                                     &Frame[RECEIVER_TEST_BOUNCE_LIMIT + RingSize],
+                                     RECEIVER_TEST_BOUNCE_BATCH) == RECEIVER_TEST_BOUNCE_BATCH);
+    KeLowerIrql(Irql);
+
+    HarnessQueryStatistics(&Harness);
+    SHIM_CHECK(Harness.ResourceIndications != ResourceIndications);
+    SHIM_CHECK(Held.Count == RECEIVER_TEST_BOUNCE_LIMIT + RingSize);
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == RECEIVER_TEST_BOUNCE_LIMIT);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Bounced - Before.Bounced == RingSize);
+    SHIM_CHECK(After.LowResources - Before.LowResources == RECEIVER_TEST_BOUNCE_BATCH);
+
+    printf("  limit %u: %llu bounced, %llu low-resources\n",
+           RECEIVER_TEST_BOUNCE_LIMIT,
+           After.Bounced - Before.Bounced,
+           After.LowResources - Before.LowResources);
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestHoldRelease(Adapter, &Held);
+
+    SHIM_CHECK(QueryDepthSList(&Receiver->Bounce.FreeList) == RingSize);
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == 0);
+    SHIM_CHECK(Receiver->InNDIS == 0);
+
+    // And it can all be done again
+    ReceiverTestHoldStart(&Held);
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    ReceiverTestBounceReceive(Adapter,
+                              Frame,
+                              0,
+                              RECEIVER_TEST_BOUNCE_LIMIT + RingSize,
+                              &Held);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Bounced - Before.Bounced == RingSize);
+    SHIM_CHECK(After.LowResources == Before.LowResources);
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestHoldRelease(Adapter, &Held);
+
+    SHIM_CHECK(QueryDepthSList(&Receiver->Bounce.FreeList) == RingSize);
+
+    for (Index = 0; Index < Total; Index++)
+        FrameFree(Frame[Index]);
+    free(Frame);
+
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Receive Side Scaling
+
+#define RECEIVER_TEST_RSS_PROCESSORS    4
+#define RECEIVER_TEST_RSS_TABLE_SIZE    16
+
+// What the last indication carried and where it was made
+typedef struct _RECEIVER_TEST_RSS {
+    ULONG   Indicated;
+    ULONG   Processor;
+    ULONG   HashValue;
+    ULONG   HashType;
+    ULONG   HashFunction;
+} RECEIVER_TEST_RSS, *PRECEIVER_TEST_RSS;
+
+static BOOLEAN
+ReceiverTestRssIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_RSS      Rss = Argument;
+
+    UNREFERENCED_PARAMETER(Adapter);
+    UNREFERENCED_PARAMETER(Flags);
+
+    SHIM_CHECK(Count == 1);
+
+    Rss->Indicated++;
+    Rss->Processor = KeGetCurrentProcessorNumberEx(NULL);
+    Rss->HashValue = NET_BUFFER_LIST_GET_HASH_VALUE(NetBufferList);
+    Rss->HashType = NET_BUFFER_LIST_GET_HASH_TYPE(NetBufferList);
+    Rss->HashFunction = NET_BUFFER_LIST_GET_HASH_FUNCTION(NetBufferList);
+
+    // Returned by the harness
+    return FALSE;
+}
+
+// A frame carrying the vector's addresses and, for TCP, its ports
+static VOID
+ReceiverTestRssBuildFrame(
+    OUT PFRAME                  Frame,
+    IN  const TOEPLITZ_VECTOR   *Vector,
+    IN  UCHAR                   Protocol
+    )
+{
+    FRAME_PARAMETERS            Parameters;
+    PIP_HEADER                  IpHeader;
+
+    FrameDefaultParameters(&Parameters);
+    Parameters.IpVersion = (Vector->AddressLength == IPV4_ADDRESS_LENGTH) ? 4 : 6;
+    Parameters.Protocol = Protocol;
+    Parameters.SourcePort = Vector->SourcePort;
+    Parameters.DestinationPort = Vector->DestinationPort;
+
+    FrameBuild(Frame, &Parameters);
+
+    // The checksums no longer match, so the adapter must not check them
+    IpHeader = (PIP_HEADER)&Frame->Data[Frame->Info.IpHeader.Offset];
+    if (Parameters.IpVersion == 4) {
+        memcpy(&IpHeader->Version4.SourceAddress, Vector->SourceAddress, IPV4_ADDRESS_LENGTH);
+        memcpy(&IpHeader->Version4.DestinationAddress, Vector->DestinationAddress, IPV4_ADDRESS_LENGTH);
+    } else {
+        memcpy(&IpHeader->Version6.SourceAddress, Vector->SourceAddress, IPV6_ADDRESS_LENGTH);
+        memcpy(&IpHeader->Version6.DestinationAddress, Vector->DestinationAddress, IPV6_ADDRESS_LENGTH);
+    }
+}
+
+static VOID
+ReceiverTestRssSetParameters(
+    IN  PRECEIVER   Receiver,
+    IN  ULONG       HashInformation,
+    IN  ULONG       Flags
+    )
+{
+    struct {
+        NDIS_RECEIVE_SCALE_PARAMETERS   Parameters;
+        UCHAR                           Table[RECEIVER_TEST_RSS_TABLE_SIZE];
+        UCHAR                           Key[TOEPLITZ_VECTOR_KEY_LENGTH];
+    } Buffer;
+    ULONG                               Index;
+
+    RtlZeroMemory(&Buffer, sizeof (Buffer));
+
+    Buffer.Parameters.Header.Type = NDIS_OBJECT_TYPE_RSS_PARAMETERS;
+    Buffer.Parameters.Header.Revision = NDIS_RECEIVE_SCALE_PARAMETERS_REVISION_1;
+    Buffer.Parameters.Header.Size = NDIS_SIZEOF_RECEIVE_SCALE_PARAMETERS_REVISION_1;
+    Buffer.Parameters.Flags = (USHORT)Flags;
+    Buffer.Parameters.BaseCpuNumber = 0;
+    Buffer.Parameters.HashInformation = HashInformation;
+
+    // Not simply round-robin, so that a wrong index picks a wrong CPU
+    for (Index = 0; Index < RECEIVER_TEST_RSS_TABLE_SIZE; Index++)
+        Buffer.Table[Index] = (UCHAR)(((Index * 3) + (Index / 4)) % RECEIVER_TEST_RSS_PROCESSORS);
+
+    Buffer.Parameters.IndirectionTableSize = sizeof (Buffer.Table);
+    Buffer.Parameters.IndirectionTableOffset = FIELD_OFFSET(__typeof__(Buffer), Table);
+
+    memcpy(Buffer.Key, ToeplitzVectorKey, sizeof (Buffer.Key));
+    Buffer.Parameters.HashSecretKeySize = sizeof (Buffer.Key);
+    Buffer.Parameters.HashSecretKeyOffset = FIELD_OFFSET(__typeof__(Buffer), Key);
+
+    SHIM_CHECK(ReceiverSetRssParameters(Receiver,
+                                        &Buffer.Parameters,
+                                        sizeof (Buffer)) == NDIS_STATUS_SUCCESS);
+}
+
+// Every verification vector received on every processor is indicated
+// with the published hash, on the processor the indirection table gives
+// for it.
+static VOID
+ReceiverTestRss(
+    VOID
+    )
+{
+    static const UCHAR  Protocol[] = { IPPROTO_TCP, IPPROTO_UDP };
+    PADAPTER            Adapter;
+    PRECEIVER           Receiver;
+    PFRAME              Frame;
+    RECEIVER_TEST_RSS   Rss;
+    RECEIVER_STATISTICS Statistics;
+    ULONG               Steered;
+    ULONG               Index;
+    ULONG               Processor;
+
+    Adapter = ReceiverTestCreateAdapter(RECEIVER_TEST_RSS_PROCESSORS, 0, NULL,
+                                        "sw_csum=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    ReceiverTestRssSetParameters(Receiver,
+                                 NdisHashFunctionToeplitz |
+                                 NDIS_HASH_IPV4 | NDIS_HASH_TCP_IPV4 |
+                                 NDIS_HASH_IPV6 | NDIS_HASH_TCP_IPV6,
+                                 0);
+    SHIM_CHECK(Receiver->Rss.Enabled);
+
+    Frame = FrameAllocate();
+    HarnessSetReceiveHook(ReceiverTestRssIndicate, &Rss);
+
+    Steered = 0;
+    for (Index = 0; Index < ARRAYSIZE(ToeplitzVector); Index++) {
+        const TOEPLITZ_VECTOR   *Vector = &ToeplitzVector[Index];
+        ULONG                   Type;
+
+        for (Type = 0; Type < ARRAYSIZE(Protocol); Type++) {
+            BOOLEAN Version4 = (Vector->AddressLength == IPV4_ADDRESS_LENGTH) ? TRUE : FALSE;
+            ULONG   HashValue;
+            ULONG   HashType;
+            ULONG   Target;
+
+            ReceiverTestRssBuildFrame(Frame, Vector, Protocol[Type]);
+
+            // Ports are only hashed for TCP
+            if (Protocol[Type] == IPPROTO_TCP) {
+                HashValue = Vector->HashWithPorts;
+                HashType = Version4 ? NDIS_HASH_TCP_IPV4 : NDIS_HASH_TCP_IPV6;
+            } else {
+                HashValue = Vector->Hash;
+                HashType = Version4 ? NDIS_HASH_IPV4 : NDIS_HASH_IPV6;
+            }
+
+            Target = Receiver->Rss.Table[HashValue & (RECEIVER_TEST_RSS_TABLE_SIZE - 1)];
+
+            for (Processor = 0; Processor < RECEIVER_TEST_RSS_PROCESSORS; Processor++) {
+                RtlZeroMemory(&Rss, sizeof (Rss));
+
+                ShimSetCurrentProcessor(Processor);
+                SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, 1) == 1);
+                ShimRunAllDpcs();
+
+                SHIM_CHECK(Rss.Indicated == 1);
+                SHIM_CHECK(Rss.HashValue == HashValue);
+                SHIM_CHECK(Rss.HashType == HashType);
+                SHIM_CHECK(Rss.HashFunction == NdisHashFunctionToeplitz);
+                SHIM_CHECK(Rss.Processor == Target);
+
+                if (Processor != Target)
+                    Steered++;
+            }
+        }
+    }
+
+    ShimSetCurrentProcessor(0);
+
+    ReceiverQueryStatistics(Receiver, &Statistics);
+    printf("  %u vectors, %llu of %u indications steered\n",
+           (ULONG)ARRAYSIZE(ToeplitzVector),
+           Statistics.Steered,
+           (ULONG)(ARRAYSIZE(ToeplitzVector) * ARRAYSIZE(Protocol) * RECEIVER_TEST_RSS_PROCESSORS));
+    SHIM_CHECK(Statistics.Steered == Steered);
+
+    // Without the TCP hash types TCP is hashed over the addresses alone
+    ReceiverTestRssSetParameters(Receiver,
+                                 NdisHashFunctionToeplitz |
+                                 NDIS_HASH_IPV4 | NDIS_HASH_IPV6,
+                                 NDIS_RSS_PARAM_FLAG_ITABLE_UNCHANGED |
+                                 NDIS_RSS_PARAM_FLAG_HASH_KEY_UNCHANGED);
+
+    for (Index = 0; Index < ARRAYSIZE(ToeplitzVector); Index++) {
+        const TOEPLITZ_VECTOR   *Vector = &ToeplitzVector[Index];
+
+        ReceiverTestRssBuildFrame(Frame, Vector, IPPROTO_TCP);
+
+        RtlZeroMemory(&Rss, sizeof (Rss));
+        SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, 1) == 1);
+        ShimRunAllDpcs();
+
+        SHIM_CHECK(Rss.Indicated == 1);
+        SHIM_CHECK(Rss.HashValue == Vector->Hash);
+        SHIM_CHECK(Rss.Processor == Receiver->Rss.Table[Vector->Hash & (RECEIVER_TEST_RSS_TABLE_SIZE - 1)]);
+    }
+
+    // Disabled, everything is indicated where it is received
+    ReceiverTestRssSetParameters(Receiver, 0, NDIS_RSS_PARAM_FLAG_DISABLE_RSS);
+    SHIM_CHECK(!Receiver->Rss.Enabled);
+
+    ReceiverTestRssBuildFrame(Frame, &ToeplitzVector[0], IPPROTO_TCP);
+
+    for (Processor = 0; Processor < RECEIVER_TEST_RSS_PROCESSORS; Processor++) {
+        RtlZeroMemory(&Rss, sizeof (Rss));
+
+        ShimSetCurrentProcessor(Processor);
+        SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, 1) == 1);
+        ShimRunAllDpcs();
+
+        SHIM_CHECK(Rss.Indicated == 1);
+        SHIM_CHECK(Rss.Processor == Processor);
+    }
+
+    ShimSetCurrentProcessor(0);
+    HarnessSetReceiveHook(NULL, NULL);
+
+    FrameFree(Frame);
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Software receive coalescing
+
+#define RECEIVER_TEST_GRO_MSS       1448
+#define RECEIVER_TEST_GRO_SEQ       1000
+#define RECEIVER_TEST_GRO_WINDOW    0x1000
+
+// A segment of the stream: where its payload starts, relative to
+// RECEIVER_TEST_GRO_SEQ, how long it is and its TCP flags
+typedef struct _RECEIVER_TEST_GRO_SEGMENT {
+    ULONG   Seq;
+    ULONG   Length;
+    UCHAR   Flags;
+} RECEIVER_TEST_GRO_SEGMENT, *PRECEIVER_TEST_GRO_SEGMENT;
+
+// Segments passed to the receiver in one callback, in the order given,
+// and the number of them each NET_BUFFER_LIST indicated should carry
+typedef struct _RECEIVER_TEST_GRO_CASE {
+    const CHAR                      *Name;
+    UCHAR                           IpVersion;
+    ULONG                           TcpOptionsLength;
+    const RECEIVER_TEST_GRO_SEGMENT *Segment;
+    ULONG                           SegmentCount;
+    const ULONG                     *Group;
+    ULONG                           GroupCount;
+} RECEIVER_TEST_GRO_CASE, *PRECEIVER_TEST_GRO_CASE;
+
+#define RECEIVER_TEST_GRO_FULL(_Index, _Flags)  \
+        { (_Index) * RECEIVER_TEST_GRO_MSS, RECEIVER_TEST_GRO_MSS, (_Flags) }
+
+static const RECEIVER_TEST_GRO_SEGMENT  ReceiverTestGroInOrder[] = {
+    RECEIVER_TEST_GRO_FULL(0, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(1, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(2, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(3, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(4, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(5, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(6, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(7, TCP_ACK),
+};
+static const ULONG  ReceiverTestGroInOrderGroup[] = { 8 };
+
+static const RECEIVER_TEST_GRO_SEGMENT  ReceiverTestGroOutOfOrder[] = {
+    RECEIVER_TEST_GRO_FULL(0, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(1, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(3, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(2, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(4, TCP_ACK),
+};
+static const ULONG  ReceiverTestGroOutOfOrderGroup[] = { 2, 1, 1, 1 };
+
+// A push ends a burst, and a pushed segment never starts one
+static const RECEIVER_TEST_GRO_SEGMENT  ReceiverTestGroPush[] = {
+    RECEIVER_TEST_GRO_FULL(0, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(1, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(2, TCP_ACK | TCP_PSH),
+    RECEIVER_TEST_GRO_FULL(3, TCP_ACK | TCP_PSH),
+    RECEIVER_TEST_GRO_FULL(4, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(5, TCP_ACK),
+};
+static const ULONG  ReceiverTestGroPushGroup[] = { 3, 1, 2 };
+
+static const RECEIVER_TEST_GRO_SEGMENT  ReceiverTestGroFlags[] = {
+    RECEIVER_TEST_GRO_FULL(0, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(1, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(2, TCP_ACK | TCP_FIN),
+    RECEIVER_TEST_GRO_FULL(3, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(4, 0),
+    RECEIVER_TEST_GRO_FULL(5, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(6, TCP_ACK | TCP_URG),
+    RECEIVER_TEST_GRO_FULL(7, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(8, TCP_ACK),
+};
+static const ULONG  ReceiverTestGroFlagsGroup[] = { 2, 1, 1, 1, 1, 1, 2 };
+
+// A short segment is the last of a burst, and one longer than the first
+// cannot belong to it
+static const RECEIVER_TEST_GRO_SEGMENT  ReceiverTestGroShort[] = {
+    RECEIVER_TEST_GRO_FULL(0, TCP_ACK),
+    RECEIVER_TEST_GRO_FULL(1, TCP_ACK),
+    { 2 * RECEIVER_TEST_GRO_MSS, 500, TCP_ACK },
+    { (2 * RECEIVER_TEST_GRO_MSS) + 500, 500, TCP_ACK },
+    { (2 * RECEIVER_TEST_GRO_MSS) + 1000, RECEIVER_TEST_GRO_MSS, TCP_ACK },
+    { (3 * RECEIVER_TEST_GRO_MSS) + 1000, RECEIVER_TEST_GRO_MSS, TCP_ACK },
+};
+static const ULONG  ReceiverTestGroShortGroup[] = { 3, 1, 2 };
+
+#define RECEIVER_TEST_GRO_CASE(_Name, _IpVersion, _TcpOptionsLength, _Segment)   \
+        { (_Name), (_IpVersion), (_TcpOptionsLength),                           \
+          (_Segment), ARRAYSIZE(_Segment),                                      \
+          (_Segment ## Group), ARRAYSIZE(_Segment ## Group) }
+
+static const RECEIVER_TEST_GRO_CASE ReceiverTestGroCase[] = {
+    RECEIVER_TEST_GRO_CASE("in order", 4, 0, ReceiverTestGroInOrder),
+    RECEIVER_TEST_GRO_CASE("in order", 6, 0, ReceiverTestGroInOrder),
+    RECEIVER_TEST_GRO_CASE("in order", 4, 12, ReceiverTestGroInOrder),
+    RECEIVER_TEST_GRO_CASE("in order", 6, 12, ReceiverTestGroInOrder),
+    RECEIVER_TEST_GRO_CASE("out of order", 4, 0, ReceiverTestGroOutOfOrder),
+    RECEIVER_TEST_GRO_CASE("out of order", 6, 0, ReceiverTestGroOutOfOrder),
+    RECEIVER_TEST_GRO_CASE("push", 4, 0, ReceiverTestGroPush),
+    RECEIVER_TEST_GRO_CASE("push", 6, 0, ReceiverTestGroPush),
+    RECEIVER_TEST_GRO_CASE("flags", 4, 0, ReceiverTestGroFlags),
+    RECEIVER_TEST_GRO_CASE("flags", 6, 0, ReceiverTestGroFlags),
+    RECEIVER_TEST_GRO_CASE("short", 4, 0, ReceiverTestGroShort),
+    RECEIVER_TEST_GRO_CASE("short", 6, 12, ReceiverTestGroShort),
+};
+
+#define RECEIVER_TEST_GRO_MAXIMUM   64
+
+// What was indicated, read back from each NET_BUFFER_LIST
+typedef struct _RECEIVER_TEST_GRO {
+    RECEIVER_TEST_HELD  Held;
+    ULONG               Indicated;
+    ULONG               Seq[RECEIVER_TEST_GRO_MAXIMUM];
+    ULONG               PayloadLength[RECEIVER_TEST_GRO_MAXIMUM];
+    UCHAR               Flags[RECEIVER_TEST_GRO_MAXIMUM];
+    USHORT              Window[RECEIVER_TEST_GRO_MAXIMUM];
+    ULONG               SegmentCount[RECEIVER_TEST_GRO_MAXIMUM];
+} RECEIVER_TEST_GRO, *PRECEIVER_TEST_GRO;
+
+static UCHAR    ReceiverTestGroData[RECEIVER_GRO_MAXIMUM_LENGTH + sizeof (ETHERNET_UNTAGGED_HEADER)];
+
+// Checks that a coalesced frame's IP length covers it, and its IPv4
+// header checksum is still right, and that its payload is the stream's,
+// then keeps it so that the test can see when its packets go back.
+static BOOLEAN
+ReceiverTestGroIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_GRO      Gro = Argument;
+    PNET_BUFFER_LIST        Current;
+
+    for (Current = NetBufferList;
+         Current != NULL;
+         Current = NET_BUFFER_LIST_NEXT_NBL(Current)) {
+        ULONG       Length;
+        PIP_HEADER  IpHeader;
+        ULONG       Offset;
+        PTCP_HEADER TcpHeader;
+        ULONG       Seq;
+        ULONG       Index;
+
+        SHIM_CHECK(Gro->Indicated < RECEIVER_TEST_GRO_MAXIMUM);
+
+        Length = HarnessCopyNetBuffer(Current, ReceiverTestGroData, sizeof (ReceiverTestGroData));
+        Offset = sizeof (ETHERNET_UNTAGGED_HEADER);
+
+        IpHeader = (PIP_HEADER)&ReceiverTestGroData[Offset];
+        if (IpHeader->Version == 4) {
+            SHIM_CHECK(NTOHS(IpHeader->Version4.PacketLength) == Length - Offset);
+            SHIM_CHECK(FrameChecksum(0, IpHeader, IPV4_HEADER_LENGTH(&IpHeader->Version4)) == 0xFFFF);
+
+            Offset += IPV4_HEADER_LENGTH(&IpHeader->Version4);
+        } else {
+            SHIM_CHECK(IpHeader->Version == 6);
+            SHIM_CHECK(NTOHS(IpHeader->Version6.PayloadLength) == Length - Offset - sizeof (IPV6_HEADER));
+
+            Offset += sizeof (IPV6_HEADER);
+        }
+
+        TcpHeader = (PTCP_HEADER)&ReceiverTestGroData[Offset];
+        Offset += TCP_HEADER_LENGTH(TcpHeader);
+        SHIM_CHECK(Offset <= Length);
+
+        // Byte n of the payload is Seq + n
+        Seq = NTOHL(TcpHeader->Seq);
+        for (Index = Offset; Index < Length; Index++)
+            SHIM_CHECK(ReceiverTestGroData[Index] == (UCHAR)(Seq + Index - Offset));
+
+        Gro->Seq[Gro->Indicated] = Seq - RECEIVER_TEST_GRO_SEQ;
+        Gro->PayloadLength[Gro->Indicated] = Length - Offset;
+        Gro->Flags[Gro->Indicated] = TcpHeader->Flags;
+        Gro->Window[Gro->Indicated] = NTOHS(TcpHeader->Window);
+        Gro->SegmentCount[Gro->Indicated] = NET_BUFFER_LIST_COALESCED_SEG_COUNT(Current);
+        Gro->Indicated++;
+    }
+
+    return ReceiverTestHold(&Gro->Held, Adapter, NetBufferList, Count, Flags);
+}
+
+// Passes the segments to the receiver in one callback and checks that
+// they were indicated in the expected groups, each carrying the flags of
+// all its segments and the window of the last. Then checks that every
+// packet is held until the NET_BUFFER_LISTs come back, and that all of
+// them, and none of the MDLs describing them, are left over after that.
+static VOID
+ReceiverTestGroRun(
+    IN  PADAPTER                        Adapter,
+    IN  UCHAR                           IpVersion,
+    IN  ULONG                           TcpOptionsLength,
+    IN  const RECEIVER_TEST_GRO_SEGMENT *Segment,
+    IN  ULONG                           SegmentCount,
+    IN  const ULONG                     *Group,
+    IN  ULONG                           GroupCount,
+    IN  PFRAME                          *Frame,
+    IN  PRECEIVER_TEST_GRO              Gro
+    )
+{
+    FRAME_PARAMETERS                    Parameters;
+    MOCK_VIF_STATISTICS                 Before;
+    MOCK_VIF_STATISTICS                 After;
+    SHIM_ALLOCATIONS                    Allocations;
+    LONG64                              Mdls;
+    ULONG                               First;
+    ULONG                               Index;
+    KIRQL                               Irql;
+
+    SHIM_CHECK(SegmentCount <= RECEIVER_TEST_MAXIMUM_BATCH);
+
+    for (Index = 0; Index < SegmentCount; Index++) {
+        PTCP_HEADER TcpHeader;
+
+        FrameDefaultParameters(&Parameters);
+        Parameters.IpVersion = IpVersion;
+        Parameters.Seq = RECEIVER_TEST_GRO_SEQ + Segment[Index].Seq;
+        Parameters.TcpFlags = Segment[Index].Flags;
+        Parameters.TcpOptionsLength = TcpOptionsLength;
+        Parameters.PayloadLength = Segment[Index].Length;
+
+        FrameBuild(Frame[Index], &Parameters);
+
+        // Validated by the backend, so the window can be changed freely
+        Frame[Index]->Flags.IpChecksumSucceeded = (IpVersion == 4) ? 1 : 0;
+        Frame[Index]->Flags.TcpChecksumSucceeded = 1;
+
+        TcpHeader = (PTCP_HEADER)&Frame[Index]->Data[Frame[Index]->Info.TcpHeader.Offset];
+        TcpHeader->Window = HTONS((USHORT)(RECEIVER_TEST_GRO_WINDOW + Index));
+    }
+
+    RtlZeroMemory(Gro, sizeof (RECEIVER_TEST_GRO));
+    Gro->Held.Tail = &Gro->Held.Head;
+
+    MockVifQueryStatistics(Adapter->VifInterface, &Before);
+    ShimQueryAllocations(&Allocations);
+    Mdls = Allocations.Mdls - Allocations.MdlFrees;
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, Frame, SegmentCount) == SegmentCount);
+    KeLowerIrql(Irql);
+
+    SHIM_CHECK(Gro->Indicated == GroupCount);
+
+    First = 0;
+    for (Index = 0; Index < GroupCount; Index++) {
+        ULONG   Last = First + Group[Index] - 1;
+        ULONG   PayloadLength;
+        UCHAR   Flags;
+        ULONG   Segments;
+
+        SHIM_CHECK(Last < SegmentCount);
+
+        PayloadLength = 0;
+        Flags = 0;
+        for (Segments = First; Segments <= Last; Segments++) {
+            PayloadLength += Segment[Segments].Length;
+            Flags |= Segment[Segments].Flags;
+        }
+
+        SHIM_CHECK(Gro->Seq[Index] == Segment[First].Seq);
+        SHIM_CHECK(Gro->PayloadLength[Index] == PayloadLength);
+        SHIM_CHECK(Gro->Flags[Index] == Flags);
+        SHIM_CHECK(Gro->Window[Index] == RECEIVER_TEST_GRO_WINDOW + Last);
+        SHIM_CHECK(Gro->SegmentCount[Index] == ((Group[Index] > 1) ? Group[Index] : 0));
+
+        First = Last + 1;
+    }
+    SHIM_CHECK(First == SegmentCount);
+
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == SegmentCount);
+
+    ReceiverTestHoldRelease(Adapter, &Gro->Held);
+
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == 0);
+    SHIM_CHECK(Adapter->Receiver.InNDIS == 0);
+
+    MockVifQueryStatistics(Adapter->VifInterface, &After);
+    SHIM_CHECK(After.ReturnedPackets - Before.ReturnedPackets == SegmentCount);
+
+    ShimQueryAllocations(&Allocations);
+    SHIM_CHECK(Allocations.Mdls - Allocations.MdlFrees == Mdls);
+}
+
+// In-order segments of a flow in one callback are indicated as one frame
+// whose IP length covers them all, up to the 64k an IP datagram can hold;
+// anything out of order, pushed, short or other than a plain ACK closes
+// the frame. The coalesced segments are counted in the statistics as
+// they are for the backend's large receives.
+static VOID
+ReceiverTestGro(
+    VOID
+    )
+{
+    MOCK_VIF_CONFIGURATION      Configuration;
+    PADAPTER                    Adapter;
+    PRECEIVER                   Receiver;
+    PFRAME                      Frame[RECEIVER_TEST_MAXIMUM_BATCH];
+    RECEIVER_TEST_GRO           Gro;
+    RECEIVER_TEST_GRO_SEGMENT   Segment[RECEIVER_TEST_GRO_MAXIMUM];
+    ULONG                       Group[2];
+    RECEIVER_STATISTICS         Before;
+    RECEIVER_STATISTICS         After;
+    ULONG64                     Coalesced;
+    ULONG64                     CoalescedSegments;
+    ULONG                       IpVersion;
+    ULONG                       Case;
+    ULONG                       Index;
+
+    // Room for a whole 64k of segments at once
+    MockVifDefaultConfiguration(&Configuration);
+    Configuration.ReceiverRingSize = RECEIVER_TEST_MAXIMUM_BATCH;
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, &Configuration,
+                                        "grov4=1",
+                                        "grov6=1",
+                                        "rx_copy_break=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        Frame[Index] = FrameAllocate();
+
+    HarnessSetReceiveHook(ReceiverTestGroIndicate, &Gro);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    Coalesced = 0;
+    CoalescedSegments = 0;
+
+    for (Case = 0; Case < ARRAYSIZE(ReceiverTestGroCase); Case++) {
+        const RECEIVER_TEST_GRO_CASE    *Current = &ReceiverTestGroCase[Case];
+
+        ReceiverTestGroRun(Adapter,
+                           Current->IpVersion,
+                           Current->TcpOptionsLength,
+                           Current->Segment,
+                           Current->SegmentCount,
+                           Current->Group,
+                           Current->GroupCount,
+                           Frame,
+                           &Gro);
+
+        for (Index = 0; Index < Current->GroupCount; Index++) {
+            if (Current->Group[Index] > 1) {
+                Coalesced++;
+                CoalescedSegments += Current->Group[Index];
+            }
+        }
+    }
+
+    // A frame that would go over 64k starts another
+    for (IpVersion = 4; IpVersion <= 6; IpVersion += 2) {
+        ULONG   HeaderLength;
+
+        for (Index = 0; Index < RECEIVER_TEST_GRO_MAXIMUM; Index++) {
+            Segment[Index].Seq = Index * RECEIVER_TEST_GRO_MSS;
+            Segment[Index].Length = RECEIVER_TEST_GRO_MSS;
+            Segment[Index].Flags = TCP_ACK;
+        }
+
+        HeaderLength = ((IpVersion == 4) ? sizeof (IPV4_HEADER) : sizeof (IPV6_HEADER)) +
+                       sizeof (TCP_HEADER);
+
+        Group[0] = (RECEIVER_GRO_MAXIMUM_LENGTH - HeaderLength) / RECEIVER_TEST_GRO_MSS;
+        Group[1] = RECEIVER_TEST_GRO_MAXIMUM - Group[0];
+
+        ReceiverTestGroRun(Adapter,
+                           (UCHAR)IpVersion,
+                           0,
+                           Segment,
+                           RECEIVER_TEST_GRO_MAXIMUM,
+                           Group,
+                           ARRAYSIZE(Group),
+                           Frame,
+                           &Gro);
+
+        Coalesced += 2;
+        CoalescedSegments += RECEIVER_TEST_GRO_MAXIMUM;
+    }
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Coalesced - Before.Coalesced == Coalesced);
+    SHIM_CHECK(After.CoalescedSegments - Before.CoalescedSegments == CoalescedSegments);
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // Nothing is coalesced with coalescing off
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "grov4=0",
+                                        "grov6=1",
+                                        "rx_copy_break=0",
+                                        NULL);
+
+    HarnessSetReceiveHook(ReceiverTestGroIndicate, &Gro);
+
+    Group[0] = 1;
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestGroInOrder); Index++)
+        ReceiverTestGroRun(Adapter,
+                           4,
+                           0,
+                           &ReceiverTestGroInOrder[Index],
+                           1,
+                           Group,
+                           1,
+                           Frame,
+                           &Gro);
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    printf("  %llu coalesced frames carrying %llu segments\n",
+           Coalesced,
+           CoalescedSegments);
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        FrameFree(Frame[Index]);
+}
+
+// Receive segment coalescing
+
+// The mock backend receives into a single page; leave room for the largest
+// headers.
+#define RECEIVER_TEST_COALESCE_MAXIMUM_PAYLOAD  3900
+
+// The RSC info of the last indication
+typedef struct _RECEIVER_TEST_COALESCE {
+    ULONG   Indicated;
+    ULONG   SegmentCount;
+    ULONG   DuplicateAckCount;
+} RECEIVER_TEST_COALESCE, *PRECEIVER_TEST_COALESCE;
+
+static BOOLEAN
+ReceiverTestCoalesceIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_COALESCE Coalesce = Argument;
+
+    UNREFERENCED_PARAMETER(Adapter);
+    UNREFERENCED_PARAMETER(Flags);
+
+    SHIM_CHECK(Count == 1);
+
+    Coalesce->Indicated++;
+    Coalesce->SegmentCount = NET_BUFFER_LIST_COALESCED_SEG_COUNT(NetBufferList);
+    Coalesce->DuplicateAckCount = NET_BUFFER_LIST_DUP_ACK_COUNT(NetBufferList);
+
+    // Returned by the harness
+    return FALSE;
+}
+
+// Receives one frame and returns the segment count it was indicated with
+static ULONG
+ReceiverTestCoalesceReceive(
+    IN  PADAPTER                Adapter,
+    IN  PFRAME                  Frame,
+    IN  PRECEIVER_TEST_COALESCE Coalesce
+    )
+{
+    RtlZeroMemory(Coalesce, sizeof (RECEIVER_TEST_COALESCE));
+
+    SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, 1) == 1);
+
+    SHIM_CHECK(Coalesce->Indicated == 1);
+    SHIM_CHECK(Coalesce->DuplicateAckCount == 0);
+
+    return Coalesce->SegmentCount;
+}
+
+// A large receive the backend coalesced is indicated with the number of
+// MSS-sized segments in its TCP payload, and the statistics count it.
+// Anything else carries no RSC info, including a frame that reuses an
+// NBL a coalesced one was indicated with.
+static VOID
+ReceiverTestCoalesce(
+    VOID
+    )
+{
+    static const USHORT     MaximumSegmentSize[] = { 1, 88, 536, 1220, 1448, 1460 };
+    static const ULONG      OptionsLength[] = { 0, 12, 40 };
+    MOCK_VIF_CONFIGURATION  Configuration;
+    PADAPTER                Adapter;
+    PRECEIVER               Receiver;
+    PFRAME                  Frame;
+    FRAME_PARAMETERS        Parameters;
+    RECEIVER_TEST_COALESCE  Coalesce;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    ULONG64                 Coalesced;
+    ULONG64                 CoalescedSegments;
+    ULONG                   Version;
+    ULONG                   Options;
+    ULONG                   Mss;
+    ULONG                   Checked;
+
+    MockVifDefaultConfiguration(&Configuration);
+    Configuration.ReceiveBufferSize = PAGE_SIZE;
+
+    // The receiver's own coalescing is off by default; only the backend's
+    // is under test here.
+    Adapter = ReceiverTestCreateAdapter(1, 0, &Configuration,
+                                        "grov4=0",
+                                        "grov6=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    Frame = FrameAllocate();
+    HarnessSetReceiveHook(ReceiverTestCoalesceIndicate, &Coalesce);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    Coalesced = 0;
+    CoalescedSegments = 0;
+    Checked = 0;
+
+    for (Version = 4; Version <= 6; Version += 2) {
+        for (Options = 0; Options < ARRAYSIZE(OptionsLength); Options++) {
+            for (Mss = 0; Mss < ARRAYSIZE(MaximumSegmentSize); Mss++) {
+                ULONG   Size = MaximumSegmentSize[Mss];
+                ULONG   Payload[8];
+                ULONG   Index;
+
+                Payload[0] = 0;
+                Payload[1] = 1;
+                Payload[2] = Size;
+                Payload[3] = Size + 1;
+                Payload[4] = (2 * Size) - 1;
+                Payload[5] = 2 * Size;
+                Payload[6] = (7 * Size) + 3;
+                if (Payload[6] > RECEIVER_TEST_COALESCE_MAXIMUM_PAYLOAD)
+                    Payload[6] = RECEIVER_TEST_COALESCE_MAXIMUM_PAYLOAD;
+                Payload[7] = RECEIVER_TEST_COALESCE_MAXIMUM_PAYLOAD;
+
+                for (Index = 0; Index < ARRAYSIZE(Payload); Index++) {
+                    ULONG   Expected;
+
+                    FrameDefaultParameters(&Parameters);
+                    Parameters.IpVersion = (UCHAR)Version;
+                    Parameters.TcpOptionsLength = OptionsLength[Options];
+                    Parameters.PayloadLength = Payload[Index];
+
+                    FrameBuild(Frame, &Parameters);
+                    Frame->MaximumSegmentSize = (USHORT)Size;
+
+                    // A single segment needs no RSC info
+                    Expected = (Payload[Index] + Size - 1) / Size;
+                    if (Expected <= 1) {
+                        Expected = 0;
+                    } else {
+                        Coalesced++;
+                        CoalescedSegments += Expected;
+                    }
+
+                    SHIM_CHECK(ReceiverTestCoalesceReceive(Adapter, Frame, &Coalesce) == Expected);
+                    Checked++;
+                }
+            }
+        }
+    }
+
+    // Without an MSS the backend has not coalesced anything...
+    FrameDefaultParameters(&Parameters);
+    Parameters.PayloadLength = RECEIVER_TEST_COALESCE_MAXIMUM_PAYLOAD;
+    FrameBuild(Frame, &Parameters);
+    SHIM_CHECK(ReceiverTestCoalesceReceive(Adapter, Frame, &Coalesce) == 0);
+
+    // ... and UDP never is
+    Parameters.Protocol = IPPROTO_UDP;
+    FrameBuild(Frame, &Parameters);
+    Frame->MaximumSegmentSize = 1460;
+    SHIM_CHECK(ReceiverTestCoalesceReceive(Adapter, Frame, &Coalesce) == 0);
+
+    // The NBL the last large receive used comes back for the next frame
+    Parameters.Protocol = IPPROTO_TCP;
+    FrameBuild(Frame, &Parameters);
+    Frame->MaximumSegmentSize = 100;
+    SHIM_CHECK(ReceiverTestCoalesceReceive(Adapter, Frame, &Coalesce) == 39);
+    Coalesced++;
+    CoalescedSegments += 39;
+
+    Frame->MaximumSegmentSize = 0;
+    SHIM_CHECK(ReceiverTestCoalesceReceive(Adapter, Frame, &Coalesce) == 0);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Coalesced - Before.Coalesced == Coalesced);
+    SHIM_CHECK(After.CoalescedSegments - Before.CoalescedSegments == CoalescedSegments);
+
+    printf("  %u combinations, %llu coalesced receives carrying %llu segments\n",
+           Checked,
+           Coalesced,
+           CoalescedSegments);
+
+    HarnessSetReceiveHook(NULL, NULL);
+
+    FrameFree(Frame);
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Cache trimming
+
+#define RECEIVER_TEST_TRIM_PROCESSORS   4
+#define RECEIVER_TEST_TRIM_CYCLES       4
+
+// NET_BUFFER_LISTs allocated from the pool and not yet freed
+static LONG64
+ReceiverTestTrimFootprint(
+    VOID
+    )
+{
+    SHIM_ALLOCATIONS    Allocations;
+
+    ShimQueryAllocations(&Allocations);
+
+    return Allocations.NetBufferLists - Allocations.NetBufferListFrees;
+}
+
+// Every processor receives, and NDIS holds, a ring's worth of frames,
+// which are then all returned at once.
+static VOID
+ReceiverTestTrimBurst(
+    IN  PADAPTER    Adapter,
+    IN  PFRAME      Frame
+    )
+{
+    RECEIVER_TEST_HELD  Held;
+    ULONG               Processor;
+
+    ReceiverTestHoldStart(&Held);
+
+    for (Processor = 0; Processor < RECEIVER_TEST_TRIM_PROCESSORS; Processor++) {
+        ShimSetCurrentProcessor(Processor);
+
+        SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_MAXIMUM_BATCH) ==
+                   RECEIVER_TEST_MAXIMUM_BATCH);
+    }
+
+    ShimSetCurrentProcessor(0);
+    SHIM_CHECK(Held.Count == RECEIVER_TEST_TRIM_PROCESSORS * RECEIVER_TEST_MAXIMUM_BATCH);
+
+    ReceiverTestHoldRelease(Adapter, &Held);
+    HarnessSetReceiveHook(NULL, NULL);
+}
+
+// Ticks the trimmer through Intervals idle intervals
+static VOID
+ReceiverTestTrimIdle(
+    IN  PRECEIVER   Receiver,
+    IN  ULONG       Intervals
+    )
+{
+    ULONG           Tick;
+
+    for (Tick = 0; Tick < Intervals * RECEIVER_TRIM_INTERVAL; Tick++)
+        ReceiverTrim(Receiver);
+}
+
+// A burst grows the NET_BUFFER_LIST cache and an idle spell afterwards
+// shrinks it back to what it was, however often that happens. Traffic
+// that keeps coming back within an interval keeps its NET_BUFFER_LISTs,
+// and low memory empties the cache at once.
+static VOID
+ReceiverTestTrim(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PRECEIVER           Receiver;
+    PFRAME              Frame;
+    FRAME_PARAMETERS    Parameters;
+    RECEIVER_STATISTICS Statistics;
+    ULONG               BaselineCacheSize;
+    LONG64              Baseline;
+    LONG64              Burst;
+    LONG64              Slack;
+    LONG64              Footprint;
+    ULONG64             Trimmed;
+    ULONG               Cycle;
+    ULONG               Tick;
+
+    // Copied frames carry NET_BUFFER_LISTs of their own, so copy nothing.
+    // A burst then needs more than the ring's worth that is pre-warmed.
+    Adapter = ReceiverTestCreateAdapter(RECEIVER_TEST_TRIM_PROCESSORS, 0, NULL,
+                                        "rx_copy_break=0",
+                                        "rx_prewarm_factor=1",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    Frame = FrameAllocate();
+    FrameDefaultParameters(&Parameters);
+    FrameBuild(Frame, &Parameters);
+
+    ReceiverQueryStatistics(Receiver, &Statistics);
+    BaselineCacheSize = Statistics.CacheSize;
+    Baseline = ReceiverTestTrimFootprint();
+    SHIM_CHECK(BaselineCacheSize != 0);
+
+    // Each processor may be left with a loaded and a spare magazine
+    Slack = RECEIVER_TEST_TRIM_PROCESSORS * 2 * RECEIVER_MAGAZINE_SIZE;
+
+    for (Cycle = 0; Cycle < RECEIVER_TEST_TRIM_CYCLES; Cycle++) {
+        ReceiverTestTrimBurst(Adapter, Frame);
+
+        Burst = ReceiverTestTrimFootprint();
+        ReceiverQueryStatistics(Receiver, &Statistics);
+        SHIM_CHECK(Burst > Baseline + Slack);
+        SHIM_CHECK(Statistics.CacheSize > BaselineCacheSize);
+        Trimmed = Statistics.Trimmed;
+
+        // Nothing goes before an interval has passed...
+        for (Tick = 0; Tick < RECEIVER_TRIM_INTERVAL - 1; Tick++)
+            ReceiverTrim(Receiver);
+        SHIM_CHECK(ReceiverTestTrimFootprint() == Burst);
+
+        // ... and everything the burst added has gone after two: the
+        // first learns the depot's low point while idle, the second frees
+        // down to it
+        ReceiverTestTrimIdle(Receiver, 2);
+
+        Footprint = ReceiverTestTrimFootprint();
+        ReceiverQueryStatistics(Receiver, &Statistics);
+
+        printf("  cycle %u: baseline %lld burst %lld idle %lld NET_BUFFER_LISTs, cache %u\n",
+               Cycle,
+               Baseline,
+               Burst,
+               Footprint,
+               Statistics.CacheSize);
+
+        SHIM_CHECK(Statistics.CacheSize == BaselineCacheSize);
+        SHIM_CHECK(Footprint <= Baseline + Slack);
+        SHIM_CHECK(Statistics.Trimmed - Trimmed == (ULONG64)(Burst - Footprint));
+    }
+
+    // A burst every interval never comes from the pool after the first
+    ReceiverTestTrimBurst(Adapter, Frame);
+    Burst = ReceiverTestTrimFootprint();
+
+    for (Cycle = 0; Cycle < RECEIVER_TEST_TRIM_CYCLES; Cycle++) {
+        for (Tick = 0; Tick < RECEIVER_TRIM_INTERVAL; Tick++) {
+            if (Tick == 0)
+                ReceiverTestTrimBurst(Adapter, Frame);
+
+            ReceiverTrim(Receiver);
+        }
+    }
+
+    SHIM_CHECK(ReceiverTestTrimFootprint() == Burst);
+
+    // Low memory frees the whole depot on the next tick
+    ReceiverQueryStatistics(Receiver, &Statistics);
+    SHIM_CHECK(Statistics.LowMemory == 0);
+
+    ShimSetLowMemory(TRUE);
+    ReceiverTrim(Receiver);
+    ShimSetLowMemory(FALSE);
+
+    Footprint = ReceiverTestTrimFootprint();
+    ReceiverQueryStatistics(Receiver, &Statistics);
+    SHIM_CHECK(Statistics.LowMemory == 1);
+    SHIM_CHECK(Statistics.CacheSize == 0);
+    SHIM_CHECK(Footprint <= Baseline - BaselineCacheSize + Slack);
+
+    printf("  low memory: %lld NET_BUFFER_LISTs\n", Footprint);
+
+    FrameFree(Frame);
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Pre-warming
+
+#define RECEIVER_TEST_PREWARM_PROCESSORS    8
+
+// Factors tried, up to beyond RECEIVER_PREWARM_MAXIMUM_FACTOR
+static const ULONG  ReceiverTestPrewarmFactor[] = { 0, 1, 2, 8, 12 };
+
+// Enabling the receiver fills the depot with the ring size times the
+// pre-warm factor, capped, of NET_BUFFER_LISTs. Processors then receive,
+// and NDIS holds, a ring's worth of frames each in turn: none of those
+// covered by the depot come from the pool, and every one after that does.
+static VOID
+ReceiverTestPrewarm(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PRECEIVER           Receiver;
+    PFRAME              Frame;
+    FRAME_PARAMETERS    Parameters;
+    RECEIVER_STATISTICS Statistics;
+    RECEIVER_TEST_HELD  Held;
+    CHAR                Assignment[32];
+    ULONG               Factor;
+    ULONG               Covered;
+    LONG64              Baseline;
+    LONG64              Allocated;
+    ULONG               Index;
+    ULONG               Processor;
+
+    Frame = FrameAllocate();
+    FrameDefaultParameters(&Parameters);
+    FrameBuild(Frame, &Parameters);
+
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestPrewarmFactor); Index++) {
+        Factor = ReceiverTestPrewarmFactor[Index];
+
+        snprintf(Assignment, sizeof (Assignment), "rx_prewarm_factor=%u", Factor);
+
+        // Copied frames carry NET_BUFFER_LISTs of their own, so copy nothing
+        Adapter = ReceiverTestCreateAdapter(RECEIVER_TEST_PREWARM_PROCESSORS, 0, NULL,
+                                            "rx_copy_break=0",
+                                            Assignment,
+                                            NULL);
+        Receiver = &Adapter->Receiver;
+        SHIM_CHECK(Receiver->RingSize == RECEIVER_TEST_MAXIMUM_BATCH);
+
+        // The number of rings the depot covers
+        Covered = (Factor < RECEIVER_PREWARM_MAXIMUM_FACTOR) ? Factor : RECEIVER_PREWARM_MAXIMUM_FACTOR;
+
+        ReceiverQueryStatistics(Receiver, &Statistics);
+        SHIM_CHECK(Statistics.CacheSize == Covered * Receiver->RingSize);
+        SHIM_CHECK(Statistics.CacheMiss == 0);
+
+        Baseline = ReceiverTestTrimFootprint();
+
+        ReceiverTestHoldStart(&Held);
+
+        for (Processor = 0; Processor < RECEIVER_TEST_PREWARM_PROCESSORS; Processor++) {
+            ULONG   Expected;
+
+            ShimSetCurrentProcessor(Processor);
+
+            SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_MAXIMUM_BATCH) ==
+                       RECEIVER_TEST_MAXIMUM_BATCH);
+
+            Expected = (Processor + 1 > Covered) ?
+                       (Processor + 1 - Covered) * Receiver->RingSize :
+                       0;
+
+            Allocated = ReceiverTestTrimFootprint() - Baseline;
+            ReceiverQueryStatistics(Receiver, &Statistics);
+            SHIM_CHECK(Allocated == Expected);
+            SHIM_CHECK(Statistics.CacheMiss == Expected);
+        }
+
+        ShimSetCurrentProcessor(0);
+        SHIM_CHECK(Held.Count == RECEIVER_TEST_PREWARM_PROCESSORS * RECEIVER_TEST_MAXIMUM_BATCH);
+
+        printf("  factor %u: depot %u NET_BUFFER_LISTs, %lld of %u frames needed one from the pool\n",
+               Factor,
+               Covered * Receiver->RingSize,
+               Allocated,
+               Held.Count);
+
+        ReceiverTestHoldRelease(Adapter, &Held);
+        HarnessSetReceiveHook(NULL, NULL);
+
+        ReceiverTestDestroyAdapter(Adapter);
+    }
+
+    FrameFree(Frame);
+}
+
+// VLAN filtering
+
+#define RECEIVER_TEST_VLAN_ROUNDS   400
+
+// What a replay through the filter should do with each tag
+typedef struct _RECEIVER_TEST_VLAN_TAG {
+    USHORT                  TagControlInformation;
+    RECEIVER_VLAN_VERDICT   Verdict;
+} RECEIVER_TEST_VLAN_TAG, *PRECEIVER_TEST_VLAN_TAG;
+
+#define RECEIVER_TEST_VLAN_TAG(_UserPriority, _VlanId, _Verdict)    \
+        { (USHORT)(((_UserPriority) << 13) | (_VlanId)), RECEIVER_VLAN_ ## _Verdict }
+
+// Filter holds VLANs 10, 100 and 4000
+static const RECEIVER_TEST_VLAN_TAG ReceiverTestVlanTag[] = {
+    RECEIVER_TEST_VLAN_TAG(0, 0, UNTAGGED),
+    RECEIVER_TEST_VLAN_TAG(0, 10, ACCEPTED),
+    RECEIVER_TEST_VLAN_TAG(0, 11, FILTERED),
+    RECEIVER_TEST_VLAN_TAG(5, 10, ACCEPTED),
+    RECEIVER_TEST_VLAN_TAG(0, 100, ACCEPTED),
+    RECEIVER_TEST_VLAN_TAG(0, 2000, FILTERED),
+    RECEIVER_TEST_VLAN_TAG(3, 0, UNTAGGED),
+    RECEIVER_TEST_VLAN_TAG(0, 4000, ACCEPTED),
+    RECEIVER_TEST_VLAN_TAG(0, 4095, INVALID),
+    RECEIVER_TEST_VLAN_TAG(7, 3999, FILTERED),
+    RECEIVER_TEST_VLAN_TAG(0, 4001, FILTERED),
+    RECEIVER_TEST_VLAN_TAG(0, 1, FILTERED),
+};
+
+// Indications, by the tag they carry
+typedef struct _RECEIVER_TEST_VLAN {
+    ULONG   Tagged;
+    ULONG   Untagged;
+    ULONG   Count[ARRAYSIZE(ReceiverTestVlanTag)];
+} RECEIVER_TEST_VLAN, *PRECEIVER_TEST_VLAN;
+
+static BOOLEAN
+ReceiverTestVlanIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_VLAN     Vlan = Argument;
+
+    UNREFERENCED_PARAMETER(Adapter);
+    UNREFERENCED_PARAMETER(Count);
+    UNREFERENCED_PARAMETER(Flags);
+
+    for (; NetBufferList != NULL; NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList)) {
+        NDIS_NET_BUFFER_LIST_8021Q_INFO Ieee8021QInfo;
+        USHORT                          TagControlInformation;
+        ULONG                           Index;
+
+        Ieee8021QInfo.Value = NET_BUFFER_LIST_INFO(NetBufferList, Ieee8021QNetBufferListInfo);
+        if (Ieee8021QInfo.Value == NULL) {
+            Vlan->Untagged++;
+            continue;
+        }
+
+        PACK_TAG_CONTROL_INFORMATION(TagControlInformation,
+                                     Ieee8021QInfo.TagHeader.UserPriority,
+                                     Ieee8021QInfo.TagHeader.CanonicalFormatId,
+                                     Ieee8021QInfo.TagHeader.VlanId);
+
+        for (Index = 0; Index < ARRAYSIZE(ReceiverTestVlanTag); Index++) {
+            if (ReceiverTestVlanTag[Index].TagControlInformation == TagControlInformation)
+                break;
+        }
+        SHIM_CHECK(Index < ARRAYSIZE(ReceiverTestVlanTag));
+
+        Vlan->Tagged++;
+        Vlan->Count[Index]++;
+    }
+
+    // Returned by the harness
+    return FALSE;
+}
+
+// Passes Count frames, taken from Frame[] in turn, to the receiver in one
+// callback.
+static ULONG
+ReceiverTestVlanReceive(
+    IN  PADAPTER    Adapter,
+    IN  PFRAME      *Frame,
+    IN  ULONG       FrameCount,
+    IN  ULONG       Count
+    )
+{
+    PFRAME          Batch[RECEIVER_TEST_MAXIMUM_BATCH];
+    ULONG           Received;
+    ULONG           Index;
+    KIRQL           Irql;
+
+    SHIM_CHECK(Count <= RECEIVER_TEST_MAXIMUM_BATCH);
+
+    for (Index = 0; Index < Count; Index++)
+        Batch[Index] = Frame[Index % FrameCount];
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    Received = MockVifReceivePackets(Adapter->VifInterface, Batch, Count);
+    KeLowerIrql(Irql);
+
+    return Received;
+}
+
+// Nanoseconds per frame to receive Rounds batches of Frame
+static double
+ReceiverTestVlanCost(
+    IN  PADAPTER    Adapter,
+    IN  PFRAME      Frame
+    )
+{
+    ULONG64         Start;
+    ULONG           Round;
+
+    Start = ShimQueryClock();
+
+    for (Round = 0; Round < RECEIVER_TEST_VLAN_ROUNDS; Round++)
+        SHIM_CHECK(ReceiverTestReceive(Adapter, Frame, RECEIVER_TEST_MAXIMUM_BATCH) ==
+                   RECEIVER_TEST_MAXIMUM_BATCH);
+
+    return (double)(ShimQueryClock() - Start) /
+           ((double)RECEIVER_TEST_VLAN_ROUNDS * RECEIVER_TEST_MAXIMUM_BATCH);
+}
+
+// A replay of mixed-VLAN traffic is filtered exactly: frames for VLANs in
+// the filter are indicated with their tag, the rest are counted by reason
+// and dropped without a NET_BUFFER_LIST being taken for them. The cost of
+// a drop is measured against that of an indication.
+static VOID
+ReceiverTestVlan(
+    VOID
+    )
+{
+    PADAPTER                Adapter;
+    PRECEIVER               Receiver;
+    PFRAME                  Frame[ARRAYSIZE(ReceiverTestVlanTag)];
+    FRAME_PARAMETERS        Parameters;
+    RECEIVER_VLAN_FILTER    Filter;
+    RECEIVER_TEST_VLAN      Vlan;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    ULONG                   Expected[RECEIVER_VLAN_INVALID + 1];
+    ULONG                   Count;
+    ULONG                   Index;
+    double                  Accepted;
+    double                  Filtered;
+    double                  Untagged;
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_copy_break=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    // VLAN IDs 0 and 0xFFF are never in the filter
+    RtlZeroMemory(&Filter, sizeof (Filter));
+    Filter.Bitmap[0] = 1ul | (1ul << 10);
+    Filter.Bitmap[100 / 32] |= 1ul << (100 % 32);
+    Filter.Bitmap[4000 / 32] |= 1ul << (4000 % 32);
+    Filter.Bitmap[ARRAYSIZE(Filter.Bitmap) - 1] = 1ul << 31;
+    ReceiverSetVlanFilter(Receiver, &Filter);
+
+    ReceiverQueryVlanFilter(Receiver, &Filter);
+    SHIM_CHECK(Filter.Bitmap[0] == (1ul << 10));
+    SHIM_CHECK(Filter.Bitmap[ARRAYSIZE(Filter.Bitmap) - 1] == 0);
+
+    FrameDefaultParameters(&Parameters);
+
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestVlanTag); Index++) {
+        Frame[Index] = FrameAllocate();
+        FrameBuild(Frame[Index], &Parameters);
+        Frame[Index]->TagControlInformation = ReceiverTestVlanTag[Index].TagControlInformation;
+    }
+
+    // A full batch takes each tag in turn, some more often than others
+    RtlZeroMemory(Expected, sizeof (Expected));
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        Expected[ReceiverTestVlanTag[Index % ARRAYSIZE(ReceiverTestVlanTag)].Verdict]++;
+
+    RtlZeroMemory(&Vlan, sizeof (Vlan));
+    HarnessSetReceiveHook(ReceiverTestVlanIndicate, &Vlan);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+    Count = ReceiverTestVlanReceive(Adapter, Frame, ARRAYSIZE(Frame), RECEIVER_TEST_MAXIMUM_BATCH);
+    ReceiverQueryStatistics(Receiver, &After);
+
+    SHIM_CHECK(Count == RECEIVER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == 0);
+
+    SHIM_CHECK(Vlan.Untagged + Vlan.Tagged ==
+               Expected[RECEIVER_VLAN_UNTAGGED] + Expected[RECEIVER_VLAN_ACCEPTED]);
+    SHIM_CHECK(After.VlanAccepted - Before.VlanAccepted == Expected[RECEIVER_VLAN_ACCEPTED]);
+    SHIM_CHECK(After.VlanFiltered - Before.VlanFiltered == Expected[RECEIVER_VLAN_FILTERED]);
+    SHIM_CHECK(After.VlanInvalid - Before.VlanInvalid == Expected[RECEIVER_VLAN_INVALID]);
+
+    // Each frame that is indicated carries its own priority and VLAN, and
+    // only a frame with neither carries no tag at all
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestVlanTag); Index++) {
+        const RECEIVER_TEST_VLAN_TAG    *Tag = &ReceiverTestVlanTag[Index];
+        ULONG                           Occurrences;
+
+        Occurrences = (RECEIVER_TEST_MAXIMUM_BATCH / ARRAYSIZE(ReceiverTestVlanTag)) +
+                      ((Index < RECEIVER_TEST_MAXIMUM_BATCH % ARRAYSIZE(ReceiverTestVlanTag)) ? 1 : 0);
+
+        if (Tag->TagControlInformation == 0)
+            SHIM_CHECK(Vlan.Untagged == Occurrences);
+
+        SHIM_CHECK(Vlan.Count[Index] ==
+                   ((Tag->Verdict == RECEIVER_VLAN_ACCEPTED ||
+                     (Tag->Verdict == RECEIVER_VLAN_UNTAGGED &&
+                      Tag->TagControlInformation != 0)) ? Occurrences : 0));
+    }
+
+    // NET_BUFFER_LISTs are only taken for what is indicated
+    SHIM_CHECK((After.CacheHit + After.CacheMiss) - (Before.CacheHit + Before.CacheMiss) ==
+               Expected[RECEIVER_VLAN_UNTAGGED] + Expected[RECEIVER_VLAN_ACCEPTED]);
+
+    // A single VLAN replaces the filter; 0xFFF cannot be one
+    SHIM_CHECK(ReceiverSetVlanId(Receiver, RECEIVER_VLAN_ID_COUNT - 1) == NDIS_STATUS_INVALID_DATA);
+    SHIM_CHECK(ReceiverSetVlanId(Receiver, 11) == NDIS_STATUS_SUCCESS);
+
+    RtlZeroMemory(&Vlan, sizeof (Vlan));
+    SHIM_CHECK(ReceiverTestVlanReceive(Adapter, Frame, ARRAYSIZE(Frame), ARRAYSIZE(Frame)) ==
+               ARRAYSIZE(Frame));
+    SHIM_CHECK(Vlan.Count[2] == 1);
+    SHIM_CHECK(Vlan.Tagged == 2);   // Including the priority-tagged frame
+
+    HarnessSetReceiveHook(NULL, NULL);
+
+    // Drops against indications of the same frames
+    SHIM_CHECK(ReceiverSetVlanId(Receiver, 10) == NDIS_STATUS_SUCCESS);
+
+    Untagged = ReceiverTestVlanCost(Adapter, Frame[0]);
+    Accepted = ReceiverTestVlanCost(Adapter, Frame[1]);
+    Filtered = ReceiverTestVlanCost(Adapter, Frame[2]);
+
+    printf("  untagged %.1f accepted %.1f filtered %.1f ns per frame\n",
+           Untagged,
+           Accepted,
+           Filtered);
+
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTestVlanTag); Index++)
+        FrameFree(Frame[Index]);
+
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Multicast filtering
+
+#define RECEIVER_TEST_MULTICAST_PROBES  100000
+
+static ULONG64  ReceiverTestMulticastState = 0x2545F4914F6CDD1Dull;
+
+// Keeps the benchmarked lookups from being optimized away
+static volatile ULONG   ReceiverTestMulticastSink;
+
+static ULONG
+ReceiverTestMulticastRandom(
+    VOID
+    )
+{
+    // xorshift64*
+    ReceiverTestMulticastState ^= ReceiverTestMulticastState >> 12;
+    ReceiverTestMulticastState ^= ReceiverTestMulticastState << 25;
+    ReceiverTestMulticastState ^= ReceiverTestMulticastState >> 27;
+
+    return (ULONG)((ReceiverTestMulticastState * 2685821657736338717ull) >> 32);
+}
+
+// Half IPv4 groups (01:00:5e plus 23 bits), half anything with the group
+// bit set
+static VOID
+ReceiverTestMulticastAddress(
+    OUT PETHERNET_ADDRESS   Address
+    )
+{
+    ULONG                   Index;
+
+    for (Index = 0; Index < ETHERNET_ADDRESS_LENGTH; Index++)
+        Address->Byte[Index] = (UCHAR)ReceiverTestMulticastRandom();
+
+    if (ReceiverTestMulticastRandom() & 1) {
+        Address->Byte[0] = 0x01;
+        Address->Byte[1] = 0x00;
+        Address->Byte[2] = 0x5e;
+        Address->Byte[3] &= 0x7f;
+    } else {
+        Address->Byte[0] |= 0x01;
+    }
+
+    // Not the broadcast address
+    if (GET_ETHERNET_ADDRESS_TYPE(Address) != ETHERNET_ADDRESS_MULTICAST)
+        Address->Byte[5] ^= 0x01;
+}
+
+static int
+ReceiverTestMulticastCompare(
+    const void  *First,
+    const void  *Second
+    )
+{
+    return memcmp(First, Second, sizeof (ETHERNET_ADDRESS));
+}
+
+// Exact membership, by binary search of the sorted list
+static BOOLEAN
+ReceiverTestMulticastMember(
+    IN  PETHERNET_ADDRESS   Sorted,
+    IN  ULONG               Count,
+    IN  PETHERNET_ADDRESS   Address
+    )
+{
+    return (bsearch(Address,
+                    Sorted,
+                    Count,
+                    sizeof (ETHERNET_ADDRESS),
+                    ReceiverTestMulticastCompare) != NULL) ? TRUE : FALSE;
+}
+
+// Nanoseconds per lookup of Count addresses
+static double
+ReceiverTestMulticastCost(
+    IN  PRECEIVER_MULTICAST_FILTER  Filter,
+    IN  PETHERNET_ADDRESS           Address,
+    IN  ULONG                       Count
+    )
+{
+    ULONG64                         Start;
+    ULONG                           Probe;
+    ULONG                           Accepted;
+
+    Accepted = 0;
+    Start = ShimQueryClock();
+
+    for (Probe = 0; Probe < RECEIVER_TEST_MULTICAST_PROBES; Probe++)
+        Accepted += __ReceiverMulticastAccept(Filter, &Address[Probe % Count]);
+
+    ReceiverTestMulticastSink = Accepted;
+
+    return (double)(ShimQueryClock() - Start) / RECEIVER_TEST_MULTICAST_PROBES;
+}
+
+// What is queried back is the list without its repeats
+static VOID
+ReceiverTestMulticastQuery(
+    IN  PRECEIVER           Receiver,
+    IN  PETHERNET_ADDRESS   Sorted,
+    IN  ULONG               Count
+    )
+{
+    PETHERNET_ADDRESS       Queried;
+    ULONG                   QueriedCount;
+
+    QueriedCount = 0;
+    ReceiverQueryMulticastAddresses(Receiver, NULL, &QueriedCount);
+    SHIM_CHECK(QueriedCount == Count);
+
+    Queried = calloc(Count, sizeof (ETHERNET_ADDRESS));
+    SHIM_CHECK(Queried != NULL);
+
+    ReceiverQueryMulticastAddresses(Receiver, Queried, &QueriedCount);
+    SHIM_CHECK(QueriedCount == Count);
+
+    qsort(Queried, Count, sizeof (ETHERNET_ADDRESS), ReceiverTestMulticastCompare);
+    SHIM_CHECK(memcmp(Queried, Sorted, Count * sizeof (ETHERNET_ADDRESS)) == 0);
+
+    free(Queried);
+}
+
+// A frame for each of Count destinations, received in one batch
+static VOID
+ReceiverTestMulticastReceive(
+    IN  PADAPTER            Adapter,
+    IN  PETHERNET_ADDRESS   Address,
+    IN  ULONG               Count
+    )
+{
+    PFRAME                  Frame[RECEIVER_TEST_MAXIMUM_BATCH];
+    FRAME_PARAMETERS        Parameters;
+    ULONG                   Index;
+    KIRQL                   Irql;
+
+    SHIM_CHECK(Count <= RECEIVER_TEST_MAXIMUM_BATCH);
+
+    FrameDefaultParameters(&Parameters);
+
+    for (Index = 0; Index < Count; Index++) {
+        Parameters.DestinationAddress = Address[Index];
+
+        Frame[Index] = FrameAllocate();
+        FrameBuild(Frame[Index], &Parameters);
+    }
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, Frame, Count) == Count);
+    KeLowerIrql(Irql);
+
+    for (Index = 0; Index < Count; Index++)
+        FrameFree(Frame[Index]);
+}
+
+// In the receive path, frames for the Count groups of Address are
+// indicated and those for other groups dropped; broadcast and unicast
+// frames are not the filter's business.
+static VOID
+ReceiverTestMulticastFilter(
+    IN  PADAPTER            Adapter,
+    IN  PETHERNET_ADDRESS   Address,
+    IN  ULONG               Count
+    )
+{
+    PRECEIVER               Receiver = &Adapter->Receiver;
+    ETHERNET_ADDRESS        Destination[RECEIVER_TEST_MAXIMUM_BATCH];
+    FRAME_PARAMETERS        Parameters;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    HARNESS_STATISTICS      Indicated;
+    ULONG64                 IndicatedBefore;
+    ULONG                   Expected;
+    ULONG                   Index;
+
+    SHIM_CHECK(ReceiverSetMulticastAddresses(Receiver, Address, Count) == NDIS_STATUS_SUCCESS);
+    ReceiverEnableMulticastFilter(Receiver, TRUE);
+
+    FrameDefaultParameters(&Parameters);
+
+    Expected = 0;
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++) {
+        switch (Index % 4) {
+        case 0:
+            Destination[Index] = Address[Index % Count];
+            Expected++;
+            break;
+
+        case 1:
+            ReceiverTestMulticastAddress(&Destination[Index]);
+            SHIM_CHECK(!__ReceiverMulticastAccept(Receiver->MulticastFilter, &Destination[Index]));
+            break;
+
+        case 2:
+            memset(&Destination[Index], 0xff, sizeof (ETHERNET_ADDRESS));
+            Expected++;
+            break;
+
+        default:
+            Destination[Index] = Parameters.DestinationAddress;
+            Expected++;
+            break;
+        }
+    }
+
+    ReceiverQueryStatistics(Receiver, &Before);
+    HarnessQueryStatistics(&Indicated);
+    IndicatedBefore = Indicated.IndicatedNetBufferLists;
+
+    ReceiverTestMulticastReceive(Adapter, Destination, RECEIVER_TEST_MAXIMUM_BATCH);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    HarnessQueryStatistics(&Indicated);
+
+    SHIM_CHECK(Indicated.IndicatedNetBufferLists - IndicatedBefore == Expected);
+    SHIM_CHECK(After.MulticastFiltered - Before.MulticastFiltered ==
+               RECEIVER_TEST_MAXIMUM_BATCH - Expected);
+
+    // Disabled, nothing is dropped
+    ReceiverEnableMulticastFilter(Receiver, FALSE);
+
+    IndicatedBefore = Indicated.IndicatedNetBufferLists;
+    ReceiverTestMulticastReceive(Adapter, Destination, RECEIVER_TEST_MAXIMUM_BATCH);
+    HarnessQueryStatistics(&Indicated);
+
+    SHIM_CHECK(Indicated.IndicatedNetBufferLists - IndicatedBefore == RECEIVER_TEST_MAXIMUM_BATCH);
+}
+
+// The software multicast filter accepts exactly the groups in its list,
+// at list sizes from what the backend could hold to well beyond what is
+// advertised, and drops frames for other groups in the receive path. The
+// cost of a lookup is measured for members and non-members at each size.
+static VOID
+ReceiverTestMulticast(
+    VOID
+    )
+{
+    static const ULONG      GroupCount[] = { 32, 1024, 10000 };
+    PADAPTER                Adapter;
+    PRECEIVER               Receiver;
+    PETHERNET_ADDRESS       Address;
+    PETHERNET_ADDRESS       Sorted;
+    PETHERNET_ADDRESS       Probe;
+    ETHERNET_ADDRESS        Unicast;
+    ULONG                   Size;
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL, NULL);
+    Receiver = &Adapter->Receiver;
+
+    Address = calloc(GroupCount[ARRAYSIZE(GroupCount) - 1], sizeof (ETHERNET_ADDRESS));
+    Sorted = calloc(GroupCount[ARRAYSIZE(GroupCount) - 1], sizeof (ETHERNET_ADDRESS));
+    Probe = calloc(RECEIVER_TEST_MULTICAST_PROBES, sizeof (ETHERNET_ADDRESS));
+    SHIM_CHECK(Address != NULL && Sorted != NULL && Probe != NULL);
+
+    for (Size = 0; Size < ARRAYSIZE(GroupCount); Size++) {
+        PRECEIVER_MULTICAST_FILTER  Filter;
+        ULONG                       Count = GroupCount[Size];
+        ULONG                       Unique;
+        ULONG                       Index;
+        ULONG                       Members;
+        double                      Hit;
+        double                      Miss;
+
+        // With some repeats, which are only held once
+        for (Index = 0; Index < Count; Index++) {
+            if (Index != 0 && ReceiverTestMulticastRandom() % 16 == 0)
+                Address[Index] = Address[ReceiverTestMulticastRandom() % Index];
+            else
+                ReceiverTestMulticastAddress(&Address[Index]);
+        }
+
+        memcpy(Sorted, Address, Count * sizeof (ETHERNET_ADDRESS));
+        qsort(Sorted, Count, sizeof (ETHERNET_ADDRESS), ReceiverTestMulticastCompare);
+
+        Unique = 0;
+        for (Index = 0; Index < Count; Index++) {
+            if (Unique == 0 ||
+                ReceiverTestMulticastCompare(&Sorted[Unique - 1], &Sorted[Index]) != 0)
+                Sorted[Unique++] = Sorted[Index];
+        }
+
+        SHIM_CHECK(ReceiverSetMulticastAddresses(Receiver, Address, Count) == NDIS_STATUS_SUCCESS);
+        Filter = Receiver->MulticastFilter;
+        SHIM_CHECK(Filter != NULL && Filter->Count == Unique);
+        SHIM_CHECK(Filter->Size >= 2 * Unique);
+
+        ReceiverTestMulticastQuery(Receiver, Sorted, Unique);
+
+        // Every member, each member with one bit flipped, and random groups
+        for (Index = 0; Index < Count; Index++)
+            SHIM_CHECK(__ReceiverMulticastAccept(Filter, &Address[Index]));
+
+        Members = 0;
+        for (Index = 0; Index < RECEIVER_TEST_MULTICAST_PROBES; Index++) {
+            BOOLEAN Member;
+
+            if (Index % 2 == 0) {
+                ULONG   Bit = 1 + (ReceiverTestMulticastRandom() % ((ETHERNET_ADDRESS_LENGTH * 8) - 1));
+
+                Probe[Index] = Address[ReceiverTestMulticastRandom() % Count];
+                Probe[Index].Byte[Bit / 8] ^= (UCHAR)(1 << (Bit % 8));
+            } else {
+                ReceiverTestMulticastAddress(&Probe[Index]);
+            }
+
+            Member = ReceiverTestMulticastMember(Sorted, Unique, &Probe[Index]);
+            SHIM_CHECK(__ReceiverMulticastAccept(Filter, &Probe[Index]) == Member);
+
+            if (Member)
+                Members++;
+        }
+
+        // Timed over as many addresses each way so that both miss the
+        // processor cache as often
+        for (Index = 0; Index < RECEIVER_TEST_MULTICAST_PROBES; Index++)
+            Probe[Index] = Address[ReceiverTestMulticastRandom() % Count];
+
+        Hit = ReceiverTestMulticastCost(Filter, Probe, RECEIVER_TEST_MULTICAST_PROBES);
+
+        for (Index = 0; Index < RECEIVER_TEST_MULTICAST_PROBES; Index++) {
+            do {
+                ReceiverTestMulticastAddress(&Probe[Index]);
+            } while (ReceiverTestMulticastMember(Sorted, Unique, &Probe[Index]));
+        }
+
+        Miss = ReceiverTestMulticastCost(Filter, Probe, RECEIVER_TEST_MULTICAST_PROBES);
+
+        printf("  %5u groups (%5u slots): member %.1f non-member %.1f ns per lookup, %u of %u probes members\n",
+               Unique,
+               Filter->Size,
+               Hit,
+               Miss,
+               Members,
+               RECEIVER_TEST_MULTICAST_PROBES);
+    }
+
+    // Only multicast groups may be listed, and a bad list leaves the old one
+    Size = GroupCount[ARRAYSIZE(GroupCount) - 1];
+    Unicast = Address[0];
+    Address[0].Byte[0] &= ~0x01;
+
+    SHIM_CHECK(ReceiverSetMulticastAddresses(Receiver, Address, Size) == NDIS_STATUS_INVALID_DATA);
+    SHIM_CHECK(__ReceiverMulticastAccept(Receiver->MulticastFilter, &Unicast));
+
+    Address[0] = Unicast;
+    ReceiverTestMulticastFilter(Adapter, Address, 1024);
+
+    SHIM_CHECK(ReceiverSetMulticastAddresses(Receiver, NULL, 0) == NDIS_STATUS_SUCCESS);
+    SHIM_CHECK(Receiver->MulticastFilter == NULL);
+
+    free(Probe);
+    free(Sorted);
+    free(Address);
+
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Storm control
+
+#define RECEIVER_TEST_STORM_BROADCAST_RATE  2000
+#define RECEIVER_TEST_STORM_MULTICAST_RATE  500
+
+// Receives the given numbers of unicast, broadcast and multicast frames,
+// interleaved, in one callback and checks that all the unicast frames and
+// the given numbers of the others were indicated, and that the rest were
+// counted as suppressed.
+static VOID
+ReceiverTestStormRun(
+    IN  PADAPTER            Adapter,
+    IN  ULONG               Unicast,
+    IN  ULONG               Broadcast,
+    IN  ULONG               Multicast,
+    IN  ULONG               BroadcastIndicated,
+    IN  ULONG               MulticastIndicated
+    )
+{
+    static ETHERNET_ADDRESS Group = { { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 } };
+    PFRAME                  Frame[RECEIVER_TEST_MAXIMUM_BATCH];
+    ULONG                   Remaining[ETHERNET_ADDRESS_TYPE_COUNT];
+    FRAME_PARAMETERS        Parameters;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    HARNESS_STATISTICS      IndicatedBefore;
+    HARNESS_STATISTICS      IndicatedAfter;
+    ETHERNET_ADDRESS_TYPE   Type;
+    ULONG                   Count;
+    ULONG                   Index;
+    KIRQL                   Irql;
+
+    Count = Unicast + Broadcast + Multicast;
+    SHIM_CHECK(Count <= RECEIVER_TEST_MAXIMUM_BATCH);
+
+    RtlZeroMemory(Remaining, sizeof (Remaining));
+    Remaining[ETHERNET_ADDRESS_UNICAST] = Unicast;
+    Remaining[ETHERNET_ADDRESS_BROADCAST] = Broadcast;
+    Remaining[ETHERNET_ADDRESS_MULTICAST] = Multicast;
+
+    FrameDefaultParameters(&Parameters);
+
+    Type = ETHERNET_ADDRESS_UNICAST;
+    for (Index = 0; Index < Count; Index++) {
+        FRAME_PARAMETERS    Destination = Parameters;
+
+        // Take each class in turn while it has frames left
+        do {
+            Type = (Type + 1) % ETHERNET_ADDRESS_TYPE_COUNT;
+        } while (Remaining[Type] == 0);
+        Remaining[Type]--;
+
+        if (Type == ETHERNET_ADDRESS_BROADCAST)
+            memset(&Destination.DestinationAddress, 0xff, sizeof (ETHERNET_ADDRESS));
+        else if (Type == ETHERNET_ADDRESS_MULTICAST)
+            Destination.DestinationAddress = Group;
+
+        Frame[Index] = FrameAllocate();
+        FrameBuild(Frame[Index], &Destination);
+    }
+
+    ReceiverQueryStatistics(&Adapter->Receiver, &Before);
+    HarnessQueryStatistics(&IndicatedBefore);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, Frame, Count) == Count);
+    KeLowerIrql(Irql);
+
+    ReceiverQueryStatistics(&Adapter->Receiver, &After);
+    HarnessQueryStatistics(&IndicatedAfter);
+
+    SHIM_CHECK(IndicatedAfter.IndicatedNetBufferLists - IndicatedBefore.IndicatedNetBufferLists ==
+               Unicast + BroadcastIndicated + MulticastIndicated);
+    SHIM_CHECK(After.BroadcastSuppressed - Before.BroadcastSuppressed ==
+               Broadcast - BroadcastIndicated);
+    SHIM_CHECK(After.MulticastSuppressed - Before.MulticastSuppressed ==
+               Multicast - MulticastIndicated);
+
+    for (Index = 0; Index < Count; Index++)
+        FrameFree(Frame[Index]);
+}
+
+// On the shim's manual clock, a burst of broadcast or multicast frames
+// over the limit has exactly the burst allowance indicated, and credit
+// then comes back at the configured rate, up to the burst allowance
+// again. Each class has its own bucket, unicast frames are never held
+// back and a rate of 0 lifts the limit.
+static VOID
+ReceiverTestStorm(
+    VOID
+    )
+{
+    PADAPTER            Adapter;
+    PRECEIVER           Receiver;
+    ULONG               BroadcastBurst;
+    ULONG               MulticastBurst;
+
+    // A tenth of a second's worth for broadcasts, the minimum for
+    // multicasts
+    BroadcastBurst = RECEIVER_TEST_STORM_BROADCAST_RATE / 10;
+    MulticastBurst = RECEIVER_STORM_MINIMUM_BURST;
+    SHIM_CHECK(BroadcastBurst > RECEIVER_STORM_MINIMUM_BURST);
+    SHIM_CHECK(RECEIVER_TEST_STORM_MULTICAST_RATE / 10 < RECEIVER_STORM_MINIMUM_BURST);
+
+    // The buckets are filled when the receiver is enabled
+    ShimSetManualClock(TRUE);
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_broadcast_limit=2000",
+                                        "rx_multicast_limit=500",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+    SHIM_CHECK(Receiver->Storm[ETHERNET_ADDRESS_BROADCAST].Rate == RECEIVER_TEST_STORM_BROADCAST_RATE);
+    SHIM_CHECK(Receiver->Storm[ETHERNET_ADDRESS_MULTICAST].Rate == RECEIVER_TEST_STORM_MULTICAST_RATE);
+    SHIM_CHECK(Receiver->Storm[ETHERNET_ADDRESS_UNICAST].Rate == 0);
+
+    // A burst over the allowance, and nothing more while the clock stands
+    // still, whatever unicast traffic comes with it
+    ReceiverTestStormRun(Adapter, 0, 256, 0, BroadcastBurst, 0);
+    ReceiverTestStormRun(Adapter, 128, 128, 0, 0, 0);
+    ReceiverTestStormRun(Adapter, 0, 0, 256, 0, MulticastBurst);
+    ReceiverTestStormRun(Adapter, 86, 85, 85, 0, 0);
+
+    // 10ms of credit at each rate
+    ShimAdvanceClock(SHIM_CLOCK_FREQUENCY / 100);
+    ReceiverTestStormRun(Adapter, 0, 64, 64,
+                         RECEIVER_TEST_STORM_BROADCAST_RATE / 100,
+                         RECEIVER_TEST_STORM_MULTICAST_RATE / 100);
+
+    // Credit accrues across quiet callbacks too
+    ShimAdvanceClock(SHIM_CLOCK_FREQUENCY / 100);
+    ReceiverTestStormRun(Adapter, 16, 0, 0, 0, 0);
+    ShimAdvanceClock(SHIM_CLOCK_FREQUENCY / 100);
+    ReceiverTestStormRun(Adapter, 0, 128, 128,
+                         2 * RECEIVER_TEST_STORM_BROADCAST_RATE / 100,
+                         2 * RECEIVER_TEST_STORM_MULTICAST_RATE / 100);
+
+    // A frame within the allowance is indicated as soon as there is credit
+    // for it, and not before
+    ShimAdvanceClock(SHIM_CLOCK_FREQUENCY / RECEIVER_TEST_STORM_BROADCAST_RATE - 1);
+    ReceiverTestStormRun(Adapter, 0, 1, 0, 0, 0);
+    ShimAdvanceClock(1);
+    ReceiverTestStormRun(Adapter, 0, 2, 0, 1, 0);
+
+    // A long quiet spell gives back no more than the allowance
+    ShimAdvanceClock(60 * SHIM_CLOCK_FREQUENCY);
+    ReceiverTestStormRun(Adapter, 0, 256, 0, BroadcastBurst, 0);
+    ReceiverTestStormRun(Adapter, 0, 0, 256, 0, MulticastBurst);
+
+    // A rate of 0 lifts each limit in turn
+    ReceiverConfigureStormControl(Receiver, ETHERNET_ADDRESS_BROADCAST, 0);
+    SHIM_CHECK(Receiver->StormControl);
+    ReceiverTestStormRun(Adapter, 0, 128, 128, 128, 0);
+
+    ReceiverConfigureStormControl(Receiver, ETHERNET_ADDRESS_MULTICAST, 0);
+    SHIM_CHECK(!Receiver->StormControl);
+    ReceiverTestStormRun(Adapter, 86, 85, 85, 85, 85);
+
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // As it is by default
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL, NULL);
+    SHIM_CHECK(!Adapter->Receiver.StormControl);
+    ReceiverTestStormRun(Adapter, 0, 128, 128, 128, 128);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    ShimSetManualClock(FALSE);
+}
+
+// Receive indication hints
+
+#define RECEIVER_TEST_HINT_BATCHES  64
+#define RECEIVER_TEST_HINT_PAYLOAD  32
+
+typedef struct _RECEIVER_TEST_HINT_CLASS {
+    UCHAR                   IpVersion;
+    USHORT                  TagControlInformation;
+    BOOLEAN                 Length;     // TypeOrLength holds a length, so there is no EtherType
+    BOOLEAN                 Tagged;     // The backend left the tag in the frame
+    ETHERNET_ADDRESS_TYPE   Type;
+} RECEIVER_TEST_HINT_CLASS, *PRECEIVER_TEST_HINT_CLASS;
+
+// The filter holds VLANs 10 and 20. Priority-tagged frames share the
+// untagged frames' VLAN ID of 0.
+static const RECEIVER_TEST_HINT_CLASS   ReceiverTestHintClass[] = {
+    { 4, 0, FALSE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 6, 0, FALSE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 4, 10, FALSE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 6, 10, FALSE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 4, 20, FALSE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 4, (3 << 13), FALSE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 4, 0, TRUE, FALSE, ETHERNET_ADDRESS_UNICAST },
+    { 4, 0, FALSE, TRUE, ETHERNET_ADDRESS_UNICAST },
+    { 6, 0, FALSE, TRUE, ETHERNET_ADDRESS_UNICAST },
+    { 4, 0, FALSE, FALSE, ETHERNET_ADDRESS_MULTICAST },
+    { 6, 10, FALSE, FALSE, ETHERNET_ADDRESS_MULTICAST },
+    { 4, 0, FALSE, FALSE, ETHERNET_ADDRESS_BROADCAST },
+};
+
+// The group the multicast frames are sent to, which the receiver's own
+// filter lists
+static ETHERNET_ADDRESS ReceiverTestHintGroup = {
+    { 0x01, 0x00, 0x5E, 0x00, 0x00, 0x01 }
+};
+
+static const ULONG  ReceiverTestHintRunLength[] = { 1, 1, 2, 3, 4, 5, 8, 30 };
+
+typedef struct _RECEIVER_TEST_HINT {
+    ULONG   Next;           // Sequence number expected next
+    ULONG   Indications;
+    ULONG   SingleEtherType;
+    ULONG   SingleVlan;
+    ULONG   Hinted;         // NET_BUFFER_LISTs indicated with hints
+    ULONG   PerfectFiltered;
+    BOOLEAN HashFilter;     // The receiver filters multicast itself
+} RECEIVER_TEST_HINT, *PRECEIVER_TEST_HINT;
+
+// A NET_BUFFER_LIST's EtherType (or 0), VLAN ID and sequence number, read
+// back from the frame and its 802.1Q info. A frame that still holds its
+// tag has no EtherType, as far as the hints go.
+static VOID
+ReceiverTestHintRead(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    OUT PULONG              FrameType,
+    OUT PULONG              VlanId,
+    OUT PULONG              Sequence
+    )
+{
+    NDIS_NET_BUFFER_LIST_8021Q_INFO Ieee8021QInfo;
+    UCHAR                           Data[256];
+    ULONG                           Length;
+    ULONG                           Offset;
+    BOOLEAN                         Tagged;
+
+    Length = HarnessCopyNetBuffer(NetBufferList, Data, sizeof (Data));
+
+    Offset = FIELD_OFFSET(ETHERNET_UNTAGGED_HEADER, TypeOrLength);
+
+    *FrameType = ((ULONG)Data[Offset] << 8) | Data[Offset + 1];
+
+    Tagged = (*FrameType == ETHERTYPE_TPID) ? TRUE : FALSE;
+    if (Tagged) {
+        Offset += sizeof (ETHERNET_TAG);
+        *FrameType = ((ULONG)Data[Offset] << 8) | Data[Offset + 1];
+    }
+
+    Offset += sizeof (USHORT) +
+              ((*FrameType == ETHERTYPE_IPV6) ? sizeof (IPV6_HEADER) : sizeof (IPV4_HEADER));
+
+    if (*FrameType < RECEIVER_MINIMUM_ETHERTYPE || Tagged)
+        *FrameType = 0;
+
+    Ieee8021QInfo.Value = NET_BUFFER_LIST_INFO(NetBufferList, Ieee8021QNetBufferListInfo);
+    *VlanId = Ieee8021QInfo.TagHeader.VlanId;
+
+    // Carried in the TCP source port
+    SHIM_CHECK(Offset + sizeof (TCP_HEADER) <= Length);
+    *Sequence = ((ULONG)Data[Offset] << 8) | Data[Offset + 1];
+}
+
+// Whether a frame passed only exact filters: those its tag was left in
+// never met the VLAN filter, and while the receiver filters multicast
+// itself the backend passes every group.
+static BOOLEAN
+ReceiverTestHintPerfect(
+    IN  PNET_BUFFER_LIST        NetBufferList,
+    IN  BOOLEAN                 HashFilter
+    )
+{
+    UCHAR                       Data[256];
+    PETHERNET_UNTAGGED_HEADER   EthernetHeader;
+
+    (VOID) HarnessCopyNetBuffer(NetBufferList, Data, sizeof (Data));
+    EthernetHeader = (PETHERNET_UNTAGGED_HEADER)Data;
+
+    if (EthernetHeader->TypeOrLength == HTONS(ETHERTYPE_TPID))
+        return FALSE;
+
+    if (HashFilter &&
+        GET_ETHERNET_ADDRESS_TYPE(&EthernetHeader->DestinationAddress) == ETHERNET_ADDRESS_MULTICAST)
+        return FALSE;
+
+    return TRUE;
+}
+
+static BOOLEAN
+ReceiverTestHintIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_HINT     Hint = Argument;
+    BOOLEAN                 SingleEtherType;
+    BOOLEAN                 SingleVlan;
+    BOOLEAN                 PerfectFiltered;
+    BOOLEAN                 Perfect;
+    ULONG                   FirstFrameType;
+    ULONG                   FirstVlanId;
+    ULONG                   RunKey;
+    ULONG                   RunCount;
+    ULONG                   Index;
+
+    UNREFERENCED_PARAMETER(Adapter);
+
+    SingleEtherType = (Flags & NDIS_RECEIVE_FLAGS_SINGLE_ETHER_TYPE) ? TRUE : FALSE;
+    SingleVlan = (Flags & NDIS_RECEIVE_FLAGS_SINGLE_VLAN) ? TRUE : FALSE;
+    PerfectFiltered = (Flags & NDIS_RECEIVE_FLAGS_PERFECT_FILTERED) ? TRUE : FALSE;
+
+    Hint->Indications++;
+    if (SingleEtherType)
+        Hint->SingleEtherType++;
+    if (SingleVlan)
+        Hint->SingleVlan++;
+    if (SingleEtherType || SingleVlan)
+        Hint->Hinted += Count;
+    if (PerfectFiltered)
+        Hint->PerfectFiltered++;
+
+    Perfect = TRUE;
+    FirstFrameType = 0;
+    FirstVlanId = 0;
+    RunKey = 0;
+    RunCount = 0;
+
+    for (Index = 0; Index < Count; Index++) {
+        ULONG   FrameType;
+        ULONG   VlanId;
+        ULONG   Sequence;
+        ULONG   Key;
+
+        SHIM_CHECK(NetBufferList != NULL);
+        ReceiverTestHintRead(NetBufferList, &FrameType, &VlanId, &Sequence);
+
+        // In the order received
+        SHIM_CHECK(Sequence == Hint->Next);
+        Hint->Next++;
+
+        if (Index == 0) {
+            FirstFrameType = FrameType;
+            FirstVlanId = VlanId;
+        }
+
+        // A hint must hold for every NET_BUFFER_LIST it covers
+        if (SingleEtherType)
+            SHIM_CHECK(FrameType != 0 && FrameType == FirstFrameType);
+        if (SingleVlan)
+            SHIM_CHECK(VlanId == FirstVlanId);
+
+        // Without hints, no run that could have had them is left in
+        Key = (FrameType != 0) ? ((FrameType << 16) | VlanId) : 0;
+        if (Key != 0 && Key == RunKey) {
+            RunCount++;
+        } else {
+            RunKey = Key;
+            RunCount = (Key != 0) ? 1 : 0;
+        }
+
+        if (!SingleEtherType)
+            SHIM_CHECK(RunCount < RECEIVER_HINT_MINIMUM_RUN);
+
+        if (!ReceiverTestHintPerfect(NetBufferList, Hint->HashFilter))
+            Perfect = FALSE;
+
+        NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList);
+    }
+    SHIM_CHECK(NetBufferList == NULL);
+
+    // Perfectly filtered only if every frame is
+    SHIM_CHECK(PerfectFiltered == Perfect);
+
+    // Returned by the harness
+    return FALSE;
+}
+
+// Puts an 802.1Q tag for VlanId in the frame, moving everything after the
+// source address along and the backend's view of the headers with it
+static VOID
+ReceiverTestHintInsertTag(
+    IN  PFRAME              Frame,
+    IN  USHORT              VlanId
+    )
+{
+    ULONG                   Offset;
+    PETHERNET_TAGGED_HEADER EthernetHeader;
+
+    Offset = FIELD_OFFSET(ETHERNET_TAGGED_HEADER, Tag);
+
+    memmove(&Frame->Data[Offset + sizeof (ETHERNET_TAG)],
+            &Frame->Data[Offset],
+            Frame->Length - Offset);
+    Frame->Length += sizeof (ETHERNET_TAG);
+
+    EthernetHeader = (PETHERNET_TAGGED_HEADER)Frame->Data;
+    EthernetHeader->Tag.ProtocolID = HTONS(ETHERTYPE_TPID);
+    EthernetHeader->Tag.ControlInformation = HTONS(VlanId);
+
+    Frame->Info.EthernetHeader.Length += sizeof (ETHERNET_TAG);
+    Frame->Info.IpHeader.Offset += sizeof (ETHERNET_TAG);
+    if (Frame->Info.IpOptions.Length != 0)
+        Frame->Info.IpOptions.Offset += sizeof (ETHERNET_TAG);
+    if (Frame->Info.TcpHeader.Length != 0)
+        Frame->Info.TcpHeader.Offset += sizeof (ETHERNET_TAG);
+    if (Frame->Info.TcpOptions.Length != 0)
+        Frame->Info.TcpOptions.Offset += sizeof (ETHERNET_TAG);
+    if (Frame->Info.UdpHeader.Length != 0)
+        Frame->Info.UdpHeader.Offset += sizeof (ETHERNET_TAG);
+    Frame->Info.Length += sizeof (ETHERNET_TAG);
+}
+
+// Batches made of runs of frames of randomly chosen classes are indicated
+// in order, split so that every hint is true and no homogeneous run of
+// RECEIVER_HINT_MINIMUM_RUN or more goes up without them, and the counters
+// agree with what was seen. Indications holding a frame with its tag left
+// in, or a multicast frame while the receiver's own filter is on (the
+// first half of the batches), are not perfectly filtered.
+static VOID
+ReceiverTestHints(
+    VOID
+    )
+{
+    PADAPTER                Adapter;
+    PRECEIVER               Receiver;
+    PFRAME                  Frame[RECEIVER_TEST_MAXIMUM_BATCH];
+    FRAME_PARAMETERS        Parameters;
+    RECEIVER_VLAN_FILTER    Filter;
+    RECEIVER_TEST_HINT      Hint;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    ULONG64                 State;
+    ULONG                   Batch;
+    ULONG                   Index;
+    KIRQL                   Irql;
+
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL, NULL);
+    Receiver = &Adapter->Receiver;
+
+    RtlZeroMemory(&Filter, sizeof (Filter));
+    Filter.Bitmap[0] = (1ul << 10) | (1ul << 20);
+    ReceiverSetVlanFilter(Receiver, &Filter);
+
+    SHIM_CHECK(ReceiverSetMulticastAddresses(Receiver, &ReceiverTestHintGroup, 1) == NDIS_STATUS_SUCCESS);
+    ReceiverEnableMulticastFilter(Receiver, TRUE);
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        Frame[Index] = FrameAllocate();
+
+    RtlZeroMemory(&Hint, sizeof (Hint));
+    Hint.HashFilter = TRUE;
+    HarnessSetReceiveHook(ReceiverTestHintIndicate, &Hint);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    State = 0x9E3779B97F4A7C15ull;
+
+    for (Batch = 0; Batch < RECEIVER_TEST_HINT_BATCHES; Batch++) {
+        const RECEIVER_TEST_HINT_CLASS  *Class;
+        ULONG                           Run;
+
+        Class = NULL;
+        Run = 0;
+
+        // Back to the backend filtering multicast exactly
+        if (Batch == RECEIVER_TEST_HINT_BATCHES / 2) {
+            ReceiverEnableMulticastFilter(Receiver, FALSE);
+            Hint.HashFilter = FALSE;
+        }
+
+        for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++) {
+            PFRAME  Current = Frame[Index];
+
+            if (Run == 0) {
+                State = (State * 6364136223846793005ull) + 1442695040888963407ull;
+
+                Class = &ReceiverTestHintClass[(State >> 33) % ARRAYSIZE(ReceiverTestHintClass)];
+                Run = ReceiverTestHintRunLength[(State >> 45) % ARRAYSIZE(ReceiverTestHintRunLength)];
+            }
+            --Run;
+
+            FrameDefaultParameters(&Parameters);
+            Parameters.IpVersion = Class->IpVersion;
+            Parameters.PayloadLength = RECEIVER_TEST_HINT_PAYLOAD;
+            Parameters.SourcePort = (USHORT)((Batch * RECEIVER_TEST_MAXIMUM_BATCH) + Index);
+
+            if (Class->Type == ETHERNET_ADDRESS_MULTICAST)
+                Parameters.DestinationAddress = ReceiverTestHintGroup;
+            else if (Class->Type == ETHERNET_ADDRESS_BROADCAST)
+                RtlFillMemory(&Parameters.DestinationAddress, ETHERNET_ADDRESS_LENGTH, 0xFF);
+
+            FrameBuild(Current, &Parameters);
+            Current->TagControlInformation = Class->TagControlInformation;
+
+            // As a backend that does not strip tags passes VLAN 10 on
+            if (Class->Tagged)
+                ReceiverTestHintInsertTag(Current, 10);
+
+            // An 802.3 length in place of the EtherType
+            if (Class->Length) {
+                PETHERNET_UNTAGGED_HEADER   EthernetHeader;
+
+                EthernetHeader = (PETHERNET_UNTAGGED_HEADER)&Current->Data[Current->Info.EthernetHeader.Offset];
+                EthernetHeader->TypeOrLength = HTONS((USHORT)(Current->Length - sizeof (ETHERNET_UNTAGGED_HEADER)));
+            }
+        }
+
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+        SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, Frame, RECEIVER_TEST_MAXIMUM_BATCH) ==
+                   RECEIVER_TEST_MAXIMUM_BATCH);
+        KeLowerIrql(Irql);
+
+        SHIM_CHECK(Hint.Next == (Batch + 1) * RECEIVER_TEST_MAXIMUM_BATCH);
+    }
+
+    ReceiverQueryStatistics(Receiver, &After);
+
+    SHIM_CHECK(After.Indications - Before.Indications == Hint.Indications);
+    SHIM_CHECK(After.PerfectFiltered - Before.PerfectFiltered == Hint.PerfectFiltered);
+    SHIM_CHECK(After.SingleEtherType - Before.SingleEtherType == Hint.SingleEtherType);
+    SHIM_CHECK(After.SingleVlan - Before.SingleVlan == Hint.SingleVlan);
+
+    // Mixed traffic still goes up in a few large indications
+    SHIM_CHECK(Hint.SingleEtherType != 0);
+    SHIM_CHECK(Hint.Indications < Hint.Next / 4);
+
+    SHIM_CHECK(Hint.PerfectFiltered != 0);
+    SHIM_CHECK(Hint.PerfectFiltered < Hint.Indications);
+
+    printf("  %u frames in %u indications, %u with hints covering %u frames, %u perfectly filtered\n",
+           Hint.Next,
+           Hint.Indications,
+           Hint.SingleEtherType,
+           Hint.Hinted,
+           Hint.PerfectFiltered);
+
+    HarnessSetReceiveHook(NULL, NULL);
+
+    SHIM_CHECK(ReceiverSetMulticastAddresses(Receiver, NULL, 0) == NDIS_STATUS_SUCCESS);
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        FrameFree(Frame[Index]);
+
+    ReceiverTestDestroyAdapter(Adapter);
+}
+
+// Receive budget
+
+#define RECEIVER_TEST_BUDGET_PACKETS    64
+#define RECEIVER_TEST_BUDGET_TIME       100     // us
+#define RECEIVER_TEST_BUDGET_STEP       10      // us per clock read
+
+typedef struct _RECEIVER_TEST_BUDGET {
+    ULONG   Next;           // Sequence number expected next
+    ULONG   Largest;        // Indication
+} RECEIVER_TEST_BUDGET, *PRECEIVER_TEST_BUDGET;
+
+static BOOLEAN
+ReceiverTestBudgetIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_BUDGET   Budget = Argument;
+
+    UNREFERENCED_PARAMETER(Adapter);
+    UNREFERENCED_PARAMETER(Flags);
+
+    if (Count > Budget->Largest)
+        Budget->Largest = Count;
+
+    for (; NetBufferList != NULL; NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList)) {
+        ULONG   FrameType;
+        ULONG   VlanId;
+        ULONG   Sequence;
+
+        ReceiverTestHintRead(NetBufferList, &FrameType, &VlanId, &Sequence);
+
+        // Nothing deferred is overtaken
+        SHIM_CHECK(Sequence == Budget->Next);
+        Budget->Next++;
+    }
+
+    // Returned by the harness
+    return FALSE;
+}
+
+// Passes a batch of small frames numbered from First to the receiver in
+// one callback, at the caller's IRQL.
+static VOID
+ReceiverTestBudgetReceive(
+    IN  PADAPTER    Adapter,
+    IN  PFRAME      *Frame,
+    IN  ULONG       First
+    )
+{
+    FRAME_PARAMETERS    Parameters;
+    ULONG               Index;
+
+    FrameDefaultParameters(&Parameters);
+    Parameters.PayloadLength = RECEIVER_TEST_HINT_PAYLOAD;
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++) {
+        Parameters.SourcePort = (USHORT)(First + Index);
+        FrameBuild(Frame[Index], &Parameters);
+    }
+
+    SHIM_CHECK(MockVifReceivePackets(Adapter->VifInterface, Frame, RECEIVER_TEST_MAXIMUM_BATCH) ==
+               RECEIVER_TEST_MAXIMUM_BATCH);
+}
+
+static ULONG64
+ReceiverTestBudgetPasses(
+    IN  PRECEIVER_STATISTICS    Statistics
+    )
+{
+    ULONG64                     Passes;
+    ULONG                       Bucket;
+
+    Passes = 0;
+    for (Bucket = 0; Bucket < RECEIVER_TIME_HISTOGRAM_SIZE; Bucket++)
+        Passes += Statistics->ProcessingTime[Bucket];
+
+    return Passes;
+}
+
+// Numbers each callback's frames from its own base, and from inside the
+// first indication runs a second over-budget callback from another
+// processor, as a backend queue on that processor would while the first
+// callback's remainder is still being processed.
+typedef struct _RECEIVER_TEST_OVERLAP {
+    PFRAME  *Frame;
+    BOOLEAN Started;
+    ULONG   Next[2];
+} RECEIVER_TEST_OVERLAP, *PRECEIVER_TEST_OVERLAP;
+
+static BOOLEAN
+ReceiverTestOverlapIndicate(
+    IN  PVOID               Argument,
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    )
+{
+    PRECEIVER_TEST_OVERLAP  Overlap = Argument;
+
+    UNREFERENCED_PARAMETER(Count);
+    UNREFERENCED_PARAMETER(Flags);
+
+    for (; NetBufferList != NULL; NetBufferList = NET_BUFFER_LIST_NEXT_NBL(NetBufferList)) {
+        ULONG   FrameType;
+        ULONG   VlanId;
+        ULONG   Sequence;
+        ULONG   Index;
+
+        ReceiverTestHintRead(NetBufferList, &FrameType, &VlanId, &Sequence);
+
+        // Each callback's frames stay in order
+        Index = Sequence / RECEIVER_TEST_MAXIMUM_BATCH;
+        SHIM_CHECK(Index < ARRAYSIZE(Overlap->Next));
+        SHIM_CHECK(Sequence == (Index * RECEIVER_TEST_MAXIMUM_BATCH) + Overlap->Next[Index]);
+        Overlap->Next[Index]++;
+    }
+
+    if (!Overlap->Started) {
+        Overlap->Started = TRUE;
+
+        ShimSetCurrentProcessor(1);
+        ReceiverTestBudgetReceive(Adapter, Overlap->Frame, RECEIVER_TEST_MAXIMUM_BATCH);
+        ShimSetCurrentProcessor(0);
+
+        // That callback ran over its budget and left a backlog while this
+        // one still has its own remainder to leave
+        SHIM_CHECK(Adapter->Receiver.BacklogActive);
+    }
+
+    return FALSE;
+}
+
+// A callback processes no more than its packet or time budget allows and
+// leaves the rest to the backlog DPC, which later callbacks queue behind
+// so that nothing is reordered. Every pass is counted in the processing
+// time histogram, and those that ran out of budget in Deferred.
+static VOID
+ReceiverTestBudget(
+    VOID
+    )
+{
+    PADAPTER                Adapter;
+    PRECEIVER               Receiver;
+    PFRAME                  Frame[RECEIVER_TEST_MAXIMUM_BATCH];
+    PFRAME                  Second[RECEIVER_TEST_MAXIMUM_BATCH];
+    RECEIVER_TEST_BUDGET    Budget;
+    RECEIVER_TEST_OVERLAP   Overlap;
+    RECEIVER_STATISTICS     Before;
+    RECEIVER_STATISTICS     After;
+    ULONG                   Bucket;
+    ULONG                   Index;
+    KIRQL                   Irql;
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        Frame[Index] = FrameAllocate();
+
+    // By packets: the backend has a ring's worth of packets per processor,
+    // so two processors' worth can be outstanding at once
+    Adapter = ReceiverTestCreateAdapter(2, 0, NULL,
+                                        "rx_copy_break=0",
+                                        "rx_budget=64",
+                                        "rx_budget_time=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    RtlZeroMemory(&Budget, sizeof (Budget));
+    HarnessSetReceiveHook(ReceiverTestBudgetIndicate, &Budget);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    ReceiverTestBudgetReceive(Adapter, Frame, 0);
+    SHIM_CHECK(Budget.Next == RECEIVER_TEST_BUDGET_PACKETS);
+    SHIM_CHECK(Receiver->BacklogActive);
+
+    // Behind the backlog, not ahead of it
+    ReceiverTestBudgetReceive(Adapter, Frame, RECEIVER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(Budget.Next == RECEIVER_TEST_BUDGET_PACKETS);
+
+    KeLowerIrql(Irql);
+
+    SHIM_CHECK(Budget.Next == 2 * RECEIVER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(Budget.Largest <= RECEIVER_TEST_BUDGET_PACKETS);
+    SHIM_CHECK(!Receiver->BacklogActive);
+
+    ReceiverQueryStatistics(Receiver, &After);
+
+    // Every pass but the last left something over
+    SHIM_CHECK(ReceiverTestBudgetPasses(&After) - ReceiverTestBudgetPasses(&Before) ==
+               (2 * RECEIVER_TEST_MAXIMUM_BATCH) / RECEIVER_TEST_BUDGET_PACKETS);
+    SHIM_CHECK(After.Deferred - Before.Deferred ==
+               ((2 * RECEIVER_TEST_MAXIMUM_BATCH) / RECEIVER_TEST_BUDGET_PACKETS) - 1);
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // Two callbacks run over budget at once: the second to finish finds
+    // the backlog already active and joins it rather than queueing the
+    // DPC again
+    Adapter = ReceiverTestCreateAdapter(2, 0, NULL,
+                                        "rx_copy_break=0",
+                                        "rx_budget=64",
+                                        "rx_budget_time=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        Second[Index] = FrameAllocate();
+
+    RtlZeroMemory(&Overlap, sizeof (Overlap));
+    Overlap.Frame = Second;
+    HarnessSetReceiveHook(ReceiverTestOverlapIndicate, &Overlap);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    ReceiverTestBudgetReceive(Adapter, Frame, 0);
+    SHIM_CHECK(Overlap.Started);
+    SHIM_CHECK(Receiver->BacklogActive);
+    SHIM_CHECK(ShimQueuedDpcs(0) + ShimQueuedDpcs(1) == 1);
+
+    KeLowerIrql(Irql);
+    ShimRunAllDpcs();
+
+    SHIM_CHECK(Overlap.Next[0] == RECEIVER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(Overlap.Next[1] == RECEIVER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(!Receiver->BacklogActive);
+    SHIM_CHECK(MockVifOutstandingPackets(Adapter->VifInterface) == 0);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Deferred - Before.Deferred ==
+               ((2 * RECEIVER_TEST_MAXIMUM_BATCH) / RECEIVER_TEST_BUDGET_PACKETS) - 1);
+
+    HarnessSetReceiveHook(NULL, NULL);
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        FrameFree(Second[Index]);
+
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // By time: each read of the clock finds it RECEIVER_TEST_BUDGET_STEP
+    // later, so a pass stops at a multiple of the check interval
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_copy_break=0",
+                                        "rx_budget=0",
+                                        "rx_budget_time=100",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    RtlZeroMemory(&Budget, sizeof (Budget));
+    HarnessSetReceiveHook(ReceiverTestBudgetIndicate, &Budget);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    ShimSetManualClock(TRUE);
+    ShimSetClockStep(RECEIVER_TEST_BUDGET_STEP * (SHIM_CLOCK_FREQUENCY / 1000000));
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+
+    ReceiverTestBudgetReceive(Adapter, Frame, 0);
+    SHIM_CHECK(Budget.Next != 0 && Budget.Next < RECEIVER_TEST_MAXIMUM_BATCH);
+    SHIM_CHECK(Budget.Next % RECEIVER_BUDGET_CHECK_INTERVAL == 0);
+
+    KeLowerIrql(Irql);
+
+    ShimSetClockStep(0);
+    ShimSetManualClock(FALSE);
+
+    SHIM_CHECK(Budget.Next == RECEIVER_TEST_MAXIMUM_BATCH);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Deferred - Before.Deferred != 0);
+
+    // A pass that ran out of time took at least the budget
+    for (Bucket = 0; Bucket < RECEIVER_TIME_HISTOGRAM_SIZE; Bucket++) {
+        if ((16ull << Bucket) > RECEIVER_TEST_BUDGET_TIME)
+            break;
+    }
+    SHIM_CHECK(Bucket < RECEIVER_TIME_HISTOGRAM_SIZE);
+    SHIM_CHECK(After.ProcessingTime[Bucket - 1] + After.ProcessingTime[Bucket] -
+               Before.ProcessingTime[Bucket - 1] - Before.ProcessingTime[Bucket] != 0);
+
+    printf("  %llu passes, %llu deferred:",
+           ReceiverTestBudgetPasses(&After) - ReceiverTestBudgetPasses(&Before),
+           After.Deferred - Before.Deferred);
+    for (Bucket = 0; Bucket < RECEIVER_TIME_HISTOGRAM_SIZE; Bucket++)
+        printf(" %llu", After.ProcessingTime[Bucket] - Before.ProcessingTime[Bucket]);
+    printf("\n");
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    // Unbounded: one pass does it all
+    Adapter = ReceiverTestCreateAdapter(1, 0, NULL,
+                                        "rx_copy_break=0",
+                                        "rx_budget=0",
+                                        "rx_budget_time=0",
+                                        NULL);
+    Receiver = &Adapter->Receiver;
+
+    RtlZeroMemory(&Budget, sizeof (Budget));
+    HarnessSetReceiveHook(ReceiverTestBudgetIndicate, &Budget);
+
+    ReceiverQueryStatistics(Receiver, &Before);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    ReceiverTestBudgetReceive(Adapter, Frame, 0);
+    SHIM_CHECK(Budget.Next == RECEIVER_TEST_MAXIMUM_BATCH);
+    KeLowerIrql(Irql);
+
+    ReceiverQueryStatistics(Receiver, &After);
+    SHIM_CHECK(After.Deferred == Before.Deferred);
+    SHIM_CHECK(ReceiverTestBudgetPasses(&After) - ReceiverTestBudgetPasses(&Before) == 1);
+
+    HarnessSetReceiveHook(NULL, NULL);
+    ReceiverTestDestroyAdapter(Adapter);
+
+    for (Index = 0; Index < RECEIVER_TEST_MAXIMUM_BATCH; Index++)
+        FrameFree(Frame[Index]);
+}
+
+static RECEIVER_TEST    ReceiverTest[] = {
+    { "cache", ReceiverTestCache },
+    { "layout", ReceiverTestLayout },
+    { "contention", ReceiverTestContention },
+    { "groups", ReceiverTestGroups },
+    { "return", ReceiverTestReturn },
+    { "watermark", ReceiverTestWatermark },
+    { "copybreak", ReceiverTestCopyBreak },
+    { "bounce", ReceiverTestBounce },
+    { "rss", ReceiverTestRss },
+    { "gro", ReceiverTestGro },
+    { "coalesce", ReceiverTestCoalesce },
+    { "trim", ReceiverTestTrim },
+    { "prewarm", ReceiverTestPrewarm },
+    { "vlan", ReceiverTestVlan },
+    { "multicast", ReceiverTestMulticast },
+    { "storm", ReceiverTestStorm },
+    { "hints", ReceiverTestHints },
+    { "budget", ReceiverTestBudget },
+};
+
+int
+main(
+    IN  int     argc,
+    IN  char    **argv
+    )
+{
+    ULONG       Index;
+    ULONG       Run;
+
+    // Keep what was printed if a check fails
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    Run = 0;
+    for (Index = 0; Index < ARRAYSIZE(ReceiverTest); Index++) {
+        PRECEIVER_TEST  Test = &ReceiverTest[Index];
+
+        if (argc > 1) {
+            int Argument;
+
+            for (Argument = 1; Argument < argc; Argument++)
+                if (strcmp(argv[Argument], Test->Name) == 0)
+                    break;
+
+            if (Argument == argc)
+                continue;
+        }
+
+        printf("receiver_test: %s\n", Test->Name);
+        Test->Function();
+        Run++;
+    }
+
+    if (Run == 0) {
+        fprintf(stderr, "receiver_test: no such test\n");
+        return 2;
+    }
+
+    printf("receiver_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,1629 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// User-mode implementation of the kernel and NDIS routines declared in
+// include/. Each thread that calls into the driver acts as one simulated
+// processor; DPCs are queued per processor and run when that processor
+// drops below DISPATCH_LEVEL or when the harness drains the queues.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <ndis.h>
+
+#include "shim.h"
+
+typedef struct _SHIM_PROCESSOR {
+    pthread_mutex_t Lock;
+    LIST_ENTRY      Queue;
+    ULONG           Count;
+} SHIM_PROCESSOR, *PSHIM_PROCESSOR;
+
+static PSHIM_PROCESSOR      ShimProcessor;
+static ULONG                ShimProcessorCount;
+static ULONG                ShimGroupSize;
+
+static __thread ULONG       ShimCurrentProcessor;
+static __thread KIRQL       ShimIrql;
+static __thread BOOLEAN     ShimDraining;
+
+static pthread_mutex_t      ShimTimerLock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_ENTRY           ShimTimerList = { &ShimTimerList, &ShimTimerList };
+
+static BOOLEAN              ShimManualClock;
+static volatile ULONG64     ShimClock;
+static ULONG64              ShimClockStep;
+
+static SHIM_ALLOCATIONS     ShimAllocations;
+
+static KEVENT               ShimLowMemoryEvent;
+
+static ULONG                ShimDebugLevel = DPFLTR_ERROR_LEVEL;
+
+static SHIM_INDICATE_RECEIVE    ShimIndicateReceive;
+static SHIM_SEND_COMPLETE       ShimSendComplete;
+
+#define SHIM_COUNT(_Field, _Delta) \
+        __atomic_add_fetch(&ShimAllocations._Field, (_Delta), __ATOMIC_RELAXED)
+
+static VOID __attribute__((noreturn))
+ShimFatal(
+    IN  const CHAR  *Message
+    )
+{
+    fprintf(stderr, "FATAL: %s\n", Message);
+    fflush(stderr);
+    abort();
+}
+
+VOID
+ShimCheckFailed(
+    IN  const CHAR  *Condition,
+    IN  const CHAR  *File,
+    IN  ULONG       Line
+    )
+{
+    fprintf(stderr, "%s:%u: check failed: %s\n", File, Line, Condition);
+    fflush(stderr);
+    abort();
+}
+
+VOID
+ShimInitialize(
+    IN  ULONG   ProcessorCount,
+    IN  ULONG   GroupSize
+    )
+{
+    const CHAR  *Level;
+    ULONG       Index;
+
+    if (ProcessorCount == 0 || ProcessorCount > MAXIMUM_PROCESSORS)
+        ShimFatal("bad processor count");
+
+    ShimProcessor = calloc(ProcessorCount, sizeof (SHIM_PROCESSOR));
+    if (ShimProcessor == NULL)
+        ShimFatal("out of memory");
+
+    for (Index = 0; Index < ProcessorCount; Index++) {
+        PSHIM_PROCESSOR Processor = &ShimProcessor[Index];
+
+        pthread_mutex_init(&Processor->Lock, NULL);
+        InitializeListHead(&Processor->Queue);
+    }
+
+    ShimProcessorCount = ProcessorCount;
+    ShimGroupSize = (GroupSize == 0 || GroupSize > ProcessorCount) ?
+                    ProcessorCount :
+                    GroupSize;
+
+    ShimCurrentProcessor = 0;
+    ShimIrql = PASSIVE_LEVEL;
+
+    Level = getenv("XENNET_DEBUG");
+    if (Level != NULL)
+        ShimDebugLevel = (ULONG)strtoul(Level, NULL, 0);
+}
+
+VOID
+ShimTeardown(
+    VOID
+    )
+{
+    ULONG   Index;
+
+    for (Index = 0; Index < ShimProcessorCount; Index++) {
+        if (!IsListEmpty(&ShimProcessor[Index].Queue))
+            ShimFatal("DPCs still queued at teardown");
+
+        pthread_mutex_destroy(&ShimProcessor[Index].Lock);
+    }
+
+    free(ShimProcessor);
+    ShimProcessor = NULL;
+    ShimProcessorCount = 0;
+}
+
+VOID
+ShimSetCurrentProcessor(
+    IN  ULONG   Index
+    )
+{
+    if (Index >= ShimProcessorCount)
+        ShimFatal("bad processor index");
+
+    ShimCurrentProcessor = Index;
+}
+
+ULONG
+ShimGetProcessorCount(
+    VOID
+    )
+{
+    return ShimProcessorCount;
+}
+
+VOID
+ShimSetManualClock(
+    IN  BOOLEAN Manual
+    )
+{
+    ShimClock = ShimQueryClock();
+    ShimManualClock = Manual;
+}
+
+VOID
+ShimAdvanceClock(
+    IN  ULONG64 Ticks
+    )
+{
+    __atomic_add_fetch(&ShimClock, Ticks, __ATOMIC_RELAXED);
+}
+
+VOID
+ShimSetClockStep(
+    IN  ULONG64 Ticks
+    )
+{
+    ShimClockStep = Ticks;
+}
+
+ULONG64
+ShimQueryClock(
+    VOID
+    )
+{
+    struct timespec Now;
+
+    if (ShimManualClock)
+        return __atomic_load_n(&ShimClock, __ATOMIC_RELAXED);
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (ULONG64)Now.tv_sec * SHIM_CLOCK_FREQUENCY + (ULONG64)Now.tv_nsec;
+}
+
+VOID
+ShimQueryAllocations(
+    OUT PSHIM_ALLOCATIONS   Allocations
+    )
+{
+    Allocations->Pool = __atomic_load_n(&ShimAllocations.Pool, __ATOMIC_RELAXED);
+    Allocations->PoolFrees = __atomic_load_n(&ShimAllocations.PoolFrees, __ATOMIC_RELAXED);
+    Allocations->NetBufferLists = __atomic_load_n(&ShimAllocations.NetBufferLists, __ATOMIC_RELAXED);
+    Allocations->NetBufferListFrees = __atomic_load_n(&ShimAllocations.NetBufferListFrees, __ATOMIC_RELAXED);
+    Allocations->Mdls = __atomic_load_n(&ShimAllocations.Mdls, __ATOMIC_RELAXED);
+    Allocations->MdlFrees = __atomic_load_n(&ShimAllocations.MdlFrees, __ATOMIC_RELAXED);
+}
+
+VOID
+ShimSetLowMemory(
+    IN  BOOLEAN Low
+    )
+{
+    ShimLowMemoryEvent.State = Low ? 1 : 0;
+}
+
+VOID
+ShimSetDebugLevel(
+    IN  ULONG   Level
+    )
+{
+    ShimDebugLevel = Level;
+}
+
+VOID
+ShimSetIndicateReceive(
+    IN  SHIM_INDICATE_RECEIVE   Function
+    )
+{
+    ShimIndicateReceive = Function;
+}
+
+VOID
+ShimSetSendComplete(
+    IN  SHIM_SEND_COMPLETE      Function
+    )
+{
+    ShimSendComplete = Function;
+}
+
+// Pool
+
+PVOID
+ExAllocatePoolWithTag(
+    IN  POOL_TYPE   PoolType,
+    IN  SIZE_T      NumberOfBytes,
+    IN  ULONG       Tag
+    )
+{
+    SIZE_T          Alignment;
+    PVOID           P;
+
+    UNREFERENCED_PARAMETER(Tag);
+
+    Alignment = (PoolType == NonPagedPoolCacheAligned) ?
+                SYSTEM_CACHE_ALIGNMENT_SIZE :
+                MEMORY_ALLOCATION_ALIGNMENT;
+
+    if (posix_memalign(&P, Alignment, (NumberOfBytes != 0) ? NumberOfBytes : 1) != 0)
+        return NULL;
+
+    SHIM_COUNT(Pool, 1);
+    return P;
+}
+
+VOID
+ExFreePool(
+    IN  PVOID   P
+    )
+{
+    SHIM_COUNT(PoolFrees, 1);
+    free(P);
+}
+
+VOID
+ExFreePoolWithTag(
+    IN  PVOID   P,
+    IN  ULONG   Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    ExFreePool(P);
+}
+
+// Singly linked lists
+
+static VOID
+ShimLockSList(
+    IN  PSLIST_HEADER   ListHead
+    )
+{
+    while (__atomic_exchange_n(&ListHead->Lock, 1, __ATOMIC_ACQUIRE) != 0)
+        sched_yield();
+}
+
+static VOID
+ShimUnlockSList(
+    IN  PSLIST_HEADER   ListHead
+    )
+{
+    __atomic_store_n(&ListHead->Lock, 0, __ATOMIC_RELEASE);
+}
+
+VOID
+InitializeSListHead(
+    IN  PSLIST_HEADER   ListHead
+    )
+{
+    ListHead->Next = NULL;
+    ListHead->Lock = 0;
+    ListHead->Depth = 0;
+}
+
+PSLIST_ENTRY
+InterlockedPushEntrySList(
+    IN  PSLIST_HEADER   ListHead,
+    IN  PSLIST_ENTRY    ListEntry
+    )
+{
+    PSLIST_ENTRY        Old;
+
+    ShimLockSList(ListHead);
+    Old = ListHead->Next;
+    ListEntry->Next = Old;
+    ListHead->Next = ListEntry;
+    ListHead->Depth++;
+    ShimUnlockSList(ListHead);
+
+    return Old;
+}
+
+PSLIST_ENTRY
+InterlockedPopEntrySList(
+    IN  PSLIST_HEADER   ListHead
+    )
+{
+    PSLIST_ENTRY        Entry;
+
+    ShimLockSList(ListHead);
+    Entry = ListHead->Next;
+    if (Entry != NULL) {
+        ListHead->Next = Entry->Next;
+        ListHead->Depth--;
+    }
+    ShimUnlockSList(ListHead);
+
+    return Entry;
+}
+
+PSLIST_ENTRY
+InterlockedFlushSList(
+    IN  PSLIST_HEADER   ListHead
+    )
+{
+    PSLIST_ENTRY        Entry;
+
+    ShimLockSList(ListHead);
+    Entry = ListHead->Next;
+    ListHead->Next = NULL;
+    ListHead->Depth = 0;
+    ShimUnlockSList(ListHead);
+
+    return Entry;
+}
+
+USHORT
+QueryDepthSList(
+    IN  PSLIST_HEADER   ListHead
+    )
+{
+    return ListHead->Depth;
+}
+
+// Processors and IRQL
+
+KIRQL
+KeGetCurrentIrql(
+    VOID
+    )
+{
+    return ShimIrql;
+}
+
+VOID
+KeRaiseIrql(
+    IN  KIRQL   NewIrql,
+    OUT PKIRQL  OldIrql
+    )
+{
+    if (NewIrql < ShimIrql)
+        ShimFatal("IRQL_NOT_GREATER_OR_EQUAL");
+
+    *OldIrql = ShimIrql;
+    ShimIrql = NewIrql;
+}
+
+VOID
+KeLowerIrql(
+    IN  KIRQL   NewIrql
+    )
+{
+    if (NewIrql > ShimIrql)
+        ShimFatal("IRQL_NOT_LESS_OR_EQUAL");
+
+    ShimIrql = NewIrql;
+
+    if (NewIrql < DISPATCH_LEVEL && !ShimDraining)
+        ShimRunDpcs(ShimCurrentProcessor);
+}
+
+// As in the kernel, the number within the current group, so processors
+// in different groups share numbers
+ULONG
+KeGetCurrentProcessorNumber(
+    VOID
+    )
+{
+    return ShimCurrentProcessor % ShimGroupSize;
+}
+
+ULONG
+KeGetCurrentProcessorNumberEx(
+    OUT PPROCESSOR_NUMBER   ProcNumber OPTIONAL
+    )
+{
+    if (ProcNumber != NULL)
+        (VOID) KeGetProcessorNumberFromIndex(ShimCurrentProcessor,
+                                             ProcNumber);
+
+    return ShimCurrentProcessor;
+}
+
+ULONG
+KeQueryActiveProcessorCount(
+    OUT PKAFFINITY  ActiveProcessors OPTIONAL
+    )
+{
+    if (ActiveProcessors != NULL)
+        *ActiveProcessors = (ShimProcessorCount == 64) ?
+                            ~(KAFFINITY)0 :
+                            ((KAFFINITY)1 << ShimProcessorCount) - 1;
+
+    return ShimProcessorCount;
+}
+
+ULONG
+KeQueryActiveProcessorCountEx(
+    IN  USHORT  GroupNumber
+    )
+{
+    ULONG       Groups;
+
+    if (GroupNumber == ALL_PROCESSOR_GROUPS)
+        return ShimProcessorCount;
+
+    Groups = (ShimProcessorCount + ShimGroupSize - 1) / ShimGroupSize;
+    if (GroupNumber >= Groups)
+        return 0;
+
+    if (GroupNumber == Groups - 1)
+        return ShimProcessorCount - GroupNumber * ShimGroupSize;
+
+    return ShimGroupSize;
+}
+
+NTSTATUS
+KeGetProcessorNumberFromIndex(
+    IN  ULONG               ProcIndex,
+    OUT PPROCESSOR_NUMBER   ProcNumber
+    )
+{
+    if (ProcIndex >= ShimProcessorCount)
+        return STATUS_INVALID_PARAMETER;
+
+    ProcNumber->Group = (USHORT)(ProcIndex / ShimGroupSize);
+    ProcNumber->Number = (UCHAR)(ProcIndex % ShimGroupSize);
+    ProcNumber->Reserved = 0;
+
+    return STATUS_SUCCESS;
+}
+
+ULONG
+KeGetProcessorIndexFromNumber(
+    IN  PPROCESSOR_NUMBER   ProcNumber
+    )
+{
+    return ProcNumber->Group * ShimGroupSize + ProcNumber->Number;
+}
+
+// Spin locks
+
+VOID
+KeInitializeSpinLock(
+    OUT PKSPIN_LOCK SpinLock
+    )
+{
+    *SpinLock = 0;
+}
+
+VOID
+KeAcquireSpinLockAtDpcLevel(
+    IN  PKSPIN_LOCK SpinLock
+    )
+{
+    ULONG           Spins;
+
+    if (ShimIrql < DISPATCH_LEVEL)
+        ShimFatal("spin lock acquired below DISPATCH_LEVEL");
+
+    Spins = 0;
+    while (__atomic_exchange_n(SpinLock, 1, __ATOMIC_ACQUIRE) != 0) {
+        while (__atomic_load_n(SpinLock, __ATOMIC_RELAXED) != 0) {
+            // More threads than CPUs is normal here so do not spin for long
+            if (++Spins % 64 == 0)
+                sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+            else
+                __builtin_ia32_pause();
+#endif
+        }
+    }
+}
+
+VOID
+KeReleaseSpinLockFromDpcLevel(
+    IN  PKSPIN_LOCK SpinLock
+    )
+{
+    if (__atomic_load_n(SpinLock, __ATOMIC_RELAXED) == 0)
+        ShimFatal("spin lock released when not held");
+
+    __atomic_store_n(SpinLock, 0, __ATOMIC_RELEASE);
+}
+
+VOID
+KeAcquireSpinLock(
+    IN  PKSPIN_LOCK SpinLock,
+    OUT PKIRQL      OldIrql
+    )
+{
+    KeRaiseIrql(DISPATCH_LEVEL, OldIrql);
+    KeAcquireSpinLockAtDpcLevel(SpinLock);
+}
+
+VOID
+KeReleaseSpinLock(
+    IN  PKSPIN_LOCK SpinLock,
+    IN  KIRQL       NewIrql
+    )
+{
+    KeReleaseSpinLockFromDpcLevel(SpinLock);
+    KeLowerIrql(NewIrql);
+}
+
+// Time
+
+LARGE_INTEGER
+KeQueryPerformanceCounter(
+    OUT PLARGE_INTEGER  PerformanceFrequency OPTIONAL
+    )
+{
+    LARGE_INTEGER       Counter;
+
+    if (PerformanceFrequency != NULL)
+        PerformanceFrequency->QuadPart = SHIM_CLOCK_FREQUENCY;
+
+    Counter.QuadPart = (LONGLONG)ShimQueryClock();
+
+    if (ShimManualClock && ShimClockStep != 0)
+        ShimAdvanceClock(ShimClockStep);
+
+    return Counter;
+}
+
+ULONGLONG
+KeQueryInterruptTime(
+    VOID
+    )
+{
+    // 100ns units
+    return ShimQueryClock() / 100;
+}
+
+// DPCs
+
+static VOID
+ShimInitializeDpc(
+    OUT PRKDPC              Dpc,
+    IN  PKDEFERRED_ROUTINE  DeferredRoutine,
+    IN  PVOID               DeferredContext,
+    IN  BOOLEAN             Threaded
+    )
+{
+    RtlZeroMemory(Dpc, sizeof (KDPC));
+    InitializeListHead(&Dpc->DpcListEntry);
+    Dpc->DeferredRoutine = DeferredRoutine;
+    Dpc->DeferredContext = DeferredContext;
+    Dpc->TargetProcessor = -1;
+    Dpc->Processor = -1;
+    Dpc->Importance = MediumImportance;
+    Dpc->Threaded = Threaded;
+}
+
+VOID
+KeInitializeDpc(
+    OUT PRKDPC              Dpc,
+    IN  PKDEFERRED_ROUTINE  DeferredRoutine,
+    IN  PVOID               DeferredContext
+    )
+{
+    ShimInitializeDpc(Dpc, DeferredRoutine, DeferredContext, FALSE);
+}
+
+VOID
+KeInitializeThreadedDpc(
+    OUT PRKDPC              Dpc,
+    IN  PKDEFERRED_ROUTINE  DeferredRoutine,
+    IN  PVOID               DeferredContext
+    )
+{
+    ShimInitializeDpc(Dpc, DeferredRoutine, DeferredContext, TRUE);
+}
+
+VOID
+KeSetImportanceDpc(
+    IN  PRKDPC          Dpc,
+    IN  KDPC_IMPORTANCE Importance
+    )
+{
+    Dpc->Importance = Importance;
+}
+
+VOID
+KeSetTargetProcessorDpc(
+    IN  PRKDPC  Dpc,
+    IN  CHAR    Number
+    )
+{
+    Dpc->TargetProcessor = Number;
+}
+
+NTSTATUS
+KeSetTargetProcessorDpcEx(
+    IN  PKDPC               Dpc,
+    IN  PPROCESSOR_NUMBER   ProcNumber
+    )
+{
+    ULONG                   Index;
+
+    Index = KeGetProcessorIndexFromNumber(ProcNumber);
+    if (Index >= ShimProcessorCount)
+        return STATUS_INVALID_PARAMETER;
+
+    Dpc->TargetProcessor = (LONG)Index;
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+KeInsertQueueDpc(
+    IN  PRKDPC          Dpc,
+    IN  PVOID           SystemArgument1,
+    IN  PVOID           SystemArgument2
+    )
+{
+    PSHIM_PROCESSOR     Processor;
+    ULONG               Index;
+
+    Index = (Dpc->TargetProcessor >= 0) ?
+            (ULONG)Dpc->TargetProcessor :
+            ShimCurrentProcessor;
+    Processor = &ShimProcessor[Index];
+
+    pthread_mutex_lock(&Processor->Lock);
+
+    if (Dpc->Inserted) {
+        pthread_mutex_unlock(&Processor->Lock);
+        return FALSE;
+    }
+
+    Dpc->SystemArgument1 = SystemArgument1;
+    Dpc->SystemArgument2 = SystemArgument2;
+    Dpc->Processor = (LONG)Index;
+    __atomic_store_n(&Dpc->Inserted, 1, __ATOMIC_RELEASE);
+
+    if (Dpc->Importance == HighImportance)
+        InsertHeadList(&Processor->Queue, &Dpc->DpcListEntry);
+    else
+        InsertTailList(&Processor->Queue, &Dpc->DpcListEntry);
+
+    Processor->Count++;
+
+    pthread_mutex_unlock(&Processor->Lock);
+
+    return TRUE;
+}
+
+BOOLEAN
+KeRemoveQueueDpc(
+    IN  PRKDPC      Dpc
+    )
+{
+    for (;;) {
+        PSHIM_PROCESSOR Processor;
+        LONG            Index;
+
+        Index = __atomic_load_n(&Dpc->Processor, __ATOMIC_ACQUIRE);
+        if (Index < 0 || !__atomic_load_n(&Dpc->Inserted, __ATOMIC_ACQUIRE))
+            return FALSE;
+
+        Processor = &ShimProcessor[Index];
+
+        pthread_mutex_lock(&Processor->Lock);
+
+        if (Dpc->Inserted && Dpc->Processor == Index) {
+            RemoveEntryList(&Dpc->DpcListEntry);
+            Processor->Count--;
+            Dpc->Inserted = 0;
+
+            pthread_mutex_unlock(&Processor->Lock);
+            return TRUE;
+        }
+
+        pthread_mutex_unlock(&Processor->Lock);
+    }
+}
+
+static VOID ShimRunTimers(VOID);
+
+VOID
+ShimRunDpcs(
+    IN  ULONG   Index
+    )
+{
+    PSHIM_PROCESSOR Processor = &ShimProcessor[Index];
+    ULONG           Saved;
+    KIRQL           Irql;
+    BOOLEAN         Draining;
+
+    Saved = ShimCurrentProcessor;
+    Irql = ShimIrql;
+    Draining = ShimDraining;
+
+    ShimCurrentProcessor = Index;
+    ShimDraining = TRUE;
+
+    ShimRunTimers();
+
+    for (;;) {
+        PLIST_ENTRY         ListEntry;
+        PKDPC               Dpc;
+        PKDEFERRED_ROUTINE  Routine;
+        PVOID               Context;
+        PVOID               Argument1;
+        PVOID               Argument2;
+
+        pthread_mutex_lock(&Processor->Lock);
+
+        if (IsListEmpty(&Processor->Queue)) {
+            pthread_mutex_unlock(&Processor->Lock);
+            break;
+        }
+
+        ListEntry = RemoveHeadList(&Processor->Queue);
+        Processor->Count--;
+
+        Dpc = CONTAINING_RECORD(ListEntry, KDPC, DpcListEntry);
+        Routine = Dpc->DeferredRoutine;
+        Context = Dpc->DeferredContext;
+        Argument1 = Dpc->SystemArgument1;
+        Argument2 = Dpc->SystemArgument2;
+
+        // As in the kernel, a DPC may be queued again once it has started
+        __atomic_store_n(&Dpc->Inserted, 0, __ATOMIC_RELEASE);
+
+        pthread_mutex_unlock(&Processor->Lock);
+
+        ShimIrql = Dpc->Threaded ? PASSIVE_LEVEL : DISPATCH_LEVEL;
+        Routine(Dpc, Context, Argument1, Argument2);
+
+        if (ShimIrql != (Dpc->Threaded ? PASSIVE_LEVEL : DISPATCH_LEVEL))
+            ShimFatal("DPC returned at the wrong IRQL");
+    }
+
+    ShimIrql = Irql;
+    ShimDraining = Draining;
+    ShimCurrentProcessor = Saved;
+}
+
+VOID
+ShimRunAllDpcs(
+    VOID
+    )
+{
+    BOOLEAN Queued;
+
+    do {
+        ULONG   Index;
+
+        Queued = FALSE;
+        for (Index = 0; Index < ShimProcessorCount; Index++) {
+            ShimRunDpcs(Index);
+            Queued |= (ShimQueuedDpcs(Index) != 0) ? TRUE : FALSE;
+        }
+    } while (Queued);
+}
+
+ULONG
+ShimQueuedDpcs(
+    IN  ULONG   Index
+    )
+{
+    PSHIM_PROCESSOR Processor = &ShimProcessor[Index];
+    ULONG           Count;
+
+    pthread_mutex_lock(&Processor->Lock);
+    Count = Processor->Count;
+    pthread_mutex_unlock(&Processor->Lock);
+
+    return Count;
+}
+
+// Only meaningful when no other thread is running DPCs, which is how the
+// harness uses the driver paths that call it.
+VOID
+KeFlushQueuedDpcs(
+    VOID
+    )
+{
+    if (ShimDraining)
+        ShimFatal("KeFlushQueuedDpcs() called from a DPC");
+
+    ShimRunAllDpcs();
+}
+
+// Timers. There is no clock interrupt: expired timers fire whenever a
+// processor's DPC queue is drained.
+
+VOID
+KeInitializeTimer(
+    OUT PKTIMER Timer
+    )
+{
+    RtlZeroMemory(Timer, sizeof (KTIMER));
+    InitializeListHead(&Timer->TimerListEntry);
+}
+
+BOOLEAN
+KeSetTimerEx(
+    IN  PKTIMER         Timer,
+    IN  LARGE_INTEGER   DueTime,
+    IN  LONG            Period,
+    IN  PKDPC           Dpc OPTIONAL
+    )
+{
+    BOOLEAN             Inserted;
+    ULONG64             Now;
+
+    Now = ShimQueryClock();
+
+    pthread_mutex_lock(&ShimTimerLock);
+
+    Inserted = Timer->Inserted;
+    if (Inserted)
+        RemoveEntryList(&Timer->TimerListEntry);
+
+    // Relative times are negative, in 100ns units. Absolute times are
+    // treated as already due.
+    Timer->DueTime = (DueTime.QuadPart < 0) ?
+                     (LONGLONG)(Now + (ULONG64)(-DueTime.QuadPart) * 100) :
+                     (LONGLONG)Now;
+    Timer->Period = Period;
+    Timer->Dpc = Dpc;
+    Timer->Inserted = TRUE;
+    InsertTailList(&ShimTimerList, &Timer->TimerListEntry);
+
+    pthread_mutex_unlock(&ShimTimerLock);
+
+    return Inserted;
+}
+
+BOOLEAN
+KeSetTimer(
+    IN  PKTIMER         Timer,
+    IN  LARGE_INTEGER   DueTime,
+    IN  PKDPC           Dpc OPTIONAL
+    )
+{
+    return KeSetTimerEx(Timer, DueTime, 0, Dpc);
+}
+
+BOOLEAN
+KeCancelTimer(
+    IN  PKTIMER Timer
+    )
+{
+    BOOLEAN     Inserted;
+
+    pthread_mutex_lock(&ShimTimerLock);
+
+    Inserted = Timer->Inserted;
+    if (Inserted) {
+        RemoveEntryList(&Timer->TimerListEntry);
+        Timer->Inserted = FALSE;
+    }
+
+    pthread_mutex_unlock(&ShimTimerLock);
+
+    return Inserted;
+}
+
+BOOLEAN
+KeReadStateTimer(
+    IN  PKTIMER Timer
+    )
+{
+    return Timer->Inserted ? FALSE : TRUE;
+}
+
+static VOID
+ShimRunTimers(
+    VOID
+    )
+{
+    PLIST_ENTRY ListEntry;
+    ULONG64     Now;
+
+    Now = ShimQueryClock();
+
+    pthread_mutex_lock(&ShimTimerLock);
+
+    ListEntry = ShimTimerList.Flink;
+    while (ListEntry != &ShimTimerList) {
+        PKTIMER Timer = CONTAINING_RECORD(ListEntry, KTIMER, TimerListEntry);
+
+        ListEntry = ListEntry->Flink;
+
+        if ((ULONG64)Timer->DueTime > Now)
+            continue;
+
+        RemoveEntryList(&Timer->TimerListEntry);
+
+        if (Timer->Period != 0) {
+            Timer->DueTime = (LONGLONG)(Now + (ULONG64)Timer->Period * 1000000);
+            InsertTailList(&ShimTimerList, &Timer->TimerListEntry);
+        } else {
+            Timer->Inserted = FALSE;
+        }
+
+        if (Timer->Dpc != NULL)
+            (VOID) KeInsertQueueDpc(Timer->Dpc, NULL, NULL);
+    }
+
+    pthread_mutex_unlock(&ShimTimerLock);
+}
+
+// Events
+
+VOID
+KeInitializeEvent(
+    OUT PRKEVENT    Event,
+    IN  EVENT_TYPE  Type,
+    IN  BOOLEAN     State
+    )
+{
+    UNREFERENCED_PARAMETER(Type);
+
+    Event->State = State ? 1 : 0;
+}
+
+LONG
+KeSetEvent(
+    IN  PRKEVENT    Event,
+    IN  LONG        Increment,
+    IN  BOOLEAN     Wait
+    )
+{
+    UNREFERENCED_PARAMETER(Increment);
+    UNREFERENCED_PARAMETER(Wait);
+
+    return __atomic_exchange_n(&Event->State, 1, __ATOMIC_SEQ_CST);
+}
+
+VOID
+KeClearEvent(
+    IN  PRKEVENT    Event
+    )
+{
+    __atomic_store_n(&Event->State, 0, __ATOMIC_SEQ_CST);
+}
+
+LONG
+KeReadStateEvent(
+    IN  PRKEVENT    Event
+    )
+{
+    return __atomic_load_n(&Event->State, __ATOMIC_SEQ_CST);
+}
+
+// The only named event the driver opens is the low memory condition
+PKEVENT
+IoCreateNotificationEvent(
+    IN  PUNICODE_STRING EventName,
+    OUT PHANDLE         EventHandle
+    )
+{
+    UNREFERENCED_PARAMETER(EventName);
+
+    *EventHandle = &ShimLowMemoryEvent;
+    return &ShimLowMemoryEvent;
+}
+
+NTSTATUS
+ZwClose(
+    IN  HANDLE  Handle
+    )
+{
+    UNREFERENCED_PARAMETER(Handle);
+
+    return STATUS_SUCCESS;
+}
+
+// MDLs
+
+VOID
+MmInitializeMdl(
+    OUT PMDL    Mdl,
+    IN  PVOID   BaseVa,
+    IN  SIZE_T  Length
+    )
+{
+    Mdl->Next = NULL;
+    Mdl->Size = (SHORT)(sizeof (MDL) +
+                        sizeof (PFN_NUMBER) * ADDRESS_AND_SIZE_TO_SPAN_PAGES(BaseVa, Length));
+    Mdl->MdlFlags = 0;
+    Mdl->MappedSystemVa = NULL;
+    Mdl->StartVa = PAGE_ALIGN(BaseVa);
+    Mdl->ByteOffset = BYTE_OFFSET(BaseVa);
+    Mdl->ByteCount = (ULONG)Length;
+}
+
+VOID
+MmBuildMdlForNonPagedPool(
+    IN OUT  PMDL    Mdl
+    )
+{
+    Mdl->MappedSystemVa = MmGetMdlVirtualAddress(Mdl);
+    Mdl->MdlFlags |= MDL_SOURCE_IS_NONPAGED_POOL;
+}
+
+VOID
+MmPrepareMdlForReuse(
+    IN OUT  PMDL    Mdl
+    )
+{
+    Mdl->MdlFlags &= ~MDL_MAPPED_TO_SYSTEM_VA;
+    Mdl->MappedSystemVa = NULL;
+}
+
+PMDL
+IoAllocateMdl(
+    IN  PVOID   VirtualAddress,
+    IN  ULONG   Length,
+    IN  BOOLEAN SecondaryBuffer,
+    IN  BOOLEAN ChargeQuota,
+    IN  PVOID   Irp
+    )
+{
+    PMDL        Mdl;
+    SIZE_T      Size;
+
+    UNREFERENCED_PARAMETER(SecondaryBuffer);
+    UNREFERENCED_PARAMETER(ChargeQuota);
+    UNREFERENCED_PARAMETER(Irp);
+
+    Size = sizeof (MDL) +
+           sizeof (PFN_NUMBER) * ADDRESS_AND_SIZE_TO_SPAN_PAGES(VirtualAddress, Length);
+
+    Mdl = malloc(Size);
+    if (Mdl == NULL)
+        return NULL;
+
+    MmInitializeMdl(Mdl, VirtualAddress, Length);
+
+    SHIM_COUNT(Mdls, 1);
+    return Mdl;
+}
+
+VOID
+IoFreeMdl(
+    IN  PMDL    Mdl
+    )
+{
+    SHIM_COUNT(MdlFrees, 1);
+    free(Mdl);
+}
+
+VOID
+IoBuildPartialMdl(
+    IN  PMDL    SourceMdl,
+    IN  PMDL    TargetMdl,
+    IN  PVOID   VirtualAddress,
+    IN  ULONG   Length
+    )
+{
+    PUCHAR      Start;
+
+    Start = MmGetMdlVirtualAddress(SourceMdl);
+    if ((PUCHAR)VirtualAddress < Start ||
+        (PUCHAR)VirtualAddress + Length > Start + SourceMdl->ByteCount)
+        ShimFatal("partial MDL outside its source");
+
+    MmInitializeMdl(TargetMdl, VirtualAddress, Length);
+    TargetMdl->MappedSystemVa = VirtualAddress;
+    TargetMdl->MdlFlags = MDL_PARTIAL | MDL_MAPPED_TO_SYSTEM_VA;
+}
+
+PMDL
+NdisAllocateMdl(
+    IN  NDIS_HANDLE NdisHandle,
+    IN  PVOID       VirtualAddress,
+    IN  ULONG       Length
+    )
+{
+    PMDL            Mdl;
+
+    UNREFERENCED_PARAMETER(NdisHandle);
+
+    Mdl = IoAllocateMdl(VirtualAddress, Length, FALSE, FALSE, NULL);
+    if (Mdl != NULL)
+        MmBuildMdlForNonPagedPool(Mdl);
+
+    return Mdl;
+}
+
+VOID
+NdisFreeMdl(
+    IN  PMDL    Mdl
+    )
+{
+    IoFreeMdl(Mdl);
+}
+
+// Extended processor state
+
+ULONG64
+RtlGetEnabledExtendedFeatures(
+    IN  ULONG64 FeatureMask
+    )
+{
+    ULONG64     Enabled = 0;
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+        Enabled |= XSTATE_MASK_AVX;
+#endif
+
+    return Enabled & FeatureMask;
+}
+
+NTSTATUS
+KeSaveExtendedProcessorState(
+    IN  ULONG64         Mask,
+    OUT PXSTATE_SAVE    XStateSave
+    )
+{
+    XStateSave->Mask = Mask;
+    return STATUS_SUCCESS;
+}
+
+VOID
+KeRestoreExtendedProcessorState(
+    IN  PXSTATE_SAVE    XStateSave
+    )
+{
+    UNREFERENCED_PARAMETER(XStateSave);
+}
+
+// Routines the driver looks up rather than imports
+
+typedef struct _SHIM_SYSTEM_ROUTINE {
+    const CHAR  *Name;
+    PVOID       Address;
+    BOOLEAN     Hidden;
+} SHIM_SYSTEM_ROUTINE, *PSHIM_SYSTEM_ROUTINE;
+
+static SHIM_SYSTEM_ROUTINE  ShimSystemRoutine[] = {
+    { "RtlGetEnabledExtendedFeatures", (PVOID)RtlGetEnabledExtendedFeatures },
+    { "KeSaveExtendedProcessorState", (PVOID)KeSaveExtendedProcessorState },
+    { "KeRestoreExtendedProcessorState", (PVOID)KeRestoreExtendedProcessorState },
+};
+
+static PSHIM_SYSTEM_ROUTINE
+ShimFindSystemRoutine(
+    IN  const WCHAR     *Name,
+    IN  const CHAR      *AsciiName,
+    IN  ULONG           Length
+    )
+{
+    ULONG               Index;
+
+    for (Index = 0; Index < ARRAYSIZE(ShimSystemRoutine); Index++) {
+        PSHIM_SYSTEM_ROUTINE    Routine = &ShimSystemRoutine[Index];
+        ULONG                   Character;
+
+        if (strlen(Routine->Name) != Length)
+            continue;
+
+        for (Character = 0; Character < Length; Character++) {
+            CHAR    Expected = Routine->Name[Character];
+
+            if ((Name != NULL && Name[Character] != (WCHAR)Expected) ||
+                (AsciiName != NULL && AsciiName[Character] != Expected))
+                break;
+        }
+
+        if (Character == Length)
+            return Routine;
+    }
+
+    return NULL;
+}
+
+VOID
+ShimSetSystemRoutineHidden(
+    IN  const CHAR          *Name,
+    IN  BOOLEAN             Hidden
+    )
+{
+    PSHIM_SYSTEM_ROUTINE    Routine;
+
+    Routine = ShimFindSystemRoutine(NULL, Name, (ULONG)strlen(Name));
+    SHIM_CHECK(Routine != NULL);
+
+    Routine->Hidden = Hidden;
+}
+
+PVOID
+MmGetSystemRoutineAddress(
+    IN  PUNICODE_STRING     SystemRoutineName
+    )
+{
+    PSHIM_SYSTEM_ROUTINE    Routine;
+
+    if (KeGetCurrentIrql() != PASSIVE_LEVEL)
+        ShimFatal("IRQL_NOT_LESS_OR_EQUAL");
+
+    Routine = ShimFindSystemRoutine(SystemRoutineName->Buffer,
+                                    NULL,
+                                    SystemRoutineName->Length / sizeof (WCHAR));
+    if (Routine == NULL || Routine->Hidden)
+        return NULL;
+
+    return Routine->Address;
+}
+
+// Run-time library
+
+VOID
+RtlInitUnicodeString(
+    OUT PUNICODE_STRING DestinationString,
+    IN  PCWSTR          SourceString
+    )
+{
+    USHORT              Length;
+
+    Length = 0;
+    if (SourceString != NULL)
+        while (SourceString[Length] != 0)
+            Length++;
+
+    DestinationString->Buffer = (PWSTR)SourceString;
+    DestinationString->Length = Length * sizeof (WCHAR);
+    DestinationString->MaximumLength = DestinationString->Length + sizeof (WCHAR);
+}
+
+ULONG
+RtlRandomEx(
+    IN OUT  PULONG  Seed
+    )
+{
+    *Seed = *Seed * 1103515245 + 12345;
+    return (*Seed >> 1) & 0x7FFFFFFF;
+}
+
+// Debugger
+
+ULONG
+vDbgPrintExWithPrefix(
+    IN  PCSTR   Prefix,
+    IN  ULONG   ComponentId,
+    IN  ULONG   Level,
+    IN  PCSTR   Format,
+    IN  va_list Arguments
+    )
+{
+    UNREFERENCED_PARAMETER(ComponentId);
+
+    if (ShimDebugLevel == SHIM_DEBUG_QUIET || Level > ShimDebugLevel)
+        return 0;
+
+    fputs(Prefix, stderr);
+    vfprintf(stderr, Format, Arguments);
+    return 0;
+}
+
+NTSTATUS
+DbgSetDebugFilterState(
+    IN  ULONG   ComponentId,
+    IN  ULONG   Level,
+    IN  BOOLEAN State
+    )
+{
+    UNREFERENCED_PARAMETER(ComponentId);
+    UNREFERENCED_PARAMETER(Level);
+    UNREFERENCED_PARAMETER(State);
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+DbgBreakPoint(
+    VOID
+    )
+{
+    ShimFatal("breakpoint");
+}
+
+VOID
+DbgRaiseAssertionFailure(
+    VOID
+    )
+{
+    ShimFatal("assertion failure");
+}
+
+VOID
+KeBugCheckEx(
+    IN  ULONG       BugCheckCode,
+    IN  ULONG_PTR   BugCheckParameter1,
+    IN  ULONG_PTR   BugCheckParameter2,
+    IN  ULONG_PTR   BugCheckParameter3,
+    IN  ULONG_PTR   BugCheckParameter4
+    )
+{
+    fprintf(stderr, "BUGCHECK %08x (%llx, %llx, %llx, %llx)\n",
+            BugCheckCode,
+            BugCheckParameter1,
+            BugCheckParameter2,
+            BugCheckParameter3,
+            BugCheckParameter4);
+    ShimFatal("bugcheck");
+}
+
+// NET_BUFFER_LIST pools. A NET_BUFFER_LIST, its NET_BUFFER and its
+// context area are allocated together.
+
+typedef struct _SHIM_NET_BUFFER_LIST_POOL {
+    NET_BUFFER_LIST_POOL_PARAMETERS Parameters;
+} SHIM_NET_BUFFER_LIST_POOL, *PSHIM_NET_BUFFER_LIST_POOL;
+
+typedef struct _SHIM_NET_BUFFER_LIST {
+    NET_BUFFER_LIST NetBufferList;
+    NET_BUFFER      NetBuffer;
+    USHORT          ContextSize;
+    UCHAR           Context[] __attribute__((aligned(MEMORY_ALLOCATION_ALIGNMENT)));
+} SHIM_NET_BUFFER_LIST, *PSHIM_NET_BUFFER_LIST;
+
+NDIS_HANDLE
+NdisAllocateNetBufferListPool(
+    IN  NDIS_HANDLE                         NdisHandle,
+    IN  PNET_BUFFER_LIST_POOL_PARAMETERS    Parameters
+    )
+{
+    PSHIM_NET_BUFFER_LIST_POOL              Pool;
+
+    UNREFERENCED_PARAMETER(NdisHandle);
+
+    Pool = ExAllocatePoolWithTag(NonPagedPool, sizeof (SHIM_NET_BUFFER_LIST_POOL), 'MIHS');
+    if (Pool == NULL)
+        return NULL;
+
+    Pool->Parameters = *Parameters;
+    return Pool;
+}
+
+VOID
+NdisFreeNetBufferListPool(
+    IN  NDIS_HANDLE PoolHandle
+    )
+{
+    ExFreePool(PoolHandle);
+}
+
+static VOID
+ShimSetNetBufferData(
+    IN  PNET_BUFFER NetBuffer,
+    IN  PMDL        MdlChain,
+    IN  ULONG       DataOffset,
+    IN  ULONG       DataLength
+    )
+{
+    PMDL            Mdl;
+    ULONG           Offset;
+
+    Mdl = MdlChain;
+    Offset = DataOffset;
+    while (Mdl != NULL && Offset >= Mdl->ByteCount && Mdl->Next != NULL) {
+        Offset -= Mdl->ByteCount;
+        Mdl = Mdl->Next;
+    }
+
+    NetBuffer->MdlChain = MdlChain;
+    NetBuffer->CurrentMdl = Mdl;
+    NetBuffer->CurrentMdlOffset = Offset;
+    NetBuffer->DataOffset = DataOffset;
+    NetBuffer->DataLength = DataLength;
+}
+
+static PNET_BUFFER_LIST
+ShimAllocateNetBufferList(
+    IN  NDIS_HANDLE PoolHandle,
+    IN  USHORT      ContextSize,
+    IN  BOOLEAN     AllocateNetBuffer
+    )
+{
+    PSHIM_NET_BUFFER_LIST_POOL  Pool = PoolHandle;
+    PSHIM_NET_BUFFER_LIST       Shim;
+    USHORT                      Size;
+
+    Size = Pool->Parameters.ContextSize + ContextSize;
+
+    Shim = calloc(1, sizeof (SHIM_NET_BUFFER_LIST) + Size);
+    if (Shim == NULL)
+        return NULL;
+
+    Shim->ContextSize = Size;
+    Shim->NetBufferList.Context = Shim->Context;
+    Shim->NetBufferList.NdisPoolHandle = Pool;
+    if (AllocateNetBuffer)
+        Shim->NetBufferList.FirstNetBuffer = &Shim->NetBuffer;
+
+    SHIM_COUNT(NetBufferLists, 1);
+    return &Shim->NetBufferList;
+}
+
+PNET_BUFFER_LIST
+NdisAllocateNetBufferList(
+    IN  NDIS_HANDLE PoolHandle,
+    IN  USHORT      ContextSize,
+    IN  USHORT      ContextBackFill
+    )
+{
+    UNREFERENCED_PARAMETER(ContextBackFill);
+
+    return ShimAllocateNetBufferList(PoolHandle, ContextSize, FALSE);
+}
+
+PNET_BUFFER_LIST
+NdisAllocateNetBufferAndNetBufferList(
+    IN  NDIS_HANDLE PoolHandle,
+    IN  USHORT      ContextSize,
+    IN  USHORT      ContextBackFill,
+    IN  PMDL        MdlChain,
+    IN  ULONG       DataOffset,
+    IN  SIZE_T      DataLength
+    )
+{
+    PNET_BUFFER_LIST    NetBufferList;
+
+    UNREFERENCED_PARAMETER(ContextBackFill);
+
+    NetBufferList = ShimAllocateNetBufferList(PoolHandle, ContextSize, TRUE);
+    if (NetBufferList == NULL)
+        return NULL;
+
+    ShimSetNetBufferData(NetBufferList->FirstNetBuffer,
+                         MdlChain,
+                         DataOffset,
+                         (ULONG)DataLength);
+
+    return NetBufferList;
+}
+
+VOID
+NdisFreeNetBufferList(
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    PSHIM_NET_BUFFER_LIST   Shim;
+
+    if (NetBufferList->NdisPoolHandle == NULL)
+        ShimFatal("freeing a NET_BUFFER_LIST that did not come from a pool");
+
+    Shim = CONTAINING_RECORD(NetBufferList, SHIM_NET_BUFFER_LIST, NetBufferList);
+    Shim->NetBufferList.NdisPoolHandle = NULL;
+
+    SHIM_COUNT(NetBufferListFrees, 1);
+    free(Shim);
+}
+
+VOID
+NdisFreeNetBufferListContext(
+    IN  PNET_BUFFER_LIST    NetBufferList,
+    IN  USHORT              ContextSize
+    )
+{
+    UNREFERENCED_PARAMETER(NetBufferList);
+    UNREFERENCED_PARAMETER(ContextSize);
+}
+
+PVOID
+NdisGetDataBuffer(
+    IN  PNET_BUFFER NetBuffer,
+    IN  ULONG       BytesNeeded,
+    IN  PVOID       Storage OPTIONAL,
+    IN  ULONG       AlignMultiple,
+    IN  ULONG       AlignOffset
+    )
+{
+    PMDL            Mdl;
+    ULONG           Offset;
+    PUCHAR          Buffer;
+    ULONG           Copied;
+
+    if (BytesNeeded == 0 || BytesNeeded > NetBuffer->DataLength)
+        return NULL;
+
+    Mdl = NetBuffer->CurrentMdl;
+    Offset = NetBuffer->CurrentMdlOffset;
+
+    Buffer = (PUCHAR)MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority) + Offset;
+    if (Mdl->ByteCount - Offset >= BytesNeeded &&
+        (AlignMultiple <= 1 ||
+         ((ULONG_PTR)Buffer - AlignOffset) % AlignMultiple == 0))
+        return Buffer;
+
+    if (Storage == NULL)
+        return NULL;
+
+    Copied = 0;
+    while (Copied < BytesNeeded) {
+        ULONG   Length;
+
+        if (Mdl == NULL)
+            return NULL;
+
+        Buffer = (PUCHAR)MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority) + Offset;
+        Length = Mdl->ByteCount - Offset;
+        if (Length > BytesNeeded - Copied)
+            Length = BytesNeeded - Copied;
+
+        RtlCopyMemory((PUCHAR)Storage + Copied, Buffer, Length);
+        Copied += Length;
+
+        Mdl = Mdl->Next;
+        Offset = 0;
+    }
+
+    return Storage;
+}
+
+// Indications
+
+VOID
+NdisMIndicateReceiveNetBufferLists(
+    IN  NDIS_HANDLE         MiniportAdapterHandle,
+    IN  PNET_BUFFER_LIST    NetBufferLists,
+    IN  NDIS_PORT_NUMBER    PortNumber,
+    IN  ULONG               NumberOfNetBufferLists,
+    IN  ULONG               ReceiveFlags
+    )
+{
+    UNREFERENCED_PARAMETER(PortNumber);
+
+    if (ShimIndicateReceive == NULL)
+        ShimFatal("no receive indication handler");
+
+    if ((ReceiveFlags & NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL) &&
+        ShimIrql != DISPATCH_LEVEL)
+        ShimFatal("NDIS_RECEIVE_FLAGS_DISPATCH_LEVEL set below DISPATCH_LEVEL");
+
+    ShimIndicateReceive(MiniportAdapterHandle,
+                        NetBufferLists,
+                        NumberOfNetBufferLists,
+                        ReceiveFlags);
+}
+
+VOID
+NdisMSendNetBufferListsComplete(
+    IN  NDIS_HANDLE         MiniportAdapterHandle,
+    IN  PNET_BUFFER_LIST    NetBufferLists,
+    IN  ULONG               SendCompleteFlags
+    )
+{
+    if (ShimSendComplete == NULL)
+        ShimFatal("no send completion handler");
+
+    if ((SendCompleteFlags & NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL) &&
+        ShimIrql != DISPATCH_LEVEL)
+        ShimFatal("NDIS_SEND_COMPLETE_FLAGS_DISPATCH_LEVEL set below DISPATCH_LEVEL");
+
+    ShimSendComplete(MiniportAdapterHandle,
+                     NetBufferLists,
+                     SendCompleteFlags);
+}
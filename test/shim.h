@@ -0,0 +1,214 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Controls for the user-mode kernel and NDIS shim, used by the harness
+// and tests but never by the driver sources themselves.
+
+#ifndef _TEST_SHIM_H
+#define _TEST_SHIM_H
+
+#include <ndis.h>
+
+// Checks made by the harness and tests whatever the build: a failure
+// reports the condition and aborts.
+#define SHIM_CHECK(_Condition)                                          \
+        do {                                                            \
+            if (!(_Condition))                                          \
+                ShimCheckFailed(#_Condition, __FILE__, __LINE__);       \
+        } while (FALSE)
+
+VOID __attribute__((noreturn))
+ShimCheckFailed(
+    IN  const CHAR  *Condition,
+    IN  const CHAR  *File,
+    IN  ULONG       Line
+    );
+
+// KeQueryPerformanceCounter() ticks per second
+#define SHIM_CLOCK_FREQUENCY    1000000000ull
+
+// Creates ProcessorCount simulated processors, split into groups of
+// GroupSize (0 for a single group). Must be called before anything else.
+VOID
+ShimInitialize(
+    IN  ULONG   ProcessorCount,
+    IN  ULONG   GroupSize
+    );
+
+VOID
+ShimTeardown(
+    VOID
+    );
+
+// Makes the calling thread act as processor Index. Two threads must never
+// act as the same processor at the same time.
+VOID
+ShimSetCurrentProcessor(
+    IN  ULONG   Index
+    );
+
+ULONG
+ShimGetProcessorCount(
+    VOID
+    );
+
+// Runs the DPCs queued to processor Index, and any that they queue to
+// it, on the calling thread. Timers that have expired fire first.
+VOID
+ShimRunDpcs(
+    IN  ULONG   Index
+    );
+
+// Runs the DPCs queued to every processor until all queues are empty.
+VOID
+ShimRunAllDpcs(
+    VOID
+    );
+
+ULONG
+ShimQueuedDpcs(
+    IN  ULONG   Index
+    );
+
+// By default the clock is CLOCK_MONOTONIC. A manual clock only moves when
+// ShimAdvanceClock() is called, which makes time-based behaviour
+// deterministic.
+VOID
+ShimSetManualClock(
+    IN  BOOLEAN Manual
+    );
+
+VOID
+ShimAdvanceClock(
+    IN  ULONG64 Ticks
+    );
+
+// While the clock is manual, every KeQueryPerformanceCounter() call moves
+// it on by Ticks, as if the driver took that long between reads. 0 stops
+// it.
+VOID
+ShimSetClockStep(
+    IN  ULONG64 Ticks
+    );
+
+ULONG64
+ShimQueryClock(
+    VOID
+    );
+
+typedef struct _SHIM_ALLOCATIONS {
+    LONG64  Pool;
+    LONG64  PoolFrees;
+    LONG64  NetBufferLists;
+    LONG64  NetBufferListFrees;
+    LONG64  Mdls;
+    LONG64  MdlFrees;
+} SHIM_ALLOCATIONS, *PSHIM_ALLOCATIONS;
+
+VOID
+ShimQueryAllocations(
+    OUT PSHIM_ALLOCATIONS   Allocations
+    );
+
+static FORCEINLINE LONG64
+ShimAllocationCount(
+    IN  PSHIM_ALLOCATIONS   Allocations
+    )
+{
+    return Allocations->Pool +
+           Allocations->NetBufferLists +
+           Allocations->Mdls;
+}
+
+static FORCEINLINE LONG64
+ShimOutstandingCount(
+    IN  PSHIM_ALLOCATIONS   Allocations
+    )
+{
+    return ShimAllocationCount(Allocations) -
+           Allocations->PoolFrees -
+           Allocations->NetBufferListFrees -
+           Allocations->MdlFrees;
+}
+
+// Sets the state of the \KernelObjects\LowMemoryCondition event
+VOID
+ShimSetLowMemory(
+    IN  BOOLEAN Low
+    );
+
+// Makes MmGetSystemRoutineAddress() fail to find, or find again, one of
+// the routines it knows about, as on a kernel that does not export it.
+VOID
+ShimSetSystemRoutineHidden(
+    IN  const CHAR  *Name,
+    IN  BOOLEAN     Hidden
+    );
+
+// Messages at or below Level are printed (DPFLTR_ERROR_LEVEL by default,
+// or the value of XENNET_DEBUG in the environment). SHIM_DEBUG_QUIET
+// prints nothing, for tests that provoke errors on purpose.
+#define SHIM_DEBUG_QUIET    ((ULONG)-1)
+
+VOID
+ShimSetDebugLevel(
+    IN  ULONG   Level
+    );
+
+// Where NdisMIndicateReceiveNetBufferLists() and
+// NdisMSendNetBufferListsComplete() deliver to. The handle is whatever
+// the driver passes, i.e. Adapter->NdisAdapterHandle.
+typedef VOID
+(*SHIM_INDICATE_RECEIVE)(
+    IN  NDIS_HANDLE         NdisHandle,
+    IN  PNET_BUFFER_LIST    NetBufferLists,
+    IN  ULONG               Count,
+    IN  ULONG               Flags
+    );
+
+typedef VOID
+(*SHIM_SEND_COMPLETE)(
+    IN  NDIS_HANDLE         NdisHandle,
+    IN  PNET_BUFFER_LIST    NetBufferLists,
+    IN  ULONG               Flags
+    );
+
+VOID
+ShimSetIndicateReceive(
+    IN  SHIM_INDICATE_RECEIVE   Function
+    );
+
+VOID
+ShimSetSendComplete(
+    IN  SHIM_SEND_COMPLETE      Function
+    );
+
+#endif  // _TEST_SHIM_H
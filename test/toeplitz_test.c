@@ -0,0 +1,382 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Tests of the Toeplitz hash: the verification vectors Microsoft
+// publishes for RSS, the table and carry-less multiply paths against the
+// bitwise reference for random keys and inputs of every length, and the
+// cost per hash of each path. The driver source is included so that the
+// path can be chosen directly.
+//
+// toeplitz_test [iterations [seed]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/xennet/toeplitz.c"
+
+#include "shim.h"
+#include "toeplitz_vectors.h"
+
+#define TOEPLITZ_TEST_BATCH         1024
+#define TOEPLITZ_TEST_ROUNDS        200
+
+static ULONG64  ToeplitzTestState;
+static ULONG    ToeplitzTestFailures;
+static BOOLEAN  ToeplitzTestClmul;
+
+// Keeps the benchmarked hashes from being optimized away
+static volatile ULONG   ToeplitzTestSink;
+
+static ULONG
+ToeplitzTestRandom(
+    IN  ULONG   Limit
+    )
+{
+    // xorshift64*
+    ToeplitzTestState ^= ToeplitzTestState >> 12;
+    ToeplitzTestState ^= ToeplitzTestState << 25;
+    ToeplitzTestState ^= ToeplitzTestState >> 27;
+
+    return (ULONG)(((ToeplitzTestState * 2685821657736338717ull) >> 32) % Limit);
+}
+
+static VOID
+ToeplitzTestFill(
+    IN  PUCHAR  Data,
+    IN  ULONG   Length
+    )
+{
+    ULONG       Index;
+
+    for (Index = 0; Index < Length; Index++)
+        Data[Index] = (UCHAR)ToeplitzTestRandom(256);
+}
+
+// Hashes Tuple with the table and, if the CPU has it, the carry-less
+// multiply path and checks both against Expected.
+static VOID
+ToeplitzTestCheck(
+    IN  const CHAR      *What,
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  PTOEPLITZ_TUPLE Tuple,
+    IN  ULONG           Expected
+    )
+{
+    ULONG               Hash;
+
+    ToeplitzKey->Clmul = FALSE;
+    ToeplitzHashBatch(ToeplitzKey, Tuple, 1, &Hash);
+
+    if (Hash != Expected) {
+        fprintf(stderr, "%s: length %u: table expected %08x got %08x\n",
+                What, Tuple->Length, Expected, Hash);
+        ToeplitzTestFailures++;
+    }
+
+    if (!ToeplitzTestClmul)
+        return;
+
+    ToeplitzKey->Clmul = TRUE;
+    ToeplitzHashBatch(ToeplitzKey, Tuple, 1, &Hash);
+
+    if (Hash != Expected) {
+        fprintf(stderr, "%s: length %u: clmul expected %08x got %08x\n",
+                What, Tuple->Length, Expected, Hash);
+        ToeplitzTestFailures++;
+    }
+}
+
+static VOID
+ToeplitzTestAppend(
+    IN  PTOEPLITZ_TUPLE Tuple,
+    IN  const UCHAR     *Data,
+    IN  ULONG           Length
+    )
+{
+    memcpy(Tuple->Data + Tuple->Length, Data, Length);
+    Tuple->Length += Length;
+}
+
+static VOID
+ToeplitzVectors(
+    IN  PTOEPLITZ_KEY   ToeplitzKey
+    )
+{
+    ULONG               Index;
+
+    ToeplitzSetKey(ToeplitzKey, ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH);
+
+    for (Index = 0; Index < ARRAYSIZE(ToeplitzVector); Index++) {
+        const TOEPLITZ_VECTOR  *Vector = &ToeplitzVector[Index];
+        TOEPLITZ_TUPLE              Tuple;
+        UCHAR                       Port[4];
+        ULONG                       Hash;
+
+        Tuple.Length = 0;
+        ToeplitzTestAppend(&Tuple, Vector->SourceAddress, Vector->AddressLength);
+        ToeplitzTestAppend(&Tuple, Vector->DestinationAddress, Vector->AddressLength);
+
+        Hash = ToeplitzHash(ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH,
+                            Tuple.Data, Tuple.Length);
+        if (Hash != Vector->Hash) {
+            fprintf(stderr, "vector %u: reference expected %08x got %08x\n",
+                    Index, Vector->Hash, Hash);
+            ToeplitzTestFailures++;
+        }
+
+        ToeplitzTestCheck("vector", ToeplitzKey, &Tuple, Vector->Hash);
+
+        Port[0] = (UCHAR)(Vector->SourcePort >> 8);
+        Port[1] = (UCHAR)Vector->SourcePort;
+        Port[2] = (UCHAR)(Vector->DestinationPort >> 8);
+        Port[3] = (UCHAR)Vector->DestinationPort;
+        ToeplitzTestAppend(&Tuple, Port, sizeof (Port));
+
+        Hash = ToeplitzHash(ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH,
+                            Tuple.Data, Tuple.Length);
+        if (Hash != Vector->HashWithPorts) {
+            fprintf(stderr, "vector %u with ports: reference expected %08x got %08x\n",
+                    Index, Vector->HashWithPorts, Hash);
+            ToeplitzTestFailures++;
+        }
+
+        ToeplitzTestCheck("vector with ports", ToeplitzKey, &Tuple, Vector->HashWithPorts);
+    }
+}
+
+// Every single-byte input at every offset exercises every table entry
+// and every key window; random inputs of every length then check that
+// the contributions combine. Keys shorter than the input plus four bytes
+// are zero-filled.
+static VOID
+ToeplitzTestKey(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  const UCHAR     *Key,
+    IN  ULONG           KeyLength
+    )
+{
+    TOEPLITZ_TUPLE      Tuple;
+    ULONG               Length;
+    ULONG               Offset;
+    ULONG               Value;
+    ULONG               Iteration;
+
+    ToeplitzSetKey(ToeplitzKey, Key, KeyLength);
+
+    for (Offset = 0; Offset < TOEPLITZ_MAXIMUM_INPUT_LENGTH; Offset++) {
+        RtlZeroMemory(&Tuple, sizeof (Tuple));
+        Tuple.Length = Offset + 1;
+
+        for (Value = 0; Value < 256; Value++) {
+            Tuple.Data[Offset] = (UCHAR)Value;
+            ToeplitzTestCheck("byte", ToeplitzKey, &Tuple,
+                              ToeplitzHash(Key, KeyLength, Tuple.Data, Tuple.Length));
+        }
+    }
+
+    for (Length = 0; Length <= TOEPLITZ_MAXIMUM_INPUT_LENGTH; Length++) {
+        for (Iteration = 0; Iteration < 16; Iteration++) {
+            Tuple.Length = Length;
+            ToeplitzTestFill(Tuple.Data, Length);
+
+            ToeplitzTestCheck("random", ToeplitzKey, &Tuple,
+                              ToeplitzHash(Key, KeyLength, Tuple.Data, Tuple.Length));
+        }
+    }
+}
+
+// A batch of tuples of mixed lengths hashes as each would on its own
+static VOID
+ToeplitzTestBatch(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  PTOEPLITZ_TUPLE Tuple,
+    IN  PULONG          Hash
+    )
+{
+    ULONG               Index;
+    ULONG               Clmul;
+
+    ToeplitzSetKey(ToeplitzKey, ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH);
+
+    for (Index = 0; Index < TOEPLITZ_TEST_BATCH; Index++) {
+        Tuple[Index].Length = ToeplitzTestRandom(TOEPLITZ_MAXIMUM_INPUT_LENGTH + 1);
+        ToeplitzTestFill(Tuple[Index].Data, Tuple[Index].Length);
+    }
+
+    for (Clmul = 0; Clmul <= (ULONG)ToeplitzTestClmul; Clmul++) {
+        ToeplitzKey->Clmul = (BOOLEAN)Clmul;
+
+        // Nothing is written for an empty batch
+        Hash[0] = 0xdeadbeef;
+        ToeplitzHashBatch(ToeplitzKey, Tuple, 0, Hash);
+        SHIM_CHECK(Hash[0] == 0xdeadbeef);
+
+        ToeplitzHashBatch(ToeplitzKey, Tuple, TOEPLITZ_TEST_BATCH, Hash);
+
+        for (Index = 0; Index < TOEPLITZ_TEST_BATCH; Index++) {
+            ULONG   Expected;
+
+            Expected = ToeplitzHash(ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH,
+                                    Tuple[Index].Data, Tuple[Index].Length);
+            if (Hash[Index] == Expected)
+                continue;
+
+            fprintf(stderr, "batch %s: tuple %u length %u: expected %08x got %08x\n",
+                    Clmul ? "clmul" : "table", Index, Tuple[Index].Length,
+                    Expected, Hash[Index]);
+            ToeplitzTestFailures++;
+        }
+    }
+}
+
+// Nanoseconds per hash of each path over batches of tuples the length of
+// the IPv4 and IPv6 inputs with and without ports.
+static VOID
+ToeplitzTestBenchmark(
+    IN  PTOEPLITZ_KEY   ToeplitzKey,
+    IN  PTOEPLITZ_TUPLE Tuple,
+    IN  PULONG          Hash
+    )
+{
+    static const ULONG  Length[] = { 8, 12, 32, 36 };
+    ULONG               Index;
+
+    ToeplitzSetKey(ToeplitzKey, ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH);
+
+    for (Index = 0; Index < ARRAYSIZE(Length); Index++) {
+        ULONG64 Elapsed[3];
+        ULONG64 Start;
+        ULONG   Round;
+        ULONG   Tuples;
+
+        for (Tuples = 0; Tuples < TOEPLITZ_TEST_BATCH; Tuples++) {
+            Tuple[Tuples].Length = Length[Index];
+            ToeplitzTestFill(Tuple[Tuples].Data, Length[Index]);
+        }
+
+        Start = ShimQueryClock();
+        for (Round = 0; Round < TOEPLITZ_TEST_ROUNDS; Round++)
+            for (Tuples = 0; Tuples < TOEPLITZ_TEST_BATCH; Tuples++)
+                ToeplitzTestSink ^= ToeplitzHash(ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH,
+                                     Tuple[Tuples].Data, Tuple[Tuples].Length);
+        Elapsed[0] = ShimQueryClock() - Start;
+
+        ToeplitzKey->Clmul = FALSE;
+
+        Start = ShimQueryClock();
+        for (Round = 0; Round < TOEPLITZ_TEST_ROUNDS; Round++) {
+            ToeplitzHashBatch(ToeplitzKey, Tuple, TOEPLITZ_TEST_BATCH, Hash);
+            ToeplitzTestSink ^= Hash[Round % TOEPLITZ_TEST_BATCH];
+        }
+        Elapsed[1] = ShimQueryClock() - Start;
+
+        Elapsed[2] = 0;
+        if (ToeplitzTestClmul) {
+            ToeplitzKey->Clmul = TRUE;
+
+            Start = ShimQueryClock();
+            for (Round = 0; Round < TOEPLITZ_TEST_ROUNDS; Round++) {
+                ToeplitzHashBatch(ToeplitzKey, Tuple, TOEPLITZ_TEST_BATCH, Hash);
+                ToeplitzTestSink ^= Hash[Round % TOEPLITZ_TEST_BATCH];
+            }
+            Elapsed[2] = ShimQueryClock() - Start;
+        }
+
+        printf("toeplitz_test: %2u bytes: reference %6.1f table %5.1f clmul %5.1f ns per hash\n",
+               Length[Index],
+               (double)Elapsed[0] / (TOEPLITZ_TEST_ROUNDS * TOEPLITZ_TEST_BATCH),
+               (double)Elapsed[1] / (TOEPLITZ_TEST_ROUNDS * TOEPLITZ_TEST_BATCH),
+               (double)Elapsed[2] / (TOEPLITZ_TEST_ROUNDS * TOEPLITZ_TEST_BATCH));
+    }
+}
+
+int
+main(
+    IN  int         argc,
+    IN  char        **argv
+    )
+{
+    ULONG           Iterations;
+    ULONG64         Seed;
+    PTOEPLITZ_KEY   ToeplitzKey;
+    PTOEPLITZ_TUPLE Tuple;
+    PULONG          Hash;
+    UCHAR           Key[TOEPLITZ_VECTOR_KEY_LENGTH];
+    ULONG           Iteration;
+
+    Iterations = (argc > 1) ? (ULONG)strtoul(argv[1], NULL, 0) : 32;
+    Seed = (argc > 2) ? strtoull(argv[2], NULL, 0) : (ULONG64)time(NULL);
+
+    printf("toeplitz_test: %u iterations seed %llu\n", Iterations, Seed);
+    ToeplitzTestState = Seed | 1;
+
+    ToeplitzKey = malloc(sizeof (TOEPLITZ_KEY));
+    Tuple = calloc(TOEPLITZ_TEST_BATCH, sizeof (TOEPLITZ_TUPLE));
+    Hash = calloc(TOEPLITZ_TEST_BATCH, sizeof (ULONG));
+    SHIM_CHECK(ToeplitzKey != NULL && Tuple != NULL && Hash != NULL);
+
+    ToeplitzTestClmul = __ToeplitzHaveClmul();
+    printf("toeplitz_test: clmul %s\n", ToeplitzTestClmul ? "available" : "not available");
+
+    ToeplitzVectors(ToeplitzKey);
+
+    ToeplitzTestKey(ToeplitzKey, ToeplitzVectorKey, TOEPLITZ_VECTOR_KEY_LENGTH);
+
+    for (Iteration = 0; Iteration < Iterations; Iteration++) {
+        ULONG   KeyLength;
+
+        // Half of them too short for the longest inputs
+        KeyLength = (Iteration & 1) ?
+                    TOEPLITZ_VECTOR_KEY_LENGTH :
+                    ToeplitzTestRandom(TOEPLITZ_VECTOR_KEY_LENGTH + 1);
+
+        ToeplitzTestFill(Key, KeyLength);
+        ToeplitzTestKey(ToeplitzKey, Key, KeyLength);
+    }
+
+    ToeplitzTestBatch(ToeplitzKey, Tuple, Hash);
+
+    if (ToeplitzTestFailures != 0) {
+        printf("toeplitz_test: %u failures\n", ToeplitzTestFailures);
+        return 1;
+    }
+
+    ToeplitzTestBenchmark(ToeplitzKey, Tuple, Hash);
+
+    free(Hash);
+    free(Tuple);
+    free(ToeplitzKey);
+
+    printf("toeplitz_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// The RSS hash verification key and examples published by Microsoft in
+// "Verifying the RSS Hash Calculation", shared by the tests of the hash
+// itself and of the receive path.
+
+#ifndef _TEST_TOEPLITZ_VECTORS_H
+#define _TEST_TOEPLITZ_VECTORS_H
+
+#include <ndis.h>
+
+#define TOEPLITZ_VECTOR_KEY_LENGTH  40
+
+static const UCHAR  ToeplitzVectorKey[TOEPLITZ_VECTOR_KEY_LENGTH] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+typedef struct _TOEPLITZ_VECTOR {
+    ULONG   AddressLength;
+    UCHAR   SourceAddress[16];
+    UCHAR   DestinationAddress[16];
+    USHORT  SourcePort;
+    USHORT  DestinationPort;
+    ULONG   Hash;           // Over the addresses
+    ULONG   HashWithPorts;  // Over the addresses and TCP ports
+} TOEPLITZ_VECTOR, *PTOEPLITZ_VECTOR;
+
+// Addresses in network byte order, ports in host order
+static const TOEPLITZ_VECTOR  ToeplitzVector[] = {
+    { 4, { 66, 9, 149, 187 }, { 161, 142, 100, 80 },
+      2794, 1766, 0x323e8fc2, 0x51ccc178 },
+    { 4, { 199, 92, 111, 2 }, { 65, 69, 140, 83 },
+      14230, 4739, 0xd718262a, 0xc626b0ea },
+    { 4, { 24, 19, 198, 95 }, { 12, 22, 207, 184 },
+      12898, 38024, 0xd2d0a5de, 0x5c2b394a },
+    { 4, { 38, 27, 205, 30 }, { 209, 142, 163, 6 },
+      48228, 2217, 0x82989176, 0xafc7327f },
+    { 4, { 153, 39, 163, 191 }, { 202, 188, 127, 2 },
+      44251, 1303, 0x5d1809c5, 0x10e828a2 },
+
+    // 3ffe:2501:200:1fff::7 -> 3ffe:2501:200:3::1
+    { 16, { 0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07 },
+          { 0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 },
+      2794, 1766, 0x2cc18cd5, 0x40207d3d },
+
+    // 3ffe:501:8::260:97ff:fe40:efab -> ff02::1
+    { 16, { 0x3f, 0xfe, 0x05, 0x01, 0x00, 0x08, 0x00, 0x00,
+            0x02, 0x60, 0x97, 0xff, 0xfe, 0x40, 0xef, 0xab },
+          { 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 },
+      14230, 4739, 0x0f0c461c, 0xdde51bbf },
+
+    // 3ffe:1900:4545:3:200:f8ff:fe21:67cf -> fe80::200:f8ff:fe21:67cf
+    { 16, { 0x3f, 0xfe, 0x19, 0x00, 0x45, 0x45, 0x00, 0x03,
+            0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf },
+          { 0xfe, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x02, 0x00, 0xf8, 0xff, 0xfe, 0x21, 0x67, 0xcf },
+      44251, 38024, 0x4b61e985, 0x02d1feef },
+};
+
+#endif  // _TEST_TOEPLITZ_VECTORS_H
@@ -0,0 +1,963 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// Tests of the transmit path. The driver source is included so that its
+// static functions can be called directly; everything else runs over the
+// mock backend through the harness. Each test brings up its own adapter
+// and fails by aborting.
+//
+// transmitter_test [test ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/xennet/transmitter.c"
+
+#include "harness.h"
+
+typedef struct _TRANSMITTER_TEST {
+    const CHAR  *Name;
+    VOID        (*Function)(VOID);
+} TRANSMITTER_TEST, *PTRANSMITTER_TEST;
+
+static PROPERTIES   TransmitterTestProperties;
+static ULONG64      TransmitterTestSent;
+
+// Creates an adapter on ProcessorCount processors over a backend with the
+// given configuration (NULL for the default) and with the default
+// properties adjusted by any property assignments given, terminated by
+// NULL.
+static PADAPTER
+TransmitterTestCreateAdapter(
+    IN  ULONG                   ProcessorCount,
+    IN  PMOCK_VIF_CONFIGURATION Configuration OPTIONAL,
+    ...
+    )
+{
+    va_list                     Arguments;
+    const CHAR                  *Assignment;
+
+    HarnessInitialize(ProcessorCount, 0);
+    HarnessDefaultProperties(&TransmitterTestProperties);
+    TransmitterTestSent = 0;
+
+    va_start(Arguments, Configuration);
+    while ((Assignment = va_arg(Arguments, const CHAR *)) != NULL)
+        SHIM_CHECK(HarnessSetProperty(&TransmitterTestProperties, Assignment));
+    va_end(Arguments);
+
+    return HarnessCreateAdapter(&TransmitterTestProperties, Configuration);
+}
+
+static VOID
+TransmitterTestDestroyAdapter(
+    IN  PADAPTER    Adapter
+    )
+{
+    HARNESS_STATISTICS  Harness;
+
+    HarnessDestroyAdapter(Adapter);
+
+    // Every send has gone back to NDIS
+    HarnessQueryStatistics(&Harness);
+    SHIM_CHECK(Harness.SendCompletedNetBufferLists == TransmitterTestSent);
+
+    HarnessTeardown();
+}
+
+// A copy of Frame carrying 802.1p priority Priority, freed when it is
+// completed.
+static PNET_BUFFER_LIST
+TransmitterTestAllocate(
+    IN  PFRAME                          Frame,
+    IN  ULONG                           Priority
+    )
+{
+    PNET_BUFFER_LIST                    NetBufferList;
+    PNDIS_NET_BUFFER_LIST_8021Q_INFO    Ieee8021QInfo;
+
+    NetBufferList = HarnessAllocateSend(Frame, 0, NULL, NULL);
+
+    Ieee8021QInfo = (PNDIS_NET_BUFFER_LIST_8021Q_INFO)&NET_BUFFER_LIST_INFO(NetBufferList,
+                                                                            Ieee8021QNetBufferListInfo);
+    Ieee8021QInfo->TagHeader.UserPriority = Priority;
+
+    return NetBufferList;
+}
+
+// Passes a chain of NET_BUFFER_LISTs to the transmitter at whatever IRQL
+// the caller is at.
+static VOID
+TransmitterTestSendChain(
+    IN  PADAPTER            Adapter,
+    IN  PNET_BUFFER_LIST    NetBufferList
+    )
+{
+    PNET_BUFFER_LIST        Next;
+
+    for (Next = NetBufferList; Next != NULL; Next = NET_BUFFER_LIST_NEXT_NBL(Next))
+        TransmitterTestSent++;
+
+    TransmitterSendNetBufferLists(Adapter->Transmitter,
+                                  NetBufferList,
+                                  0,
+                                  (KeGetCurrentIrql() == DISPATCH_LEVEL) ?
+                                  NDIS_SEND_FLAGS_DISPATCH_LEVEL :
+                                  0);
+}
+
+// Sends Count copies of Frame in one chain, each carrying 802.1p priority
+// Priority.
+static VOID
+TransmitterTestSend(
+    IN  PADAPTER            Adapter,
+    IN  PFRAME              Frame,
+    IN  ULONG               Count,
+    IN  ULONG               Priority
+    )
+{
+    PNET_BUFFER_LIST        Head;
+    PNET_BUFFER_LIST        *Tail;
+    ULONG                   Index;
+
+    Head = NULL;
+    Tail = &Head;
+    for (Index = 0; Index < Count; Index++) {
+        *Tail = TransmitterTestAllocate(Frame, Priority);
+        Tail = &NET_BUFFER_LIST_NEXT_NBL(*Tail);
+    }
+
+    TransmitterTestSendChain(Adapter, Head);
+}
+
+// What the transmitter and backend have counted so far
+typedef struct _TRANSMITTER_TEST_SNAPSHOT {
+    TRANSMITTER_STATISTICS  Transmitter;
+    MOCK_VIF_STATISTICS     Vif;
+} TRANSMITTER_TEST_SNAPSHOT, *PTRANSMITTER_TEST_SNAPSHOT;
+
+static VOID
+TransmitterTestSnapshot(
+    IN  PADAPTER                    Adapter,
+    OUT PTRANSMITTER_TEST_SNAPSHOT  Snapshot
+    )
+{
+    TransmitterQueryStatistics(Adapter->Transmitter, &Snapshot->Transmitter);
+    MockVifQueryStatistics(Adapter->VifInterface, &Snapshot->Vif);
+}
+
+// Checks that since Snapshot queue 0 has either been flushed once, for
+// Reason, passing Count packets to the backend in one notification and
+// charging them all with latency bucket Bucket, or, if Count is 0, not
+// been flushed at all. Snapshot is then brought up to date.
+static VOID
+TransmitterTestCheckFlush(
+    IN      PADAPTER                    Adapter,
+    IN OUT  PTRANSMITTER_TEST_SNAPSHOT  Snapshot,
+    IN      TRANSMITTER_FLUSH_REASON    Reason,
+    IN      ULONG                       Count,
+    IN      ULONG                       Bucket
+    )
+{
+    TRANSMITTER_TEST_SNAPSHOT           Now;
+    ULONG64                             Latency;
+    ULONG                               Index;
+
+    TransmitterTestSnapshot(Adapter, &Now);
+
+    SHIM_CHECK(Now.Transmitter.Packets - Snapshot->Transmitter.Packets == Count);
+    SHIM_CHECK(Now.Vif.QueuedPackets[0] - Snapshot->Vif.QueuedPackets[0] == Count);
+
+    if (Count == 0) {
+        SHIM_CHECK(Now.Transmitter.Flushes == Snapshot->Transmitter.Flushes);
+        SHIM_CHECK(Now.Vif.Notifications[0] == Snapshot->Vif.Notifications[0]);
+    } else {
+        SHIM_CHECK(Now.Transmitter.Flushes - Snapshot->Transmitter.Flushes == 1);
+        SHIM_CHECK(Now.Transmitter.Flush[Reason] - Snapshot->Transmitter.Flush[Reason] == 1);
+        SHIM_CHECK(Now.Vif.Notifications[0] - Snapshot->Vif.Notifications[0] == 1);
+        SHIM_CHECK(Now.Transmitter.Latency[Bucket] - Snapshot->Transmitter.Latency[Bucket] == Count);
+    }
+
+    Latency = 0;
+    for (Index = 0; Index < TRANSMITTER_LATENCY_HISTOGRAM_SIZE; Index++)
+        Latency += Now.Transmitter.Latency[Index] - Snapshot->Transmitter.Latency[Index];
+
+    SHIM_CHECK(Latency == Count);
+
+    *Snapshot = Now;
+}
+
+#define TRANSMITTER_TEST_TICKS_PER_US   (SHIM_CLOCK_FREQUENCY / 1000000)
+
+// Sends made at DISPATCH_LEVEL are held until the batch fills, the batch
+// time runs out on a later send, a high priority frame arrives or the CPU
+// leaves DISPATCH_LEVEL; others go straight to the backend. The clock
+// only moves when told to, so each flush's reason and latency bucket are
+// known exactly.
+static VOID
+TransmitterTestStaging(
+    VOID
+    )
+{
+    PADAPTER                    Adapter;
+    PFRAME                      Frame;
+    FRAME_PARAMETERS            Parameters;
+    TRANSMITTER_TEST_SNAPSHOT   Snapshot;
+    ULONG                       Index;
+    KIRQL                       Irql;
+
+    FrameDefaultParameters(&Parameters);
+    Frame = FrameAllocate();
+    FrameBuild(Frame, &Parameters);
+
+    // tx_batch=32 and tx_batch_time=50
+    Adapter = TransmitterTestCreateAdapter(1, NULL, NULL);
+    SHIM_CHECK(Adapter->Transmitter->Queue[0].Batch == 32);
+
+    ShimSetManualClock(TRUE);
+
+    TransmitterTestSnapshot(Adapter, &Snapshot);
+
+    // Nothing else will be sent before a flush DPC could run
+    TransmitterTestSend(Adapter, Frame, 5, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_IMMEDIATE, 5, 0);
+
+    // End of the burst, 10us after the first send
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    for (Index = 0; Index < 3; Index++)
+        TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+    ShimAdvanceClock(10 * TRANSMITTER_TEST_TICKS_PER_US);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_DEFERRED, 3, 2);
+
+    // A full batch goes at once and the rest waits for the DPC
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 31, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_FULL, 32, 0);
+    for (Index = 0; Index < 8; Index++)
+        TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_DEFERRED, 8, 0);
+
+    // A chain longer than the batch is not split
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 40, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_FULL, 40, 0);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+
+    // The batch time is only checked when a send arrives, and is reached
+    // at exactly tx_batch_time
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    ShimAdvanceClock(50 * TRANSMITTER_TEST_TICKS_PER_US - 1);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+    ShimAdvanceClock(1);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_EXPIRED, 3, 4);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+
+    // Priority 5 and above takes what is staged along with it
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 2, 0);
+    TransmitterTestSend(Adapter, Frame, 1, TRANSMITTER_URGENT_PRIORITY - 1);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+    TransmitterTestSend(Adapter, Frame, 1, TRANSMITTER_URGENT_PRIORITY);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_URGENT, 4, 0);
+    TransmitterTestSend(Adapter, Frame, 1, 7);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_URGENT, 1, 0);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+
+    ShimSetManualClock(FALSE);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    // Staging disabled
+    Adapter = TransmitterTestCreateAdapter(1, NULL, "tx_batch=0", NULL);
+    SHIM_CHECK(Adapter->Transmitter->Queue[0].Batch == 0);
+
+    ShimSetManualClock(TRUE);
+
+    TransmitterTestSnapshot(Adapter, &Snapshot);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_IMMEDIATE, 1, 0);
+    TransmitterTestSend(Adapter, Frame, 2, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_IMMEDIATE, 2, 0);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+
+    ShimSetManualClock(FALSE);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    // Never more than half the ring is held back
+    Adapter = TransmitterTestCreateAdapter(1, NULL, "tx_batch=1000", NULL);
+    SHIM_CHECK(Adapter->Transmitter->Queue[0].Batch == 128);
+
+    ShimSetManualClock(TRUE);
+
+    TransmitterTestSnapshot(Adapter, &Snapshot);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 127, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, 0, 0, 0);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_FULL, 128, 0);
+    KeLowerIrql(Irql);
+
+    ShimSetManualClock(FALSE);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    FrameFree(Frame);
+}
+
+// Each packet is charged with the age of the oldest in its chain when the
+// chain is flushed, in buckets whose upper bounds double from 4us.
+static VOID
+TransmitterTestLatency(
+    VOID
+    )
+{
+    PADAPTER                    Adapter;
+    PFRAME                      Frame;
+    FRAME_PARAMETERS            Parameters;
+    TRANSMITTER_TEST_SNAPSHOT   Snapshot;
+    ULONG                       Bucket;
+    KIRQL                       Irql;
+
+    FrameDefaultParameters(&Parameters);
+    Frame = FrameAllocate();
+    FrameBuild(Frame, &Parameters);
+
+    // No send expires a batch, however old
+    Adapter = TransmitterTestCreateAdapter(1, NULL, "tx_batch_time=100000", NULL);
+
+    ShimSetManualClock(TRUE);
+
+    TransmitterTestSnapshot(Adapter, &Snapshot);
+
+    // The second packet is charged the first's 5us, not its own 2us
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    ShimAdvanceClock(3 * TRANSMITTER_TEST_TICKS_PER_US);
+    TransmitterTestSend(Adapter, Frame, 1, 0);
+    ShimAdvanceClock(2 * TRANSMITTER_TEST_TICKS_PER_US);
+    KeLowerIrql(Irql);
+    TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_DEFERRED, 2, 1);
+
+    // Either side of each bucket's upper bound
+    for (Bucket = 0; Bucket < TRANSMITTER_LATENCY_HISTOGRAM_SIZE; Bucket++) {
+        ULONG64 Bound = (4ull << Bucket) * TRANSMITTER_TEST_TICKS_PER_US;
+        ULONG   Next;
+
+        Next = Bucket + 1;
+        if (Next == TRANSMITTER_LATENCY_HISTOGRAM_SIZE)
+            Next = Bucket;
+
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+        TransmitterTestSend(Adapter, Frame, 1, 0);
+        ShimAdvanceClock(Bound - 1);
+        KeLowerIrql(Irql);
+        TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_DEFERRED, 1, Bucket);
+
+        KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+        TransmitterTestSend(Adapter, Frame, 1, 0);
+        ShimAdvanceClock(Bound);
+        KeLowerIrql(Irql);
+        TransmitterTestCheckFlush(Adapter, &Snapshot, TRANSMITTER_FLUSH_DEFERRED, 1, Next);
+    }
+
+    ShimSetManualClock(FALSE);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    FrameFree(Frame);
+}
+
+#define TRANSMITTER_TEST_FLOWS          64
+#define TRANSMITTER_TEST_FLOW_PORT      40000
+#define TRANSMITTER_TEST_QUEUE_ROUNDS   8
+
+// Where the backend saw each flow's packets go
+typedef struct _TRANSMITTER_TEST_QUEUES {
+    PTRANSMITTER    Transmitter;
+    ULONG           FlowQueue[TRANSMITTER_TEST_FLOWS];
+    ULONG64         Packets[MOCK_VIF_MAXIMUM_QUEUES];
+    ULONG           Last;
+} TRANSMITTER_TEST_QUEUES, *PTRANSMITTER_TEST_QUEUES;
+
+// Flows alternate between IPv4 and IPv6 and are told apart by their
+// source ports.
+static VOID
+TransmitterTestBuildFlows(
+    OUT PFRAME          *Frame
+    )
+{
+    ULONG               Flow;
+
+    for (Flow = 0; Flow < TRANSMITTER_TEST_FLOWS; Flow++) {
+        FRAME_PARAMETERS    Parameters;
+
+        FrameDefaultParameters(&Parameters);
+        Parameters.IpVersion = (Flow & 1) ? 6 : 4;
+        Parameters.SourcePort = (USHORT)(TRANSMITTER_TEST_FLOW_PORT + Flow);
+        Parameters.PayloadLength = 64;
+
+        Frame[Flow] = FrameAllocate();
+        FrameBuild(Frame[Flow], &Parameters);
+    }
+}
+
+static VOID
+TransmitterTestQueueTransmit(
+    IN  PVOID                       Argument,
+    IN  ULONG                       Index,
+    IN  PXENVIF_TRANSMITTER_PACKET  Packet,
+    IN  PMDL                        Mdl,
+    IN  ULONG                       Offset,
+    IN  ULONG                       Length
+    )
+{
+    PTRANSMITTER_TEST_QUEUES        Queues = Argument;
+    PNET_BUFFER_RESERVED            Reserved;
+    PETHERNET_HEADER                EthernetHeader;
+    ULONG                           PortOffset;
+    ULONG                           Flow;
+
+    // The queue is the one the transmitter chose for the NET_BUFFER_LIST
+    Reserved = CONTAINING_RECORD(Packet, NET_BUFFER_RESERVED, Packet);
+    SHIM_CHECK(Index == __TransmitterSelectQueue(Reserved->NetBufferList,
+                                                 Queues->Transmitter->QueueCount));
+
+    Queues->Packets[Index]++;
+    Queues->Last = Index;
+
+    EthernetHeader = (PETHERNET_HEADER)((PUCHAR)MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority) +
+                                        Offset);
+
+    PortOffset = sizeof (ETHERNET_UNTAGGED_HEADER) +
+                 ((NTOHS(EthernetHeader->Untagged.TypeOrLength) == ETHERTYPE_IPV6) ?
+                  sizeof (IPV6_HEADER) :
+                  sizeof (IPV4_HEADER));
+    SHIM_CHECK(PortOffset + sizeof (USHORT) <= Length);
+
+    Flow = NTOHS(*(USHORT UNALIGNED *)((PUCHAR)EthernetHeader + PortOffset)) -
+           TRANSMITTER_TEST_FLOW_PORT;
+    SHIM_CHECK(Flow < TRANSMITTER_TEST_FLOWS);
+
+    // Every packet of a flow goes to the same queue
+    if (Queues->FlowQueue[Flow] == MAXULONG)
+        Queues->FlowQueue[Flow] = Index;
+    SHIM_CHECK(Queues->FlowQueue[Flow] == Index);
+}
+
+// Sends every flow TRANSMITTER_TEST_QUEUE_ROUNDS times, a round per chain
+// at PASSIVE_LEVEL, and checks that each flow stayed on one queue, that
+// QueueCount queues and no others were used and that the transmitter's
+// per-queue counts agree with the backend's: one notification per queue
+// per round, since a chain is split by queue before it is flushed.
+static VOID
+TransmitterTestQueueRounds(
+    IN  PADAPTER                Adapter,
+    IN  PFRAME                  *Frame,
+    IN  ULONG                   QueueCount
+    )
+{
+    TRANSMITTER_TEST_QUEUES     Queues;
+    TRANSMITTER_STATISTICS      Transmitter;
+    MOCK_VIF_STATISTICS         Vif;
+    ULONG                       Round;
+    ULONG                       Flow;
+    ULONG                       Index;
+
+    SHIM_CHECK(Adapter->Transmitter->QueueCount == QueueCount);
+
+    RtlZeroMemory(&Queues, sizeof (Queues));
+    Queues.Transmitter = Adapter->Transmitter;
+    for (Flow = 0; Flow < TRANSMITTER_TEST_FLOWS; Flow++)
+        Queues.FlowQueue[Flow] = MAXULONG;
+
+    MockVifSetTransmitHook(Adapter->VifInterface, TransmitterTestQueueTransmit, &Queues);
+
+    for (Round = 0; Round < TRANSMITTER_TEST_QUEUE_ROUNDS; Round++) {
+        PNET_BUFFER_LIST    Head;
+        PNET_BUFFER_LIST    *Tail;
+
+        Head = NULL;
+        Tail = &Head;
+        for (Flow = 0; Flow < TRANSMITTER_TEST_FLOWS; Flow++) {
+            *Tail = TransmitterTestAllocate(Frame[(Flow + Round) % TRANSMITTER_TEST_FLOWS], 0);
+            Tail = &NET_BUFFER_LIST_NEXT_NBL(*Tail);
+        }
+
+        TransmitterTestSendChain(Adapter, Head);
+    }
+
+    MockVifSetTransmitHook(Adapter->VifInterface, NULL, NULL);
+
+    TransmitterQueryStatistics(Adapter->Transmitter, &Transmitter);
+    MockVifQueryStatistics(Adapter->VifInterface, &Vif);
+
+    SHIM_CHECK(Transmitter.QueueCount == QueueCount);
+    SHIM_CHECK(Transmitter.Packets == TRANSMITTER_TEST_QUEUE_ROUNDS * TRANSMITTER_TEST_FLOWS);
+
+    for (Index = 0; Index < MOCK_VIF_MAXIMUM_QUEUES; Index++) {
+        if (Index >= QueueCount) {
+            SHIM_CHECK(Queues.Packets[Index] == 0);
+            SHIM_CHECK(Vif.Notifications[Index] == 0);
+            continue;
+        }
+
+        // 64 flows are plenty to reach every queue
+        SHIM_CHECK(Queues.Packets[Index] != 0);
+        SHIM_CHECK(Queues.Packets[Index] % TRANSMITTER_TEST_QUEUE_ROUNDS == 0);
+
+        SHIM_CHECK(Transmitter.QueuePackets[Index] == Queues.Packets[Index]);
+        SHIM_CHECK(Vif.QueuedPackets[Index] == Queues.Packets[Index]);
+        SHIM_CHECK(Vif.Notifications[Index] == TRANSMITTER_TEST_QUEUE_ROUNDS);
+
+        // Completion ran as the transmitter left DISPATCH_LEVEL
+        SHIM_CHECK(Transmitter.QueueCompleted[Index] == Queues.Packets[Index]);
+    }
+}
+
+// A hash supplied by the stack picks the queue by its top bits in place
+// of the transmitter's own.
+static VOID
+TransmitterTestQueueHash(
+    IN  PADAPTER                Adapter,
+    IN  PFRAME                  Frame
+    )
+{
+    static const struct {
+        ULONG   Hash;
+        ULONG   Queue;
+    } Case[] = {
+        { 0x00000000, 0 },
+        { 0x3FFFFFFF, 0 },
+        { 0x40000000, 1 },
+        { 0x7FFFFFFF, 1 },
+        { 0x80000000, 2 },
+        { 0xC0000000, 3 },
+        { 0xFFFFFFFF, 3 },
+    };
+    TRANSMITTER_TEST_QUEUES     Queues;
+    ULONG                       Flow;
+    ULONG                       Index;
+
+    SHIM_CHECK(Adapter->Transmitter->QueueCount == 4);
+
+    RtlZeroMemory(&Queues, sizeof (Queues));
+    Queues.Transmitter = Adapter->Transmitter;
+
+    MockVifSetTransmitHook(Adapter->VifInterface, TransmitterTestQueueTransmit, &Queues);
+
+    for (Index = 0; Index < ARRAYSIZE(Case); Index++) {
+        PNET_BUFFER_LIST    NetBufferList;
+
+        // Each case is a flow of its own as far as the hook is concerned
+        for (Flow = 0; Flow < TRANSMITTER_TEST_FLOWS; Flow++)
+            Queues.FlowQueue[Flow] = MAXULONG;
+
+        NetBufferList = TransmitterTestAllocate(Frame, 0);
+        NET_BUFFER_LIST_SET_HASH_VALUE(NetBufferList, Case[Index].Hash);
+        NET_BUFFER_LIST_SET_HASH_TYPE(NetBufferList, NDIS_HASH_TCP_IPV4);
+        NET_BUFFER_LIST_SET_HASH_FUNCTION(NetBufferList, NdisHashFunctionToeplitz);
+
+        Queues.Last = MAXULONG;
+        TransmitterTestSendChain(Adapter, NetBufferList);
+        SHIM_CHECK(Queues.Last == Case[Index].Queue);
+    }
+
+    // A value without a type is not a hash
+    for (Flow = 0; Flow < TRANSMITTER_TEST_FLOWS; Flow++)
+        Queues.FlowQueue[Flow] = MAXULONG;
+
+    for (Index = 0; Index < ARRAYSIZE(Case); Index++) {
+        PNET_BUFFER_LIST    NetBufferList;
+
+        NetBufferList = TransmitterTestAllocate(Frame, 0);
+        NET_BUFFER_LIST_SET_HASH_VALUE(NetBufferList, Case[Index].Hash);
+
+        TransmitterTestSendChain(Adapter, NetBufferList);
+    }
+
+    MockVifSetTransmitHook(Adapter->VifInterface, NULL, NULL);
+}
+
+// Flows are spread over as many queues as the backend offers, up to
+// tx_queues and TRANSMITTER_MAXIMUM_QUEUES, and a backend too old to
+// offer more than one gets everything through QueuePackets.
+static VOID
+TransmitterTestQueues(
+    VOID
+    )
+{
+    PFRAME                  Frame[TRANSMITTER_TEST_FLOWS];
+    MOCK_VIF_CONFIGURATION  Configuration;
+    PADAPTER                Adapter;
+    ULONG                   Flow;
+
+    TransmitterTestBuildFlows(Frame);
+
+    MockVifDefaultConfiguration(&Configuration);
+    Configuration.QueueCount = 4;
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, NULL);
+    TransmitterTestQueueRounds(Adapter, Frame, 4);
+    TransmitterTestQueueHash(Adapter, Frame[0]);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    // All the mock has
+    Configuration.QueueCount = MOCK_VIF_MAXIMUM_QUEUES;
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, NULL);
+    TransmitterTestQueueRounds(Adapter, Frame, TRANSMITTER_MAXIMUM_QUEUES);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, "tx_queues=2", NULL);
+    TransmitterTestQueueRounds(Adapter, Frame, 2);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, "tx_queues=0", NULL);
+    TransmitterTestQueueRounds(Adapter, Frame, 1);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    Configuration.QueueCount = 1;
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, NULL);
+    TransmitterTestQueueRounds(Adapter, Frame, 1);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    // The backend has the queues but not the interface to use them
+    Configuration.QueueCount = 4;
+    Configuration.Version = VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES - 1;
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, NULL);
+    TransmitterTestQueueRounds(Adapter, Frame, 1);
+    TransmitterTestDestroyAdapter(Adapter);
+
+    for (Flow = 0; Flow < TRANSMITTER_TEST_FLOWS; Flow++)
+        FrameFree(Frame[Flow]);
+}
+
+#define TRANSMITTER_TEST_MAXIMUM_COMPLETED  128
+
+// The NET_BUFFER_LISTs handed back to NDIS, in the order they came back,
+// with the status each carried and the number of the
+// NdisMSendNetBufferListsComplete() call that returned it.
+typedef struct _TRANSMITTER_TEST_COMPLETED {
+    ULONG               Count;
+    PNET_BUFFER_LIST    NetBufferList[TRANSMITTER_TEST_MAXIMUM_COMPLETED];
+    NDIS_STATUS         Status[TRANSMITTER_TEST_MAXIMUM_COMPLETED];
+    ULONG64             Call[TRANSMITTER_TEST_MAXIMUM_COMPLETED];
+} TRANSMITTER_TEST_COMPLETED, *PTRANSMITTER_TEST_COMPLETED;
+
+static VOID
+TransmitterTestRecordCompletion(
+    IN  PVOID                   Argument,
+    IN  PNET_BUFFER_LIST        NetBufferList
+    )
+{
+    PTRANSMITTER_TEST_COMPLETED Completed = Argument;
+    HARNESS_STATISTICS          Harness;
+    ULONG                       Index;
+
+    Index = Completed->Count++;
+    SHIM_CHECK(Index < TRANSMITTER_TEST_MAXIMUM_COMPLETED);
+
+    // Already counted by the harness
+    HarnessQueryStatistics(&Harness);
+
+    Completed->NetBufferList[Index] = NetBufferList;
+    Completed->Status[Index] = NET_BUFFER_LIST_STATUS(NetBufferList);
+    Completed->Call[Index] = Harness.SendCompletions;
+
+    HarnessFreeSend(NetBufferList);
+}
+
+// Sends Count copies of Frame in one chain, noting each NET_BUFFER_LIST
+// in Sent, to be recorded in Completed when they come back.
+static VOID
+TransmitterTestSendRecorded(
+    IN  PADAPTER                    Adapter,
+    IN  PFRAME                      Frame,
+    IN  ULONG                       Count,
+    IN  PTRANSMITTER_TEST_COMPLETED Completed,
+    OUT PNET_BUFFER_LIST            *Sent
+    )
+{
+    PNET_BUFFER_LIST                Head;
+    PNET_BUFFER_LIST                *Tail;
+    ULONG                           Index;
+
+    Head = NULL;
+    Tail = &Head;
+    for (Index = 0; Index < Count; Index++) {
+        Sent[Index] = HarnessAllocateSend(Frame, 0, TransmitterTestRecordCompletion, Completed);
+
+        *Tail = Sent[Index];
+        Tail = &NET_BUFFER_LIST_NEXT_NBL(Sent[Index]);
+    }
+
+    TransmitterTestSendChain(Adapter, Head);
+}
+
+// Checks that Count NET_BUFFER_LISTs came back since Completed held First,
+// in the order they were sent, with Status and all in NDIS call Call.
+static VOID
+TransmitterTestCheckCompleted(
+    IN  PTRANSMITTER_TEST_COMPLETED Completed,
+    IN  ULONG                       First,
+    IN  PNET_BUFFER_LIST            *Sent,
+    IN  ULONG                       Count,
+    IN  NDIS_STATUS                 Status,
+    IN  ULONG64                     Call
+    )
+{
+    ULONG                           Index;
+
+    SHIM_CHECK(Completed->Count == First + Count);
+
+    for (Index = 0; Index < Count; Index++) {
+        SHIM_CHECK(Completed->NetBufferList[First + Index] == Sent[Index]);
+        SHIM_CHECK(Completed->Status[First + Index] == Status);
+        SHIM_CHECK(Completed->Call[First + Index] == Call);
+    }
+}
+
+#define TRANSMITTER_TEST_COMPLETION_ROUNDS  10
+#define TRANSMITTER_TEST_COMPLETION_CHAIN   8
+
+// Everything the backend completes in one callback goes back to NDIS in
+// one call per status, including packets the backend refused.
+static VOID
+TransmitterTestCompletion(
+    VOID
+    )
+{
+    static const NDIS_STATUS    Status[] = {
+        NDIS_STATUS_SUCCESS,
+        NDIS_STATUS_INVALID_PACKET,
+        NDIS_STATUS_SUCCESS,
+        NDIS_STATUS_RESOURCES,
+        NDIS_STATUS_INVALID_PACKET,
+        NDIS_STATUS_FAILURE,
+        NDIS_STATUS_NOT_ACCEPTED,   // One status too many shares the last chain
+        NDIS_STATUS_SUCCESS,
+        NDIS_STATUS_NOT_ACCEPTED,
+    };
+    static const ULONG          Order[] = { 0, 2, 7, 1, 4, 3, 5, 6, 8 };
+    static const ULONG64        Call[] = { 1, 1, 1, 2, 2, 3, 4, 4, 4 };
+    PTRANSMITTER_TEST_COMPLETED Completed;
+    PNET_BUFFER_LIST            Sent[TRANSMITTER_TEST_MAXIMUM_COMPLETED];
+    MOCK_VIF_CONFIGURATION      Configuration;
+    PADAPTER                    Adapter;
+    PFRAME                      Frame;
+    FRAME_PARAMETERS            Parameters;
+    TRANSMITTER_COMPLETION      Completion;
+    TRANSMITTER_STATISTICS      Transmitter;
+    HARNESS_STATISTICS          Harness;
+    MOCK_VIF_STATISTICS         Vif;
+    ULONG                       Round;
+    ULONG                       Index;
+    KIRQL                       Irql;
+
+    C_ASSERT(ARRAYSIZE(Order) == ARRAYSIZE(Status));
+    C_ASSERT(ARRAYSIZE(Call) == ARRAYSIZE(Status));
+
+    FrameDefaultParameters(&Parameters);
+    Frame = FrameAllocate();
+    FrameBuild(Frame, &Parameters);
+
+    Completed = calloc(1, sizeof (TRANSMITTER_TEST_COMPLETED));
+    SHIM_CHECK(Completed != NULL);
+
+    MockVifDefaultConfiguration(&Configuration);
+    Configuration.Completion = MOCK_VIF_COMPLETE_MANUAL;
+
+    Adapter = TransmitterTestCreateAdapter(1, &Configuration, NULL);
+
+    // Ten flushes, completed together
+    for (Round = 0; Round < TRANSMITTER_TEST_COMPLETION_ROUNDS; Round++)
+        TransmitterTestSendRecorded(Adapter,
+                                    Frame,
+                                    TRANSMITTER_TEST_COMPLETION_CHAIN,
+                                    Completed,
+                                    &Sent[Round * TRANSMITTER_TEST_COMPLETION_CHAIN]);
+
+    SHIM_CHECK(Completed->Count == 0);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    MockVifCompletePackets(Adapter->VifInterface);
+    KeLowerIrql(Irql);
+
+    TransmitterTestCheckCompleted(Completed,
+                                  0,
+                                  Sent,
+                                  TRANSMITTER_TEST_COMPLETION_ROUNDS * TRANSMITTER_TEST_COMPLETION_CHAIN,
+                                  NDIS_STATUS_SUCCESS,
+                                  1);
+
+    TransmitterQueryStatistics(Adapter->Transmitter, &Transmitter);
+    SHIM_CHECK(Transmitter.Completions == 1);
+    SHIM_CHECK(Transmitter.CompletedNetBufferLists ==
+               TRANSMITTER_TEST_COMPLETION_ROUNDS * TRANSMITTER_TEST_COMPLETION_CHAIN);
+
+    // A chain the backend refuses comes straight back, in one call
+    MockVifFailQueuePackets(Adapter->VifInterface, 1);
+
+    TransmitterTestSendRecorded(Adapter, Frame, 5, Completed, Sent);
+    TransmitterTestCheckCompleted(Completed, 80, Sent, 5, NDIS_STATUS_NOT_ACCEPTED, 2);
+
+    // As does a staged chain, refused when the flush DPC passes it on
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    for (Index = 0; Index < 3; Index++)
+        TransmitterTestSendRecorded(Adapter, Frame, 1, Completed, &Sent[Index]);
+    MockVifFailQueuePackets(Adapter->VifInterface, 1);
+    KeLowerIrql(Irql);
+
+    TransmitterTestCheckCompleted(Completed, 85, Sent, 3, NDIS_STATUS_NOT_ACCEPTED, 3);
+
+    // The backend is unaffected
+    TransmitterTestSendRecorded(Adapter, Frame, 2, Completed, Sent);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    MockVifCompletePackets(Adapter->VifInterface);
+    KeLowerIrql(Irql);
+
+    TransmitterTestCheckCompleted(Completed, 88, Sent, 2, NDIS_STATUS_SUCCESS, 4);
+
+    TransmitterQueryStatistics(Adapter->Transmitter, &Transmitter);
+    SHIM_CHECK(Transmitter.Completions == 4);
+    SHIM_CHECK(Transmitter.CompletedNetBufferLists == 90);
+
+    MockVifQueryStatistics(Adapter->VifInterface, &Vif);
+    SHIM_CHECK(Vif.QueuedPackets[0] == 82);
+    SHIM_CHECK(Vif.CompletedPackets == 82);
+
+    // Chains are formed in the order statuses are first seen, each keeping
+    // its NET_BUFFER_LISTs in order, and each NET_BUFFER_LIST keeps its own
+    // status whichever chain it joins
+    Completed->Count = 0;
+    Completion.Count = 0;
+
+    for (Index = 0; Index < ARRAYSIZE(Status); Index++) {
+        Sent[Index] = HarnessAllocateSend(Frame, 0, TransmitterTestRecordCompletion, Completed);
+        NET_BUFFER_LIST_STATUS(Sent[Index]) = Status[Index];
+
+        TransmitterReturnNetBufferList(Adapter->Transmitter, Sent[Index], &Completion);
+    }
+
+    TransmitterTestSent += ARRAYSIZE(Status);
+
+    SHIM_CHECK(Completion.Count == TRANSMITTER_COMPLETION_CHAINS);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    TransmitterCompleteNetBufferLists(Adapter->Transmitter, &Completion);
+    KeLowerIrql(Irql);
+
+    SHIM_CHECK(Completed->Count == ARRAYSIZE(Status));
+
+    for (Index = 0; Index < ARRAYSIZE(Status); Index++) {
+        SHIM_CHECK(Completed->NetBufferList[Index] == Sent[Order[Index]]);
+        SHIM_CHECK(Completed->Status[Index] == Status[Order[Index]]);
+        SHIM_CHECK(Completed->Call[Index] == 4 + Call[Index]);
+    }
+
+    TransmitterQueryStatistics(Adapter->Transmitter, &Transmitter);
+    SHIM_CHECK(Transmitter.Completions == 4 + TRANSMITTER_COMPLETION_CHAINS);
+    SHIM_CHECK(Transmitter.CompletedNetBufferLists == 90 + ARRAYSIZE(Status));
+
+    HarnessQueryStatistics(&Harness);
+    SHIM_CHECK(Harness.SendCompletions == Transmitter.Completions);
+    SHIM_CHECK(Harness.SendCompletedNetBufferLists == Transmitter.CompletedNetBufferLists);
+
+    TransmitterTestDestroyAdapter(Adapter);
+
+    free(Completed);
+    FrameFree(Frame);
+}
+
+static TRANSMITTER_TEST TransmitterTest[] = {
+    { "staging", TransmitterTestStaging },
+    { "latency", TransmitterTestLatency },
+    { "queues", TransmitterTestQueues },
+    { "completion", TransmitterTestCompletion },
+};
+
+int
+main(
+    IN  int     argc,
+    IN  char    **argv
+    )
+{
+    ULONG       Index;
+    ULONG       Run;
+
+    // Keep what was printed if a check fails
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    Run = 0;
+    for (Index = 0; Index < ARRAYSIZE(TransmitterTest); Index++) {
+        PTRANSMITTER_TEST   Test = &TransmitterTest[Index];
+
+        if (argc > 1) {
+            int Argument;
+
+            for (Argument = 1; Argument < argc; Argument++)
+                if (strcmp(argv[Argument], Test->Name) == 0)
+                    break;
+
+            if (Argument == argc)
+                continue;
+        }
+
+        printf("transmitter_test: %s\n", Test->Name);
+        Test->Function();
+        Run++;
+    }
+
+    if (Run == 0) {
+        fprintf(stderr, "transmitter_test: no such test\n");
+        return 2;
+    }
+
+    printf("transmitter_test: passed\n");
+    return 0;
+}
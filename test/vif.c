@@ -0,0 +1,925 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ndis.h>
+
+#include "shim.h"
+#include "vif.h"
+
+typedef VOID
+(*MOCK_VIF_CALLBACK)(
+    IN  PVOID                   Argument,
+    IN  XENVIF_CALLBACK_TYPE    Type,
+    ...
+    );
+
+typedef struct _MOCK_VIF_PROCESSOR {
+    PXENVIF_VIF_CONTEXT         Context;
+    KSPIN_LOCK                  Lock;
+    LIST_ENTRY                  Free;
+    PXENVIF_TRANSMITTER_PACKET  CompleteHead;
+    PXENVIF_TRANSMITTER_PACKET  *CompleteTail;
+    KDPC                        Dpc;
+
+    // Only updated on the owning processor
+    MOCK_VIF_STATISTICS         Statistics;
+} DECLSPEC_CACHEALIGN MOCK_VIF_PROCESSOR, *PMOCK_VIF_PROCESSOR;
+
+struct _XENVIF_VIF_CONTEXT {
+    MOCK_VIF_CONFIGURATION              Configuration;
+    XENVIF_VIF_INTERFACE                Interface;
+    LONG                                References;
+    BOOLEAN                             Enabled;
+    MOCK_VIF_CALLBACK                   Callback;
+    PVOID                               Argument;
+    XENVIF_TRANSMITTER_PACKET_METADATA  Metadata;
+    XENVIF_OFFLOAD_OPTIONS              ReceiverOffloadOptions;
+    ETHERNET_ADDRESS                    PermanentAddress;
+    ETHERNET_ADDRESS                    CurrentAddress;
+    ETHERNET_ADDRESS                    MulticastAddress[MAXIMUM_MULTICAST_ADDRESS_COUNT];
+    ULONG                               MulticastAddressCount;
+    XENVIF_MAC_FILTER_LEVEL             FilterLevel[ETHERNET_ADDRESS_TYPE_COUNT];
+    MOCK_VIF_TRANSMIT                   Transmit;
+    PVOID                               TransmitArgument;
+    volatile LONG                       QueueFailures;
+    PXENVIF_RECEIVER_PACKET             Packet;
+    ULONG                               PacketCount;
+    PUCHAR                              Buffer;
+    volatile LONG                       Outstanding;
+    ULONG                               ProcessorCount;
+    PMOCK_VIF_PROCESSOR                 Processor;
+};
+
+#define VIF_OPERATION(_Type, _Name, _Arguments) \
+        static _Type MockVif ## _Name _Arguments;
+
+DEFINE_VIF_OPERATIONS
+
+#undef VIF_OPERATION
+
+static KDEFERRED_ROUTINE MockVifCompleteDpc;
+
+static FORCEINLINE PMOCK_VIF_PROCESSOR
+__MockVifGetProcessor(
+    IN  PXENVIF_VIF_CONTEXT Context
+    )
+{
+    ULONG                   Index;
+
+    Index = KeGetCurrentProcessorNumberEx(NULL);
+    SHIM_CHECK(Index < Context->ProcessorCount);
+
+    return &Context->Processor[Index];
+}
+
+static VOID
+MockVifAcquire(
+    IN  PXENVIF_VIF_CONTEXT Context
+    )
+{
+    (VOID) InterlockedIncrement(&Context->References);
+}
+
+static VOID
+MockVifRelease(
+    IN  PXENVIF_VIF_CONTEXT Context
+    )
+{
+    SHIM_CHECK(Context->References != 0);
+    (VOID) InterlockedDecrement(&Context->References);
+}
+
+static NTSTATUS
+MockVifEnable(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  VOID                (*Function)(PVOID, XENVIF_CALLBACK_TYPE, ...),
+    IN  PVOID               Argument OPTIONAL
+    )
+{
+    SHIM_CHECK(Context->References != 0);
+    SHIM_CHECK(!Context->Enabled);
+
+    Context->Callback = Function;
+    Context->Argument = Argument;
+    Context->Enabled = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+MockVifDisable(
+    IN  PXENVIF_VIF_CONTEXT Context
+    )
+{
+    KIRQL                   Irql;
+
+    SHIM_CHECK(Context->Enabled);
+
+    // Whatever is still on the rings is completed before the backend
+    // stops making callbacks.
+    KeRaiseIrql(DISPATCH_LEVEL, &Irql);
+    MockVifCompletePackets(&Context->Interface);
+    KeLowerIrql(Irql);
+
+    Context->Enabled = FALSE;
+    Context->Callback = NULL;
+    Context->Argument = NULL;
+}
+
+static VOID
+MockVifQueryPacketStatistics(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    OUT PXENVIF_PACKET_STATISTICS   Statistics
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    RtlZeroMemory(Statistics, sizeof (XENVIF_PACKET_STATISTICS));
+}
+
+static VOID
+MockVifUpdatePacketMetadata(
+    IN  PXENVIF_VIF_CONTEXT                 Context,
+    IN  PXENVIF_TRANSMITTER_PACKET_METADATA Metadata
+    )
+{
+    Context->Metadata = *Metadata;
+}
+
+static VOID
+MockVifReturnPacket(
+    IN  PXENVIF_VIF_CONTEXT     Context,
+    IN  PXENVIF_RECEIVER_PACKET Packet
+    )
+{
+    PMOCK_VIF_PROCESSOR         Processor;
+
+    Processor = __MockVifGetProcessor(Context);
+
+    SHIM_CHECK(Packet >= Context->Packet &&
+               Packet < Context->Packet + Context->PacketCount);
+    SHIM_CHECK(Packet->Mdl.Next == NULL);
+
+    KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+    InsertTailList(&Processor->Free, &Packet->ListEntry);
+    KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+
+    Processor->Statistics.ReturnPacketCalls++;
+    Processor->Statistics.ReturnedPackets++;
+
+    SHIM_CHECK(InterlockedDecrement(&Context->Outstanding) >= 0);
+}
+
+static NTSTATUS
+__MockVifQueuePackets(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    IN  ULONG                       Index,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    );
+
+// All an older backend has, feeding the first queue
+static NTSTATUS
+MockVifQueuePackets(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    )
+{
+    return __MockVifQueuePackets(Context, 0, HeadPacket);
+}
+
+static VOID
+MockVifQueryOffloadOptions(
+    IN  PXENVIF_VIF_CONTEXT     Context,
+    OUT PXENVIF_OFFLOAD_OPTIONS Options
+    )
+{
+    *Options = Context->Configuration.OffloadOptions;
+}
+
+static VOID
+MockVifUpdateOffloadOptions(
+    IN  PXENVIF_VIF_CONTEXT     Context,
+    IN  XENVIF_OFFLOAD_OPTIONS  Options
+    )
+{
+    Context->ReceiverOffloadOptions = Options;
+}
+
+static VOID
+MockVifQueryLargePacketSize(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  UCHAR               Version,
+    OUT PULONG              Size
+    )
+{
+    XENVIF_OFFLOAD_OPTIONS  Options = Context->Configuration.OffloadOptions;
+
+    if ((Version == 4 && Options.OffloadIpVersion4LargePacket) ||
+        (Version == 6 && Options.OffloadIpVersion6LargePacket))
+        *Size = Context->Configuration.LargePacketSize;
+    else
+        *Size = 0;
+}
+
+static VOID
+MockVifQueryMediaState(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    OUT PNET_IF_MEDIA_CONNECT_STATE MediaConnectState OPTIONAL,
+    OUT PULONG64                    LinkSpeed OPTIONAL,
+    OUT PNET_IF_MEDIA_DUPLEX_STATE  MediaDuplexState OPTIONAL
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (MediaConnectState != NULL)
+        *MediaConnectState = MediaConnectStateConnected;
+
+    if (LinkSpeed != NULL)
+        *LinkSpeed = 10000000000ull;
+
+    if (MediaDuplexState != NULL)
+        *MediaDuplexState = MediaDuplexStateFull;
+}
+
+static VOID
+MockVifQueryMaximumFrameSize(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PULONG              Size
+    )
+{
+    *Size = Context->Configuration.MaximumFrameSize;
+}
+
+static VOID
+MockVifQueryPermanentAddress(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PETHERNET_ADDRESS   Address
+    )
+{
+    *Address = Context->PermanentAddress;
+}
+
+static VOID
+MockVifQueryCurrentAddress(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PETHERNET_ADDRESS   Address
+    )
+{
+    *Address = Context->CurrentAddress;
+}
+
+static NTSTATUS
+MockVifUpdateCurrentAddress(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  PETHERNET_ADDRESS   Address
+    )
+{
+    Context->CurrentAddress = *Address;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+MockVifQueryMulticastAddresses(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PETHERNET_ADDRESS   Address OPTIONAL,
+    OUT PULONG              Count
+    )
+{
+    if (Address == NULL || *Count < Context->MulticastAddressCount) {
+        *Count = Context->MulticastAddressCount;
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    RtlCopyMemory(Address,
+                  Context->MulticastAddress,
+                  Context->MulticastAddressCount * sizeof (ETHERNET_ADDRESS));
+    *Count = Context->MulticastAddressCount;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+MockVifUpdateMulticastAddresses(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  PETHERNET_ADDRESS   Address,
+    IN  ULONG               Count
+    )
+{
+    if (Count > MAXIMUM_MULTICAST_ADDRESS_COUNT)
+        return STATUS_INVALID_PARAMETER;
+
+    RtlCopyMemory(Context->MulticastAddress,
+                  Address,
+                  Count * sizeof (ETHERNET_ADDRESS));
+    Context->MulticastAddressCount = Count;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+MockVifQueryFilterLevel(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    IN  ETHERNET_ADDRESS_TYPE       Type,
+    OUT PXENVIF_MAC_FILTER_LEVEL    Level
+    )
+{
+    SHIM_CHECK(Type < ETHERNET_ADDRESS_TYPE_COUNT);
+
+    *Level = Context->FilterLevel[Type];
+}
+
+static NTSTATUS
+MockVifUpdateFilterLevel(
+    IN  PXENVIF_VIF_CONTEXT     Context,
+    IN  ETHERNET_ADDRESS_TYPE   Type,
+    IN  XENVIF_MAC_FILTER_LEVEL Level
+    )
+{
+    if (Type >= ETHERNET_ADDRESS_TYPE_COUNT)
+        return STATUS_INVALID_PARAMETER;
+
+    Context->FilterLevel[Type] = Level;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+MockVifQueryReceiverRingSize(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PULONG              Size
+    )
+{
+    *Size = Context->Configuration.ReceiverRingSize;
+}
+
+static VOID
+MockVifQueryTransmitterRingSize(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PULONG              Size
+    )
+{
+    *Size = Context->Configuration.TransmitterRingSize;
+}
+
+static VOID
+MockVifReturnPackets(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  PLIST_ENTRY         List
+    )
+{
+    PMOCK_VIF_PROCESSOR     Processor;
+    LIST_ENTRY              Free;
+    LONG                    Count;
+
+    SHIM_CHECK(Context->Configuration.Version >= VIF_INTERFACE_VERSION_RETURN_PACKETS);
+
+    Processor = __MockVifGetProcessor(Context);
+
+    InitializeListHead(&Free);
+
+    Count = 0;
+    while (!IsListEmpty(List)) {
+        PLIST_ENTRY             ListEntry;
+        PXENVIF_RECEIVER_PACKET Packet;
+
+        ListEntry = RemoveHeadList(List);
+        Packet = CONTAINING_RECORD(ListEntry, XENVIF_RECEIVER_PACKET, ListEntry);
+
+        SHIM_CHECK(Packet >= Context->Packet &&
+                   Packet < Context->Packet + Context->PacketCount);
+        SHIM_CHECK(Packet->Mdl.Next == NULL);
+
+        InsertTailList(&Free, ListEntry);
+        Count++;
+    }
+
+    KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+    AppendTailList(&Processor->Free, &Free);
+    RemoveEntryList(&Free);
+    KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+
+    Processor->Statistics.ReturnPacketsCalls++;
+    Processor->Statistics.ReturnedPackets += Count;
+
+    SHIM_CHECK(InterlockedExchangeAdd(&Context->Outstanding, -Count) >= Count);
+}
+
+static VOID
+MockVifQueryTransmitterQueueCount(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    OUT PULONG              Count
+    )
+{
+    SHIM_CHECK(Context->Configuration.Version >= VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES);
+
+    *Count = Context->Configuration.QueueCount;
+}
+
+static VOID
+MockVifQueryTransmitterQueueRingSize(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  ULONG               Index,
+    OUT PULONG              Size
+    )
+{
+    SHIM_CHECK(Context->Configuration.Version >= VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES);
+    SHIM_CHECK(Index < Context->Configuration.QueueCount);
+
+    *Size = Context->Configuration.TransmitterRingSize;
+}
+
+static NTSTATUS
+__MockVifQueuePackets(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    IN  ULONG                       Index,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    )
+{
+    PMOCK_VIF_PROCESSOR             Processor;
+    PXENVIF_TRANSMITTER_PACKET      Packet;
+    PXENVIF_TRANSMITTER_PACKET      TailPacket;
+    ULONG                           Count;
+    ULONG64                         Bytes;
+    KIRQL                           Irql;
+
+    SHIM_CHECK(Context->Enabled);
+    SHIM_CHECK(Index < Context->Configuration.QueueCount);
+    SHIM_CHECK(HeadPacket != NULL);
+
+    if (Context->QueueFailures > 0 &&
+        InterlockedDecrement(&Context->QueueFailures) >= 0)
+        return STATUS_UNSUCCESSFUL;
+
+    Processor = __MockVifGetProcessor(Context);
+
+    Count = 0;
+    Bytes = 0;
+    TailPacket = NULL;
+    for (Packet = HeadPacket; Packet != NULL; Packet = Packet->Next) {
+        PUCHAR              Base = (PUCHAR)Packet;
+        PMDL                Mdl;
+        ULONG               Offset;
+        ULONG               Length;
+        PETHERNET_ADDRESS   DestinationAddress;
+
+        Mdl = *(PMDL *)(Base + Context->Metadata.MdlOffset);
+        Offset = *(PULONG)(Base + Context->Metadata.OffsetOffset);
+        Length = *(PULONG)(Base + Context->Metadata.LengthOffset);
+
+        SHIM_CHECK(Mdl != NULL);
+        SHIM_CHECK(Length >= sizeof (ETHERNET_UNTAGGED_HEADER));
+        SHIM_CHECK(Offset + sizeof (ETHERNET_ADDRESS) <= Mdl->ByteCount);
+
+        if (Context->Transmit != NULL)
+            Context->Transmit(Context->TransmitArgument,
+                              Index,
+                              Packet,
+                              Mdl,
+                              Offset,
+                              Length);
+
+        DestinationAddress = (PETHERNET_ADDRESS)((PUCHAR)MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority) +
+                                                 Offset);
+
+        Packet->Completion.Type = (UCHAR)GET_ETHERNET_ADDRESS_TYPE(DestinationAddress);
+        Packet->Completion.Status = PACKET_OK;
+        Packet->Completion.PacketLength = (USHORT)Length;
+        Packet->Completion.PayloadLength = 0;
+
+        TailPacket = Packet;
+        Count++;
+        Bytes += Length;
+    }
+
+    Processor->Statistics.Notifications[Index]++;
+    Processor->Statistics.QueuedPackets[Index] += Count;
+    Processor->Statistics.QueuedBytes += Bytes;
+
+    KeAcquireSpinLock(&Processor->Lock, &Irql);
+
+    *Processor->CompleteTail = HeadPacket;
+    Processor->CompleteTail = &TailPacket->Next;
+
+    if (Context->Configuration.Completion == MOCK_VIF_COMPLETE_DEFERRED)
+        (VOID) KeInsertQueueDpc(&Processor->Dpc, NULL, NULL);
+
+    KeReleaseSpinLock(&Processor->Lock, Irql);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+MockVifQueueTransmitterPackets(
+    IN  PXENVIF_VIF_CONTEXT         Context,
+    IN  ULONG                       Index,
+    IN  PXENVIF_TRANSMITTER_PACKET  HeadPacket
+    )
+{
+    SHIM_CHECK(Context->Configuration.Version >= VIF_INTERFACE_VERSION_TRANSMITTER_QUEUES);
+
+    return __MockVifQueuePackets(Context, Index, HeadPacket);
+}
+
+#define VIF_OPERATION(_Type, _Name, _Arguments) \
+        .VIF_ ## _Name = MockVif ## _Name,
+
+static XENVIF_VIF_OPERATIONS    MockVifOperations = {
+    DEFINE_VIF_OPERATIONS
+};
+
+#undef VIF_OPERATION
+
+// Must be called at DISPATCH_LEVEL
+static VOID
+MockVifCompleteProcessor(
+    IN  PMOCK_VIF_PROCESSOR     Processor
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Processor->Context;
+    PMOCK_VIF_PROCESSOR         Current;
+    PXENVIF_TRANSMITTER_PACKET  HeadPacket;
+    PXENVIF_TRANSMITTER_PACKET  Packet;
+    ULONG                       Count;
+
+    KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+
+    HeadPacket = Processor->CompleteHead;
+    Processor->CompleteHead = NULL;
+    Processor->CompleteTail = &Processor->CompleteHead;
+
+    KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+
+    if (HeadPacket == NULL)
+        return;
+
+    Count = 0;
+    for (Packet = HeadPacket; Packet != NULL; Packet = Packet->Next)
+        Count++;
+
+    Current = __MockVifGetProcessor(Context);
+    Current->Statistics.CompleteCalls++;
+    Current->Statistics.CompletedPackets += Count;
+
+    SHIM_CHECK(Context->Callback != NULL);
+    Context->Callback(Context->Argument,
+                      XENVIF_CALLBACK_COMPLETE_PACKETS,
+                      HeadPacket);
+}
+
+static VOID
+MockVifCompleteDpc(
+    IN  PKDPC           Dpc,
+    IN  PVOID           DeferredContext,
+    IN  PVOID           Argument1,
+    IN  PVOID           Argument2
+    )
+{
+    PMOCK_VIF_PROCESSOR Processor = DeferredContext;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(Argument1);
+    UNREFERENCED_PARAMETER(Argument2);
+
+    MockVifCompleteProcessor(Processor);
+}
+
+VOID
+MockVifDefaultConfiguration(
+    OUT PMOCK_VIF_CONFIGURATION Configuration
+    )
+{
+    RtlZeroMemory(Configuration, sizeof (MOCK_VIF_CONFIGURATION));
+
+    Configuration->Version = VIF_INTERFACE_VERSION;
+    Configuration->ReceiverRingSize = 256;
+    Configuration->ReceiveBufferSize = 2048;
+    Configuration->TransmitterRingSize = 256;
+    Configuration->QueueCount = 1;
+    Configuration->MaximumFrameSize = ETHERNET_MAX;
+    Configuration->Completion = MOCK_VIF_COMPLETE_DEFERRED;
+}
+
+PXENVIF_VIF_INTERFACE
+MockVifCreate(
+    IN  PMOCK_VIF_CONFIGURATION Configuration
+    )
+{
+    static const ETHERNET_ADDRESS   Address = {{ 0x00, 0x16, 0x3e, 0x00, 0x00, 0x01 }};
+    PXENVIF_VIF_CONTEXT             Context;
+    ULONG                           Index;
+
+    SHIM_CHECK(Configuration->ReceiveBufferSize != 0 &&
+               Configuration->ReceiveBufferSize <= PAGE_SIZE &&
+               (PAGE_SIZE % Configuration->ReceiveBufferSize) == 0);
+    SHIM_CHECK(Configuration->QueueCount != 0 &&
+               Configuration->QueueCount <= MOCK_VIF_MAXIMUM_QUEUES);
+
+    Context = calloc(1, sizeof (XENVIF_VIF_CONTEXT));
+    SHIM_CHECK(Context != NULL);
+
+    Context->Configuration = *Configuration;
+    Context->Interface.Operations = &MockVifOperations;
+    Context->Interface.Context = Context;
+    Context->PermanentAddress = Address;
+    Context->CurrentAddress = Address;
+
+    Context->ProcessorCount = ShimGetProcessorCount();
+    SHIM_CHECK(posix_memalign((void **)&Context->Processor,
+                              64,
+                              sizeof (MOCK_VIF_PROCESSOR) * Context->ProcessorCount) == 0);
+    RtlZeroMemory(Context->Processor,
+                  sizeof (MOCK_VIF_PROCESSOR) * Context->ProcessorCount);
+
+    // A ring's worth of buffers per processor
+    Context->PacketCount = Configuration->ReceiverRingSize * Context->ProcessorCount;
+
+    Context->Packet = calloc(Context->PacketCount, sizeof (XENVIF_RECEIVER_PACKET));
+    SHIM_CHECK(Context->Packet != NULL);
+
+    SHIM_CHECK(posix_memalign((void **)&Context->Buffer,
+                              PAGE_SIZE,
+                              (SIZE_T)Context->PacketCount * Configuration->ReceiveBufferSize) == 0);
+
+    for (Index = 0; Index < Context->ProcessorCount; Index++) {
+        PMOCK_VIF_PROCESSOR Processor = &Context->Processor[Index];
+        PROCESSOR_NUMBER    ProcessorNumber;
+        ULONG               Slot;
+
+        Processor->Context = Context;
+        KeInitializeSpinLock(&Processor->Lock);
+        InitializeListHead(&Processor->Free);
+        Processor->CompleteTail = &Processor->CompleteHead;
+
+        KeInitializeDpc(&Processor->Dpc, MockVifCompleteDpc, Processor);
+        (VOID) KeGetProcessorNumberFromIndex(Index, &ProcessorNumber);
+        (VOID) KeSetTargetProcessorDpcEx(&Processor->Dpc, &ProcessorNumber);
+
+        for (Slot = 0; Slot < Configuration->ReceiverRingSize; Slot++) {
+            ULONG                   Number = (Index * Configuration->ReceiverRingSize) + Slot;
+            PXENVIF_RECEIVER_PACKET Packet = &Context->Packet[Number];
+
+            Packet->Cookie = Context->Buffer + ((SIZE_T)Number * Configuration->ReceiveBufferSize);
+            InsertTailList(&Processor->Free, &Packet->ListEntry);
+        }
+    }
+
+    return &Context->Interface;
+}
+
+VOID
+MockVifDestroy(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+    ULONG                       Index;
+
+    SHIM_CHECK(!Context->Enabled);
+    SHIM_CHECK(Context->References == 0);
+    SHIM_CHECK(Context->Outstanding == 0);
+
+    for (Index = 0; Index < Context->ProcessorCount; Index++)
+        SHIM_CHECK(Context->Processor[Index].CompleteHead == NULL);
+
+    free(Context->Buffer);
+    free(Context->Packet);
+    free(Context->Processor);
+    free(Context);
+}
+
+// Takes up to Count free packets, those of the current processor first
+static ULONG
+MockVifGetPackets(
+    IN  PXENVIF_VIF_CONTEXT Context,
+    IN  PLIST_ENTRY         List,
+    IN  ULONG               Count
+    )
+{
+    ULONG                   Current;
+    ULONG                   Taken;
+    ULONG                   Index;
+
+    Current = KeGetCurrentProcessorNumberEx(NULL);
+
+    Taken = 0;
+    for (Index = 0; Index < Context->ProcessorCount && Taken < Count; Index++) {
+        PMOCK_VIF_PROCESSOR Processor;
+
+        Processor = &Context->Processor[(Current + Index) % Context->ProcessorCount];
+
+        KeAcquireSpinLockAtDpcLevel(&Processor->Lock);
+
+        while (Taken < Count && !IsListEmpty(&Processor->Free)) {
+            PLIST_ENTRY ListEntry = RemoveHeadList(&Processor->Free);
+
+            InsertTailList(List, ListEntry);
+            Taken++;
+        }
+
+        KeReleaseSpinLockFromDpcLevel(&Processor->Lock);
+    }
+
+    return Taken;
+}
+
+ULONG
+MockVifReceivePackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    IN  PFRAME                  *Frame,
+    IN  ULONG                   Count
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+    PMOCK_VIF_PROCESSOR         Processor;
+    LIST_ENTRY                  List;
+    PLIST_ENTRY                 ListEntry;
+    ULONG                       Received;
+    ULONG                       Index;
+
+    SHIM_CHECK(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    SHIM_CHECK(Context->Enabled);
+
+    Processor = __MockVifGetProcessor(Context);
+
+    InitializeListHead(&List);
+    Received = MockVifGetPackets(Context, &List, Count);
+
+    Processor->Statistics.ReceiveShortfall += Count - Received;
+
+    if (Received == 0)
+        return 0;
+
+    Index = 0;
+    for (ListEntry = List.Flink; ListEntry != &List; ListEntry = ListEntry->Flink) {
+        PXENVIF_RECEIVER_PACKET Packet;
+        PFRAME                  Current = Frame[Index++];
+
+        Packet = CONTAINING_RECORD(ListEntry, XENVIF_RECEIVER_PACKET, ListEntry);
+
+        SHIM_CHECK(Current->Length <= Context->Configuration.ReceiveBufferSize);
+        memcpy(Packet->Cookie, Current->Data, Current->Length);
+
+        Packet->Offset = 0;
+        Packet->Length = Current->Length;
+        Packet->Info = Current->Info;
+        Packet->Flags = Current->Flags;
+        Packet->TagControlInformation = Current->TagControlInformation;
+        Packet->MaximumSegmentSize = Current->MaximumSegmentSize;
+
+        MmInitializeMdl(&Packet->Mdl, Packet->Cookie, Current->Length);
+        MmBuildMdlForNonPagedPool(&Packet->Mdl);
+    }
+
+    (VOID) InterlockedExchangeAdd(&Context->Outstanding, (LONG)Received);
+
+    Processor->Statistics.ReceiveCalls++;
+    Processor->Statistics.ReceivedPackets += Received;
+
+    Context->Callback(Context->Argument,
+                      XENVIF_CALLBACK_RECEIVE_PACKETS,
+                      &List);
+
+    SHIM_CHECK(IsListEmpty(&List));
+
+    return Received;
+}
+
+VOID
+MockVifCompletePackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+    ULONG                       Index;
+
+    SHIM_CHECK(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    for (Index = 0; Index < Context->ProcessorCount; Index++)
+        MockVifCompleteProcessor(&Context->Processor[Index]);
+}
+
+VOID
+MockVifFailQueuePackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    IN  ULONG                   Count
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+
+    (VOID) InterlockedExchange(&Context->QueueFailures, (LONG)Count);
+}
+
+VOID
+MockVifSetTransmitHook(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    IN  MOCK_VIF_TRANSMIT       Function,
+    IN  PVOID                   Argument
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+
+    Context->Transmit = Function;
+    Context->TransmitArgument = Argument;
+}
+
+ULONG
+MockVifOutstandingPackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+
+    return (ULONG)Context->Outstanding;
+}
+
+VOID
+MockVifQueryStatistics(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    OUT PMOCK_VIF_STATISTICS    Statistics
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+    ULONG                       Index;
+
+    RtlZeroMemory(Statistics, sizeof (MOCK_VIF_STATISTICS));
+
+    for (Index = 0; Index < Context->ProcessorCount; Index++) {
+        PMOCK_VIF_STATISTICS    Processor = &Context->Processor[Index].Statistics;
+        ULONG                   Queue;
+
+        Statistics->ReceiveCalls += Processor->ReceiveCalls;
+        Statistics->ReceivedPackets += Processor->ReceivedPackets;
+        Statistics->ReceiveShortfall += Processor->ReceiveShortfall;
+        Statistics->ReturnPacketCalls += Processor->ReturnPacketCalls;
+        Statistics->ReturnPacketsCalls += Processor->ReturnPacketsCalls;
+        Statistics->ReturnedPackets += Processor->ReturnedPackets;
+
+        for (Queue = 0; Queue < MOCK_VIF_MAXIMUM_QUEUES; Queue++) {
+            Statistics->Notifications[Queue] += Processor->Notifications[Queue];
+            Statistics->QueuedPackets[Queue] += Processor->QueuedPackets[Queue];
+        }
+
+        Statistics->QueuedBytes += Processor->QueuedBytes;
+        Statistics->CompleteCalls += Processor->CompleteCalls;
+        Statistics->CompletedPackets += Processor->CompletedPackets;
+    }
+}
+
+XENVIF_OFFLOAD_OPTIONS
+MockVifGetReceiverOffloadOptions(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+
+    return Context->ReceiverOffloadOptions;
+}
+
+ULONG
+MockVifGetMulticastAddresses(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    OUT PETHERNET_ADDRESS       Address,
+    IN  ULONG                   Count
+    )
+{
+    PXENVIF_VIF_CONTEXT         Context = Interface->Context;
+
+    if (Count > Context->MulticastAddressCount)
+        Count = Context->MulticastAddressCount;
+
+    RtlCopyMemory(Address, Context->MulticastAddress, Count * sizeof (ETHERNET_ADDRESS));
+
+    return Context->MulticastAddressCount;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) Citrix Systems Inc.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, 
+ * with or without modification, are permitted provided 
+ * that the following conditions are met:
+ * 
+ * *   Redistributions of source code must retain the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer.
+ * *   Redistributions in binary form must reproduce the above 
+ *     copyright notice, this list of conditions and the 
+ *     following disclaimer in the documentation and/or other 
+ *     materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND 
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF 
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, 
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF 
+ * SUCH DAMAGE.
+ */
+
+// A user-mode stand-in for the XENVIF backend. Its operations table is
+// generated from DEFINE_VIF_OPERATIONS so that it fails to build if an
+// operation is added to the interface without being mocked. Received
+// frames are copied into a ring's worth of packets per processor, and
+// transmitted packets are completed from a DPC on the processor that
+// queued them, or only when the test says so.
+
+#ifndef _TEST_VIF_H
+#define _TEST_VIF_H
+
+#include <ndis.h>
+#include <ethernet.h>
+#include <tcpip.h>
+#include <vif_interface.h>
+
+#include "frame.h"
+
+#define MOCK_VIF_MAXIMUM_QUEUES 8
+
+struct _XENVIF_VIF_INTERFACE {
+    PXENVIF_VIF_OPERATIONS  Operations;
+    PXENVIF_VIF_CONTEXT     Context;
+};
+
+typedef enum _MOCK_VIF_COMPLETION {
+    MOCK_VIF_COMPLETE_DEFERRED = 0,     // From a DPC, as the backend does
+    MOCK_VIF_COMPLETE_MANUAL            // Only from MockVifCompletePackets()
+} MOCK_VIF_COMPLETION, *PMOCK_VIF_COMPLETION;
+
+typedef struct _MOCK_VIF_CONFIGURATION {
+    ULONG                   Version;
+    ULONG                   ReceiverRingSize;
+    ULONG                   ReceiveBufferSize;      // At most PAGE_SIZE
+    ULONG                   TransmitterRingSize;
+    ULONG                   QueueCount;
+    XENVIF_OFFLOAD_OPTIONS  OffloadOptions;         // Transmit side
+    ULONG                   LargePacketSize;
+    ULONG                   MaximumFrameSize;
+    MOCK_VIF_COMPLETION     Completion;
+} MOCK_VIF_CONFIGURATION, *PMOCK_VIF_CONFIGURATION;
+
+// Each call to QueuePackets or QueueTransmitterPackets is counted as a
+// notification of the backend.
+typedef struct _MOCK_VIF_STATISTICS {
+    ULONG64 ReceiveCalls;
+    ULONG64 ReceivedPackets;
+    ULONG64 ReceiveShortfall;   // Frames dropped for want of a free packet
+    ULONG64 ReturnPacketCalls;
+    ULONG64 ReturnPacketsCalls;
+    ULONG64 ReturnedPackets;
+    ULONG64 Notifications[MOCK_VIF_MAXIMUM_QUEUES];
+    ULONG64 QueuedPackets[MOCK_VIF_MAXIMUM_QUEUES];
+    ULONG64 QueuedBytes;
+    ULONG64 CompleteCalls;
+    ULONG64 CompletedPackets;
+} MOCK_VIF_STATISTICS, *PMOCK_VIF_STATISTICS;
+
+// Called for each transmitted packet before it is completed, with the
+// data described by the packet's NET_BUFFER.
+typedef VOID
+(*MOCK_VIF_TRANSMIT)(
+    IN  PVOID                       Argument,
+    IN  ULONG                       Index,
+    IN  PXENVIF_TRANSMITTER_PACKET  Packet,
+    IN  PMDL                        Mdl,
+    IN  ULONG                       Offset,
+    IN  ULONG                       Length
+    );
+
+// Version 16, 256 slot rings of 2048 byte buffers, one queue, no
+// transmit offloads and deferred completion.
+VOID
+MockVifDefaultConfiguration(
+    OUT PMOCK_VIF_CONFIGURATION Configuration
+    );
+
+// Must be called after ShimInitialize()
+PXENVIF_VIF_INTERFACE
+MockVifCreate(
+    IN  PMOCK_VIF_CONFIGURATION Configuration
+    );
+
+VOID
+MockVifDestroy(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    );
+
+// Passes Count frames to the frontend in one callback, as many as there
+// are free packets for on the current processor. Returns the number
+// passed. Must be called at DISPATCH_LEVEL.
+ULONG
+MockVifReceivePackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    IN  PFRAME                  *Frame,
+    IN  ULONG                   Count
+    );
+
+// Completes every packet that has been queued but not yet completed.
+// Must be called at DISPATCH_LEVEL.
+VOID
+MockVifCompletePackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    );
+
+// Makes the next Count calls to QueuePackets or QueueTransmitterPackets
+// fail without taking the packets, as they do once the backend has been
+// disabled.
+VOID
+MockVifFailQueuePackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    IN  ULONG                   Count
+    );
+
+VOID
+MockVifSetTransmitHook(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    IN  MOCK_VIF_TRANSMIT       Function,
+    IN  PVOID                   Argument
+    );
+
+// Packets received but not yet returned
+ULONG
+MockVifOutstandingPackets(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    );
+
+VOID
+MockVifQueryStatistics(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    OUT PMOCK_VIF_STATISTICS    Statistics
+    );
+
+// The receive side options last set with UpdateOffloadOptions
+XENVIF_OFFLOAD_OPTIONS
+MockVifGetReceiverOffloadOptions(
+    IN  PXENVIF_VIF_INTERFACE   Interface
+    );
+
+// The addresses last set with UpdateMulticastAddresses
+ULONG
+MockVifGetMulticastAddresses(
+    IN  PXENVIF_VIF_INTERFACE   Interface,
+    OUT PETHERNET_ADDRESS       Address,
+    IN  ULONG                   Count
+    );
+
+#endif  // _TEST_VIF_H